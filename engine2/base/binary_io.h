@@ -0,0 +1,186 @@
+#ifndef ENGINE2_BASE_BINARY_IO_H_
+#define ENGINE2_BASE_BINARY_IO_H_
+
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <string>
+
+extern "C" {
+#include <endian.h>
+}
+
+#include "engine2/vec.h"
+
+// Helpers for reading and writing little-endian binary data. All functions
+// return false if the stream is in a bad state afterwards.
+
+namespace engine2 {
+namespace binary_io_internal {
+
+// The endianness conversion functions are wrapped like this because I can't
+// seem to pass them as function pointers directly.
+inline uint16_t Le16ToH(uint16_t val) {
+  return le16toh(val);
+}
+inline uint32_t Le32ToH(uint32_t val) {
+  return le32toh(val);
+}
+inline uint64_t Le64ToH(uint64_t val) {
+  return le64toh(val);
+}
+inline uint16_t HToLe16(uint16_t val) {
+  return htole16(val);
+}
+inline uint32_t HToLe32(uint32_t val) {
+  return htole32(val);
+}
+inline uint64_t HToLe64(uint64_t val) {
+  return htole64(val);
+}
+
+template <class T>
+bool ReadInt(std::istream& stream, T& out, T (*conv)(T)) {
+  uint8_t bytes[sizeof(T)] = {};
+  stream.read(reinterpret_cast<char*>(bytes), sizeof(T));
+  out = 0;
+  for (int i = 0; i < sizeof(T); ++i)
+    out |= (T(bytes[i]) << (i * 8));
+  out = conv(out);
+  return stream.good();
+}
+
+template <class T>
+bool WriteInt(std::ostream& stream, T val, T (*conv)(T)) {
+  T le_val = conv(val);
+  for (int i = 0; i < sizeof(T); ++i)
+    stream.put((le_val >> (i * 8)) & 0xff);
+  return stream.good();
+}
+
+}  // namespace binary_io_internal
+
+// An input stream over bytes in memory, which reads them in place instead of
+// copying them. The bytes must outlive the stream.
+class MemoryInputStream : public std::istream {
+ public:
+  MemoryInputStream(const char* data, size_t size)
+      : std::istream(&buffer_), buffer_(data, size) {}
+
+ private:
+  class Buffer : public std::streambuf {
+   public:
+    Buffer(const char* data, size_t size) {
+      char* begin = const_cast<char*>(data);
+      setg(begin, begin, begin + size);
+    }
+
+   protected:
+    pos_type seekoff(off_type offset,
+                     std::ios_base::seekdir direction,
+                     std::ios_base::openmode which) override {
+      char* base = direction == std::ios_base::beg   ? eback()
+                   : direction == std::ios_base::cur ? gptr()
+                                                     : egptr();
+      if (offset < eback() - base || offset > egptr() - base)
+        return pos_type(off_type(-1));
+      setg(eback(), base + offset, egptr());
+      return pos_type(gptr() - eback());
+    }
+    pos_type seekpos(pos_type position,
+                     std::ios_base::openmode which) override {
+      return seekoff(off_type(position), std::ios_base::beg, which);
+    }
+  };
+
+  Buffer buffer_;
+};
+
+inline bool ReadInt8(std::istream& stream, uint8_t& out) {
+  out = stream.get();
+  return stream.good();
+}
+inline bool ReadInt16(std::istream& stream, uint16_t& out) {
+  return binary_io_internal::ReadInt(stream, out, binary_io_internal::Le16ToH);
+}
+inline bool ReadInt32(std::istream& stream, uint32_t& out) {
+  return binary_io_internal::ReadInt(stream, out, binary_io_internal::Le32ToH);
+}
+inline bool ReadInt64(std::istream& stream, uint64_t& out) {
+  return binary_io_internal::ReadInt(stream, out, binary_io_internal::Le64ToH);
+}
+
+inline bool ReadDouble(std::istream& stream, double& out) {
+  uint64_t bits;
+  if (!ReadInt64(stream, bits))
+    return false;
+  std::memcpy(&out, &bits, sizeof(out));
+  return true;
+}
+
+template <int N>
+bool ReadVecInt64(std::istream& stream, Vec<int64_t, N>& out) {
+  for (int i = 0; i < N; ++i) {
+    uint64_t val;
+    if (!ReadInt64(stream, val))
+      return false;
+    out[i] = val;
+  }
+  return true;
+}
+
+inline bool ReadString(std::istream& stream, std::string& str) {
+  uint32_t length;
+  if (!ReadInt32(stream, length))
+    return false;
+
+  auto data = std::make_unique<char[]>(length + 1);
+  data.get()[length] = '\0';
+
+  stream.read(data.get(), length);
+  str.assign(data.get(), length);
+
+  return stream.good();
+}
+
+inline bool WriteInt8(std::ostream& stream, uint8_t val) {
+  stream.put(val);
+  return stream.good();
+}
+inline bool WriteInt16(std::ostream& stream, uint16_t val) {
+  return binary_io_internal::WriteInt(stream, val, binary_io_internal::HToLe16);
+}
+inline bool WriteInt32(std::ostream& stream, uint32_t val) {
+  return binary_io_internal::WriteInt(stream, val, binary_io_internal::HToLe32);
+}
+inline bool WriteInt64(std::ostream& stream, uint64_t val) {
+  return binary_io_internal::WriteInt(stream, val, binary_io_internal::HToLe64);
+}
+
+inline bool WriteDouble(std::ostream& stream, double val) {
+  uint64_t bits;
+  std::memcpy(&bits, &val, sizeof(bits));
+  return WriteInt64(stream, bits);
+}
+
+template <int N>
+bool WriteVecInt64(std::ostream& stream, const Vec<int64_t, N>& val) {
+  for (int i = 0; i < N; ++i) {
+    if (!WriteInt64(stream, val[i]))
+      return false;
+  }
+  return true;
+}
+
+inline bool WriteString(std::ostream& stream, const std::string& str) {
+  if (!WriteInt32(stream, str.length()))
+    return false;
+  stream.write(str.data(), str.length());
+  return stream.good();
+}
+
+}  // namespace engine2
+
+#endif  // ENGINE2_BASE_BINARY_IO_H_
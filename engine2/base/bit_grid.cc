@@ -0,0 +1,89 @@
+#include "engine2/base/bit_grid.h"
+
+#include <algorithm>
+
+namespace engine2 {
+namespace {
+
+int CountBits(uint64_t word) {
+  return __builtin_popcountll(word);
+}
+
+int LowestBit(uint64_t word) {
+  return __builtin_ctzll(word);
+}
+
+}  // namespace
+
+BitGrid::BitGrid(const Vec<int64_t, 2>& size)
+    : size_(size),
+      words_per_row_((size.x() + kBitsPerWord - 1) / kBitsPerWord),
+      words_(words_per_row_ * size.y()) {}
+
+bool BitGrid::Get(const Point<>& point) const {
+  if (point.x() < 0 || point.y() < 0 || point.x() >= size_.x() ||
+      point.y() >= size_.y()) {
+    return false;
+  }
+  uint64_t word = GetRow(point.y())[point.x() / kBitsPerWord];
+  return (word >> (point.x() % kBitsPerWord)) & 1;
+}
+
+void BitGrid::Set(const Point<>& point, bool value) {
+  if (point.x() < 0 || point.y() < 0 || point.x() >= size_.x() ||
+      point.y() >= size_.y()) {
+    return;
+  }
+  uint64_t& word =
+      words_[point.y() * words_per_row_ + point.x() / kBitsPerWord];
+  uint64_t bit = uint64_t{1} << (point.x() % kBitsPerWord);
+  if (value)
+    word |= bit;
+  else
+    word &= ~bit;
+}
+
+void BitGrid::Fill(bool value) {
+  std::fill(words_.begin(), words_.end(), value ? ~uint64_t{0} : 0);
+  int64_t tail_bits = size_.x() % kBitsPerWord;
+  if (!value || tail_bits == 0)
+    return;
+  // Keep the bits past the end of each row clear.
+  for (int64_t y = 0; y < size_.y(); ++y) {
+    words_[(y + 1) * words_per_row_ - 1] =
+        ~uint64_t{0} >> (kBitsPerWord - tail_bits);
+  }
+}
+
+BitGrid& BitGrid::operator|=(const BitGrid& other) {
+  for (size_t i = 0; i < other.words_.size(); ++i)
+    words_[i] |= other.words_[i];
+  return *this;
+}
+
+int64_t BitGrid::Count(const Rect<>& rect) const {
+  int64_t count = 0;
+  VisitWords(rect, [&count](int64_t y, int64_t i, uint64_t word) {
+    count += CountBits(word);
+    return true;
+  });
+  return count;
+}
+
+bool BitGrid::Find(const Rect<>& rect, Point<>* found) const {
+  return !VisitWords(rect, [found](int64_t y, int64_t i, uint64_t word) {
+    if (found)
+      *found = {i * kBitsPerWord + LowestBit(word), y};
+    return false;
+  });
+}
+
+void BitGrid::FindAll(const Rect<>& rect, std::vector<Point<>>* found) const {
+  VisitWords(rect, [found](int64_t y, int64_t i, uint64_t word) {
+    for (; word; word &= word - 1)
+      found->push_back({i * kBitsPerWord + LowestBit(word), y});
+    return true;
+  });
+}
+
+}  // namespace engine2
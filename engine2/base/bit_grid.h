@@ -0,0 +1,88 @@
+#ifndef ENGINE2_BASE_BIT_GRID_H_
+#define ENGINE2_BASE_BIT_GRID_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "engine2/rect.h"
+
+namespace engine2 {
+
+// A 2D grid of bits, packed 64 to a word along each row, so rect queries test
+// 64 cells at a time. Points outside the grid read as false, and queries clip
+// their rects to the grid.
+class BitGrid {
+ public:
+  static constexpr int kBitsPerWord = 64;
+
+  BitGrid() = default;
+  explicit BitGrid(const Vec<int64_t, 2>& size);
+
+  const Vec<int64_t, 2>& size() const { return size_; }
+  bool empty() const { return words_.empty(); }
+
+  bool Get(const Point<>& point) const;
+  // Does nothing if |point| is outside the grid.
+  void Set(const Point<>& point, bool value);
+  void Fill(bool value);
+  // Sets the bits set in |other|, which must be the same size or empty.
+  BitGrid& operator|=(const BitGrid& other);
+
+  // Number of set bits in |rect|.
+  int64_t Count(const Rect<>& rect) const;
+  // Finds the first set bit in |rect|, going row by row from the top. Returns
+  // false if there isn't one. |found| may be null.
+  bool Find(const Rect<>& rect, Point<>* found) const;
+  // Appends the set bits in |rect| to |found|, in the same order as Find().
+  void FindAll(const Rect<>& rect, std::vector<Point<>>* found) const;
+
+  // Row |y| as GetWordsPerRow() words. Cell x is bit x % 64 of word x / 64.
+  // Bits past the end of the row are always 0.
+  const uint64_t* GetRow(int64_t y) const {
+    return &words_[y * words_per_row_];
+  }
+  int64_t GetWordsPerRow() const { return words_per_row_; }
+
+ private:
+  // Calls visit(y, word_index, word) for the words of each row of |rect|, with
+  // the bits outside |rect| cleared, until visit() returns false. Returns
+  // false if it did.
+  template <typename Visit>
+  bool VisitWords(const Rect<>& rect, Visit visit) const;
+
+  Vec<int64_t, 2> size_;
+  int64_t words_per_row_ = 0;
+  std::vector<uint64_t> words_;
+};
+
+template <typename Visit>
+bool BitGrid::VisitWords(const Rect<>& rect, Visit visit) const {
+  Rect<> clipped = rect.GetOverlap({{0, 0}, size_});
+  if (clipped.w() <= 0 || clipped.h() <= 0)
+    return true;
+
+  int64_t begin = clipped.x();
+  int64_t end = clipped.x() + clipped.w();
+  int64_t first_word = begin / kBitsPerWord;
+  int64_t last_word = (end - 1) / kBitsPerWord;
+  uint64_t first_mask = ~uint64_t{0} << (begin % kBitsPerWord);
+  int64_t last_bit = (end - 1) % kBitsPerWord;
+  uint64_t last_mask = ~uint64_t{0} >> (kBitsPerWord - 1 - last_bit);
+  for (int64_t y = clipped.y(); y < clipped.y() + clipped.h(); ++y) {
+    const uint64_t* row = GetRow(y);
+    for (int64_t i = first_word; i <= last_word; ++i) {
+      uint64_t word = row[i];
+      if (i == first_word)
+        word &= first_mask;
+      if (i == last_word)
+        word &= last_mask;
+      if (word && !visit(y, i, word))
+        return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace engine2
+
+#endif  // ENGINE2_BASE_BIT_GRID_H_
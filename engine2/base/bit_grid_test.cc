@@ -0,0 +1,110 @@
+#include "engine2/base/bit_grid.h"
+#include "engine2/base/bit_grid_test.h"
+#include "engine2/test/assert_macros.h"
+
+#include <vector>
+
+namespace engine2 {
+namespace test {
+
+void BitGridTest::TestGetSet() {
+  BitGrid grid({130, 3});
+  EXPECT_EQ(3, grid.GetWordsPerRow());
+  grid.Set({0, 0}, true);
+  grid.Set({64, 1}, true);
+  grid.Set({129, 2}, true);
+  grid.Set({130, 2}, true);
+  grid.Set({-1, 0}, true);
+  bool value = grid.Get({0, 0});
+  EXPECT_TRUE(value);
+  value = grid.Get({64, 1});
+  EXPECT_TRUE(value);
+  value = grid.Get({129, 2});
+  EXPECT_TRUE(value);
+  value = grid.Get({1, 0});
+  EXPECT_FALSE(value);
+  value = grid.Get({130, 2});
+  EXPECT_FALSE(value);
+  value = grid.Get({0, 3});
+  EXPECT_FALSE(value);
+  EXPECT_EQ(0, grid.GetRow(2)[0]);
+  EXPECT_EQ(uint64_t{1} << 1, grid.GetRow(2)[2]);
+
+  grid.Set({64, 1}, false);
+  value = grid.Get({64, 1});
+  EXPECT_FALSE(value);
+}
+
+void BitGridTest::TestCount() {
+  BitGrid grid({200, 10});
+  for (int64_t x = 0; x < 200; x += 3)
+    grid.Set({x, 5}, true);
+  EXPECT_EQ(67, grid.Count({{0, 0}, {200, 10}}));
+  EXPECT_EQ(67, grid.Count({{-50, -50}, {500, 500}}));
+  // Both ends inside one word.
+  EXPECT_EQ(2, grid.Count({{1, 5}, {6, 1}}));
+  // Across words.
+  EXPECT_EQ(10, grid.Count({{60, 0}, {30, 10}}));
+  EXPECT_EQ(0, grid.Count({{0, 0}, {200, 5}}));
+  EXPECT_EQ(0, grid.Count({{300, 0}, {10, 10}}));
+  EXPECT_EQ(0, BitGrid().Count({{0, 0}, {10, 10}}));
+}
+
+void BitGridTest::TestFind() {
+  BitGrid grid({100, 100});
+  Point<> found;
+  bool result = grid.Find({{0, 0}, {100, 100}}, &found);
+  EXPECT_FALSE(result);
+
+  grid.Set({70, 40}, true);
+  grid.Set({10, 50}, true);
+  grid.Set({5, 50}, true);
+  result = grid.Find({{0, 0}, {100, 100}}, &found);
+  EXPECT_TRUE(result);
+  EXPECT_TRUE((Point<>{70, 40}) == found);
+  result = grid.Find({{0, 0}, {70, 100}}, &found);
+  EXPECT_TRUE(result);
+  EXPECT_TRUE((Point<>{5, 50}) == found);
+  result = grid.Find({{6, 0}, {64, 100}}, &found);
+  EXPECT_TRUE(result);
+  EXPECT_TRUE((Point<>{10, 50}) == found);
+  result = grid.Find({{71, 0}, {29, 100}}, nullptr);
+  EXPECT_FALSE(result);
+
+  std::vector<Point<>> all;
+  grid.FindAll({{0, 0}, {100, 100}}, &all);
+  ASSERT_EQ(3, all.size());
+  EXPECT_TRUE((Point<>{70, 40}) == all[0]);
+  EXPECT_TRUE((Point<>{5, 50}) == all[1]);
+  EXPECT_TRUE((Point<>{10, 50}) == all[2]);
+}
+
+void BitGridTest::TestFill() {
+  BitGrid grid({70, 2});
+  grid.Fill(true);
+  EXPECT_EQ(140, grid.Count({{0, 0}, {100, 100}}));
+  EXPECT_EQ(~uint64_t{0} >> 58, grid.GetRow(1)[1]);
+  grid.Fill(false);
+  EXPECT_EQ(0, grid.Count({{0, 0}, {100, 100}}));
+
+  BitGrid other({70, 2});
+  other.Set({69, 1}, true);
+  grid.Set({0, 0}, true);
+  grid |= other;
+  grid |= BitGrid();
+  EXPECT_EQ(2, grid.Count({{0, 0}, {100, 100}}));
+  bool value = grid.Get({69, 1});
+  EXPECT_TRUE(value);
+}
+
+BitGridTest::BitGridTest()
+    : TestGroup("BitGridTest",
+                {
+                    std::bind(&BitGridTest::TestGetSet, this),
+                    std::bind(&BitGridTest::TestCount, this),
+                    std::bind(&BitGridTest::TestFind, this),
+                    std::bind(&BitGridTest::TestFill, this),
+                }) {}
+
+}  // namespace test
+}  // namespace engine2
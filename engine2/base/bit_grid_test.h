@@ -0,0 +1,21 @@
+#ifndef ENGINE2_BASE_BIT_GRID_TEST_H_
+#define ENGINE2_BASE_BIT_GRID_TEST_H_
+
+#include "engine2/test/test_group.h"
+
+namespace engine2 {
+namespace test {
+
+class BitGridTest : public TestGroup {
+ public:
+  void TestGetSet();
+  void TestCount();
+  void TestFind();
+  void TestFill();
+  BitGridTest();
+};
+
+}  // namespace test
+}  // namespace engine2
+
+#endif  // ENGINE2_BASE_BIT_GRID_TEST_H_
@@ -0,0 +1,202 @@
+#include "engine2/base/compression.h"
+
+#include <algorithm>
+
+namespace engine2 {
+namespace {
+
+// Shortest repeat worth encoding as a match.
+constexpr size_t kMinMatch = 4;
+constexpr int kHashBits = 12;
+// Runs shorter than this are cheaper to store as literals.
+constexpr size_t kMinRun = 3;
+// RunLengthEncode() never writes more than this per value: a token's varint
+// is never longer than the values it covers.
+constexpr size_t kMaxEncodedBytesPerValue = 3;
+
+void WriteVarint(uint64_t value, std::vector<uint8_t>* out) {
+  while (value >= 0x80) {
+    out->push_back(value | 0x80);
+    value >>= 7;
+  }
+  out->push_back(value);
+}
+
+bool ReadVarint(const uint8_t* data,
+                size_t size,
+                size_t* position,
+                uint64_t* value) {
+  *value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (*position >= size)
+      return false;
+    uint8_t byte = data[(*position)++];
+    *value |= uint64_t(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+      return true;
+  }
+  return false;
+}
+
+void WriteUint16(uint16_t value, std::vector<uint8_t>* out) {
+  out->push_back(value & 0xff);
+  out->push_back(value >> 8);
+}
+
+uint32_t Hash(const uint8_t* bytes) {
+  uint32_t word = bytes[0] | bytes[1] << 8 | bytes[2] << 16 | bytes[3] << 24;
+  return (word * 2654435761u) >> (32 - kHashBits);
+}
+
+// Encodes |values| as tokens of (count - 1) << 1 | is_run. A run token is
+// followed by one value, and a literal token by |count| values.
+std::vector<uint8_t> RunLengthEncode(const uint16_t* values, size_t count) {
+  std::vector<uint8_t> out;
+  size_t literal_start = 0;
+  auto flush_literals = [&](size_t end) {
+    if (end == literal_start)
+      return;
+    WriteVarint((end - literal_start - 1) << 1, &out);
+    for (size_t i = literal_start; i < end; ++i)
+      WriteUint16(values[i], &out);
+  };
+
+  size_t i = 0;
+  while (i < count) {
+    size_t run_end = i + 1;
+    while (run_end < count && values[run_end] == values[i])
+      ++run_end;
+
+    if (run_end - i >= kMinRun) {
+      flush_literals(i);
+      WriteVarint((run_end - i - 1) << 1 | 1, &out);
+      WriteUint16(values[i], &out);
+      literal_start = run_end;
+    }
+    i = run_end;
+  }
+  flush_literals(count);
+  return out;
+}
+
+bool RunLengthDecode(const std::vector<uint8_t>& data,
+                     uint16_t* values,
+                     size_t count) {
+  size_t position = 0;
+  size_t written = 0;
+  while (position < data.size()) {
+    uint64_t token;
+    if (!ReadVarint(data.data(), data.size(), &position, &token))
+      return false;
+
+    uint64_t length = (token >> 1) + 1;
+    bool is_run = token & 1;
+    size_t value_bytes = is_run ? 2 : length * 2;
+    if (length > count - written || value_bytes > data.size() - position)
+      return false;
+
+    for (uint64_t i = 0; i < length; ++i) {
+      size_t at = is_run ? position : position + i * 2;
+      values[written++] = data[at] | data[at + 1] << 8;
+    }
+    position += value_bytes;
+  }
+  return written == count;
+}
+
+}  // namespace
+
+std::vector<uint8_t> CompressUint16(const uint16_t* values, size_t count) {
+  std::vector<uint8_t> encoded = RunLengthEncode(values, count);
+  return LzCompress(encoded.data(), encoded.size());
+}
+
+bool DecompressUint16(const uint8_t* data,
+                      size_t size,
+                      uint16_t* values,
+                      size_t count) {
+  std::vector<uint8_t> encoded;
+  return LzDecompress(data, size, count * kMaxEncodedBytesPerValue,
+                      &encoded) &&
+         RunLengthDecode(encoded, values, count);
+}
+
+// Format: varint uncompressed size, then sequences of varint literal count,
+// the literals, and unless the output is complete, varint match length minus
+// kMinMatch and varint distance back to the start of the match.
+std::vector<uint8_t> LzCompress(const uint8_t* data, size_t size) {
+  std::vector<uint8_t> out;
+  WriteVarint(size, &out);
+
+  // Most recent position of each hashed 4-byte sequence, plus one.
+  std::vector<size_t> table(1 << kHashBits);
+  size_t literal_start = 0;
+  size_t i = 0;
+  while (i + kMinMatch <= size) {
+    uint32_t hash = Hash(data + i);
+    size_t candidate = table[hash];
+    table[hash] = i + 1;
+    if (!candidate ||
+        !std::equal(data + candidate - 1, data + candidate - 1 + kMinMatch,
+                    data + i)) {
+      ++i;
+      continue;
+    }
+
+    size_t match_start = candidate - 1;
+    size_t length = kMinMatch;
+    while (i + length < size && data[match_start + length] == data[i + length])
+      ++length;
+
+    WriteVarint(i - literal_start, &out);
+    out.insert(out.end(), data + literal_start, data + i);
+    WriteVarint(length - kMinMatch, &out);
+    WriteVarint(i - match_start, &out);
+
+    i += length;
+    literal_start = i;
+  }
+
+  WriteVarint(size - literal_start, &out);
+  out.insert(out.end(), data + literal_start, data + size);
+  return out;
+}
+
+bool LzDecompress(const uint8_t* data,
+                  size_t size,
+                  size_t max_size,
+                  std::vector<uint8_t>* out) {
+  size_t position = 0;
+  uint64_t total;
+  if (!ReadVarint(data, size, &position, &total) || total > max_size)
+    return false;
+
+  // |total| comes from the data, so it isn't trusted with a reserve().
+  out->clear();
+  while (true) {
+    uint64_t literal_count;
+    if (!ReadVarint(data, size, &position, &literal_count) ||
+        literal_count > size - position ||
+        literal_count > total - out->size()) {
+      return false;
+    }
+    out->insert(out->end(), data + position, data + position + literal_count);
+    position += literal_count;
+    if (out->size() == total)
+      return position == size;
+
+    uint64_t length, distance;
+    if (!ReadVarint(data, size, &position, &length) ||
+        !ReadVarint(data, size, &position, &distance) || distance == 0 ||
+        distance > out->size() || length > total ||
+        length + kMinMatch > total - out->size()) {
+      return false;
+    }
+    // Matches may overlap the bytes they produce, so copy one at a time.
+    size_t from = out->size() - distance;
+    for (size_t i = 0; i < length + kMinMatch; ++i)
+      out->push_back((*out)[from + i]);
+  }
+}
+
+}  // namespace engine2
@@ -0,0 +1,34 @@
+#ifndef ENGINE2_BASE_COMPRESSION_H_
+#define ENGINE2_BASE_COMPRESSION_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace engine2 {
+
+// Compresses 16-bit values, such as tile indices. Runs of equal values are
+// run-length encoded first, then repeated byte sequences are replaced with
+// references to earlier copies, LZ77-style. The output doesn't depend on the
+// host's byte order.
+std::vector<uint8_t> CompressUint16(const uint16_t* values, size_t count);
+
+// Decompresses data from CompressUint16() into |values|. Returns false if
+// |data| is corrupt or doesn't hold exactly |count| values.
+bool DecompressUint16(const uint8_t* data,
+                      size_t size,
+                      uint16_t* values,
+                      size_t count);
+
+// The LZ77 stage on its own, for arbitrary bytes.
+std::vector<uint8_t> LzCompress(const uint8_t* data, size_t size);
+// Returns false if |data| is corrupt or would decompress to more than
+// |max_size| bytes, which is checked before anything is allocated.
+bool LzDecompress(const uint8_t* data,
+                  size_t size,
+                  size_t max_size,
+                  std::vector<uint8_t>* out);
+
+}  // namespace engine2
+
+#endif  // ENGINE2_BASE_COMPRESSION_H_
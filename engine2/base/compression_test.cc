@@ -0,0 +1,110 @@
+#include "engine2/base/compression.h"
+#include "engine2/base/compression_test.h"
+#include "engine2/test/assert_macros.h"
+
+#include <random>
+#include <vector>
+
+namespace engine2 {
+namespace test {
+namespace {
+
+bool RoundTrips(const std::vector<uint16_t>& values) {
+  std::vector<uint8_t> compressed =
+      CompressUint16(values.data(), values.size());
+  std::vector<uint16_t> decompressed(values.size());
+  return DecompressUint16(compressed.data(), compressed.size(),
+                          decompressed.data(), decompressed.size()) &&
+         decompressed == values;
+}
+
+}  // namespace
+
+void CompressionTest::TestEmpty() {
+  EXPECT_TRUE(RoundTrips({}));
+  EXPECT_TRUE(RoundTrips({7}));
+  EXPECT_TRUE(RoundTrips({7, 7}));
+}
+
+void CompressionTest::TestRuns() {
+  // Mostly empty, with a floor and a few scattered tiles.
+  std::vector<uint16_t> values(64 * 64 * 2, 0);
+  std::fill(values.begin() + 1000, values.begin() + 3000, 12);
+  values[50] = 3;
+  values[51] = 4;
+  values[4000] = 65535;
+  EXPECT_TRUE(RoundTrips(values));
+
+  std::vector<uint8_t> compressed =
+      CompressUint16(values.data(), values.size());
+  EXPECT_TRUE(compressed.size() < 40);
+}
+
+void CompressionTest::TestRandom() {
+  std::mt19937 random(7);
+  for (int max_value : {1, 3, 255, 65535}) {
+    std::uniform_int_distribution<int> value(0, max_value);
+    std::vector<uint16_t> values(5000);
+    for (uint16_t& v : values)
+      v = value(random);
+    EXPECT_TRUE(RoundTrips(values));
+  }
+}
+
+void CompressionTest::TestRepeatedPattern() {
+  // Rows of alternating tiles, which run-length encoding alone can't shrink.
+  std::vector<uint16_t> values;
+  for (int i = 0; i < 4096; ++i)
+    values.push_back(i % 2 ? 5 : 9);
+  EXPECT_TRUE(RoundTrips(values));
+
+  std::vector<uint8_t> compressed =
+      CompressUint16(values.data(), values.size());
+  EXPECT_TRUE(compressed.size() < 100);
+}
+
+void CompressionTest::TestCorrupt() {
+  std::vector<uint16_t> values;
+  for (int i = 0; i < 1000; ++i)
+    values.push_back(i % 7 == 0 ? i : 1);
+  std::vector<uint8_t> compressed =
+      CompressUint16(values.data(), values.size());
+  std::vector<uint16_t> out(values.size());
+
+  // Wrong size.
+  EXPECT_FALSE(DecompressUint16(compressed.data(), compressed.size(),
+                                out.data(), out.size() - 1));
+  // Truncated.
+  EXPECT_FALSE(DecompressUint16(compressed.data(), compressed.size() - 1,
+                                out.data(), out.size()));
+
+  // Random damage must never crash or overrun |out|.
+  std::mt19937 random(11);
+  for (int i = 0; i < 200; ++i) {
+    std::vector<uint8_t> damaged = compressed;
+    damaged[random() % damaged.size()] = random();
+    DecompressUint16(damaged.data(), damaged.size(), out.data(), out.size());
+  }
+
+  // A huge declared size is rejected before anything is allocated.
+  const std::vector<uint8_t> huge{0xff, 0xff, 0xff, 0xff, 0xff,
+                                  0xff, 0xff, 0xff, 0x7f, 0x00};
+  EXPECT_FALSE(
+      DecompressUint16(huge.data(), huge.size(), out.data(), out.size()));
+  std::vector<uint8_t> bytes;
+  EXPECT_FALSE(LzDecompress(huge.data(), huge.size(), /*max_size=*/1 << 20,
+                            &bytes));
+}
+
+CompressionTest::CompressionTest()
+    : TestGroup("CompressionTest",
+                {
+                    std::bind(&CompressionTest::TestEmpty, this),
+                    std::bind(&CompressionTest::TestRuns, this),
+                    std::bind(&CompressionTest::TestRandom, this),
+                    std::bind(&CompressionTest::TestRepeatedPattern, this),
+                    std::bind(&CompressionTest::TestCorrupt, this),
+                }) {}
+
+}  // namespace test
+}  // namespace engine2
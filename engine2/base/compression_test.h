@@ -0,0 +1,22 @@
+#ifndef ENGINE2_BASE_COMPRESSION_TEST_H_
+#define ENGINE2_BASE_COMPRESSION_TEST_H_
+
+#include "engine2/test/test_group.h"
+
+namespace engine2 {
+namespace test {
+
+class CompressionTest : public TestGroup {
+ public:
+  void TestEmpty();
+  void TestRuns();
+  void TestRandom();
+  void TestRepeatedPattern();
+  void TestCorrupt();
+  CompressionTest();
+};
+
+}  // namespace test
+}  // namespace engine2
+
+#endif  // ENGINE2_BASE_COMPRESSION_TEST_H_
@@ -1,52 +1,138 @@
 #ifndef ENGINE2_BASE_LIST_H_
 #define ENGINE2_BASE_LIST_H_
 
-#include <memory>
+#include <type_traits>
 
 namespace engine2 {
 
+template <typename T>
+class List;
+
+// Base class for objects that can be linked into a List<T>. The links live in
+// the object itself, so linking never allocates. An object can be on one list
+// at a time, and can unlink itself without knowing which list that is.
+template <typename T>
+class ListNode {
+ public:
+  ListNode() = default;
+  ListNode(const ListNode&) = delete;
+  ListNode& operator=(const ListNode&) = delete;
+  ~ListNode() { UnlinkSelf(); }
+
+  bool IsLinked() const { return next_; }
+
+  // Removes this object from its list, if any. O(1).
+  void UnlinkSelf() {
+    if (!next_)
+      return;
+    prev_->next_ = next_;
+    next_->prev_ = prev_;
+    prev_ = nullptr;
+    next_ = nullptr;
+  }
+
+ private:
+  friend class List<T>;
+
+  void LinkBefore(ListNode* position) {
+    prev_ = position->prev_;
+    next_ = position;
+    prev_->next_ = this;
+    position->prev_ = this;
+  }
+
+  ListNode* prev_ = nullptr;
+  ListNode* next_ = nullptr;
+};
+
+// A doubly-linked list of objects deriving from ListNode<T>. The list doesn't
+// own its objects: they are allocated and freed by the caller (see Pool), and
+// are unlinked when the list is destroyed.
 template <typename T>
 class List {
  public:
-  struct Node {
+  template <typename Value>
+  class BasicIterator {
    public:
-    T payload;
-    Node* prev = nullptr;
-    std::unique_ptr<Node> next = nullptr;
-
-    Node() = default;
-    explicit Node(T payload) : payload(payload) {}
-
-    Node* Next() { return next.get(); }
-
-    std::unique_ptr<Node> UnlinkSelf() {
-      auto self = std::move(prev->next);
-      if (next) {
-        next->prev = prev;
-        prev->next = std::move(next);
-      }
-      prev = nullptr;
-      next = nullptr;
-      return std::move(self);
+    BasicIterator() = default;
+
+    Value& operator*() const { return static_cast<Value&>(*node_); }
+    Value* operator->() const { return &**this; }
+    BasicIterator& operator++() {
+      node_ = node_->next_;
+      return *this;
+    }
+    bool operator==(const BasicIterator& other) const {
+      return node_ == other.node_;
     }
+    bool operator!=(const BasicIterator& other) const {
+      return !(*this == other);
+    }
+
+   private:
+    friend class List;
+
+    using Node = std::
+        conditional_t<std::is_const_v<Value>, const ListNode<T>, ListNode<T>>;
+
+    explicit BasicIterator(Node* node) : node_(node) {}
+
+    Node* node_ = nullptr;
   };
 
-  Node* Head() const { return sentinel.next.get(); }
+  using Iterator = BasicIterator<T>;
+  using ConstIterator = BasicIterator<const T>;
 
-  void AddToHead(T val) { AddToHead(std::make_unique<Node>(val)); }
+  List() { sentinel_.prev_ = sentinel_.next_ = &sentinel_; }
+  List(const List&) = delete;
+  List& operator=(const List&) = delete;
+  ~List() { Clear(); }
 
-  void AddToHead(std::unique_ptr<Node> node) {
-    node->next = std::move(sentinel.next);
-    node->prev = &sentinel;
-    if (node->next)
-      node->next->prev = node.get();
-    sentinel.next = std::move(node);
-  }
+  bool Empty() const { return sentinel_.next_ == &sentinel_; }
+  // Linear time.
+  int Size() const;
+
+  // Returns the first object, or null if the list is empty.
+  T* Head() { return Empty() ? nullptr : &*begin(); }
+
+  void AddToHead(T* object) { object->LinkBefore(sentinel_.next_); }
+  void AddToTail(T* object) { object->LinkBefore(&sentinel_); }
+  // Links |object| in front of |position| and returns an iterator to it.
+  Iterator InsertBefore(Iterator position, T* object);
+
+  // Unlinks every object.
+  void Clear();
+
+  Iterator begin() { return Iterator(sentinel_.next_); }
+  Iterator end() { return Iterator(&sentinel_); }
+  ConstIterator begin() const { return ConstIterator(sentinel_.next_); }
+  ConstIterator end() const { return ConstIterator(&sentinel_); }
 
  private:
-  Node sentinel;
+  ListNode<T> sentinel_;
 };
 
+template <typename T>
+int List<T>::Size() const {
+  int size = 0;
+  for (auto it = begin(); it != end(); ++it)
+    ++size;
+  return size;
+}
+
+template <typename T>
+typename List<T>::Iterator List<T>::InsertBefore(Iterator position,
+                                                 T* object) {
+  object->LinkBefore(position.node_);
+  return Iterator(object);
+}
+
+template <typename T>
+void List<T>::Clear() {
+  while (!Empty())
+    sentinel_.next_->UnlinkSelf();
+}
+
 }  // namespace engine2
 
 #endif  // ENGINE2_BASE_LIST_H_
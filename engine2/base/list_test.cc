@@ -2,20 +2,24 @@
 #include "engine2/base/list_test.h"
 #include "engine2/test/assert_macros.h"
 
+#include <memory>
 #include <sstream>
 
 namespace engine2 {
 namespace test {
 namespace {
 
+struct Item : public ListNode<Item> {
+  explicit Item(int payload) : payload(payload) {}
+
+  int payload;
+};
+
 template <typename T>
-std::vector<T> ListToVector(const List<T>& list) {
-  std::vector<T> result;
-  auto* node = list.Head();
-  while (node) {
-    result.push_back(node->payload);
-    node = node->next.get();
-  }
+std::vector<int> ListToVector(const List<T>& list) {
+  std::vector<int> result;
+  for (const T& item : list)
+    result.push_back(item.payload);
   return result;
 }
 
@@ -41,94 +45,134 @@ std::string ListToString(const List<T>& list) {
 }  // namespace
 
 void ListTest::TestEmpty() {
-  List<int> list;
+  List<Item> list;
   ASSERT_NULL(list.Head());
+  EXPECT_TRUE(list.Empty());
+  EXPECT_EQ(0, list.Size());
+  EXPECT_TRUE(list.begin() == list.end());
 }
 
 void ListTest::TestAddToHead() {
-  List<int> list;
-  list.AddToHead(4);
+  List<Item> list;
+  Item item(4);
+  list.AddToHead(&item);
   ASSERT_NOT_NULL(list.Head());
   EXPECT_EQ(4, list.Head()->payload);
+  EXPECT_TRUE(item.IsLinked());
+  EXPECT_FALSE(list.Empty());
 }
 
 void ListTest::TestAddManyToHead() {
-  List<int> list;
-  list.AddToHead(4);
-  list.AddToHead(5);
-  list.AddToHead(6);
-
-  List<int>::Node* node = list.Head();
-  ASSERT_NOT_NULL(node);
-  EXPECT_EQ(6, node->payload);
-
-  node = node->next.get();
-  ASSERT_NOT_NULL(node);
-  EXPECT_EQ(5, node->payload);
-
-  node = node->next.get();
-  ASSERT_NOT_NULL(node);
-  EXPECT_EQ(4, node->payload);
-
-  EXPECT_NULL(node->next.get());
+  List<Item> list;
+  Item a(4), b(5), c(6);
+  list.AddToHead(&a);
+  list.AddToHead(&b);
+  list.AddToHead(&c);
+
+  EXPECT_EQ(&c, list.Head());
+  EXPECT_EQ(3, list.Size());
   EXPECT_EQ("{6, 5, 4}", ListToString(list));
 }
 
 void ListTest::TestUnlink() {
-  List<int> list;
-  list.AddToHead(4);
-  list.AddToHead(5);
-  list.AddToHead(6);
-  auto* node = list.Head();
-  ASSERT_NOT_NULL(node);
-  ASSERT_NOT_NULL(node->next);
-  auto middle = node->next->UnlinkSelf();
-  ASSERT_NOT_NULL(middle);
-  EXPECT_EQ(5, middle->payload);
+  List<Item> list;
+  Item a(4), b(5), c(6);
+  list.AddToHead(&a);
+  list.AddToHead(&b);
+  list.AddToHead(&c);
+  b.UnlinkSelf();
   EXPECT_EQ("{6, 4}", ListToString(list));
+  EXPECT_FALSE(b.IsLinked());
 
-  EXPECT_NULL(middle->prev);
-  EXPECT_NULL(middle->next.get());
+  // Unlinking twice is harmless.
+  b.UnlinkSelf();
+  EXPECT_EQ("{6, 4}", ListToString(list));
 }
 
 void ListTest::TestRelink() {
-  List<int> list;
-  list.AddToHead(4);
-  list.AddToHead(5);
-  list.AddToHead(6);
-  list.AddToHead(list.Head()->next->UnlinkSelf());
+  List<Item> list;
+  Item a(4), b(5), c(6);
+  list.AddToHead(&a);
+  list.AddToHead(&b);
+  list.AddToHead(&c);
+  b.UnlinkSelf();
+  list.AddToHead(&b);
   EXPECT_EQ("{5, 6, 4}", ListToString(list));
+
+  // Objects can move between lists.
+  List<Item> other;
+  c.UnlinkSelf();
+  other.AddToHead(&c);
+  EXPECT_EQ("{5, 4}", ListToString(list));
+  EXPECT_EQ("{6}", ListToString(other));
 }
 
 void ListTest::TestUnlinkTail() {
-  List<int> list;
-  list.AddToHead(4);
-  list.AddToHead(5);
-  list.AddToHead(6);
-  auto tail = list.Head()->next->next->UnlinkSelf();
+  List<Item> list;
+  Item a(4), b(5), c(6);
+  list.AddToHead(&a);
+  list.AddToHead(&b);
+  list.AddToHead(&c);
+  a.UnlinkSelf();
   EXPECT_EQ("{6, 5}", ListToString(list));
-  EXPECT_EQ(4, tail->payload);
-  EXPECT_NULL(tail->prev);
-  EXPECT_NULL(tail->next.get());
+  EXPECT_FALSE(a.IsLinked());
 }
 
 void ListTest::TestUnlinkHead() {
-  List<int> list;
-  list.AddToHead(4);
-  list.AddToHead(5);
-  list.AddToHead(6);
-  auto head = list.Head()->UnlinkSelf();
+  List<Item> list;
+  Item a(4), b(5), c(6);
+  list.AddToHead(&a);
+  list.AddToHead(&b);
+  list.AddToHead(&c);
+  c.UnlinkSelf();
   EXPECT_EQ("{5, 4}", ListToString(list));
-  EXPECT_EQ(6, head->payload);
-  EXPECT_NULL(head->prev);
-  EXPECT_NULL(head->next.get());
+  EXPECT_EQ(&b, list.Head());
 }
 
 void ListTest::TestUnlinkAll() {
-  List<int> list;
-  list.AddToHead(4);
-  auto head = list.Head()->UnlinkSelf();
+  List<Item> list;
+  Item a(4);
+  list.AddToHead(&a);
+  a.UnlinkSelf();
   EXPECT_NULL(list.Head());
+  EXPECT_TRUE(list.Empty());
+}
+
+void ListTest::TestAddToTail() {
+  List<Item> list;
+  Item a(4), b(5), c(6);
+  list.AddToTail(&a);
+  list.AddToTail(&b);
+  list.AddToHead(&c);
+  EXPECT_EQ("{6, 4, 5}", ListToString(list));
+}
+
+void ListTest::TestInsertBefore() {
+  List<Item> list;
+  Item a(4), b(5), c(6);
+  list.AddToHead(&a);
+  List<Item>::Iterator it = list.InsertBefore(list.begin(), &b);
+  EXPECT_EQ(5, it->payload);
+  it = list.InsertBefore(list.end(), &c);
+  EXPECT_EQ(&c, &*it);
+  EXPECT_EQ("{5, 4, 6}", ListToString(list));
+}
+
+void ListTest::TestDestroyUnlinks() {
+  List<Item> list;
+  Item a(4);
+  list.AddToHead(&a);
+  {
+    Item b(5);
+    list.AddToHead(&b);
+  }
+  EXPECT_EQ("{4}", ListToString(list));
+
+  auto other = std::make_unique<List<Item>>();
+  a.UnlinkSelf();
+  other->AddToHead(&a);
+  other.reset();
+  EXPECT_FALSE(a.IsLinked());
 }
 
 ListTest::ListTest()
@@ -142,7 +186,10 @@ ListTest::ListTest()
                     std::bind(&ListTest::TestUnlinkTail, this),
                     std::bind(&ListTest::TestUnlinkHead, this),
                     std::bind(&ListTest::TestUnlinkAll, this),
+                    std::bind(&ListTest::TestAddToTail, this),
+                    std::bind(&ListTest::TestInsertBefore, this),
+                    std::bind(&ListTest::TestDestroyUnlinks, this),
                 }) {}
 
 }  // namespace test
-}  // namespace engine2
\ No newline at end of file
+}  // namespace engine2
@@ -18,6 +18,9 @@ class ListTest : public TestGroup {
   void TestUnlinkTail();
   void TestUnlinkHead();
   void TestUnlinkAll();
+  void TestAddToTail();
+  void TestInsertBefore();
+  void TestDestroyUnlinks();
   ListTest();
 };
 
@@ -0,0 +1,40 @@
+#include "engine2/base/mapped_file.h"
+
+extern "C" {
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+}
+
+namespace engine2 {
+
+// static
+std::unique_ptr<MappedFile> MappedFile::Open(const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd == -1)
+    return nullptr;
+
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) == -1 || file_stat.st_size == 0) {
+    close(fd);
+    return nullptr;
+  }
+
+  size_t size = file_stat.st_size;
+  void* data =
+      mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, /*offset=*/0);
+  // The mapping keeps the file open.
+  close(fd);
+  if (data == MAP_FAILED)
+    return nullptr;
+
+  return std::unique_ptr<MappedFile>(
+      new MappedFile(static_cast<char*>(data), size));
+}
+
+MappedFile::~MappedFile() {
+  munmap(data_, size_);
+}
+
+}  // namespace engine2
@@ -0,0 +1,34 @@
+#ifndef ENGINE2_BASE_MAPPED_FILE_H_
+#define ENGINE2_BASE_MAPPED_FILE_H_
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace engine2 {
+
+// A file mapped into memory copy-on-write. The mapping can be written to, but
+// the changes are private to this process and never reach the file. Pages are
+// read from disk when they're first touched.
+class MappedFile {
+ public:
+  // Returns null if the file can't be opened or mapped.
+  static std::unique_ptr<MappedFile> Open(const std::string& path);
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  ~MappedFile();
+
+  char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  MappedFile(char* data, size_t size) : data_(data), size_(size) {}
+
+  char* data_;
+  size_t size_;
+};
+
+}  // namespace engine2
+
+#endif  // ENGINE2_BASE_MAPPED_FILE_H_
@@ -0,0 +1,84 @@
+#ifndef ENGINE2_BASE_POOL_H_
+#define ENGINE2_BASE_POOL_H_
+
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace engine2 {
+
+// Allocates objects of type T from slabs and reuses freed slots, so once the
+// pool has grown, New() and Delete() don't touch the heap. Objects never move.
+// Every object must be Delete()d before the pool is destroyed.
+template <typename T>
+class Pool {
+ public:
+  Pool() = default;
+  Pool(const Pool&) = delete;
+  Pool& operator=(const Pool&) = delete;
+
+  template <typename... Args>
+  T* New(Args&&... args);
+  void Delete(T* object);
+
+  // Number of objects that haven't been deleted.
+  int Size() const { return size_; }
+  // Number of objects that fit without allocating another slab.
+  int Capacity() const { return capacity_; }
+
+ private:
+  // Slabs double in size from kMinSlabSize up to kMaxSlabSize.
+  static constexpr int kMinSlabSize = 16;
+  static constexpr int kMaxSlabSize = 4096;
+
+  union Slot {
+    Slot* next_free;
+    alignas(T) unsigned char storage[sizeof(T)];
+  };
+
+  void AddSlab();
+
+  std::vector<std::unique_ptr<Slot[]>> slabs_;
+  Slot* free_ = nullptr;
+  int size_ = 0;
+  int capacity_ = 0;
+};
+
+template <typename T>
+template <typename... Args>
+T* Pool<T>::New(Args&&... args) {
+  if (!free_)
+    AddSlab();
+
+  Slot* slot = free_;
+  free_ = slot->next_free;
+  ++size_;
+  return new (slot->storage) T(std::forward<Args>(args)...);
+}
+
+template <typename T>
+void Pool<T>::Delete(T* object) {
+  object->~T();
+  Slot* slot = reinterpret_cast<Slot*>(object);
+  slot->next_free = free_;
+  free_ = slot;
+  --size_;
+}
+
+template <typename T>
+void Pool<T>::AddSlab() {
+  int slab_size = std::min(std::max(kMinSlabSize, capacity_), kMaxSlabSize);
+  slabs_.push_back(std::make_unique<Slot[]>(slab_size));
+  Slot* slab = slabs_.back().get();
+  for (int i = slab_size - 1; i >= 0; --i) {
+    slab[i].next_free = free_;
+    free_ = &slab[i];
+  }
+  capacity_ += slab_size;
+}
+
+}  // namespace engine2
+
+#endif  // ENGINE2_BASE_POOL_H_
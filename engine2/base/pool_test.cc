@@ -0,0 +1,85 @@
+#include "engine2/base/pool.h"
+#include "engine2/base/pool_test.h"
+#include "engine2/test/assert_macros.h"
+
+#include <set>
+#include <string>
+#include <vector>
+
+namespace engine2 {
+namespace test {
+namespace {
+
+struct Counted {
+  Counted(std::string name, int* alive) : name(name), alive(alive) {
+    ++*alive;
+  }
+  ~Counted() { --*alive; }
+
+  std::string name;
+  int* alive;
+};
+
+}  // namespace
+
+void PoolTest::TestNewDelete() {
+  Pool<Counted> pool;
+  int alive = 0;
+  Counted* a = pool.New("a", &alive);
+  Counted* b = pool.New("b", &alive);
+  EXPECT_EQ(2, alive);
+  EXPECT_EQ(2, pool.Size());
+  EXPECT_EQ("a", a->name);
+  EXPECT_EQ("b", b->name);
+
+  pool.Delete(a);
+  EXPECT_EQ(1, alive);
+  EXPECT_EQ(1, pool.Size());
+  pool.Delete(b);
+  EXPECT_EQ(0, alive);
+}
+
+void PoolTest::TestReuse() {
+  Pool<int> pool;
+  int* a = pool.New(1);
+  pool.New(2);
+  pool.Delete(a);
+  int* c = pool.New(3);
+  EXPECT_EQ(a, c);
+  EXPECT_EQ(3, *c);
+}
+
+void PoolTest::TestGrow() {
+  Pool<int> pool;
+  std::vector<int*> objects;
+  for (int i = 0; i < 1000; ++i)
+    objects.push_back(pool.New(i));
+  EXPECT_EQ(1000, pool.Size());
+  EXPECT_TRUE(pool.Capacity() >= 1000);
+
+  // Objects never move while the pool grows.
+  std::set<int*> distinct(objects.begin(), objects.end());
+  EXPECT_EQ(1000, distinct.size());
+  for (int i = 0; i < 1000; ++i)
+    EXPECT_EQ(i, *objects[i]);
+
+  int capacity = pool.Capacity();
+  for (int* object : objects)
+    pool.Delete(object);
+  for (int i = 0; i < 1000; ++i)
+    objects[i] = pool.New(i);
+  EXPECT_EQ(capacity, pool.Capacity());
+  for (int* object : objects)
+    pool.Delete(object);
+}
+
+PoolTest::PoolTest()
+    : TestGroup("PoolTest",
+                {
+                    std::bind(&PoolTest::TestNewDelete, this),
+                    std::bind(&PoolTest::TestReuse, this),
+                    std::bind(&PoolTest::TestGrow, this),
+                }) {}
+
+}  // namespace test
+}  // namespace engine2
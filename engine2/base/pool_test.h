@@ -0,0 +1,20 @@
+#ifndef ENGINE2_BASE_POOL_TEST_H_
+#define ENGINE2_BASE_POOL_TEST_H_
+
+#include "engine2/test/test_group.h"
+
+namespace engine2 {
+namespace test {
+
+class PoolTest : public TestGroup {
+ public:
+  void TestNewDelete();
+  void TestReuse();
+  void TestGrow();
+  PoolTest();
+};
+
+}  // namespace test
+}  // namespace engine2
+
+#endif  // ENGINE2_BASE_POOL_TEST_H_
@@ -0,0 +1,39 @@
+#ifndef ENGINE2_BASE_PUBLISHED_H_
+#define ENGINE2_BASE_PUBLISHED_H_
+
+#include <atomic>
+#include <memory>
+
+namespace engine2 {
+
+// Published holds the latest version of an immutable value that one thread
+// publishes and other threads read. Readers keep the version they got alive
+// for as long as they hold the returned pointer, so the writer never waits for
+// them.
+//
+// LogicContext and VideoContext don't publish or read anything themselves;
+// the game does it from its own callbacks. VideoContext runs OnDraw() without
+// the state lock, so that's where a snapshot can stand in for reading state.
+//
+// Example:
+//  // In the logic context's EveryFrame()->Run() callback, after updating:
+//  published_space.Publish(space.TakeSnapshot());
+//  // In the video context's EveryFrame()->OnDraw() callback:
+//  auto snapshot = published_space.Get();
+template <typename T>
+class Published {
+ public:
+  void Publish(std::shared_ptr<const T> value) {
+    std::atomic_store(&value_, std::move(value));
+  }
+
+  // Returns null if nothing has been published yet.
+  std::shared_ptr<const T> Get() const { return std::atomic_load(&value_); }
+
+ private:
+  std::shared_ptr<const T> value_;
+};
+
+}  // namespace engine2
+
+#endif  // ENGINE2_BASE_PUBLISHED_H_
@@ -0,0 +1,84 @@
+#include "engine2/base/worker_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+namespace engine2 {
+
+WorkerPool::WorkerPool(int thread_count) {
+  if (thread_count == 0) {
+    thread_count =
+        std::max(1, static_cast<int>(std::thread::hardware_concurrency()) - 1);
+  }
+  for (int i = 0; i < thread_count; ++i)
+    threads_.emplace_back(&WorkerPool::RunTasks, this);
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quitting_ = true;
+  }
+  wake_.notify_all();
+  for (std::thread& thread : threads_)
+    thread.join();
+}
+
+void WorkerPool::Post(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tasks_.push_back(std::move(task));
+  }
+  wake_.notify_one();
+}
+
+void WorkerPool::ParallelFor(int64_t count,
+                             const std::function<void(int64_t)>& body) {
+  if (count <= 0)
+    return;
+
+  // Shared with the helper tasks, which may start after this returns and then
+  // find nothing left to do.
+  struct State {
+    std::atomic<int64_t> next{0};
+    std::atomic<int64_t> done{0};
+    std::mutex mutex;
+    std::condition_variable finished;
+  };
+  auto state = std::make_shared<State>();
+  auto work = [state, count, &body] {
+    for (int64_t i = state->next++; i < count; i = state->next++) {
+      body(i);
+      if (++state->done == count) {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->finished.notify_all();
+      }
+    }
+  };
+
+  int64_t helpers = std::min<int64_t>(threads_.size(), count - 1);
+  for (int64_t i = 0; i < helpers; ++i)
+    Post(work);
+  work();
+
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->finished.wait(lock, [&state, count] { return state->done == count; });
+}
+
+void WorkerPool::RunTasks() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait(lock, [this] { return quitting_ || !tasks_.empty(); });
+      if (tasks_.empty())
+        return;
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+    }
+    task();
+  }
+}
+
+}  // namespace engine2
@@ -0,0 +1,45 @@
+#ifndef ENGINE2_BASE_WORKER_POOL_H_
+#define ENGINE2_BASE_WORKER_POOL_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace engine2 {
+
+// A fixed set of threads that run posted tasks in the order they're posted.
+class WorkerPool {
+ public:
+  // With |thread_count| 0, starts one thread per hardware thread, less one for
+  // the thread that posts tasks.
+  explicit WorkerPool(int thread_count = 0);
+  // Runs the tasks that are still queued, then joins the threads.
+  ~WorkerPool();
+  WorkerPool(const WorkerPool&) = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
+
+  int GetThreadCount() const { return threads_.size(); }
+
+  void Post(std::function<void()> task);
+
+  // Calls body(i) for each i in [0, count), spread over the workers and the
+  // calling thread, and returns once every call has returned.
+  void ParallelFor(int64_t count, const std::function<void(int64_t)>& body);
+
+ private:
+  void RunTasks();
+
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::deque<std::function<void()>> tasks_;
+  bool quitting_ = false;
+};
+
+}  // namespace engine2
+
+#endif  // ENGINE2_BASE_WORKER_POOL_H_
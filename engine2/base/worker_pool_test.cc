@@ -0,0 +1,51 @@
+#include "engine2/base/worker_pool.h"
+#include "engine2/base/worker_pool_test.h"
+#include "engine2/test/assert_macros.h"
+
+#include <atomic>
+#include <vector>
+
+namespace engine2 {
+namespace test {
+
+void WorkerPoolTest::TestPost() {
+  std::atomic<int> sum{0};
+  {
+    WorkerPool pool(3);
+    EXPECT_EQ(3, pool.GetThreadCount());
+    for (int i = 1; i <= 100; ++i)
+      pool.Post([&sum, i] { sum += i; });
+  }
+  // Destroying the pool runs what's still queued.
+  EXPECT_EQ(5050, sum.load());
+}
+
+void WorkerPoolTest::TestParallelFor() {
+  WorkerPool pool(4);
+  std::vector<int> calls(1000);
+  pool.ParallelFor(calls.size(), [&calls](int64_t i) { ++calls[i]; });
+  bool all_once = true;
+  for (int count : calls)
+    all_once = all_once && count == 1;
+  EXPECT_TRUE(all_once);
+
+  int runs = 0;
+  pool.ParallelFor(0, [&runs](int64_t i) { ++runs; });
+  pool.ParallelFor(1, [&runs](int64_t i) { ++runs; });
+  EXPECT_EQ(1, runs);
+
+  WorkerPool single_thread_pool(1);
+  std::atomic<int64_t> sum{0};
+  single_thread_pool.ParallelFor(10, [&sum](int64_t i) { sum += i; });
+  EXPECT_EQ(45, sum.load());
+}
+
+WorkerPoolTest::WorkerPoolTest()
+    : TestGroup("WorkerPoolTest",
+                {
+                    std::bind(&WorkerPoolTest::TestPost, this),
+                    std::bind(&WorkerPoolTest::TestParallelFor, this),
+                }) {}
+
+}  // namespace test
+}  // namespace engine2
@@ -0,0 +1,19 @@
+#ifndef ENGINE2_BASE_WORKER_POOL_TEST_H_
+#define ENGINE2_BASE_WORKER_POOL_TEST_H_
+
+#include "engine2/test/test_group.h"
+
+namespace engine2 {
+namespace test {
+
+class WorkerPoolTest : public TestGroup {
+ public:
+  void TestPost();
+  void TestParallelFor();
+  WorkerPoolTest();
+};
+
+}  // namespace test
+}  // namespace engine2
+
+#endif  // ENGINE2_BASE_WORKER_POOL_TEST_H_
@@ -0,0 +1,413 @@
+#include "engine2/flow_field.h"
+
+#include <algorithm>
+#include <limits>
+#include <queue>
+
+namespace engine2 {
+namespace {
+
+constexpr float kInfinity = std::numeric_limits<float>::infinity();
+constexpr float kDiagonalLength = 1.41421356f;
+
+const Point<> kDirections[] = {{1, 0},  {-1, 0}, {0, 1},  {0, -1},
+                               {1, 1},  {1, -1}, {-1, 1}, {-1, -1}};
+
+// Tiles to visit, cheapest first.
+using OpenList = std::priority_queue<std::pair<float, int64_t>,
+                                     std::vector<std::pair<float, int64_t>>,
+                                     std::greater<std::pair<float, int64_t>>>;
+
+float GetStepLength(const Point<>& direction) {
+  return direction.x() && direction.y() ? kDiagonalLength : 1;
+}
+
+}  // namespace
+
+Point<> FlowField::GetDirection(const TileMap::GridPoint& point) const {
+  if (point.x() < 0 || point.y() < 0 || point.x() >= size_.x() ||
+      point.y() >= size_.y()) {
+    return {0, 0};
+  }
+  int8_t direction = directions_[point.y() * size_.x() + point.x()];
+  return direction < 0 ? Point<>{0, 0} : kDirections[direction];
+}
+
+float FlowField::GetCost(const TileMap::GridPoint& point) const {
+  if (point.x() < 0 || point.y() < 0 || point.x() >= size_.x() ||
+      point.y() >= size_.y()) {
+    return kInfinity;
+  }
+  return costs_[point.y() * size_.x() + point.x()];
+}
+
+FlowFieldCache::FlowFieldCache(TileMap* map,
+                               int blocking_tag,
+                               WorkerPool* pool)
+    : map_(map),
+      pool_(pool),
+      grid_size_(map->GetGridSize()),
+      chunk_grid_size_(
+          (grid_size_ + Vec<int64_t, 2>::Fill(TileMap::kChunkSize - 1)) /
+          Vec<int64_t, 2>::Fill(TileMap::kChunkSize)),
+      tag_costs_{{blocking_tag, kWall}},
+      max_cost_(kInfinity) {
+  if (!map_->IsTagIndexEnabled())
+    map_->SetTagIndexEnabled(true);
+  map_->AddChangeListener(this);
+  BuildCosts();
+}
+
+FlowFieldCache::~FlowFieldCache() {
+  map_->RemoveChangeListener(this);
+}
+
+void FlowFieldCache::SetTagCost(int tag, int cost) {
+  uint8_t tile_cost = std::min(std::max(cost, 0), 255);
+  auto it = std::find_if(tag_costs_.begin(), tag_costs_.end(),
+                         [tag](const std::pair<int, uint8_t>& entry) {
+                           return entry.first == tag;
+                         });
+  if (it != tag_costs_.end())
+    it->second = tile_cost;
+  else
+    tag_costs_.push_back({tag, tile_cost});
+  BuildCosts();
+  fields_.clear();
+}
+
+void FlowFieldCache::SetMaxCost(float cost) {
+  max_cost_ = cost;
+  fields_.clear();
+}
+
+void FlowFieldCache::SetMaxFields(int count) {
+  max_fields_ = count;
+  while (fields_.size() > max_fields_)
+    fields_.pop_back();
+}
+
+std::shared_ptr<const FlowField> FlowFieldCache::GetField(
+    const TileMap::GridPoint& goal) {
+  for (auto it = fields_.begin(); it != fields_.end(); ++it) {
+    if ((*it)->goal() == goal) {
+      fields_.splice(fields_.begin(), fields_, it);
+      return fields_.front();
+    }
+  }
+
+  std::shared_ptr<const FlowField> field = Integrate(goal);
+  if (max_fields_ > 0) {
+    fields_.push_front(field);
+    while (fields_.size() > max_fields_)
+      fields_.pop_back();
+  }
+  return field;
+}
+
+void FlowFieldCache::OnTileChanged(const TileMap::GridPoint& point,
+                                   int layer) {
+  int64_t index = point.y() * grid_size_.x() + point.x();
+  uint8_t cost = GetTileCost(point);
+  if (costs_[index] == cost)
+    return;
+  costs_[index] = cost;
+
+  // A field can change if it reached the tile's chunk, or a chunk next to
+  // the tile that a wall may have kept it out of until now.
+  std::vector<int> chunks{GetChunkIndex(point)};
+  for (const Point<>& direction : kDirections) {
+    Point<> neighbour = point + direction;
+    if (Rect<>{{0, 0}, grid_size_}.Contains(neighbour))
+      chunks.push_back(GetChunkIndex(neighbour));
+  }
+  fields_.remove_if([&chunks](const std::shared_ptr<const FlowField>& field) {
+    for (int chunk : chunks) {
+      if (field->touched_chunks_[chunk])
+        return true;
+    }
+    return false;
+  });
+}
+
+void FlowFieldCache::OnRectChanged(const Rect<>& grid_rect) {
+  // Same as OnTileChanged(), but collects the chunks for the whole rect so
+  // the cache is only searched once.
+  std::vector<bool> chunks(chunk_grid_size_.x() * chunk_grid_size_.y());
+  bool changed = false;
+  Rect<> bounds{{0, 0}, grid_size_};
+  Rect<> rect = grid_rect.GetOverlap(bounds);
+  Point<> point;
+  for (point.y() = rect.y(); point.y() < rect.y() + rect.h(); ++point.y()) {
+    for (point.x() = rect.x(); point.x() < rect.x() + rect.w(); ++point.x()) {
+      int64_t index = point.y() * grid_size_.x() + point.x();
+      uint8_t cost = GetTileCost(point);
+      if (costs_[index] == cost)
+        continue;
+      costs_[index] = cost;
+      changed = true;
+      chunks[GetChunkIndex(point)] = true;
+      for (const Point<>& direction : kDirections) {
+        Point<> neighbour = point + direction;
+        if (bounds.Contains(neighbour))
+          chunks[GetChunkIndex(neighbour)] = true;
+      }
+    }
+  }
+  if (!changed)
+    return;
+
+  fields_.remove_if([&chunks](const std::shared_ptr<const FlowField>& field) {
+    for (int chunk = 0; chunk < chunks.size(); ++chunk) {
+      if (chunks[chunk] && field->touched_chunks_[chunk])
+        return true;
+    }
+    return false;
+  });
+}
+
+void FlowFieldCache::OnTileSetChanged() {
+  BuildCosts();
+  fields_.clear();
+}
+
+std::shared_ptr<FlowField> FlowFieldCache::Integrate(
+    const TileMap::GridPoint& goal) const {
+  std::shared_ptr<FlowField> field(new FlowField);
+  field->goal_ = goal;
+  field->size_ = grid_size_;
+  field->costs_.assign(grid_size_.x() * grid_size_.y(), kInfinity);
+  field->directions_.assign(field->costs_.size(), -1);
+  int chunk_count = chunk_grid_size_.x() * chunk_grid_size_.y();
+  field->touched_chunks_.assign(chunk_count, 0);
+  if (!Rect<>{{0, 0}, grid_size_}.Contains(goal) ||
+      costs_[goal.y() * grid_size_.x() + goal.x()] == kWall) {
+    return field;
+  }
+  field->costs_[goal.y() * grid_size_.x() + goal.x()] = 0;
+
+  // Chunks are integrated until their edges stop changing. Chunks of one
+  // colour never touch, even at the corners, so each colour's chunks can run
+  // in parallel: each writes only its own tiles and reads its neighbours'.
+  int goal_chunk = GetChunkIndex(goal);
+  std::vector<char> active(chunk_count);
+  std::vector<char> edge_changed(chunk_count);
+  active[goal_chunk] = true;
+  bool any_active = true;
+  std::vector<int> batch;
+  while (any_active) {
+    any_active = false;
+    for (int colour = 0; colour < 4; ++colour) {
+      batch.clear();
+      for (int i = 0; i < chunk_count; ++i) {
+        int64_t x = i % chunk_grid_size_.x();
+        int64_t y = i / chunk_grid_size_.x();
+        if (active[i] && (x % 2) + (y % 2) * 2 == colour) {
+          batch.push_back(i);
+          active[i] = false;
+        }
+      }
+      auto integrate = [this, field, goal_chunk, &batch,
+                        &edge_changed](int64_t i) {
+        int index = batch[i];
+        bool seed_goal = index == goal_chunk && !field->touched_chunks_[index];
+        field->touched_chunks_[index] = true;
+        edge_changed[index] = IntegrateChunk(field.get(), index, seed_goal);
+      };
+      if (pool_) {
+        pool_->ParallelFor(batch.size(), integrate);
+      } else {
+        for (int64_t i = 0; i < batch.size(); ++i)
+          integrate(i);
+      }
+
+      for (int index : batch) {
+        if (!edge_changed[index])
+          continue;
+        int64_t x = index % chunk_grid_size_.x();
+        int64_t y = index / chunk_grid_size_.x();
+        for (int64_t dy = -1; dy <= 1; ++dy) {
+          for (int64_t dx = -1; dx <= 1; ++dx) {
+            if ((dx || dy) && x + dx >= 0 && y + dy >= 0 &&
+                x + dx < chunk_grid_size_.x() &&
+                y + dy < chunk_grid_size_.y()) {
+              active[(y + dy) * chunk_grid_size_.x() + x + dx] = true;
+              any_active = true;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  std::vector<int> touched;
+  for (int i = 0; i < chunk_count; ++i) {
+    if (field->touched_chunks_[i])
+      touched.push_back(i);
+  }
+  auto find_directions = [this, field, &touched](int64_t i) {
+    FindDirections(field.get(), touched[i]);
+  };
+  if (pool_) {
+    pool_->ParallelFor(touched.size(), find_directions);
+  } else {
+    for (int64_t i = 0; i < touched.size(); ++i)
+      find_directions(i);
+  }
+  return field;
+}
+
+bool FlowFieldCache::IntegrateChunk(FlowField* field,
+                                    int index,
+                                    bool seed_goal) const {
+  Rect<> rect = GetChunkRect(index);
+  int64_t width = grid_size_.x();
+  std::vector<float>& costs = field->costs_;
+  auto on_edge = [&rect](const Point<>& point) {
+    return point.x() == rect.x() || point.y() == rect.y() ||
+           point.x() == rect.x() + rect.w() - 1 ||
+           point.y() == rect.y() + rect.h() - 1;
+  };
+
+  OpenList open;
+  bool edge_changed = false;
+  if (seed_goal) {
+    const Point<>& goal = field->goal_;
+    open.push({0, goal.y() * width + goal.x()});
+    edge_changed = on_edge(goal);
+  }
+  // Pull in the costs found by the chunks around this one.
+  for (int64_t y = rect.y(); y < rect.y() + rect.h(); ++y) {
+    bool whole_row = y == rect.y() || y == rect.y() + rect.h() - 1;
+    int64_t step = whole_row ? 1 : std::max<int64_t>(rect.w() - 1, 1);
+    for (int64_t x = rect.x(); x < rect.x() + rect.w(); x += step) {
+      Point<> point{x, y};
+      float& cost = costs[y * width + x];
+      for (const Point<>& direction : kDirections) {
+        Point<> neighbour = point + direction;
+        if (rect.Contains(neighbour) || !CanStep(point, direction))
+          continue;
+        int64_t neighbour_index = neighbour.y() * width + neighbour.x();
+        float through = costs[neighbour_index] +
+                        costs_[neighbour_index] * GetStepLength(direction);
+        if (through < cost && through <= max_cost_) {
+          cost = through;
+          open.push({through, y * width + x});
+          edge_changed = true;
+        }
+      }
+    }
+  }
+
+  while (!open.empty()) {
+    float cost = open.top().first;
+    int64_t tile = open.top().second;
+    open.pop();
+    if (cost > costs[tile])
+      continue;
+
+    // Tiles that can step onto this one.
+    Point<> point{tile % width, tile / width};
+    for (const Point<>& direction : kDirections) {
+      Point<> from = point - direction;
+      if (!rect.Contains(from) || !CanStep(from, direction))
+        continue;
+      float through = cost + costs_[tile] * GetStepLength(direction);
+      int64_t from_index = from.y() * width + from.x();
+      if (through < costs[from_index] && through <= max_cost_) {
+        costs[from_index] = through;
+        open.push({through, from_index});
+        edge_changed = edge_changed || on_edge(from);
+      }
+    }
+  }
+  return edge_changed;
+}
+
+void FlowFieldCache::FindDirections(FlowField* field, int index) const {
+  Rect<> rect = GetChunkRect(index);
+  int64_t width = grid_size_.x();
+  const std::vector<float>& costs = field->costs_;
+  for (int64_t y = rect.y(); y < rect.y() + rect.h(); ++y) {
+    for (int64_t x = rect.x(); x < rect.x() + rect.w(); ++x) {
+      int64_t tile = y * width + x;
+      if (costs[tile] == 0 || costs[tile] == kInfinity)
+        continue;
+      float best = kInfinity;
+      for (int i = 0; i < 8; ++i) {
+        const Point<>& direction = kDirections[i];
+        if (!CanStep({x, y}, direction))
+          continue;
+        int64_t next = (y + direction.y()) * width + x + direction.x();
+        float through = costs[next] + costs_[next] * GetStepLength(direction);
+        if (through < best) {
+          best = through;
+          field->directions_[tile] = i;
+        }
+      }
+    }
+  }
+}
+
+void FlowFieldCache::BuildCosts() {
+  costs_.assign(grid_size_.x() * grid_size_.y(), 1);
+  std::vector<Point<>> tagged;
+  for (const auto& tag_cost : tag_costs_) {
+    for (int layer = 0; layer < map_->GetLayerCount(); ++layer) {
+      const BitGrid* grid = map_->GetTagGrid(tag_cost.first, layer);
+      if (!grid)
+        continue;
+      tagged.clear();
+      grid->FindAll({{0, 0}, grid_size_}, &tagged);
+      for (const Point<>& point : tagged) {
+        uint8_t& cost = costs_[point.y() * grid_size_.x() + point.x()];
+        if (cost != kWall)
+          cost = tag_cost.second == kWall ? kWall
+                                          : std::max(cost, tag_cost.second);
+      }
+    }
+  }
+}
+
+uint8_t FlowFieldCache::GetTileCost(const Point<>& point) const {
+  uint8_t cost = 1;
+  for (const auto& tag_cost : tag_costs_) {
+    for (int layer = 0; layer < map_->GetLayerCount(); ++layer) {
+      const BitGrid* grid = map_->GetTagGrid(tag_cost.first, layer);
+      if (!grid || !grid->Get(point))
+        continue;
+      if (tag_cost.second == kWall)
+        return kWall;
+      cost = std::max(cost, tag_cost.second);
+    }
+  }
+  return cost;
+}
+
+bool FlowFieldCache::CanStep(const Point<>& from,
+                             const Point<>& direction) const {
+  auto is_open = [this](int64_t x, int64_t y) {
+    return x >= 0 && y >= 0 && x < grid_size_.x() && y < grid_size_.y() &&
+           costs_[y * grid_size_.x() + x] != kWall;
+  };
+  int64_t x = from.x();
+  int64_t y = from.y();
+  int64_t dx = direction.x();
+  int64_t dy = direction.y();
+  return is_open(x, y) && is_open(x + dx, y + dy) &&
+         (!dx || !dy || (is_open(x + dx, y) && is_open(x, y + dy)));
+}
+
+Rect<> FlowFieldCache::GetChunkRect(int index) const {
+  Point<> corner{index % chunk_grid_size_.x() * TileMap::kChunkSize,
+                 index / chunk_grid_size_.x() * TileMap::kChunkSize};
+  Rect<> rect{corner, Vec<int64_t, 2>::Fill(TileMap::kChunkSize)};
+  return rect.GetOverlap({{0, 0}, grid_size_});
+}
+
+int FlowFieldCache::GetChunkIndex(const Point<>& point) const {
+  return point.y() / TileMap::kChunkSize * chunk_grid_size_.x() +
+         point.x() / TileMap::kChunkSize;
+}
+
+}  // namespace engine2
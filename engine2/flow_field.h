@@ -0,0 +1,113 @@
+#ifndef ENGINE2_FLOW_FIELD_H_
+#define ENGINE2_FLOW_FIELD_H_
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "engine2/base/worker_pool.h"
+#include "engine2/tile_map.h"
+
+namespace engine2 {
+
+// The cheapest way to one goal from every tile of a map, for steering any
+// number of units there. Made by FlowFieldCache, and never changes after.
+class FlowField {
+ public:
+  const TileMap::GridPoint& goal() const { return goal_; }
+
+  // The step to take from |point| toward the goal, such as {1, -1}. {0, 0} at
+  // the goal, on walls and where the goal can't be reached.
+  Point<> GetDirection(const TileMap::GridPoint& point) const;
+  // The cost of getting from |point| to the goal, or infinity if it can't.
+  float GetCost(const TileMap::GridPoint& point) const;
+
+ private:
+  friend class FlowFieldCache;
+
+  FlowField() = default;
+
+  TileMap::GridPoint goal_;
+  Vec<int64_t, 2> size_;
+  std::vector<float> costs_;
+  // Indices into the list of directions, or -1 for none.
+  std::vector<int8_t> directions_;
+  // Set for each chunk the integration reached, so edits elsewhere don't
+  // invalidate the field.
+  std::vector<char> touched_chunks_;
+};
+
+// Makes and caches flow fields over a TileMap, so units sharing a goal share
+// one field. Fields integrate the cost of stepping onto each tile outward
+// from the goal, with 8-way moves that don't cut the corners of walls. Tiles
+// with a blocking tag on any layer are walls; other tags can make tiles more
+// expensive. The map is integrated in TileMap::kChunkSize chunks, spread over
+// a worker pool. An edit drops the cached fields that reached it.
+class FlowFieldCache : public TileMap::ChangeListener {
+ public:
+  static constexpr int kDefaultMaxFields = 8;
+
+  // Turns on |map|'s tag index, which must stay on. A null |pool| integrates
+  // on the calling thread. |map| and |pool| must outlive the cache.
+  FlowFieldCache(TileMap* map, int blocking_tag, WorkerPool* pool);
+  ~FlowFieldCache() override;
+  FlowFieldCache(const FlowFieldCache&) = delete;
+  FlowFieldCache& operator=(const FlowFieldCache&) = delete;
+
+  // Stepping onto a tile with |tag| on any layer costs |cost|, from 1 to 255,
+  // or 0 to make it a wall. Tiles without such tags cost 1; tiles with
+  // several cost the most of them. Clears the cache.
+  void SetTagCost(int tag, int cost);
+  // Fields stop where the cost of reaching the goal would pass |cost|, so
+  // they take less time and fewer edits reach them. Clears the cache.
+  void SetMaxCost(float cost);
+  // Keeps at most |count| fields, dropping the least recently used.
+  void SetMaxFields(int count);
+
+  // Returns the field for |goal|, making it if it isn't cached. Fields that
+  // are dropped stay valid for whoever holds them, but don't see later edits.
+  std::shared_ptr<const FlowField> GetField(const TileMap::GridPoint& goal);
+  int GetCachedFieldCount() const { return fields_.size(); }
+
+  // TileMap::ChangeListener:
+  void OnTileChanged(const TileMap::GridPoint& point, int layer) override;
+  void OnTileSetChanged() override;
+  void OnRectChanged(const Rect<>& grid_rect) override;
+
+ private:
+  // Cost of stepping onto a wall.
+  static constexpr uint8_t kWall = 0;
+
+  std::shared_ptr<FlowField> Integrate(const TileMap::GridPoint& goal) const;
+  // Runs Dijkstra's algorithm over chunk |index| of |field|, starting from
+  // the costs of the tiles around it, and from the goal if |seed_goal|.
+  // Returns true if a tile on its edge got cheaper.
+  bool IntegrateChunk(FlowField* field, int index, bool seed_goal) const;
+  void FindDirections(FlowField* field, int index) const;
+
+  void BuildCosts();
+  uint8_t GetTileCost(const Point<>& point) const;
+  // Whether a unit can step from |from| in |direction|.
+  bool CanStep(const Point<>& from, const Point<>& direction) const;
+  Rect<> GetChunkRect(int index) const;
+  int GetChunkIndex(const Point<>& point) const;
+
+  TileMap* map_;
+  WorkerPool* pool_;
+  Vec<int64_t, 2> grid_size_;
+  Vec<int64_t, 2> chunk_grid_size_;
+  // Costs of the tags that change them.
+  std::vector<std::pair<int, uint8_t>> tag_costs_;
+  // The cost of stepping onto each tile, row by row.
+  std::vector<uint8_t> costs_;
+  float max_cost_;
+  int max_fields_ = kDefaultMaxFields;
+  // Most recently used first.
+  std::list<std::shared_ptr<const FlowField>> fields_;
+};
+
+}  // namespace engine2
+
+#endif  // ENGINE2_FLOW_FIELD_H_
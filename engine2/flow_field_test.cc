@@ -0,0 +1,259 @@
+#include "engine2/flow_field.h"
+#include "engine2/flow_field_test.h"
+#include "engine2/test/assert_macros.h"
+
+#include <cmath>
+#include <limits>
+
+namespace engine2 {
+namespace test {
+namespace {
+
+const Vec<int64_t, 2> kTileSize{16, 16};
+constexpr int kWallTag = 0;
+constexpr int kMudTag = 1;
+constexpr uint16_t kFloor = 0;
+constexpr uint16_t kWall = 1;
+constexpr uint16_t kMud = 2;
+
+std::unique_ptr<TileMap> CreateMap(const Vec<int64_t, 2>& grid_size) {
+  auto map = std::make_unique<TileMap>(kTileSize, grid_size, /*layer_count=*/2,
+                                       Point<>{}, /*sprite_cache=*/nullptr);
+  TileMap::Tile wall{nullptr};
+  wall.SetTag(kWallTag, true);
+  TileMap::Tile mud{nullptr};
+  mud.SetTag(kMudTag, true);
+  map->AddTiles({{nullptr}, wall, mud});
+  return map;
+}
+
+// Follows |field| from |start|, returning true if it reaches the goal without
+// stepping onto a wall.
+bool FollowField(TileMap* map,
+                 const FlowField& field,
+                 const TileMap::GridPoint& start) {
+  TileMap::GridPoint point = start;
+  for (int i = 0; i < 1000; ++i) {
+    if (point == field.goal())
+      return true;
+    Point<> direction = field.GetDirection(point);
+    if (direction == Point<>{0, 0})
+      return false;
+    point = {point.x() + direction.x(), point.y() + direction.y()};
+    if (map->GetTileIndex(point, 1) == kWall)
+      return false;
+  }
+  return false;
+}
+
+}  // namespace
+
+void FlowFieldTest::TestDirections() {
+  auto map = CreateMap({20, 10});
+  FlowFieldCache cache(map.get(), kWallTag, /*pool=*/nullptr);
+  std::shared_ptr<const FlowField> field = cache.GetField({10, 5});
+  ASSERT_NOT_NULL(field.get());
+  EXPECT_TRUE((TileMap::GridPoint{10, 5}) == field->goal());
+  EXPECT_EQ(0, field->GetCost({10, 5}));
+  EXPECT_TRUE((Point<>{0, 0}) == field->GetDirection({10, 5}));
+
+  EXPECT_EQ(3, field->GetCost({13, 5}));
+  EXPECT_TRUE((Point<>{-1, 0}) == field->GetDirection({13, 5}));
+  EXPECT_TRUE((Point<>{0, 1}) == field->GetDirection({10, 2}));
+  float cost = field->GetCost({7, 8});
+  EXPECT_TRUE(std::abs(cost - 3 * std::sqrt(2.0f)) < 1e-4);
+  EXPECT_TRUE((Point<>{1, -1}) == field->GetDirection({7, 8}));
+  cost = field->GetCost({0, 0});
+  EXPECT_TRUE(std::abs(cost - (5 + 5 * std::sqrt(2.0f))) < 1e-4);
+
+  cost = field->GetCost({-1, 0});
+  EXPECT_TRUE(std::isinf(cost));
+  EXPECT_TRUE((Point<>{0, 0}) == field->GetDirection({20, 0}));
+}
+
+void FlowFieldTest::TestWalls() {
+  auto map = CreateMap({30, 20});
+  // A wall down column 15 with a gap at row 17.
+  for (int64_t y = 0; y < 20; ++y) {
+    if (y != 17)
+      map->SetTileIndex({15, y}, 1, kWall);
+  }
+  // A walled-in room in the corner.
+  for (int64_t i = 0; i < 4; ++i) {
+    map->SetTileIndex({i, 3}, 1, kWall);
+    map->SetTileIndex({3, i}, 1, kWall);
+  }
+  FlowFieldCache cache(map.get(), kWallTag, /*pool=*/nullptr);
+  std::shared_ptr<const FlowField> field = cache.GetField({25, 2});
+  bool reached = FollowField(map.get(), *field, {5, 2});
+  EXPECT_TRUE(reached);
+  reached = FollowField(map.get(), *field, {14, 0});
+  EXPECT_TRUE(reached);
+  // The way around is longer than the straight line.
+  bool longer = field->GetCost({5, 2}) > 2 * 17;
+  EXPECT_TRUE(longer);
+
+  float cost = field->GetCost({1, 1});
+  EXPECT_TRUE(std::isinf(cost));
+  EXPECT_TRUE((Point<>{0, 0}) == field->GetDirection({1, 1}));
+  cost = field->GetCost({15, 5});
+  EXPECT_TRUE(std::isinf(cost));
+
+  // A goal on a wall can't be reached from anywhere.
+  field = cache.GetField({15, 5});
+  cost = field->GetCost({14, 5});
+  EXPECT_TRUE(std::isinf(cost));
+
+  // Diagonal steps don't cut the corners of walls.
+  field = cache.GetField({16, 16});
+  EXPECT_TRUE((Point<>{1, 0}) == field->GetDirection({15, 17}));
+  EXPECT_TRUE((Point<>{0, -1}) == field->GetDirection({16, 17}));
+}
+
+void FlowFieldTest::TestTagCost() {
+  auto map = CreateMap({20, 10});
+  map->SetTileIndex({5, 5}, 0, kMud);
+  FlowFieldCache cache(map.get(), kWallTag, /*pool=*/nullptr);
+  std::shared_ptr<const FlowField> field = cache.GetField({2, 5});
+  EXPECT_TRUE((Point<>{-1, 0}) == field->GetDirection({6, 5}));
+  EXPECT_EQ(4, field->GetCost({6, 5}));
+
+  cache.SetTagCost(kMudTag, 10);
+  EXPECT_EQ(0, cache.GetCachedFieldCount());
+  field = cache.GetField({2, 5});
+  // Around the mud instead of through it.
+  Point<> direction = field->GetDirection({6, 5});
+  EXPECT_TRUE(direction.x() == -1 && direction.y() != 0);
+  float cost = field->GetCost({6, 5});
+  EXPECT_TRUE(std::abs(cost - (2 + 2 * std::sqrt(2.0f))) < 1e-4);
+
+  cache.SetTagCost(kMudTag, 0);
+  field = cache.GetField({2, 5});
+  cost = field->GetCost({5, 5});
+  EXPECT_TRUE(std::isinf(cost));
+}
+
+void FlowFieldTest::TestCache() {
+  auto map = CreateMap({200, 40});
+  FlowFieldCache cache(map.get(), kWallTag, /*pool=*/nullptr);
+  std::shared_ptr<const FlowField> field = cache.GetField({5, 5});
+  EXPECT_TRUE(field == cache.GetField({5, 5}));
+  EXPECT_EQ(1, cache.GetCachedFieldCount());
+
+  cache.SetMaxFields(2);
+  cache.GetField({6, 5});
+  cache.GetField({5, 5});
+  cache.GetField({7, 5});
+  EXPECT_EQ(2, cache.GetCachedFieldCount());
+  // The least recently used field was dropped.
+  EXPECT_TRUE(field == cache.GetField({5, 5}));
+  std::shared_ptr<const FlowField> other = cache.GetField({6, 5});
+  EXPECT_EQ(2, cache.GetCachedFieldCount());
+
+  // Edits drop the fields that reached them, unless they change nothing.
+  map->SetTileIndex({150, 20}, 0, kFloor);
+  EXPECT_TRUE(other == cache.GetField({6, 5}));
+  map->SetTileIndex({150, 20}, 1, kWall);
+  EXPECT_FALSE(other == cache.GetField({6, 5}));
+  float cost = cache.GetField({6, 5})->GetCost({150, 20});
+  EXPECT_TRUE(std::isinf(cost));
+  // Holders of dropped fields can keep using them.
+  cost = other->GetCost({150, 20});
+  EXPECT_TRUE(std::abs(cost - (129 + 15 * std::sqrt(2.0f))) < 1e-3);
+
+  // Fields that stop short of an edit keep it.
+  cache.SetMaxCost(30);
+  EXPECT_EQ(0, cache.GetCachedFieldCount());
+  field = cache.GetField({5, 5});
+  cost = field->GetCost({60, 5});
+  EXPECT_TRUE(std::isinf(cost));
+  EXPECT_EQ(20, field->GetCost({25, 5}));
+  map->SetTileIndex({150, 20}, 1, kFloor);
+  EXPECT_TRUE(field == cache.GetField({5, 5}));
+  map->SetTileIndex({60, 5}, 1, kWall);
+  EXPECT_FALSE(field == cache.GetField({5, 5}));
+
+  // Replacing a chunk drops the fields that reached it.
+  field = cache.GetField({5, 5});
+  auto make_chunk = [] {
+    return std::make_unique<uint16_t[]>(TileMap::kChunkSize *
+                                        TileMap::kChunkSize * 2);
+  };
+  map->SetChunkTiles({128, 0}, make_chunk());
+  EXPECT_TRUE(field == cache.GetField({5, 5}));
+  std::unique_ptr<uint16_t[]> tiles = make_chunk();
+  tiles[(5 * TileMap::kChunkSize + 10) * 2] = kWall;
+  map->SetChunkTiles({0, 0}, std::move(tiles));
+  EXPECT_FALSE(field == cache.GetField({5, 5}));
+
+  // Changing the tile set drops everything.
+  cache.GetField({6, 5});
+  TileMap::Tile floor{nullptr};
+  map->SetTile(kMud, floor);
+  EXPECT_EQ(0, cache.GetCachedFieldCount());
+}
+
+void FlowFieldTest::TestParallel() {
+  const Vec<int64_t, 2> kGridSize{300, 200};
+  auto map = CreateMap(kGridSize);
+  // Short wall segments and mud in a fixed pseudo-random pattern.
+  uint32_t seed = 12345;
+  auto random = [&seed](int n) {
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 16) % n;
+  };
+  for (int i = 0; i < 2000; ++i) {
+    int64_t x = random(kGridSize.x());
+    int64_t y = random(kGridSize.y());
+    bool horizontal = random(2);
+    uint16_t index = random(3) ? kWall : kMud;
+    for (int j = 0; j < 8; ++j) {
+      map->SetTileIndex({x + (horizontal ? j : 0), y + (horizontal ? 0 : j)},
+                        1, index);
+    }
+  }
+  map->SetTileIndex({150, 100}, 1, kFloor);
+
+  FlowFieldCache cache(map.get(), kWallTag, /*pool=*/nullptr);
+  cache.SetTagCost(kMudTag, 3);
+  WorkerPool pool(3);
+  FlowFieldCache parallel_cache(map.get(), kWallTag, &pool);
+  parallel_cache.SetTagCost(kMudTag, 3);
+  std::shared_ptr<const FlowField> field = cache.GetField({150, 100});
+  std::shared_ptr<const FlowField> parallel_field =
+      parallel_cache.GetField({150, 100});
+
+  bool all_match = true;
+  int reached_count = 0;
+  for (int64_t y = 0; y < kGridSize.y(); ++y) {
+    for (int64_t x = 0; x < kGridSize.x(); ++x) {
+      float cost = field->GetCost({x, y});
+      float parallel_cost = parallel_field->GetCost({x, y});
+      if (std::isinf(cost)) {
+        all_match = all_match && std::isinf(parallel_cost);
+      } else {
+        all_match = all_match && std::abs(cost - parallel_cost) < 1e-3;
+        ++reached_count;
+      }
+    }
+  }
+  EXPECT_TRUE(all_match);
+  bool most_reached = reached_count > kGridSize.x() * kGridSize.y() / 2;
+  EXPECT_TRUE(most_reached);
+  bool reached = FollowField(map.get(), *parallel_field, {1, 1}) ||
+                 std::isinf(parallel_field->GetCost({1, 1}));
+  EXPECT_TRUE(reached);
+}
+
+FlowFieldTest::FlowFieldTest()
+    : TestGroup("FlowFieldTest",
+                {
+                    std::bind(&FlowFieldTest::TestDirections, this),
+                    std::bind(&FlowFieldTest::TestWalls, this),
+                    std::bind(&FlowFieldTest::TestTagCost, this),
+                    std::bind(&FlowFieldTest::TestCache, this),
+                    std::bind(&FlowFieldTest::TestParallel, this),
+                }) {}
+
+}  // namespace test
+}  // namespace engine2
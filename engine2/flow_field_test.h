@@ -0,0 +1,22 @@
+#ifndef ENGINE2_FLOW_FIELD_TEST_H_
+#define ENGINE2_FLOW_FIELD_TEST_H_
+
+#include "engine2/test/test_group.h"
+
+namespace engine2 {
+namespace test {
+
+class FlowFieldTest : public TestGroup {
+ public:
+  void TestDirections();
+  void TestWalls();
+  void TestTagCost();
+  void TestCache();
+  void TestParallel();
+  FlowFieldTest();
+};
+
+}  // namespace test
+}  // namespace engine2
+
+#endif  // ENGINE2_FLOW_FIELD_TEST_H_
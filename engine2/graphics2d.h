@@ -3,6 +3,8 @@
 
 #include <SDL2/SDL_render.h>
 
+#include <memory>
+
 #include "engine2/point.h"
 #include "engine2/rect.h"
 #include "engine2/rgba_color.h"
@@ -35,6 +37,23 @@ class Graphics2D {
   virtual Graphics2D* DrawTexture(const Texture& texture,
                                   const Rect<>& src,
                                   const Rect<>& dest) = 0;
+  // Draws triangles textured with |texture| in one call. Each three entries of
+  // |indices| are the vertices of a triangle. Texture coordinates range from 0
+  // to 1.
+  virtual Graphics2D* DrawGeometry(const Texture& texture,
+                                   const SDL_Vertex* vertices,
+                                   int vertex_count,
+                                   const int* indices,
+                                   int index_count) = 0;
+
+  // Render targets. CreateTargetTexture() returns a texture that can be drawn
+  // into and is alpha blended when it's drawn, or null on failure.
+  virtual std::unique_ptr<Texture> CreateTargetTexture(int width,
+                                                       int height) = 0;
+  // Drawing goes to |texture|, which must come from CreateTargetTexture(), or
+  // to the window if it's null.
+  virtual Graphics2D* SetRenderTarget(Texture* texture) = 0;
+  virtual Texture* GetRenderTarget() = 0;
 
   virtual Graphics2D* Clear() = 0;
   virtual Graphics2D* Present() = 0;
@@ -0,0 +1,490 @@
+#ifndef ENGINE2_IMPL_AABB_TREE_H_
+#define ENGINE2_IMPL_AABB_TREE_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "engine2/rect.h"
+
+namespace engine2 {
+namespace aabb_tree_internal {
+
+constexpr int kNullNode = -1;
+
+// Leaves store their object's rect grown by 1/kFatMarginDivisor of its size on
+// each side so that small movements don't require reinsertion.
+constexpr int64_t kFatMarginDivisor = 4;
+
+template <int N>
+Rect<int64_t, N> Union(const Rect<int64_t, N>& a, const Rect<int64_t, N>& b) {
+  Rect<int64_t, N> result;
+  for (int i = 0; i < N; ++i) {
+    result.pos[i] = std::min(a.pos[i], b.pos[i]);
+    result.size[i] =
+        std::max(a.pos[i] + a.size[i], b.pos[i] + b.size[i]) - result.pos[i];
+  }
+  return result;
+}
+
+// True if |a| and |b| overlap or touch. This is deliberately looser than
+// Rect::Overlaps() || Rect::Touches() since callers filter results anyway.
+template <int N>
+bool TouchesOrOverlaps(const Rect<int64_t, N>& a, const Rect<int64_t, N>& b) {
+  for (int i = 0; i < N; ++i) {
+    if (a.pos[i] > b.pos[i] + b.size[i] || b.pos[i] > a.pos[i] + a.size[i])
+      return false;
+  }
+  return true;
+}
+
+template <int N>
+bool ContainsInclusive(const Rect<int64_t, N>& outer,
+                       const Rect<int64_t, N>& inner) {
+  for (int i = 0; i < N; ++i) {
+    if (inner.pos[i] < outer.pos[i] ||
+        inner.pos[i] + inner.size[i] > outer.pos[i] + outer.size[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <int N>
+Rect<int64_t, N> Fatten(const Rect<int64_t, N>& rect) {
+  Rect<int64_t, N> result = rect;
+  for (int i = 0; i < N; ++i) {
+    int64_t margin = rect.size[i] / kFatMarginDivisor;
+    result.pos[i] -= margin;
+    result.size[i] += margin * 2;
+  }
+  return result;
+}
+
+}  // namespace aabb_tree_internal
+
+// AabbTree is a dynamic bounding volume hierarchy with the same interface as
+// RectSearchTree. Rather than bisecting a fixed region, each leaf holds one
+// object and each internal node holds the bounding box of its children, so the
+// tree adapts to clustered objects and to objects of very different sizes.
+//
+// New leaves are placed where they least increase the tree's total surface
+// area (approximated by the sum of each node's scaled side lengths), and the
+// tree is kept height-balanced with rotations.
+//
+// Unlike RectSearchTree, any Insert(), Move() or Remove() may restructure the
+// tree, so a Near() traversal is invalidated by any modification. Iterators
+// returned by Insert() and Move() stay valid as handles to their objects until
+// the objects are removed.
+template <int N, class Rep>
+class AabbTree {
+ public:
+  using Rect = Rect<int64_t, N>;
+  class NearIterator;
+  struct NearIterable;
+
+  // Iterator: Visits all objects in the tree.
+  NearIterator begin() { return NearIterator(this, rect_, /*match_all=*/true); }
+  NearIterator end() { return NearIterator(); }
+
+  // NearIterator: Visits objects whose bounding boxes touch or overlap |rect|.
+  NearIterable Near(Rect rect) { return NearIterable{this, rect}; }
+  struct NearIterable {
+    AabbTree* tree;
+    Rect rect;
+    NearIterator begin() { return NearIterator(tree, rect, false); }
+    NearIterator end() { return NearIterator(); }
+  };
+
+  // Create an empty tree. The tree grows to fit its contents, so |rect| is only
+  // used by InsertTrimmed() and GetRect(), and |tree_depth| is ignored; both
+  // are accepted so AabbTree can be used in place of RectSearchTree.
+  // |breakdown_scale| weights each dimension when comparing placement costs,
+  // the same way RectSearchTree uses it to pick which dimension to split.
+  static std::unique_ptr<AabbTree> Create(
+      const Rect& rect,
+      int tree_depth = 0,
+      const Point<double, N>& breakdown_scale = Point<double, N>::Ones());
+
+  // Add an object to the tree. Returns an iterator to the object.
+  NearIterator Insert(const Rect& rect, Rep obj);
+
+  // Same as Insert(Rect, Rep), but use the intersection of rect and rect_.
+  NearIterator InsertTrimmed(const Rect& rect, Rep obj);
+
+  // Remove an object from the tree.
+  void Remove(NearIterator&& iterator);
+
+  // Update an object's bounds and return a new iterator to the object.
+  NearIterator Move(NearIterator&& iterator, Rect dest);
+
+  const Rect& GetRect() const { return rect_; }
+
+  // Returns the number of levels in the tree (0 if the tree is empty).
+  int GetHeight() const;
+  int Size() const { return leaf_count_; }
+
+  class NearIterator {
+   public:
+    NearIterator() = default;
+
+    Rep& operator*() { return tree_->nodes_[leaf_].rep; }
+    operator bool() const { return leaf_ != aabb_tree_internal::kNullNode; }
+    bool operator==(const NearIterator& other) const {
+      return leaf_ == other.leaf_ &&
+             (leaf_ == aabb_tree_internal::kNullNode || tree_ == other.tree_);
+    }
+    bool operator!=(const NearIterator& other) const {
+      return !(*this == other);
+    }
+    NearIterator& operator++() {
+      Advance();
+      return *this;
+    }
+
+    // Remove the current object from the tree.
+    void Erase();
+
+   private:
+    friend class AabbTree;
+
+    // Traverse all leaves touching or overlapping |rect|.
+    NearIterator(AabbTree* tree, Rect rect, bool match_all);
+    // Point at a single leaf.
+    NearIterator(AabbTree* tree, int leaf) : tree_(tree), leaf_(leaf) {}
+
+    bool ShouldIncludeNode(int node) const {
+      return match_all_ || aabb_tree_internal::TouchesOrOverlaps(
+                               rect_, tree_->nodes_[node].rect);
+    }
+    void Advance();
+
+    AabbTree* tree_ = nullptr;
+    Rect rect_{};
+    bool match_all_ = false;
+    std::vector<int> stack_;
+    int leaf_ = aabb_tree_internal::kNullNode;
+  };
+
+ private:
+  struct Node {
+    // For leaves, the object's rect plus a margin.
+    Rect rect{};
+    // Doubles as the next free node when the node is unused.
+    int parent = aabb_tree_internal::kNullNode;
+    int child_a = aabb_tree_internal::kNullNode;
+    int child_b = aabb_tree_internal::kNullNode;
+    // Leaves have height 0.
+    int height = 0;
+    Rep rep{};
+
+    bool IsLeaf() const { return child_a == aabb_tree_internal::kNullNode; }
+  };
+
+  AabbTree(const Rect& rect, const Point<double, N>& breakdown_scale)
+      : rect_(rect), breakdown_scale_(breakdown_scale) {}
+
+  double Cost(const Rect& rect) const;
+  double CostOfDescending(int child, const Rect& leaf_rect) const;
+
+  int AllocateNode();
+  void FreeNode(int node);
+
+  void InsertLeaf(int leaf);
+  void RemoveLeaf(int leaf);
+  void ReplaceChild(int parent, int old_child, int new_child);
+  void Refit(int node);
+  void RefitAncestors(int node);
+  int Balance(int node);
+  int RotateUp(int node, int child);
+
+  Rect rect_;
+  Point<double, N> breakdown_scale_;
+  std::vector<Node> nodes_;
+  int root_ = aabb_tree_internal::kNullNode;
+  int free_list_ = aabb_tree_internal::kNullNode;
+  int leaf_count_ = 0;
+};
+
+template <int N, class Rep>
+AabbTree<N, Rep>::NearIterator::NearIterator(AabbTree* tree,
+                                             Rect rect,
+                                             bool match_all)
+    : tree_(tree), rect_(rect), match_all_(match_all) {
+  if (tree_->root_ != aabb_tree_internal::kNullNode &&
+      ShouldIncludeNode(tree_->root_)) {
+    stack_.push_back(tree_->root_);
+  }
+  Advance();
+}
+
+template <int N, class Rep>
+void AabbTree<N, Rep>::NearIterator::Advance() {
+  leaf_ = aabb_tree_internal::kNullNode;
+  while (!stack_.empty()) {
+    int index = stack_.back();
+    stack_.pop_back();
+
+    const Node& node = tree_->nodes_[index];
+    if (node.IsLeaf()) {
+      leaf_ = index;
+      return;
+    }
+
+    if (ShouldIncludeNode(node.child_a))
+      stack_.push_back(node.child_a);
+    if (ShouldIncludeNode(node.child_b))
+      stack_.push_back(node.child_b);
+  }
+}
+
+template <int N, class Rep>
+void AabbTree<N, Rep>::NearIterator::Erase() {
+  tree_->RemoveLeaf(leaf_);
+  tree_->FreeNode(leaf_);
+  --tree_->leaf_count_;
+  leaf_ = aabb_tree_internal::kNullNode;
+}
+
+// static
+template <int N, class Rep>
+std::unique_ptr<AabbTree<N, Rep>> AabbTree<N, Rep>::Create(
+    const Rect& rect,
+    int tree_depth,
+    const Point<double, N>& breakdown_scale) {
+  return std::unique_ptr<AabbTree>(new AabbTree(rect, breakdown_scale));
+}
+
+template <int N, class Rep>
+typename AabbTree<N, Rep>::NearIterator AabbTree<N, Rep>::Insert(
+    const Rect& rect,
+    Rep obj) {
+  int leaf = AllocateNode();
+  nodes_[leaf].rect = aabb_tree_internal::Fatten(rect);
+  nodes_[leaf].rep = obj;
+  InsertLeaf(leaf);
+  ++leaf_count_;
+  return NearIterator(this, leaf);
+}
+
+template <int N, class Rep>
+typename AabbTree<N, Rep>::NearIterator AabbTree<N, Rep>::InsertTrimmed(
+    const Rect& rect,
+    Rep obj) {
+  return Insert(rect.GetOverlap(rect_), obj);
+}
+
+template <int N, class Rep>
+void AabbTree<N, Rep>::Remove(NearIterator&& iterator) {
+  iterator.Erase();
+}
+
+template <int N, class Rep>
+typename AabbTree<N, Rep>::NearIterator AabbTree<N, Rep>::Move(
+    NearIterator&& iterator,
+    Rect dest) {
+  int leaf = iterator.leaf_;
+  Rect fat_dest = aabb_tree_internal::Fatten(dest);
+
+  // Keep the current leaf bounds if they still contain the object and haven't
+  // become too loose (e.g. after the object stopped moving).
+  if (aabb_tree_internal::ContainsInclusive(nodes_[leaf].rect, dest) &&
+      Cost(nodes_[leaf].rect) <= 2 * Cost(fat_dest) + N) {
+    return NearIterator(this, leaf);
+  }
+
+  RemoveLeaf(leaf);
+  nodes_[leaf].rect = fat_dest;
+  InsertLeaf(leaf);
+  return NearIterator(this, leaf);
+}
+
+template <int N, class Rep>
+int AabbTree<N, Rep>::GetHeight() const {
+  if (root_ == aabb_tree_internal::kNullNode)
+    return 0;
+  return nodes_[root_].height + 1;
+}
+
+template <int N, class Rep>
+double AabbTree<N, Rep>::Cost(const Rect& rect) const {
+  double cost = 0;
+  for (int i = 0; i < N; ++i)
+    cost += rect.size[i] / breakdown_scale_[i];
+  return cost;
+}
+
+// Returns the cost increase caused by putting a leaf with |leaf_rect| somewhere
+// under |child|.
+template <int N, class Rep>
+double AabbTree<N, Rep>::CostOfDescending(int child,
+                                          const Rect& leaf_rect) const {
+  const Node& node = nodes_[child];
+  double combined_cost = Cost(aabb_tree_internal::Union(leaf_rect, node.rect));
+  if (node.IsLeaf())
+    return combined_cost;
+  return combined_cost - Cost(node.rect);
+}
+
+template <int N, class Rep>
+int AabbTree<N, Rep>::AllocateNode() {
+  if (free_list_ == aabb_tree_internal::kNullNode) {
+    nodes_.emplace_back();
+    return nodes_.size() - 1;
+  }
+
+  int node = free_list_;
+  free_list_ = nodes_[node].parent;
+  nodes_[node] = Node();
+  return node;
+}
+
+template <int N, class Rep>
+void AabbTree<N, Rep>::FreeNode(int node) {
+  nodes_[node] = Node();
+  nodes_[node].parent = free_list_;
+  nodes_[node].height = -1;
+  free_list_ = node;
+}
+
+template <int N, class Rep>
+void AabbTree<N, Rep>::InsertLeaf(int leaf) {
+  if (root_ == aabb_tree_internal::kNullNode) {
+    root_ = leaf;
+    nodes_[leaf].parent = aabb_tree_internal::kNullNode;
+    return;
+  }
+
+  // Descend towards the cheapest place to put the leaf. Stop when pairing the
+  // leaf with the current node is cheaper than going further down.
+  Rect leaf_rect = nodes_[leaf].rect;
+  int sibling = root_;
+  while (!nodes_[sibling].IsLeaf()) {
+    const Node& node = nodes_[sibling];
+    double combined_cost =
+        Cost(aabb_tree_internal::Union(node.rect, leaf_rect));
+    double pair_cost = 2 * combined_cost;
+    // Every node below this one grows by this much too.
+    double inherited_cost = 2 * (combined_cost - Cost(node.rect));
+
+    double cost_a = CostOfDescending(node.child_a, leaf_rect) + inherited_cost;
+    double cost_b = CostOfDescending(node.child_b, leaf_rect) + inherited_cost;
+    if (pair_cost < cost_a && pair_cost < cost_b)
+      break;
+
+    sibling = cost_a < cost_b ? node.child_a : node.child_b;
+  }
+
+  // Create a new parent for the leaf and its sibling.
+  int old_parent = nodes_[sibling].parent;
+  int new_parent = AllocateNode();
+  nodes_[new_parent].parent = old_parent;
+  nodes_[new_parent].child_a = sibling;
+  nodes_[new_parent].child_b = leaf;
+  ReplaceChild(old_parent, sibling, new_parent);
+  nodes_[sibling].parent = new_parent;
+  nodes_[leaf].parent = new_parent;
+  // Give the new parent its real height so Balance() considers it.
+  Refit(new_parent);
+
+  RefitAncestors(new_parent);
+}
+
+template <int N, class Rep>
+void AabbTree<N, Rep>::RemoveLeaf(int leaf) {
+  if (leaf == root_) {
+    root_ = aabb_tree_internal::kNullNode;
+    return;
+  }
+
+  // Replace the leaf's parent with the leaf's sibling.
+  int parent = nodes_[leaf].parent;
+  int grandparent = nodes_[parent].parent;
+  int sibling = nodes_[parent].child_a == leaf ? nodes_[parent].child_b
+                                               : nodes_[parent].child_a;
+  ReplaceChild(grandparent, parent, sibling);
+  nodes_[sibling].parent = grandparent;
+  FreeNode(parent);
+  nodes_[leaf].parent = aabb_tree_internal::kNullNode;
+
+  if (grandparent != aabb_tree_internal::kNullNode)
+    RefitAncestors(grandparent);
+}
+
+template <int N, class Rep>
+void AabbTree<N, Rep>::ReplaceChild(int parent, int old_child, int new_child) {
+  if (parent == aabb_tree_internal::kNullNode) {
+    root_ = new_child;
+  } else if (nodes_[parent].child_a == old_child) {
+    nodes_[parent].child_a = new_child;
+  } else {
+    nodes_[parent].child_b = new_child;
+  }
+}
+
+template <int N, class Rep>
+void AabbTree<N, Rep>::Refit(int node) {
+  const Node& a = nodes_[nodes_[node].child_a];
+  const Node& b = nodes_[nodes_[node].child_b];
+  nodes_[node].rect = aabb_tree_internal::Union(a.rect, b.rect);
+  nodes_[node].height = 1 + std::max(a.height, b.height);
+}
+
+// Rebalances and recomputes bounds from |node| up to the root.
+template <int N, class Rep>
+void AabbTree<N, Rep>::RefitAncestors(int node) {
+  while (node != aabb_tree_internal::kNullNode) {
+    node = Balance(node);
+    Refit(node);
+    node = nodes_[node].parent;
+  }
+}
+
+// If one of |node|'s subtrees is more than one level taller than the other,
+// rotate the taller child into |node|'s place. Returns the index of the node
+// now at |node|'s old position.
+template <int N, class Rep>
+int AabbTree<N, Rep>::Balance(int node) {
+  if (nodes_[node].IsLeaf() || nodes_[node].height < 2)
+    return node;
+
+  int child_a = nodes_[node].child_a;
+  int child_b = nodes_[node].child_b;
+  int balance = nodes_[child_b].height - nodes_[child_a].height;
+  if (balance > 1)
+    return RotateUp(node, child_b);
+  if (balance < -1)
+    return RotateUp(node, child_a);
+  return node;
+}
+
+// Moves |child| into |node|'s position, making |node| a child of |child|.
+// |node| takes the shorter of |child|'s children; |child| keeps the taller.
+template <int N, class Rep>
+int AabbTree<N, Rep>::RotateUp(int node, int child) {
+  int keep = nodes_[child].child_a;
+  int give = nodes_[child].child_b;
+  if (nodes_[keep].height < nodes_[give].height)
+    std::swap(keep, give);
+
+  int parent = nodes_[node].parent;
+  ReplaceChild(parent, node, child);
+  nodes_[child].parent = parent;
+
+  ReplaceChild(node, child, give);
+  nodes_[give].parent = node;
+
+  nodes_[child].child_a = node;
+  nodes_[child].child_b = keep;
+  nodes_[node].parent = child;
+
+  Refit(node);
+  Refit(child);
+  return child;
+}
+
+}  // namespace engine2
+
+#endif  // ENGINE2_IMPL_AABB_TREE_H_
@@ -0,0 +1,189 @@
+#include "engine2/impl/aabb_tree_test.h"
+#include "engine2/impl/aabb_tree.h"
+#include "engine2/test/assert_macros.h"
+
+#include <random>
+#include <unordered_set>
+#include <vector>
+
+namespace engine2 {
+namespace test {
+namespace {
+
+using Tree = AabbTree<2, int>;
+
+std::unordered_set<int> FindNear(Tree* tree, const Rect<>& rect) {
+  std::unordered_set<int> found;
+  for (int i : tree->Near(rect))
+    found.insert(i);
+  return found;
+}
+
+}  // namespace
+
+void AabbTreeTest::TestEmpty() {
+  auto tree = Tree::Create({0, 0, 100, 100});
+  ASSERT_NOT_NULL(tree.get());
+  EXPECT_EQ(0, tree->GetHeight());
+  EXPECT_TRUE(tree->begin() == tree->end());
+  EXPECT_EQ(0, FindNear(tree.get(), {0, 0, 100, 100}).size());
+}
+
+void AabbTreeTest::TestNear() {
+  auto tree = Tree::Create({0, 0, 100, 100});
+  tree->Insert({1, 1, 90, 90}, 0);
+  tree->Insert({0, 0, 10, 10}, 1);
+  tree->Insert({90, 90, 2, 2}, 2);
+
+  std::unordered_set<int> found = FindNear(tree.get(), {60, 60, 10, 10});
+  EXPECT_EQ(1, found.size());
+  EXPECT_EQ(1, found.count(0));
+
+  found = FindNear(tree.get(), {40, 40, 60, 60});
+  EXPECT_EQ(2, found.size());
+  EXPECT_EQ(1, found.count(0));
+  EXPECT_EQ(1, found.count(2));
+
+  // Objects outside the creation rect are still found.
+  tree->Insert({500, 500, 5, 5}, 3);
+  found = FindNear(tree.get(), {498, 498, 4, 4});
+  EXPECT_EQ(1, found.size());
+  EXPECT_EQ(1, found.count(3));
+}
+
+void AabbTreeTest::TestTouch() {
+  auto tree = Tree::Create({0, 0, 100, 100});
+  tree->Insert({10, 10, 10, 10}, 0);
+  tree->Insert({40, 40, 10, 10}, 1);
+
+  // Touches the right edge of object 0.
+  std::unordered_set<int> found = FindNear(tree.get(), {20, 10, 5, 5});
+  EXPECT_EQ(1, found.size());
+  EXPECT_EQ(1, found.count(0));
+}
+
+void AabbTreeTest::TestMove() {
+  auto tree = Tree::Create({0, 0, 100, 100});
+  auto iter = tree->Insert({0, 0, 10, 10}, 1);
+  tree->Insert({50, 0, 10, 10}, 2);
+
+  EXPECT_EQ(0, FindNear(tree.get(), {70, 70, 10, 10}).size());
+
+  iter = tree->Move(std::move(iter), {72, 72, 10, 10});
+  std::unordered_set<int> found = FindNear(tree.get(), {70, 70, 10, 10});
+  EXPECT_EQ(1, found.size());
+  EXPECT_EQ(1, found.count(1));
+  EXPECT_EQ(0, FindNear(tree.get(), {0, 0, 5, 5}).size());
+
+  // A small move stays within the leaf's margin.
+  iter = tree->Move(std::move(iter), {73, 72, 10, 10});
+  EXPECT_EQ(1, *iter);
+  EXPECT_EQ(2, tree->Size());
+}
+
+void AabbTreeTest::TestRemove() {
+  auto tree = Tree::Create({0, 0, 100, 100});
+  auto iter_a = tree->Insert({0, 0, 10, 10}, 1);
+  auto iter_b = tree->Insert({5, 5, 10, 10}, 2);
+  auto iter_c = tree->Insert({8, 8, 10, 10}, 3);
+
+  tree->Remove(std::move(iter_b));
+  std::unordered_set<int> found = FindNear(tree.get(), {0, 0, 20, 20});
+  EXPECT_EQ(2, found.size());
+  EXPECT_EQ(0, found.count(2));
+
+  tree->Remove(std::move(iter_a));
+  tree->Remove(std::move(iter_c));
+  EXPECT_EQ(0, tree->Size());
+  EXPECT_EQ(0, tree->GetHeight());
+
+  // Freed nodes are reused.
+  tree->Insert({1, 1, 1, 1}, 4);
+  found = FindNear(tree.get(), {0, 0, 20, 20});
+  EXPECT_EQ(1, found.size());
+  EXPECT_EQ(1, found.count(4));
+}
+
+void AabbTreeTest::TestAllIterator() {
+  auto tree = Tree::Create({0, 0, 100, 100});
+  tree->Insert({1, 1, 90, 90}, 4);
+  tree->Insert({0, 0, 10, 10}, 5);
+  tree->Insert({90, 90, 2, 2}, 6);
+  tree->Insert({-200, -200, 2, 2}, 7);
+
+  std::unordered_set<int> found;
+  for (int i : *tree)
+    found.insert(i);
+
+  EXPECT_EQ(4, found.size());
+  EXPECT_EQ(1, found.count(4));
+  EXPECT_EQ(1, found.count(5));
+  EXPECT_EQ(1, found.count(6));
+  EXPECT_EQ(1, found.count(7));
+}
+
+void AabbTreeTest::TestBalanced() {
+  // Inserting in sorted order would produce a list without rebalancing. The
+  // height should stay within a couple of levels of log2(size).
+  for (int log_size = 4; log_size <= 12; log_size += 4) {
+    auto tree = Tree::Create({0, 0, 10000, 10});
+    int size = 1 << log_size;
+    for (int i = 0; i < size; ++i)
+      tree->Insert({i * 10, 0, 5, 5}, i);
+
+    EXPECT_EQ(size, tree->Size());
+    int height = tree->GetHeight();
+    EXPECT_TRUE(height <= log_size + 2);
+
+    // A leaf that covers everything is paired with the root itself.
+    tree->Insert({-10, -10, size * 10 + 20, 30}, size);
+    height = tree->GetHeight();
+    EXPECT_TRUE(height <= log_size + 2);
+  }
+}
+
+void AabbTreeTest::TestMatchesBruteForce() {
+  auto tree = Tree::Create({0, 0, 1000, 1000});
+  std::mt19937 random(1234);
+  std::uniform_int_distribution<int64_t> position(0, 1000);
+  std::uniform_int_distribution<int64_t> size(1, 50);
+  auto random_rect = [&]() -> Rect<> {
+    return {position(random), position(random), size(random), size(random)};
+  };
+
+  std::vector<Rect<>> rects;
+  std::vector<Tree::NearIterator> iterators;
+  for (int i = 0; i < 500; ++i) {
+    rects.push_back(random_rect());
+    iterators.push_back(tree->Insert(rects.back(), i));
+  }
+  for (int i = 0; i < 500; i += 2) {
+    rects[i] = random_rect();
+    iterators[i] = tree->Move(std::move(iterators[i]), rects[i]);
+  }
+
+  for (int query_index = 0; query_index < 50; ++query_index) {
+    Rect<> query = random_rect();
+    std::unordered_set<int> found = FindNear(tree.get(), query);
+    for (int i = 0; i < 500; ++i) {
+      if (query.Overlaps(rects[i]) || query.Touches(rects[i]))
+        ASSERT_EQ(1, found.count(i));
+    }
+  }
+}
+
+AabbTreeTest::AabbTreeTest()
+    : TestGroup("AabbTreeTest",
+                {
+                    std::bind(&AabbTreeTest::TestEmpty, this),
+                    std::bind(&AabbTreeTest::TestNear, this),
+                    std::bind(&AabbTreeTest::TestTouch, this),
+                    std::bind(&AabbTreeTest::TestMove, this),
+                    std::bind(&AabbTreeTest::TestRemove, this),
+                    std::bind(&AabbTreeTest::TestAllIterator, this),
+                    std::bind(&AabbTreeTest::TestBalanced, this),
+                    std::bind(&AabbTreeTest::TestMatchesBruteForce, this),
+                }) {}
+
+}  // namespace test
+}  // namespace engine2
@@ -0,0 +1,26 @@
+#ifndef ENGINE2_IMPL_AABB_TREE_TEST_H_
+#define ENGINE2_IMPL_AABB_TREE_TEST_H_
+
+#include "engine2/test/test_group.h"
+
+namespace engine2 {
+namespace test {
+
+class AabbTreeTest : public TestGroup {
+ public:
+  void TestEmpty();
+  void TestNear();
+  void TestTouch();
+  void TestMove();
+  void TestRemove();
+  void TestAllIterator();
+  void TestBalanced();
+  void TestMatchesBruteForce();
+
+  AabbTreeTest();
+};
+
+}  // namespace test
+}  // namespace engine2
+
+#endif  // ENGINE2_IMPL_AABB_TREE_TEST_H_
@@ -131,4 +131,35 @@ Graphics2D* BasicGraphics2D::DrawTexture(const Texture& texture,
   return this;
 }
 
+Graphics2D* BasicGraphics2D::DrawGeometry(const Texture& texture,
+                                          const SDL_Vertex* vertices,
+                                          int vertex_count,
+                                          const int* indices,
+                                          int index_count) {
+  SDL_RenderGeometry(renderer_, texture.texture_, vertices, vertex_count,
+                     indices, index_count);
+  return this;
+}
+
+std::unique_ptr<Texture> BasicGraphics2D::CreateTargetTexture(int width,
+                                                              int height) {
+  SDL_Texture* sdl_texture =
+      SDL_CreateTexture(renderer_, SDL_PIXELFORMAT_RGBA8888,
+                        SDL_TEXTUREACCESS_TARGET, width, height);
+  if (!sdl_texture)
+    return nullptr;
+  SDL_SetTextureBlendMode(sdl_texture, SDL_BLENDMODE_BLEND);
+  return std::make_unique<Texture>(sdl_texture);
+}
+
+Graphics2D* BasicGraphics2D::SetRenderTarget(Texture* texture) {
+  SDL_SetRenderTarget(renderer_, texture ? texture->texture_ : nullptr);
+  render_target_ = texture;
+  return this;
+}
+
+Texture* BasicGraphics2D::GetRenderTarget() {
+  return render_target_;
+}
+
 }  // namespace engine2
\ No newline at end of file
@@ -48,6 +48,15 @@ class BasicGraphics2D : public Graphics2D {
   Graphics2D* DrawTexture(const Texture& texture,
                           const Rect<>& src,
                           const Rect<>& dest) override;
+  Graphics2D* DrawGeometry(const Texture& texture,
+                           const SDL_Vertex* vertices,
+                           int vertex_count,
+                           const int* indices,
+                           int index_count) override;
+
+  std::unique_ptr<Texture> CreateTargetTexture(int width, int height) override;
+  Graphics2D* SetRenderTarget(Texture* texture) override;
+  Texture* GetRenderTarget() override;
 
   Graphics2D* Clear() override;
   Graphics2D* Present() override;
@@ -60,6 +69,7 @@ class BasicGraphics2D : public Graphics2D {
  private:
   friend class Texture;
   SDL_Renderer* renderer_;
+  Texture* render_target_ = nullptr;
 };
 
 }  // namespace engine2
@@ -1,12 +1,19 @@
 #ifndef ENGINE2_IMPL_RECT_SEARCH_TREE_H_
 #define ENGINE2_IMPL_RECT_SEARCH_TREE_H_
 
+#include <algorithm>
 #include <cstdint>
-#include <list>
+#include <functional>
+#include <istream>
 #include <memory>
+#include <ostream>
+#include <queue>
+#include <utility>
 #include <vector>
 
+#include "engine2/base/binary_io.h"
 #include "engine2/base/list.h"
+#include "engine2/base/pool.h"
 #include "engine2/rect.h"
 
 namespace engine2 {
@@ -29,6 +36,7 @@ class RectSearchTree {
   using Rect = Rect<int64_t, N>;
   class NearIterator;
   struct NearIterable;
+  class Snapshot;
 
   // Iterators can only be invalidated by their target objects being moved
   // or removed from the tree.
@@ -47,11 +55,68 @@ class RectSearchTree {
     NearIterator end() { return NearIterator(); }
   };
 
-  // Create a new tree of depth |tree_depth| spanning |rect|.
+  // Runs many Near() lookups in a single traversal. For every object that
+  // Near(rects[i]) would visit, calls callback(i, rep). Each node is visited
+  // once for all of the lookups that reach it, carrying along only the lookups
+  // that touch or overlap it. The tree must not be modified from |callback|.
+  template <class Callback>
+  void NearMany(const std::vector<Rect>& rects, Callback callback);
+
+  // Returns up to |k| objects for which filter(rep) is true, nearest to |point|
+  // first. Distance is measured from |point| to the nearest point of each
+  // object's rect, with each dimension's offset multiplied by
+  // |dimension_weights| (a weight of 0 ignores that dimension). Subtrees are
+  // visited closest first and skipped once they can't hold anything closer
+  // than the k-th object found so far.
+  template <class Filter>
+  std::vector<Rep> Nearest(
+      const Point<int64_t, N>& point,
+      int k,
+      Filter filter,
+      const Point<double, N>& dimension_weights = Point<double, N>::Ones())
+      const;
+  std::vector<Rep> Nearest(const Point<int64_t, N>& point, int k) const {
+    return Nearest(point, k, [](const Rep&) { return true; });
+  }
+
+  // The deepest tree Write() and Read() handle, and the default limit for
+  // AutoTune(). A tree has 2^depth - 1 nodes, all allocated up front.
+  static constexpr int kMaxTreeDepth = 20;
+
+  // Create a new tree of depth |tree_depth| spanning |rect|. Each node is
+  // split in half across its longest dimension, after dividing each
+  // dimension's length by |breakdown_scale|. A larger scale makes a dimension
+  // split less often.
   static std::unique_ptr<RectSearchTree> Create(
       const Rect& rect,
       int tree_depth,
       const Point<double, N>& breakdown_scale = Point<double, N>::Ones());
+  ~RectSearchTree();
+
+  // Create a tree the same way as Create() and fill it with |objects| in one
+  // pass. Objects are partitioned down the tree in place rather than being
+  // inserted from the root one at a time, so this is much faster for loading
+  // static geometry. Each object ends up in the same node Insert() would have
+  // put it in.
+  static std::unique_ptr<RectSearchTree> BuildFrom(
+      const Rect& rect,
+      int tree_depth,
+      std::vector<std::pair<Rect, Rep>> objects,
+      const Point<double, N>& breakdown_scale = Point<double, N>::Ones());
+
+  // Serialize the tree and the placement of every object in it. |write_rep| is
+  // called as write_rep(std::ostream&, const Rep&) and returns false on error.
+  // Fails for trees deeper than kMaxTreeDepth, which Read() would reject.
+  template <class WriteRep>
+  bool Write(std::ostream& stream, WriteRep write_rep) const;
+
+  // Read a tree written by Write() without re-placing its objects.
+  // |read_rep| is called as read_rep(std::istream&, Rep*) and returns false on
+  // error. Returns null if the data is malformed, or if it describes a tree
+  // deeper than kMaxTreeDepth.
+  template <class ReadRep>
+  static std::unique_ptr<RectSearchTree> Read(std::istream& stream,
+                                              ReadRep read_rep);
 
   // Add an object to the search tree. Returns iterator to the subtree the
   // object was added to.
@@ -71,8 +136,85 @@ class RectSearchTree {
   // Finds the smallest subtree |rect| could belong to.
   RectSearchTree* Find(const Rect& rect);
 
+  // Returns the number of objects that overlap |rect|. Subtrees that |rect|
+  // fully covers are counted without visiting their objects, so this is
+  // O(log n) for most rects. (Empty objects in covered subtrees are counted
+  // even though they don't technically overlap anything.)
+  int Count(const Rect& rect) const;
+
+  // Same as Count(), but sums the weights of the objects instead.
+  double SumWeights(const Rect& rect) const;
+
+  // Sets the function used to weigh objects for SumWeights(). By default every
+  // object weighs 1. Objects are weighed when they are added, so if an
+  // object's weight changes it must be removed and added again. Must be called
+  // on the root.
+  void SetWeightFunction(std::function<double(const Rep&)> weight_function);
+
+  // Number of objects in this subtree.
+  int Size() const { return subtree_count_; }
+
+  struct Stats {
+    // Indexed by depth. The root is at depth 0.
+    std::vector<int> nodes_per_depth;
+    std::vector<int> objects_per_depth;
+    // Share of objects stored in nodes with children rather than in leaves.
+    // Objects end up in interior nodes when they straddle a split.
+    double interior_share = 0;
+    // Per lookup in the sample passed to GetStats(): the number of nodes a
+    // NearIterator visits and the number of objects it returns.
+    double average_nodes_visited = 0;
+    double average_candidates = 0;
+  };
+
+  // Collects stats about the tree's layout and how well it serves
+  // |sample_lookups|.
+  Stats GetStats(const std::vector<Rect>& sample_lookups = {}) const;
+
+  struct Parameters {
+    int tree_depth;
+    Point<double, N> breakdown_scale;
+  };
+
+  // Picks Create() parameters for a tree spanning |rect| that minimize the
+  // work NearIterator does for |sample_lookups| against |sample_objects|.
+  // Candidate trees are built from the samples, so keep them to a few thousand
+  // rects.
+  static Parameters AutoTune(const Rect& rect,
+                             const std::vector<Rect>& sample_objects,
+                             const std::vector<Rect>& sample_lookups,
+                             int max_tree_depth = kMaxTreeDepth);
+
+  // Copies the tree's objects into an immutable Snapshot, which can be read
+  // from other threads while this tree keeps changing.
+  Snapshot TakeSnapshot() const;
+
+  // Same as TakeSnapshot(), but stores convert(rep) for each object instead of
+  // the rep itself. Useful when reps aren't safe to use from other threads.
+  template <class Convert>
+  auto TakeSnapshot(Convert convert) const -> typename RectSearchTree<
+      N,
+      decltype(convert(std::declval<const Rep&>()))>::Snapshot;
+
   const Rect& GetRect() const { return rect_; }
 
+  class Iterator;
+
+ private:
+  // Entries are allocated from the root's pool and linked into the list of
+  // the node that holds them, so moving an object between nodes only relinks
+  // it.
+  struct Entry : public ListNode<Entry> {
+    Entry(const Rect& rect, Rep rep, double weight)
+        : rect(rect), rep(std::move(rep)), weight(weight) {}
+
+    Rect rect;
+    Rep rep;
+    // Cached so the same weight is subtracted when the object is removed.
+    double weight;
+  };
+
+ public:
   class Iterator {
    public:
     virtual bool ShouldIncludeSubtree(RectSearchTree* subtree) {
@@ -83,13 +225,17 @@ class RectSearchTree {
     Iterator() = default;
     Iterator(RectSearchTree* start_node);
 
-    RectSearchTree* Subtree() { return node_queue_.front(); }
+    RectSearchTree* Subtree() { return node_queue_[queue_head_]; }
 
-    Iterator InsertBefore(Rep obj);
+    // Adds an object to the current subtree without checking that |rect|
+    // belongs there.
+    Iterator InsertBefore(const Rect& rect, Rep obj);
     void Erase();
 
-    Rep& operator*() { return *list_iterator_; }
-    operator bool() const { return !node_queue_.empty(); }
+    Rep& operator*() { return list_iterator_->rep; }
+    // The rect the current object was added or last moved with.
+    const Rect& GetObjectRect() const { return list_iterator_->rect; }
+    operator bool() const { return queue_head_ < node_queue_.size(); }
     bool operator==(const Iterator& other) const;
     bool operator!=(const Iterator& other) const { return !(*this == other); }
     Iterator& operator++() {
@@ -98,21 +244,60 @@ class RectSearchTree {
     }
 
    protected:
+    friend class RectSearchTree;
+
     void Init(RectSearchTree* start_node) {
       if (ShouldIncludeSubtree(start_node)) {
         list_iterator_ = start_node->reps_.begin();
         node_queue_.push_back(start_node);
 
         // If start_node is empty, advance until a valid state is reached.
-        if (start_node->reps_.empty())
+        if (start_node->reps_.Empty())
           Advance();
       }
     }
 
     void Advance();
+    // Drops the current subtree from the front of the queue.
+    void PopSubtree();
+
+    // Subtrees left to visit, breadth first, from node_queue_[queue_head_].
+    // Visited ones are dropped in bulk so the storage gets reused.
+    std::vector<RectSearchTree*> node_queue_;
+    size_t queue_head_ = 0;
+    typename List<Entry>::Iterator list_iterator_;
+  };
+
+  // A read-only copy of a tree, stored in flat arrays. Snapshots never change
+  // after they're taken, so they are safe to query from any number of threads.
+  class Snapshot {
+   public:
+    Snapshot() = default;
 
-    std::list<RectSearchTree*> node_queue_;
-    typename std::list<Rep>::iterator list_iterator_;
+    // Calls callback(const Rect&, const Rep&) for each object that touches or
+    // overlaps |rect|. Unlike NearIterator, each object's rect is checked, so
+    // there are no false positives.
+    template <class Callback>
+    void Near(const Rect& rect, Callback callback) const;
+
+    int Size() const { return entries_.size(); }
+
+   private:
+    template <int, class>
+    friend class RectSearchTree;
+
+    struct Node {
+      Rect rect;
+      int child_a = -1;
+      int child_b = -1;
+      // The node's objects are entries_[entries_begin, entries_end).
+      int entries_begin = 0;
+      int entries_end = 0;
+    };
+
+    // Nodes in preorder. Subtrees with no objects are left out.
+    std::vector<Node> nodes_;
+    std::vector<std::pair<Rect, Rep>> entries_;
   };
 
   class NearIterator : public Iterator {
@@ -136,15 +321,94 @@ class RectSearchTree {
   };
 
  private:
-  RectSearchTree(Rect rect);
+  template <int, class>
+  friend class RectSearchTree;
+
+  // Bumped whenever Write()'s format or Create()'s node layout changes.
+  static constexpr uint32_t kSerializationVersion = 3;
+
+  RectSearchTree(Rect rect,
+                 int tree_depth,
+                 const Point<double, N>& breakdown_scale);
   RectSearchTree* FindInternal(const Rect& rect);
   RectSearchTree* FindOrNull(const Rect& rect);
-  NearIterator InsertLocal(Rep obj);
+  NearIterator InsertLocal(const Rect& rect, Rep obj);
+  // Links |entry| into this node.
+  NearIterator InsertEntry(Entry* entry);
+
+  RectSearchTree* GetRoot();
+  Pool<Entry>* GetEntryPool();
+  double GetWeight(const Rep& rep);
+
+  // Adds |count| and |weight| to the totals of this node and its ancestors.
+  void AddToSubtreeTotals(int count, double weight);
+  // Recomputes weights and totals for this node and its descendants.
+  void RecomputeSubtreeTotals();
+  // Number of objects in this node itself, from the cached subtree counts
+  // rather than by walking |reps_|.
+  int GetNodeCount() const;
+  // Adds the count and weight of the objects in this subtree that overlap
+  // |rect|.
+  void AccumulateOverlapping(const Rect& rect,
+                             int* count,
+                             double* weight) const;
+
+  // Visits this node and its descendants for NearMany(). |active| holds the
+  // indices of the lookups that reached the parent node in
+  // [active_begin, active->size()); this node appends the ones that reach it.
+  template <class Callback>
+  void NearManyInternal(const std::vector<Rect>& rects,
+                        std::vector<int>* active,
+                        size_t active_begin,
+                        Callback& callback);
+
+  // Places objects in [first, last) in this node or below. Objects that don't
+  // fit in a child stay here.
+  template <class It>
+  void Place(It first, It last);
+
+  // Appends this node and its non-empty subtrees to |snapshot| in preorder.
+  // Returns the index of this node.
+  template <class SnapshotType, class Convert>
+  int FillSnapshot(SnapshotType* snapshot, Convert& convert) const;
+
+  void CollectStats(int depth, Stats* stats) const;
+
+  // Returns the weighted squared distance from |point| to the nearest point of
+  // |rect|.
+  static double GetSquaredDistance(const Point<int64_t, N>& point,
+                                   const Rect& rect,
+                                   const Point<double, N>& dimension_weights);
+  // Adds the nodes and objects NearIterator would visit for |rect|.
+  void CountVisits(const Rect& rect, int* nodes, int* objects) const;
+
+  // Returns the per-lookup cost of |sample_lookups| in a tree built with
+  // |parameters|.
+  static double GetCost(const Rect& rect,
+                        const Parameters& parameters,
+                        const std::vector<std::pair<Rect, int>>& objects,
+                        const std::vector<Rect>& lookups);
+
+  // Appends |node| and its descendants to |nodes| in preorder. |Node| is
+  // either RectSearchTree or const RectSearchTree.
+  template <class Node>
+  static void CollectNodes(Node* node, std::vector<Node*>* nodes);
 
   Rect rect_;
+  // The arguments this subtree was created with.
+  int tree_depth_;
+  Point<double, N> breakdown_scale_;
+  RectSearchTree* parent_ = nullptr;
   std::unique_ptr<RectSearchTree> child_a_;
   std::unique_ptr<RectSearchTree> child_b_;
-  std::list<Rep> reps_;
+  List<Entry> reps_;
+
+  // Number of objects in this subtree, and the sum of their weights.
+  int subtree_count_ = 0;
+  double subtree_weight_ = 0;
+  // Only set on the root.
+  std::unique_ptr<std::function<double(const Rep&)>> weight_function_;
+  std::unique_ptr<Pool<Entry>> entry_pool_;
 };  // namespace engine2
 
 template <int N, class Rep>
@@ -170,26 +434,35 @@ RectSearchTree<N, Rep>::NearIterator::NearIterator(RectSearchTree* start_node,
 
 template <int N, class Rep>
 typename RectSearchTree<N, Rep>::Iterator
-RectSearchTree<N, Rep>::Iterator::InsertBefore(Rep obj) {
-  Iterator result(Subtree());
-  result.list_iterator_ = Subtree()->reps_.insert(list_iterator_, obj);
+RectSearchTree<N, Rep>::Iterator::InsertBefore(const Rect& rect, Rep obj) {
+  RectSearchTree* subtree = Subtree();
+  double weight = subtree->GetWeight(obj);
+  Iterator result(subtree);
+  result.list_iterator_ = subtree->reps_.InsertBefore(
+      list_iterator_, subtree->GetEntryPool()->New(rect, obj, weight));
+  subtree->AddToSubtreeTotals(1, weight);
   return result;
 }
 
 template <int N, class Rep>
 void RectSearchTree<N, Rep>::Iterator::Erase() {
-  Subtree()->reps_.erase(list_iterator_);
+  RectSearchTree* subtree = Subtree();
+  subtree->AddToSubtreeTotals(-1, -list_iterator_->weight);
+  Entry* entry = &*list_iterator_;
+  entry->UnlinkSelf();
+  subtree->GetEntryPool()->Delete(entry);
 }
 
 template <int N, class Rep>
 bool RectSearchTree<N, Rep>::Iterator::operator==(const Iterator& other) const {
-  if (node_queue_.empty() && other.node_queue_.empty())
+  if (!*this && !other)
     return true;
 
-  if (node_queue_.empty() != other.node_queue_.empty())
+  if (bool(*this) != bool(other))
     return false;
 
-  return (node_queue_.front() == other.node_queue_.front()) &&
+  return (node_queue_[queue_head_] ==
+          other.node_queue_[other.queue_head_]) &&
          (list_iterator_ == other.list_iterator_);
 }
 
@@ -202,9 +475,9 @@ void RectSearchTree<N, Rep>::Iterator::Advance() {
   bool in_same_node = true;
 
   // Keep going until we reach a non-empty node or we reach the end.
-  while (!node_queue_.empty()) {
+  while (*this) {
     // Stop if we're still inside current_node.
-    RectSearchTree* current_node = node_queue_.front();
+    RectSearchTree* current_node = node_queue_[queue_head_];
     if (in_same_node && (list_iterator_ != current_node->reps_.end()) &&
         (++list_iterator_ != current_node->reps_.end())) {
       return;
@@ -217,14 +490,14 @@ void RectSearchTree<N, Rep>::Iterator::Advance() {
       node_queue_.push_back(current_node->child_b_.get());
 
     // Try to get the next subtree and point list_iterator_ at its beginning.
-    node_queue_.pop_front();
+    PopSubtree();
     in_same_node = false;
 
-    if (node_queue_.empty())
+    if (!*this)
       return;
 
-    if (!node_queue_.front()->reps_.empty()) {
-      list_iterator_ = node_queue_.front()->reps_.begin();
+    if (!node_queue_[queue_head_]->reps_.Empty()) {
+      list_iterator_ = node_queue_[queue_head_]->reps_.begin();
       return;
     }
 
@@ -232,6 +505,18 @@ void RectSearchTree<N, Rep>::Iterator::Advance() {
   }
 }
 
+template <int N, class Rep>
+void RectSearchTree<N, Rep>::Iterator::PopSubtree() {
+  ++queue_head_;
+  if (queue_head_ == node_queue_.size()) {
+    node_queue_.clear();
+    queue_head_ = 0;
+  } else if (queue_head_ >= 16 && queue_head_ * 2 >= node_queue_.size()) {
+    node_queue_.erase(node_queue_.begin(), node_queue_.begin() + queue_head_);
+    queue_head_ = 0;
+  }
+}
+
 // static
 template <int N, class Rep>
 std::unique_ptr<RectSearchTree<N, Rep>> RectSearchTree<N, Rep>::Create(
@@ -241,20 +526,21 @@ std::unique_ptr<RectSearchTree<N, Rep>> RectSearchTree<N, Rep>::Create(
   if (tree_depth == 0)
     return nullptr;
 
-  auto tree =
-      std::unique_ptr<RectSearchTree<N, Rep>>(new RectSearchTree<N, Rep>(rect));
+  auto tree = std::unique_ptr<RectSearchTree<N, Rep>>(
+      new RectSearchTree<N, Rep>(rect, tree_depth, breakdown_scale));
 
-  // Find index and length of longest dimension of rect
+  // Find index of longest dimension of rect, after scaling
   int longest_dimension = 0;
-  int64_t longest_dimension_length = 0;
+  double longest_scaled_length = 0;
   for (int i = 0; i < N; ++i) {
-    int64_t length = rect.size[i] / breakdown_scale[i];
-    if (length > longest_dimension_length) {
+    double length = rect.size[i] / breakdown_scale[i];
+    if (length > longest_scaled_length) {
       longest_dimension = i;
-      longest_dimension_length = length;
+      longest_scaled_length = length;
     }
   }
 
+  int64_t longest_dimension_length = rect.size[longest_dimension];
   int64_t half_longest_length = longest_dimension_length / 2;
 
   // Rect is divided in half across its longest dimension
@@ -273,9 +559,223 @@ std::unique_ptr<RectSearchTree<N, Rep>> RectSearchTree<N, Rep>::Create(
 
   // Recursively create child trees
   --tree_depth;
-  tree->child_a_ = Create(child_rect_1, tree_depth),
-  tree->child_b_ = Create(child_rect_2, tree_depth);
+  tree->child_a_ = Create(child_rect_1, tree_depth, breakdown_scale),
+  tree->child_b_ = Create(child_rect_2, tree_depth, breakdown_scale);
+  if (tree->child_a_)
+    tree->child_a_->parent_ = tree.get();
+  if (tree->child_b_)
+    tree->child_b_->parent_ = tree.get();
+
+  return tree;
+}
+
+template <int N, class Rep>
+template <class Callback>
+void RectSearchTree<N, Rep>::NearMany(const std::vector<Rect>& rects,
+                                      Callback callback) {
+  std::vector<int> active;
+  active.reserve(rects.size() * 2);
+  for (int i = 0; i < rects.size(); ++i)
+    active.push_back(i);
+  // Every lookup starts out active, and the root filters them like any other
+  // node.
+  NearManyInternal(rects, &active, 0, callback);
+}
+
+template <int N, class Rep>
+template <class Callback>
+void RectSearchTree<N, Rep>::NearManyInternal(const std::vector<Rect>& rects,
+                                              std::vector<int>* active,
+                                              size_t active_begin,
+                                              Callback& callback) {
+  // |active| is used as a stack: each level appends the lookups that reach it
+  // and pops them before returning.
+  size_t parent_end = active->size();
+  for (size_t i = active_begin; i < parent_end; ++i) {
+    const Rect& rect = rects[(*active)[i]];
+    if (rect.Overlaps(rect_) || rect.Touches(rect_))
+      active->push_back((*active)[i]);
+  }
+  if (active->size() == parent_end)
+    return;
+
+  for (Entry& entry : reps_) {
+    for (size_t i = parent_end; i < active->size(); ++i)
+      callback((*active)[i], entry.rep);
+  }
+
+  if (child_a_)
+    child_a_->NearManyInternal(rects, active, parent_end, callback);
+  if (child_b_)
+    child_b_->NearManyInternal(rects, active, parent_end, callback);
+  active->resize(parent_end);
+}
+
+// static
+template <int N, class Rep>
+std::unique_ptr<RectSearchTree<N, Rep>> RectSearchTree<N, Rep>::BuildFrom(
+    const Rect& rect,
+    int tree_depth,
+    std::vector<std::pair<Rect, Rep>> objects,
+    const Point<double, N>& breakdown_scale) {
+  auto tree = Create(rect, tree_depth, breakdown_scale);
+  if (tree) {
+    tree->Place(objects.begin(), objects.end());
+    tree->RecomputeSubtreeTotals();
+  }
+  return tree;
+}
 
+template <int N, class Rep>
+template <class It>
+void RectSearchTree<N, Rep>::Place(It first, It last) {
+  if (child_a_ && child_b_) {
+    // Same padding as FindOrNull().
+    auto fits_in = [](RectSearchTree* child) {
+      return [child](const std::pair<Rect, Rep>& object) {
+        Rect rect = object.first;
+        for (int i = 0; i < N; ++i)
+          ++rect.size[i];
+        return child->rect_.Contains(rect);
+      };
+    };
+
+    // child_a_ is preferred when an object fits in both, like FindInternal().
+    It a_last = std::partition(first, last, fits_in(child_a_.get()));
+    It b_last = std::partition(a_last, last, fits_in(child_b_.get()));
+    child_a_->Place(first, a_last);
+    child_b_->Place(a_last, b_last);
+    first = b_last;
+  }
+
+  Pool<Entry>* pool = GetEntryPool();
+  for (; first != last; ++first)
+    reps_.AddToHead(pool->New(first->first, first->second, 0));
+}
+
+// static
+template <int N, class Rep>
+template <class Node>
+void RectSearchTree<N, Rep>::CollectNodes(Node* node,
+                                          std::vector<Node*>* nodes) {
+  nodes->push_back(node);
+  if (node->child_a_)
+    CollectNodes<Node>(node->child_a_.get(), nodes);
+  if (node->child_b_)
+    CollectNodes<Node>(node->child_b_.get(), nodes);
+}
+
+// Format (little-endian):
+//  u32 version, u32 N, i64[N] pos, i64[N] size, u32 depth, f64[N] scale,
+//  u32 non-empty node count, then for each non-empty node in preorder:
+//    u32 node index, u32 object count, then for each object:
+//      i64[N] pos, i64[N] size, rep written by |write_rep|.
+template <int N, class Rep>
+template <class WriteRep>
+bool RectSearchTree<N, Rep>::Write(std::ostream& stream,
+                                   WriteRep write_rep) const {
+  if (tree_depth_ > kMaxTreeDepth ||
+      !WriteInt32(stream, kSerializationVersion) || !WriteInt32(stream, N) ||
+      !WriteVecInt64(stream, rect_.pos) || !WriteVecInt64(stream, rect_.size) ||
+      !WriteInt32(stream, tree_depth_)) {
+    return false;
+  }
+  for (int i = 0; i < N; ++i) {
+    if (!WriteDouble(stream, breakdown_scale_[i]))
+      return false;
+  }
+
+  std::vector<const RectSearchTree*> nodes;
+  CollectNodes(this, &nodes);
+
+  uint32_t non_empty_count = 0;
+  for (const RectSearchTree* node : nodes)
+    non_empty_count += !node->reps_.Empty();
+  if (!WriteInt32(stream, non_empty_count))
+    return false;
+
+  for (uint32_t i = 0; i < nodes.size(); ++i) {
+    const List<Entry>& reps = nodes[i]->reps_;
+    if (reps.Empty())
+      continue;
+
+    if (!WriteInt32(stream, i) || !WriteInt32(stream, nodes[i]->GetNodeCount()))
+      return false;
+    for (const Entry& entry : reps) {
+      if (!WriteVecInt64(stream, entry.rect.pos) ||
+          !WriteVecInt64(stream, entry.rect.size) ||
+          !write_rep(stream, entry.rep)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// static
+template <int N, class Rep>
+template <class ReadRep>
+std::unique_ptr<RectSearchTree<N, Rep>> RectSearchTree<N, Rep>::Read(
+    std::istream& stream,
+    ReadRep read_rep) {
+  uint32_t version, dimensions, tree_depth;
+  Rect rect;
+  if (!ReadInt32(stream, version) || version != kSerializationVersion ||
+      !ReadInt32(stream, dimensions) || dimensions != N ||
+      !ReadVecInt64(stream, rect.pos) || !ReadVecInt64(stream, rect.size) ||
+      !ReadInt32(stream, tree_depth) || tree_depth > kMaxTreeDepth) {
+    return nullptr;
+  }
+  Point<double, N> breakdown_scale;
+  for (int i = 0; i < N; ++i) {
+    if (!ReadDouble(stream, breakdown_scale[i]))
+      return nullptr;
+  }
+
+  // Check the node count against the tree and the stream before allocating
+  // the tree, so corrupt data can't make us build a huge one. Each node
+  // record takes at least 8 bytes.
+  uint32_t non_empty_count;
+  if (!ReadInt32(stream, non_empty_count) ||
+      non_empty_count >= (uint32_t(1) << tree_depth)) {
+    return nullptr;
+  }
+  std::streampos nodes_start = stream.tellg();
+  if (nodes_start != std::streampos(-1)) {
+    stream.seekg(0, std::ios::end);
+    std::streamoff remaining = stream.tellg() - nodes_start;
+    stream.seekg(nodes_start);
+    if (!stream.good() || remaining < std::streamoff(non_empty_count) * 8)
+      return nullptr;
+  }
+
+  auto tree = Create(rect, tree_depth, breakdown_scale);
+  if (!tree)
+    return nullptr;
+
+  std::vector<RectSearchTree*> nodes;
+  CollectNodes(tree.get(), &nodes);
+
+  for (uint32_t i = 0; i < non_empty_count; ++i) {
+    uint32_t node_index, rep_count;
+    if (!ReadInt32(stream, node_index) || node_index >= nodes.size() ||
+        !ReadInt32(stream, rep_count)) {
+      return nullptr;
+    }
+
+    List<Entry>& reps = nodes[node_index]->reps_;
+    for (uint32_t j = 0; j < rep_count; ++j) {
+      // Linked before it's filled in so the tree frees it on failure.
+      Entry* entry = tree->GetEntryPool()->New(Rect{}, Rep{}, 0);
+      reps.AddToTail(entry);
+      if (!ReadVecInt64(stream, entry->rect.pos) ||
+          !ReadVecInt64(stream, entry->rect.size) ||
+          !read_rep(stream, &entry->rep)) {
+        return nullptr;
+      }
+    }
+  }
+  tree->RecomputeSubtreeTotals();
   return tree;
 }
 
@@ -283,13 +783,20 @@ template <int N, class Rep>
 typename RectSearchTree<N, Rep>::NearIterator RectSearchTree<N, Rep>::Insert(
     const Rect& rect,
     Rep obj) {
-  return Find(rect)->InsertLocal(obj);
+  return Find(rect)->InsertLocal(rect, obj);
 }
 
 template <int N, class Rep>
 typename RectSearchTree<N, Rep>::NearIterator
-RectSearchTree<N, Rep>::InsertLocal(Rep obj) {
-  reps_.push_front(obj);
+RectSearchTree<N, Rep>::InsertLocal(const Rect& rect, Rep obj) {
+  return InsertEntry(GetEntryPool()->New(rect, obj, GetWeight(obj)));
+}
+
+template <int N, class Rep>
+typename RectSearchTree<N, Rep>::NearIterator
+RectSearchTree<N, Rep>::InsertEntry(Entry* entry) {
+  AddToSubtreeTotals(1, entry->weight);
+  reps_.AddToHead(entry);
   return NearIterator{this, rect_};
 }
 
@@ -312,18 +819,21 @@ typename RectSearchTree<N, Rep>::NearIterator RectSearchTree<N, Rep>::Move(
     Rect dest) {
   // First try searching below the current node.
   RectSearchTree* subtree = iterator.Subtree()->FindOrNull(dest);
-  if (subtree == iterator.Subtree())
+  if (subtree == iterator.Subtree()) {
+    iterator.list_iterator_->rect = dest;
     return iterator;
-
-  NearIterator new_iterator;
-  if (subtree) {
-    new_iterator = subtree->InsertLocal(*iterator);
-  } else {
-    // If object isn't at or below its current node, search from the top.
-    new_iterator = Insert(dest, *iterator);
   }
-  iterator.Erase();
-  return new_iterator;
+
+  // If object isn't at or below its current node, search from the top.
+  if (!subtree)
+    subtree = Find(dest);
+
+  // Relink the entry, keeping the object's original weight.
+  Entry* entry = &*iterator.list_iterator_;
+  entry->rect = dest;
+  iterator.Subtree()->AddToSubtreeTotals(-1, -entry->weight);
+  entry->UnlinkSelf();
+  return subtree->InsertEntry(entry);
 }
 
 template <int N, class Rep>
@@ -364,7 +874,430 @@ RectSearchTree<N, Rep>* RectSearchTree<N, Rep>::FindInternal(const Rect& rect) {
 }
 
 template <int N, class Rep>
-RectSearchTree<N, Rep>::RectSearchTree(Rect rect) : rect_(rect) {}
+typename RectSearchTree<N, Rep>::Snapshot RectSearchTree<N, Rep>::TakeSnapshot()
+    const {
+  return TakeSnapshot([](const Rep& rep) { return rep; });
+}
+
+template <int N, class Rep>
+template <class Convert>
+auto RectSearchTree<N, Rep>::TakeSnapshot(Convert convert) const
+    -> typename RectSearchTree<
+        N,
+        decltype(convert(std::declval<const Rep&>()))>::Snapshot {
+  typename RectSearchTree<N, decltype(convert(std::declval<const Rep&>()))>::
+      Snapshot snapshot;
+  snapshot.entries_.reserve(subtree_count_);
+  FillSnapshot(&snapshot, convert);
+  return snapshot;
+}
+
+template <int N, class Rep>
+template <class SnapshotType, class Convert>
+int RectSearchTree<N, Rep>::FillSnapshot(SnapshotType* snapshot,
+                                         Convert& convert) const {
+  int index = snapshot->nodes_.size();
+  snapshot->nodes_.emplace_back();
+  snapshot->nodes_[index].rect = rect_;
+  snapshot->nodes_[index].entries_begin = snapshot->entries_.size();
+  for (const Entry& entry : reps_)
+    snapshot->entries_.emplace_back(entry.rect, convert(entry.rep));
+  snapshot->nodes_[index].entries_end = snapshot->entries_.size();
+
+  // Recursion reallocates nodes_, so don't hold a reference across it.
+  if (child_a_ && child_a_->subtree_count_ > 0) {
+    int child_a = child_a_->FillSnapshot(snapshot, convert);
+    snapshot->nodes_[index].child_a = child_a;
+  }
+  if (child_b_ && child_b_->subtree_count_ > 0) {
+    int child_b = child_b_->FillSnapshot(snapshot, convert);
+    snapshot->nodes_[index].child_b = child_b;
+  }
+  return index;
+}
+
+template <int N, class Rep>
+template <class Callback>
+void RectSearchTree<N, Rep>::Snapshot::Near(const Rect& rect,
+                                            Callback callback) const {
+  if (nodes_.empty())
+    return;
+
+  // The root is always visited since it may hold objects outside of its rect.
+  std::vector<int> stack = {0};
+  while (!stack.empty()) {
+    const Node& node = nodes_[stack.back()];
+    stack.pop_back();
+
+    for (int i = node.entries_begin; i < node.entries_end; ++i) {
+      const std::pair<Rect, Rep>& entry = entries_[i];
+      if (rect.Overlaps(entry.first) || rect.Touches(entry.first))
+        callback(entry.first, entry.second);
+    }
+
+    for (int child : {node.child_a, node.child_b}) {
+      if (child < 0)
+        continue;
+      const Rect& child_rect = nodes_[child].rect;
+      if (rect.Overlaps(child_rect) || rect.Touches(child_rect))
+        stack.push_back(child);
+    }
+  }
+}
+
+template <int N, class Rep>
+template <class Filter>
+std::vector<Rep> RectSearchTree<N, Rep>::Nearest(
+    const Point<int64_t, N>& point,
+    int k,
+    Filter filter,
+    const Point<double, N>& dimension_weights) const {
+  if (k <= 0)
+    return {};
+
+  // Nodes to visit, closest first.
+  using QueuedNode = std::pair<double, const RectSearchTree*>;
+  std::priority_queue<QueuedNode, std::vector<QueuedNode>,
+                      std::greater<QueuedNode>>
+      nodes;
+  // The best objects so far, farthest first.
+  using Found = std::pair<double, const Entry*>;
+  auto closer = [](const Found& a, const Found& b) {
+    return a.first < b.first;
+  };
+  std::priority_queue<Found, std::vector<Found>, decltype(closer)> found(
+      closer);
+
+  // The root may hold objects outside of its rect, so it can't be ranked by
+  // its rect.
+  nodes.push({0, this});
+  while (!nodes.empty()) {
+    auto [node_distance, node] = nodes.top();
+    nodes.pop();
+    if (found.size() == k && node_distance >= found.top().first)
+      break;
+
+    for (const Entry& entry : node->reps_) {
+      double distance =
+          GetSquaredDistance(point, entry.rect, dimension_weights);
+      if (found.size() == k && distance >= found.top().first)
+        continue;
+      if (!filter(entry.rep))
+        continue;
+
+      found.push({distance, &entry});
+      if (found.size() > k)
+        found.pop();
+    }
+
+    for (const RectSearchTree* child :
+         {node->child_a_.get(), node->child_b_.get()}) {
+      if (!child || child->subtree_count_ == 0)
+        continue;
+
+      double distance =
+          GetSquaredDistance(point, child->rect_, dimension_weights);
+      if (found.size() < k || distance < found.top().first)
+        nodes.push({distance, child});
+    }
+  }
+
+  std::vector<Rep> result(found.size());
+  for (int i = found.size() - 1; i >= 0; --i) {
+    result[i] = found.top().second->rep;
+    found.pop();
+  }
+  return result;
+}
+
+// static
+template <int N, class Rep>
+double RectSearchTree<N, Rep>::GetSquaredDistance(
+    const Point<int64_t, N>& point,
+    const Rect& rect,
+    const Point<double, N>& dimension_weights) {
+  double distance = 0;
+  for (int i = 0; i < N; ++i) {
+    int64_t offset = 0;
+    if (point[i] < rect.pos[i])
+      offset = rect.pos[i] - point[i];
+    else if (point[i] > rect.pos[i] + rect.size[i])
+      offset = point[i] - (rect.pos[i] + rect.size[i]);
+
+    double weighted = offset * dimension_weights[i];
+    distance += weighted * weighted;
+  }
+  return distance;
+}
+
+template <int N, class Rep>
+typename RectSearchTree<N, Rep>::Stats RectSearchTree<N, Rep>::GetStats(
+    const std::vector<Rect>& sample_lookups) const {
+  Stats stats;
+  CollectStats(0, &stats);
+
+  int interior_count = 0;
+  for (int depth = 0; depth + 1 < stats.objects_per_depth.size(); ++depth)
+    interior_count += stats.objects_per_depth[depth];
+  if (subtree_count_ > 0)
+    stats.interior_share = double(interior_count) / subtree_count_;
+
+  if (!sample_lookups.empty()) {
+    int nodes = 0;
+    int objects = 0;
+    for (const Rect& rect : sample_lookups)
+      CountVisits(rect, &nodes, &objects);
+    stats.average_nodes_visited = double(nodes) / sample_lookups.size();
+    stats.average_candidates = double(objects) / sample_lookups.size();
+  }
+  return stats;
+}
+
+template <int N, class Rep>
+void RectSearchTree<N, Rep>::CollectStats(int depth, Stats* stats) const {
+  if (stats->nodes_per_depth.size() <= depth) {
+    stats->nodes_per_depth.resize(depth + 1);
+    stats->objects_per_depth.resize(depth + 1);
+  }
+  ++stats->nodes_per_depth[depth];
+  stats->objects_per_depth[depth] += GetNodeCount();
+
+  if (child_a_)
+    child_a_->CollectStats(depth + 1, stats);
+  if (child_b_)
+    child_b_->CollectStats(depth + 1, stats);
+}
+
+template <int N, class Rep>
+void RectSearchTree<N, Rep>::CountVisits(const Rect& rect,
+                                         int* nodes,
+                                         int* objects) const {
+  // Same test as NearIterator::ShouldIncludeSubtree().
+  if (!rect.Overlaps(rect_) && !rect.Touches(rect_))
+    return;
+
+  ++*nodes;
+  *objects += GetNodeCount();
+  if (child_a_)
+    child_a_->CountVisits(rect, nodes, objects);
+  if (child_b_)
+    child_b_->CountVisits(rect, nodes, objects);
+}
+
+// static
+template <int N, class Rep>
+typename RectSearchTree<N, Rep>::Parameters RectSearchTree<N, Rep>::AutoTune(
+    const Rect& rect,
+    const std::vector<Rect>& sample_objects,
+    const std::vector<Rect>& sample_lookups,
+    int max_tree_depth) {
+  std::vector<std::pair<Rect, int>> objects;
+  objects.reserve(sample_objects.size());
+  for (const Rect& object : sample_objects)
+    objects.push_back({object.GetOverlap(rect), 0});
+
+  Parameters best{1, Point<double, N>::Ones()};
+  double best_cost = GetCost(rect, best, objects, sample_lookups);
+  auto try_parameters = [&](const Parameters& parameters) {
+    double cost = GetCost(rect, parameters, objects, sample_lookups);
+    if (cost >= best_cost)
+      return false;
+    best = parameters;
+    best_cost = cost;
+    return true;
+  };
+
+  // Deepen the tree until it stops helping. The cost usually falls steadily
+  // and then rises, but allow one plateau before giving up.
+  int misses = 0;
+  for (int depth = 2; depth <= max_tree_depth && misses < 2; ++depth) {
+    if (try_parameters({depth, best.breakdown_scale}))
+      misses = 0;
+    else
+      ++misses;
+  }
+
+  // Then adjust the scale one dimension at a time, re-checking the depths
+  // nearby since the best depth shifts with the scale.
+  for (int round = 0; round < 3; ++round) {
+    bool improved = false;
+    for (int i = 0; i < N; ++i) {
+      for (double factor : {0.25, 0.5, 2.0, 4.0}) {
+        Parameters parameters = best;
+        parameters.breakdown_scale[i] *= factor;
+        for (int depth_change : {-1, 0, 1}) {
+          parameters.tree_depth = best.tree_depth + depth_change;
+          if (parameters.tree_depth >= 1 &&
+              parameters.tree_depth <= max_tree_depth) {
+            improved |= try_parameters(parameters);
+          }
+        }
+      }
+    }
+    if (!improved)
+      break;
+  }
+  return best;
+}
+
+// static
+template <int N, class Rep>
+double RectSearchTree<N, Rep>::GetCost(
+    const Rect& rect,
+    const Parameters& parameters,
+    const std::vector<std::pair<Rect, int>>& objects,
+    const std::vector<Rect>& lookups) {
+  auto tree = RectSearchTree<N, int>::BuildFrom(
+      rect, parameters.tree_depth, objects, parameters.breakdown_scale);
+
+  int nodes = 0;
+  int candidates = 0;
+  for (const Rect& lookup : lookups)
+    tree->CountVisits(lookup, &nodes, &candidates);
+
+  // Visiting a node is cheap compared to the caller testing a candidate.
+  return (nodes + 2.0 * candidates) / std::max<size_t>(lookups.size(), 1);
+}
+
+template <int N, class Rep>
+int RectSearchTree<N, Rep>::Count(const Rect& rect) const {
+  int count = 0;
+  double weight = 0;
+  AccumulateOverlapping(rect, &count, &weight);
+  return count;
+}
+
+template <int N, class Rep>
+double RectSearchTree<N, Rep>::SumWeights(const Rect& rect) const {
+  int count = 0;
+  double weight = 0;
+  AccumulateOverlapping(rect, &count, &weight);
+  return weight;
+}
+
+template <int N, class Rep>
+void RectSearchTree<N, Rep>::SetWeightFunction(
+    std::function<double(const Rep&)> weight_function) {
+  weight_function_ = std::make_unique<std::function<double(const Rep&)>>(
+      std::move(weight_function));
+  RecomputeSubtreeTotals();
+}
+
+template <int N, class Rep>
+RectSearchTree<N, Rep>* RectSearchTree<N, Rep>::GetRoot() {
+  RectSearchTree* root = this;
+  while (root->parent_)
+    root = root->parent_;
+  return root;
+}
+
+template <int N, class Rep>
+Pool<typename RectSearchTree<N, Rep>::Entry>*
+RectSearchTree<N, Rep>::GetEntryPool() {
+  RectSearchTree* root = GetRoot();
+  if (!root->entry_pool_)
+    root->entry_pool_ = std::make_unique<Pool<Entry>>();
+  return root->entry_pool_.get();
+}
+
+template <int N, class Rep>
+double RectSearchTree<N, Rep>::GetWeight(const Rep& rep) {
+  RectSearchTree* root = GetRoot();
+  if (!root->weight_function_)
+    return 1;
+  return (*root->weight_function_)(rep);
+}
+
+template <int N, class Rep>
+void RectSearchTree<N, Rep>::AddToSubtreeTotals(int count, double weight) {
+  for (RectSearchTree* node = this; node; node = node->parent_) {
+    node->subtree_count_ += count;
+    node->subtree_weight_ += weight;
+  }
+}
+
+template <int N, class Rep>
+void RectSearchTree<N, Rep>::RecomputeSubtreeTotals() {
+  subtree_count_ = 0;
+  subtree_weight_ = 0;
+  for (Entry& entry : reps_) {
+    ++subtree_count_;
+    entry.weight = GetWeight(entry.rep);
+    subtree_weight_ += entry.weight;
+  }
+
+  for (RectSearchTree* child : {child_a_.get(), child_b_.get()}) {
+    if (!child)
+      continue;
+    child->RecomputeSubtreeTotals();
+    subtree_count_ += child->subtree_count_;
+    subtree_weight_ += child->subtree_weight_;
+  }
+}
+
+template <int N, class Rep>
+int RectSearchTree<N, Rep>::GetNodeCount() const {
+  int count = subtree_count_;
+  for (const RectSearchTree* child : {child_a_.get(), child_b_.get()}) {
+    if (child)
+      count -= child->subtree_count_;
+  }
+  return count;
+}
+
+template <int N, class Rep>
+void RectSearchTree<N, Rep>::AccumulateOverlapping(const Rect& rect,
+                                                   int* count,
+                                                   double* weight) const {
+  // The root also holds objects that don't fit inside it, so it's never
+  // skipped or counted wholesale.
+  if (parent_) {
+    if (!rect.Overlaps(rect_))
+      return;
+
+    // Objects are always stored in a node that contains them.
+    if (rect.Contains(rect_)) {
+      *count += subtree_count_;
+      *weight += subtree_weight_;
+      return;
+    }
+  }
+
+  for (const Entry& entry : reps_) {
+    if (rect.Overlaps(entry.rect)) {
+      ++*count;
+      *weight += entry.weight;
+    }
+  }
+
+  if (child_a_)
+    child_a_->AccumulateOverlapping(rect, count, weight);
+  if (child_b_)
+    child_b_->AccumulateOverlapping(rect, count, weight);
+}
+
+template <int N, class Rep>
+RectSearchTree<N, Rep>::RectSearchTree(Rect rect,
+                                       int tree_depth,
+                                       const Point<double, N>& breakdown_scale)
+    : rect_(rect), tree_depth_(tree_depth), breakdown_scale_(breakdown_scale) {}
+
+template <int N, class Rep>
+RectSearchTree<N, Rep>::~RectSearchTree() {
+  // Only the root owns a pool. Return every entry in the tree to it before it
+  // goes away.
+  if (!entry_pool_)
+    return;
+
+  std::vector<RectSearchTree*> nodes;
+  CollectNodes(this, &nodes);
+  for (RectSearchTree* node : nodes) {
+    while (Entry* entry = node->reps_.Head()) {
+      entry->UnlinkSelf();
+      entry_pool_->Delete(entry);
+    }
+  }
+}
 
 }  // namespace engine2
 
@@ -3,7 +3,15 @@
 #include "engine2/rect_object.h"
 #include "engine2/test/assert_macros.h"
 
+#include <algorithm>
+#include <map>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
 namespace engine2 {
 namespace test {
@@ -43,6 +51,43 @@ void RunCallbacksOn(RectSearchTree<N, SomeObject<N>*>* tree,
   }
 }
 
+using Tree = RectSearchTree<2, int>;
+using RectSearchTree3D = RectSearchTree<3, int>;
+
+// Maps each object in |tree| to the rect of the node it's stored in.
+std::map<int, std::string> GetPlacement(Tree* tree) {
+  std::map<int, std::string> placement;
+  for (auto iter = tree->begin(); iter != tree->end(); ++iter)
+    placement[*iter] = RectToString(iter.Subtree()->GetRect());
+  return placement;
+}
+
+std::vector<std::pair<Rect<>, int>> MakeRandomObjects(int count) {
+  std::mt19937 random(99);
+  std::uniform_int_distribution<int64_t> position(-10, 100);
+  std::uniform_int_distribution<int64_t> size(1, 30);
+
+  std::vector<std::pair<Rect<>, int>> objects;
+  for (int i = 0; i < count; ++i) {
+    objects.push_back(
+        {{position(random), position(random), size(random), size(random)}, i});
+  }
+  return objects;
+}
+
+// Weighted squared distance from |point| to the nearest point of |rect|.
+double SquaredDistance(const Point<>& point,
+                       const Rect<>& rect,
+                       const Point<double, 2>& weights = {1, 1}) {
+  double distance = 0;
+  for (int i = 0; i < 2; ++i) {
+    int64_t offset = std::max<int64_t>(
+        {0, rect.pos[i] - point[i], point[i] - rect.pos[i] - rect.size[i]});
+    distance += offset * weights[i] * offset * weights[i];
+  }
+  return distance;
+}
+
 }  // namespace
 
 #define ASSERT_RECT_EQ(a, b) ASSERT_EQ(RectToString(a), RectToString(b))
@@ -261,6 +306,293 @@ void RectSearchTreeTest::TestMove() {
   EXPECT_EQ(1, found.count(1));
 }
 
+void RectSearchTreeTest::TestBuildFrom() {
+  std::vector<std::pair<Rect<>, int>> objects = MakeRandomObjects(200);
+
+  auto inserted = Tree::Create({0, 0, 100, 100}, 5);
+  for (const auto& object : objects)
+    inserted->Insert(object.first, object.second);
+
+  auto built = Tree::BuildFrom({0, 0, 100, 100}, 5, objects);
+  ASSERT_NOT_NULL(built.get());
+
+  std::map<int, std::string> placement = GetPlacement(built.get());
+  EXPECT_EQ(200, placement.size());
+  EXPECT_TRUE(GetPlacement(inserted.get()) == placement);
+
+  EXPECT_NULL(Tree::BuildFrom({0, 0, 1, 1}, 0, {}).get());
+}
+
+void RectSearchTreeTest::TestWriteRead() {
+  auto tree = Tree::BuildFrom({0, 0, 100, 100}, 5, MakeRandomObjects(100));
+  auto write_rep = [](std::ostream& stream, int rep) {
+    return WriteInt32(stream, rep);
+  };
+  auto read_rep = [](std::istream& stream, int* rep) {
+    uint32_t val;
+    if (!ReadInt32(stream, val))
+      return false;
+    *rep = val;
+    return true;
+  };
+
+  std::stringstream stream;
+  ASSERT_TRUE(tree->Write(stream, write_rep));
+
+  auto read = Tree::Read(stream, read_rep);
+  ASSERT_NOT_NULL(read.get());
+  EXPECT_EQ(RectToString(tree->GetRect()), RectToString(read->GetRect()));
+  EXPECT_TRUE(GetPlacement(tree.get()) == GetPlacement(read.get()));
+
+  // Truncated data is rejected.
+  std::string data = stream.str();
+  std::istringstream truncated(data.substr(0, data.size() - 2));
+  EXPECT_NULL(Tree::Read(truncated, read_rep).get());
+
+  // So is data for a tree of a different dimension.
+  std::istringstream wrong_dimension(data);
+  EXPECT_NULL(RectSearchTree3D::Read(wrong_dimension, read_rep).get());
+
+  // And data for a tree too deep to allocate, or with more nodes than the
+  // tree or the stream holds. The depth follows the version, N, pos and size,
+  // and the node count follows the depth and scale.
+  const size_t depth_offset = 4 + 4 + 2 * 2 * sizeof(int64_t);
+  const size_t count_offset = depth_offset + 4 + 2 * sizeof(double);
+  struct Corruption {
+    size_t offset;
+    uint32_t value;
+    size_t size;
+  };
+  for (const Corruption& corruption :
+       {Corruption{depth_offset, 0xffffffff, data.size()},
+        Corruption{depth_offset, Tree::kMaxTreeDepth + 1, data.size()},
+        Corruption{count_offset, 32, data.size()},
+        Corruption{count_offset, 31, count_offset + 4}}) {
+    std::string corrupt = data.substr(0, corruption.size);
+    for (int i = 0; i < 4; ++i)
+      corrupt[corruption.offset + i] = char(corruption.value >> (8 * i));
+    std::istringstream corrupt_stream(corrupt);
+    auto corrupt_read = Tree::Read(corrupt_stream, read_rep);
+    EXPECT_NULL(corrupt_read.get());
+  }
+}
+
+void RectSearchTreeTest::TestNearMany() {
+  auto tree = Tree::BuildFrom({0, 0, 100, 100}, 5, MakeRandomObjects(200));
+
+  std::vector<Rect<>> rects;
+  for (const auto& object : MakeRandomObjects(40))
+    rects.push_back(object.first);
+
+  std::vector<std::multiset<int>> found(rects.size());
+  tree->NearMany(rects, [&](int i, int rep) { found[i].insert(rep); });
+
+  for (int i = 0; i < rects.size(); ++i) {
+    std::multiset<int> expected;
+    for (int rep : tree->Near(rects[i]))
+      expected.insert(rep);
+    EXPECT_TRUE(expected == found[i]);
+  }
+
+  // No lookups means no callbacks.
+  int calls = 0;
+  tree->NearMany({}, [&](int, int) { ++calls; });
+  EXPECT_EQ(0, calls);
+}
+
+void RectSearchTreeTest::TestCount() {
+  std::vector<std::pair<Rect<>, int>> objects = MakeRandomObjects(300);
+  auto tree = Tree::Create({0, 0, 100, 100}, 6);
+  tree->SetWeightFunction([](int rep) { return rep % 3; });
+
+  std::vector<Tree::NearIterator> iterators;
+  for (const auto& object : objects)
+    iterators.push_back(tree->Insert(object.first, object.second));
+  EXPECT_EQ(300, tree->Size());
+
+  // Move some objects and remove others.
+  for (int i = 0; i < objects.size(); i += 3) {
+    objects[i].first.pos += Vec<int64_t, 2>{7, -5};
+    iterators[i] = tree->Move(std::move(iterators[i]), objects[i].first);
+  }
+  for (int i = 1; i < objects.size(); i += 5)
+    tree->Remove(std::move(iterators[i]));
+  EXPECT_EQ(240, tree->Size());
+
+  std::vector<std::pair<Rect<>, int>> queries = MakeRandomObjects(30);
+  queries.push_back({{0, 0, 100, 100}, 0});
+  queries.push_back({{-1000, -1000, 2000, 2000}, 0});
+  for (const auto& query : queries) {
+    int count = 0;
+    double weight = 0;
+    for (int i = 0; i < objects.size(); ++i) {
+      if (i % 5 != 1 && query.first.Overlaps(objects[i].first)) {
+        ++count;
+        weight += objects[i].second % 3;
+      }
+    }
+    EXPECT_EQ(count, tree->Count(query.first));
+    EXPECT_EQ(weight, tree->SumWeights(query.first));
+  }
+
+  // Bulk-loaded trees have totals too.
+  auto built = Tree::BuildFrom({0, 0, 100, 100}, 6, MakeRandomObjects(50));
+  EXPECT_EQ(50, built->Size());
+  EXPECT_EQ(50, built->Count({-1000, -1000, 2000, 2000}));
+  EXPECT_EQ(50., built->SumWeights({-1000, -1000, 2000, 2000}));
+}
+
+void RectSearchTreeTest::TestSnapshot() {
+  std::vector<std::pair<Rect<>, int>> objects = MakeRandomObjects(100);
+  auto tree = Tree::Create({0, 0, 100, 100}, 5);
+  std::vector<Tree::NearIterator> iterators;
+  for (const auto& object : objects)
+    iterators.push_back(tree->Insert(object.first, object.second));
+
+  Tree::Snapshot snapshot = tree->TakeSnapshot();
+  EXPECT_EQ(100, snapshot.Size());
+
+  // Changing the tree doesn't affect the snapshot.
+  for (int i = 0; i < 50; ++i)
+    tree->Remove(std::move(iterators[i]));
+  EXPECT_EQ(100, snapshot.Size());
+
+  for (const auto& query : MakeRandomObjects(20)) {
+    std::multiset<int> expected;
+    for (const auto& object : objects) {
+      if (query.first.Overlaps(object.first) ||
+          query.first.Touches(object.first)) {
+        expected.insert(object.second);
+      }
+    }
+
+    std::multiset<int> found;
+    snapshot.Near(query.first, [&](const Rect<>& rect, int rep) {
+      EXPECT_EQ(RectToString(objects[rep].first), RectToString(rect));
+      found.insert(rep);
+    });
+    EXPECT_TRUE(expected == found);
+  }
+
+  // Reps can be converted while copying.
+  auto names = tree->TakeSnapshot([](int rep) { return std::to_string(rep); });
+  EXPECT_EQ(50, names.Size());
+  int count = 0;
+  names.Near({-1000, -1000, 2000, 2000},
+             [&](const Rect<>&, const std::string& name) {
+               EXPECT_TRUE(std::stoi(name) >= 50);
+               ++count;
+             });
+  EXPECT_EQ(50, count);
+}
+
+void RectSearchTreeTest::TestBreakdownScale() {
+  // x is 100 long after scaling, so it's split first, into halves of its
+  // real length.
+  auto tree = Tree::Create({0, 0, 1000, 100}, 3, {10, 1});
+  ASSERT_RECT_EQ(Rect<>({500, 0, 500, 100}),
+                 tree->Find({600, 10, 1, 80})->GetRect());
+
+  // The scale also applies further down, where y is now longest.
+  ASSERT_RECT_EQ(Rect<>({0, 0, 500, 50}),
+                 tree->Find({10, 10, 1, 1})->GetRect());
+}
+
+void RectSearchTreeTest::TestStats() {
+  auto tree = Tree::Create({0, 0, 100, 100}, 3);
+  tree->Insert({10, 10, 5, 5}, 0);   // leaf
+  tree->Insert({45, 10, 10, 5}, 1);  // straddles the first split
+  tree->Insert({60, 60, 5, 5}, 2);   // leaf
+
+  Tree::Stats stats = tree->GetStats({{0, 0, 20, 20}, {200, 200, 5, 5}});
+  EXPECT_EQ(3, stats.nodes_per_depth.size());
+  EXPECT_EQ(1, stats.nodes_per_depth[0]);
+  EXPECT_EQ(2, stats.nodes_per_depth[1]);
+  EXPECT_EQ(4, stats.nodes_per_depth[2]);
+  EXPECT_EQ(1, stats.objects_per_depth[0]);
+  EXPECT_EQ(0, stats.objects_per_depth[1]);
+  EXPECT_EQ(2, stats.objects_per_depth[2]);
+  EXPECT_EQ(1. / 3, stats.interior_share);
+
+  // The first lookup visits the root, the left half and its top quarter, and
+  // returns objects 0 and 1. The second misses the tree entirely.
+  EXPECT_EQ(1.5, stats.average_nodes_visited);
+  EXPECT_EQ(1., stats.average_candidates);
+}
+
+void RectSearchTreeTest::TestAutoTune() {
+  // Small objects spread along a long, thin strip.
+  std::mt19937 random(5);
+  std::uniform_int_distribution<int64_t> x(0, 9990);
+  std::uniform_int_distribution<int64_t> y(0, 90);
+  std::vector<Rect<>> objects;
+  std::vector<Rect<>> lookups;
+  for (int i = 0; i < 1000; ++i)
+    objects.push_back({x(random), y(random), 4, 4});
+  for (int i = 0; i < 100; ++i)
+    lookups.push_back({x(random), y(random), 8, 8});
+
+  Rect<> rect{0, 0, 10000, 100};
+  Tree::Parameters parameters = Tree::AutoTune(rect, objects, lookups, 16);
+  EXPECT_TRUE(parameters.tree_depth > 4);
+
+  auto stats_for = [&](int depth, const Point<double, 2>& scale) {
+    std::vector<std::pair<Rect<>, int>> entries;
+    for (const Rect<>& object : objects)
+      entries.push_back({object, 0});
+    return Tree::BuildFrom(rect, depth, entries, scale)->GetStats(lookups);
+  };
+  Tree::Stats tuned =
+      stats_for(parameters.tree_depth, parameters.breakdown_scale);
+  Tree::Stats shallow = stats_for(2, {1, 1});
+  EXPECT_TRUE(tuned.average_nodes_visited + 2 * tuned.average_candidates <
+              shallow.average_nodes_visited + 2 * shallow.average_candidates);
+}
+
+void RectSearchTreeTest::TestNearest() {
+  std::vector<std::pair<Rect<>, int>> objects = MakeRandomObjects(200);
+  auto tree = Tree::Create({0, 0, 100, 100}, 6);
+  for (const auto& object : objects)
+    tree->Insert(object.first, object.second);
+
+  EXPECT_TRUE(tree->Nearest({50, 50}, 0).empty());
+  EXPECT_EQ(200, tree->Nearest({50, 50}, 500).size());
+
+  // Compare the distances of the results with a brute force search, since
+  // objects at equal distances may come back in any order.
+  auto check = [&](const Point<>& point, int k, auto filter,
+                   const Point<double, 2>& weights) {
+    std::vector<double> expected;
+    for (const auto& object : objects) {
+      if (filter(object.second))
+        expected.push_back(SquaredDistance(point, object.first, weights));
+    }
+    std::sort(expected.begin(), expected.end());
+    expected.resize(std::min<int>(k, expected.size()));
+
+    std::vector<int> nearest = tree->Nearest(point, k, filter, weights);
+    ASSERT_EQ(expected.size(), nearest.size());
+    for (int i = 0; i < nearest.size(); ++i) {
+      EXPECT_TRUE(filter(nearest[i]));
+      EXPECT_EQ(expected[i],
+                SquaredDistance(point, objects[nearest[i]].first, weights));
+    }
+  };
+
+  std::mt19937 random(3);
+  std::uniform_int_distribution<int64_t> position(-50, 150);
+  auto all = [](int) { return true; };
+  auto even = [](int rep) { return rep % 2 == 0; };
+  for (int i = 0; i < 50; ++i) {
+    Point<> point{position(random), position(random)};
+    check(point, 1, all, {1, 1});
+    check(point, 7, all, {1, 1});
+    check(point, 7, even, {1, 1});
+    check(point, 7, all, {1, 0});
+    check(point, 7, all, {0.5, 3});
+  }
+}
+
 RectSearchTreeTest::RectSearchTreeTest()
     : TestGroup("RectSearchTreeTest",
                 {
@@ -272,6 +604,15 @@ RectSearchTreeTest::RectSearchTreeTest()
                     std::bind(&RectSearchTreeTest::Test4D, this),
                     std::bind(&RectSearchTreeTest::TestAllIterator, this),
                     std::bind(&RectSearchTreeTest::TestNearIterator, this),
+                    std::bind(&RectSearchTreeTest::TestBuildFrom, this),
+                    std::bind(&RectSearchTreeTest::TestWriteRead, this),
+                    std::bind(&RectSearchTreeTest::TestNearMany, this),
+                    std::bind(&RectSearchTreeTest::TestCount, this),
+                    std::bind(&RectSearchTreeTest::TestSnapshot, this),
+                    std::bind(&RectSearchTreeTest::TestBreakdownScale, this),
+                    std::bind(&RectSearchTreeTest::TestStats, this),
+                    std::bind(&RectSearchTreeTest::TestAutoTune, this),
+                    std::bind(&RectSearchTreeTest::TestNearest, this),
                 }) {}
 
 }  // namespace test
@@ -19,6 +19,16 @@ class RectSearchTreeTest : public TestGroup {
   void TestAllIterator();
   void TestNearIterator();
 
+  void TestBuildFrom();
+  void TestWriteRead();
+  void TestNearMany();
+  void TestCount();
+  void TestSnapshot();
+  void TestBreakdownScale();
+  void TestStats();
+  void TestAutoTune();
+  void TestNearest();
+
   RectSearchTreeTest();
 };
 
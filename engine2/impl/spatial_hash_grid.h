@@ -0,0 +1,532 @@
+#ifndef ENGINE2_IMPL_SPATIAL_HASH_GRID_H_
+#define ENGINE2_IMPL_SPATIAL_HASH_GRID_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "engine2/rect.h"
+
+namespace engine2 {
+namespace spatial_hash_grid_internal {
+
+constexpr int kNone = -1;
+constexpr size_t kMinSlotCount = 16;
+
+inline int64_t FloorDiv(int64_t a, int64_t b) {
+  int64_t quotient = a / b;
+  if ((a % b != 0) && ((a < 0) != (b < 0)))
+    --quotient;
+  return quotient;
+}
+
+}  // namespace spatial_hash_grid_internal
+
+// SpatialHashGrid divides space into equally sized cells and stores each
+// object in the cell containing its rect's top-left corner. It has the same
+// interface as RectSearchTree, and works best when objects are all about the
+// size of a cell (e.g. tile-sized entities).
+//
+// Cells are stored in an open-addressed hash table keyed by integer cell
+// coordinates, so only occupied cells use memory and the grid isn't limited to
+// the rect it was created with. Moving an object within its cell is free;
+// moving it to another cell relinks it without allocating.
+//
+// Lookups are widened by the largest object size seen so far, so a few very
+// large objects make every lookup visit more cells.
+//
+// Iterators can be invalidated by their target objects being moved or removed.
+// Inserting, or moving an object into a cell with no slot, may rehash the cell
+// table, which invalidates any Near() or begin() traversal in progress;
+// iterators returned by Insert() and Move() stay valid. New cells take over
+// the slots of emptied cells where they can, so objects moving around a
+// bounded area rarely cause a rehash.
+template <int N, class Rep>
+class SpatialHashGrid {
+ public:
+  using Rect = Rect<int64_t, N>;
+  using Cell = Point<int64_t, N>;
+  class NearIterator;
+  struct NearIterable;
+
+  // Iterator: Visits all objects in the grid.
+  NearIterator begin() { return NearIterator(this); }
+  NearIterator end() { return NearIterator(); }
+
+  // NearIterator: Visits objects in cells that could hold objects touching or
+  // overlapping |rect|.
+  NearIterable Near(Rect rect) { return NearIterable{this, rect}; }
+  struct NearIterable {
+    SpatialHashGrid* grid;
+    Rect rect;
+    NearIterator begin() { return NearIterator(grid, rect); }
+    NearIterator end() { return NearIterator(); }
+  };
+
+  // Create a grid with cells of size |cell_size|. |rect| is used by
+  // InsertTrimmed() and GetRect().
+  static std::unique_ptr<SpatialHashGrid> Create(
+      const Rect& rect,
+      const Vec<int64_t, N>& cell_size);
+
+  // Create a grid whose cells are the size of the leaves of a RectSearchTree
+  // created with the same arguments.
+  static std::unique_ptr<SpatialHashGrid> Create(
+      const Rect& rect,
+      int tree_depth,
+      const Point<double, N>& breakdown_scale = Point<double, N>::Ones());
+
+  // Add an object to the grid. Returns an iterator to the object.
+  NearIterator Insert(const Rect& rect, Rep obj);
+
+  // Same as Insert(Rect, Rep), but use the intersection of rect and rect_.
+  NearIterator InsertTrimmed(const Rect& rect, Rep obj);
+
+  // Remove an object from the grid.
+  void Remove(NearIterator&& iterator);
+
+  // Update an object's position in the grid and return a new iterator to it.
+  // Like Insert(), this may rehash when |dest| is in a new cell.
+  NearIterator Move(NearIterator&& iterator, Rect dest);
+
+  const Rect& GetRect() const { return rect_; }
+  const Vec<int64_t, N>& GetCellSize() const { return cell_size_; }
+  int Size() const { return entry_count_; }
+
+  Cell CellFor(const Point<int64_t, N>& point) const;
+
+  class NearIterator {
+   public:
+    NearIterator() = default;
+
+    Rep& operator*() { return grid_->entries_[entry_].rep; }
+    operator bool() const {
+      return entry_ != spatial_hash_grid_internal::kNone;
+    }
+    bool operator==(const NearIterator& other) const {
+      return entry_ == other.entry_ &&
+             (entry_ == spatial_hash_grid_internal::kNone ||
+              grid_ == other.grid_);
+    }
+    bool operator!=(const NearIterator& other) const {
+      return !(*this == other);
+    }
+    NearIterator& operator++() {
+      Advance();
+      return *this;
+    }
+
+    // Remove the current object from the grid.
+    void Erase();
+
+   private:
+    friend class SpatialHashGrid;
+
+    enum class Mode {
+      // Only visit one object.
+      kSingle,
+      // Look up each cell in [first_cell_, last_cell_].
+      kCells,
+      // Walk the whole cell table. Used when the lookup range covers more
+      // cells than the table has slots.
+      kSlots,
+    };
+
+    // Visit everything.
+    explicit NearIterator(SpatialHashGrid* grid);
+    // Visit cells near |rect|.
+    NearIterator(SpatialHashGrid* grid, const Rect& rect);
+    // Point at a single entry.
+    NearIterator(SpatialHashGrid* grid, int entry)
+        : grid_(grid), mode_(Mode::kSingle), entry_(entry) {}
+
+    void Advance();
+    // Moves to the next slot with entries. Returns false when there are none.
+    bool NextSlot();
+    bool SlotInRange(int slot) const;
+
+    SpatialHashGrid* grid_ = nullptr;
+    Mode mode_ = Mode::kSingle;
+    bool match_all_ = false;
+    Cell first_cell_{};
+    Cell last_cell_{};
+    Cell cell_{};
+    int slot_ = spatial_hash_grid_internal::kNone;
+    int entry_ = spatial_hash_grid_internal::kNone;
+  };
+
+ private:
+  struct Slot {
+    Cell cell{};
+    bool used = false;
+    int head = spatial_hash_grid_internal::kNone;
+  };
+
+  struct Entry {
+    Rep rep{};
+    int slot = spatial_hash_grid_internal::kNone;
+    // Doubles as the next free entry when the entry is unused.
+    int next = spatial_hash_grid_internal::kNone;
+    int prev = spatial_hash_grid_internal::kNone;
+  };
+
+  SpatialHashGrid(const Rect& rect, const Vec<int64_t, N>& cell_size);
+
+  static size_t Hash(const Cell& cell);
+
+  // Returns the slot for |cell|, or kNone if |cell| isn't in the table.
+  int FindSlot(const Cell& cell) const;
+  // Same as FindSlot(), but adds |cell| to the table if it's missing, reusing
+  // the slot of a cell with no entries on its probe path if there is one.
+  int FindOrAddSlot(const Cell& cell);
+  // Resizes the slot table, dropping cells with no entries.
+  void Rehash(size_t min_capacity);
+
+  void Link(int entry, int slot);
+  void Unlink(int entry);
+
+  Rect rect_;
+  Vec<int64_t, N> cell_size_;
+  // Size of the largest object inserted so far.
+  Vec<int64_t, N> max_size_{};
+
+  std::vector<Slot> slots_;
+  size_t used_slot_count_ = 0;
+
+  std::vector<Entry> entries_;
+  int free_entry_ = spatial_hash_grid_internal::kNone;
+  int entry_count_ = 0;
+};
+
+template <int N, class Rep>
+SpatialHashGrid<N, Rep>::NearIterator::NearIterator(SpatialHashGrid* grid)
+    : grid_(grid), mode_(Mode::kSlots), match_all_(true) {
+  NextSlot();
+}
+
+template <int N, class Rep>
+SpatialHashGrid<N, Rep>::NearIterator::NearIterator(SpatialHashGrid* grid,
+                                                    const Rect& rect)
+    : grid_(grid) {
+  // Objects are stored by their top-left corner, so anything that touches rect
+  // has its corner within max_size_ above and to the left of rect.
+  first_cell_ = grid_->CellFor(rect.pos - grid_->max_size_);
+  last_cell_ = grid_->CellFor(rect.pos + rect.size);
+
+  double cell_count = 1;
+  for (int i = 0; i < N; ++i)
+    cell_count *= last_cell_[i] - first_cell_[i] + 1;
+
+  if (cell_count > grid_->slots_.size()) {
+    mode_ = Mode::kSlots;
+    NextSlot();
+    return;
+  }
+
+  mode_ = Mode::kCells;
+  cell_ = first_cell_;
+  slot_ = grid_->FindSlot(cell_);
+  if (slot_ != spatial_hash_grid_internal::kNone)
+    entry_ = grid_->slots_[slot_].head;
+  if (entry_ == spatial_hash_grid_internal::kNone)
+    Advance();
+}
+
+template <int N, class Rep>
+void SpatialHashGrid<N, Rep>::NearIterator::Advance() {
+  if (entry_ != spatial_hash_grid_internal::kNone)
+    entry_ = grid_->entries_[entry_].next;
+  if (entry_ != spatial_hash_grid_internal::kNone)
+    return;
+
+  switch (mode_) {
+    case Mode::kSingle:
+      entry_ = spatial_hash_grid_internal::kNone;
+      return;
+    case Mode::kSlots:
+      NextSlot();
+      return;
+    case Mode::kCells:
+      while (true) {
+        // Step to the next cell in the range, like an odometer.
+        int i = 0;
+        for (; i < N; ++i) {
+          if (++cell_[i] <= last_cell_[i])
+            break;
+          cell_[i] = first_cell_[i];
+        }
+        if (i == N)
+          return;
+
+        slot_ = grid_->FindSlot(cell_);
+        if (slot_ == spatial_hash_grid_internal::kNone)
+          continue;
+
+        entry_ = grid_->slots_[slot_].head;
+        if (entry_ != spatial_hash_grid_internal::kNone)
+          return;
+      }
+  }
+}
+
+template <int N, class Rep>
+bool SpatialHashGrid<N, Rep>::NearIterator::NextSlot() {
+  int slot_count = grid_->slots_.size();
+  for (++slot_; slot_ < slot_count; ++slot_) {
+    const Slot& slot = grid_->slots_[slot_];
+    if (slot.head != spatial_hash_grid_internal::kNone && SlotInRange(slot_)) {
+      entry_ = slot.head;
+      return true;
+    }
+  }
+  entry_ = spatial_hash_grid_internal::kNone;
+  return false;
+}
+
+template <int N, class Rep>
+bool SpatialHashGrid<N, Rep>::NearIterator::SlotInRange(int slot) const {
+  if (match_all_)
+    return true;
+
+  const Cell& cell = grid_->slots_[slot].cell;
+  for (int i = 0; i < N; ++i) {
+    if (cell[i] < first_cell_[i] || cell[i] > last_cell_[i])
+      return false;
+  }
+  return true;
+}
+
+template <int N, class Rep>
+void SpatialHashGrid<N, Rep>::NearIterator::Erase() {
+  grid_->Unlink(entry_);
+  grid_->entries_[entry_] = Entry();
+  grid_->entries_[entry_].next = grid_->free_entry_;
+  grid_->free_entry_ = entry_;
+  --grid_->entry_count_;
+  entry_ = spatial_hash_grid_internal::kNone;
+}
+
+// static
+template <int N, class Rep>
+std::unique_ptr<SpatialHashGrid<N, Rep>> SpatialHashGrid<N, Rep>::Create(
+    const Rect& rect,
+    const Vec<int64_t, N>& cell_size) {
+  return std::unique_ptr<SpatialHashGrid>(new SpatialHashGrid(rect, cell_size));
+}
+
+// static
+template <int N, class Rep>
+std::unique_ptr<SpatialHashGrid<N, Rep>> SpatialHashGrid<N, Rep>::Create(
+    const Rect& rect,
+    int tree_depth,
+    const Point<double, N>& breakdown_scale) {
+  // Split the longest dimension in half once per tree level, the same way
+  // RectSearchTree does.
+  Vec<int64_t, N> cell_size = rect.size;
+  for (int level = 1; level < tree_depth; ++level) {
+    int longest_dimension = 0;
+    double longest_length = 0;
+    for (int i = 0; i < N; ++i) {
+      double length = cell_size[i] / breakdown_scale[i];
+      if (length > longest_length) {
+        longest_dimension = i;
+        longest_length = length;
+      }
+    }
+    cell_size[longest_dimension] /= 2;
+  }
+
+  for (int i = 0; i < N; ++i)
+    cell_size[i] = std::max<int64_t>(cell_size[i], 1);
+  return Create(rect, cell_size);
+}
+
+template <int N, class Rep>
+SpatialHashGrid<N, Rep>::SpatialHashGrid(const Rect& rect,
+                                         const Vec<int64_t, N>& cell_size)
+    : rect_(rect), cell_size_(cell_size) {
+  slots_.resize(spatial_hash_grid_internal::kMinSlotCount);
+}
+
+template <int N, class Rep>
+typename SpatialHashGrid<N, Rep>::NearIterator SpatialHashGrid<N, Rep>::Insert(
+    const Rect& rect,
+    Rep obj) {
+  for (int i = 0; i < N; ++i)
+    max_size_[i] = std::max(max_size_[i], rect.size[i]);
+
+  int entry = free_entry_;
+  if (entry == spatial_hash_grid_internal::kNone) {
+    entries_.emplace_back();
+    entry = entries_.size() - 1;
+  } else {
+    free_entry_ = entries_[entry].next;
+    entries_[entry] = Entry();
+  }
+  entries_[entry].rep = obj;
+  ++entry_count_;
+
+  Link(entry, FindOrAddSlot(CellFor(rect.pos)));
+  return NearIterator(this, entry);
+}
+
+template <int N, class Rep>
+typename SpatialHashGrid<N, Rep>::NearIterator
+SpatialHashGrid<N, Rep>::InsertTrimmed(const Rect& rect, Rep obj) {
+  return Insert(rect.GetOverlap(rect_), obj);
+}
+
+template <int N, class Rep>
+void SpatialHashGrid<N, Rep>::Remove(NearIterator&& iterator) {
+  iterator.Erase();
+}
+
+template <int N, class Rep>
+typename SpatialHashGrid<N, Rep>::NearIterator SpatialHashGrid<N, Rep>::Move(
+    NearIterator&& iterator,
+    Rect dest) {
+  for (int i = 0; i < N; ++i)
+    max_size_[i] = std::max(max_size_[i], dest.size[i]);
+
+  int entry = iterator.entry_;
+  Cell cell = CellFor(dest.pos);
+  if (slots_[entries_[entry].slot].cell == cell)
+    return NearIterator(this, entry);
+
+  Unlink(entry);
+  Link(entry, FindOrAddSlot(cell));
+  return NearIterator(this, entry);
+}
+
+template <int N, class Rep>
+typename SpatialHashGrid<N, Rep>::Cell SpatialHashGrid<N, Rep>::CellFor(
+    const Point<int64_t, N>& point) const {
+  Cell cell;
+  for (int i = 0; i < N; ++i)
+    cell[i] = spatial_hash_grid_internal::FloorDiv(point[i], cell_size_[i]);
+  return cell;
+}
+
+// static
+template <int N, class Rep>
+size_t SpatialHashGrid<N, Rep>::Hash(const Cell& cell) {
+  uint64_t hash = 0xcbf29ce484222325;
+  for (int i = 0; i < N; ++i) {
+    hash ^= uint64_t(cell[i]);
+    hash *= 0x9e3779b97f4a7c15;
+    hash ^= hash >> 29;
+  }
+  return hash;
+}
+
+template <int N, class Rep>
+int SpatialHashGrid<N, Rep>::FindSlot(const Cell& cell) const {
+  size_t mask = slots_.size() - 1;
+  for (size_t i = Hash(cell) & mask;; i = (i + 1) & mask) {
+    const Slot& slot = slots_[i];
+    if (!slot.used)
+      return spatial_hash_grid_internal::kNone;
+    if (slot.cell == cell)
+      return i;
+  }
+}
+
+template <int N, class Rep>
+int SpatialHashGrid<N, Rep>::FindOrAddSlot(const Cell& cell) {
+  // Empty cells keep their slots so probe chains through them stay intact,
+  // but one on |cell|'s chain can hold |cell| instead.
+  size_t mask = slots_.size() - 1;
+  int empty = spatial_hash_grid_internal::kNone;
+  for (size_t i = Hash(cell) & mask; slots_[i].used; i = (i + 1) & mask) {
+    if (slots_[i].cell == cell)
+      return i;
+    if (empty == spatial_hash_grid_internal::kNone &&
+        slots_[i].head == spatial_hash_grid_internal::kNone) {
+      empty = i;
+    }
+  }
+  if (empty != spatial_hash_grid_internal::kNone) {
+    slots_[empty].cell = cell;
+    return empty;
+  }
+
+  // Keep the table at most half full.
+  if ((used_slot_count_ + 1) * 2 > slots_.size())
+    Rehash(used_slot_count_ + 1);
+
+  mask = slots_.size() - 1;
+  size_t i = Hash(cell) & mask;
+  while (slots_[i].used)
+    i = (i + 1) & mask;
+
+  slots_[i].used = true;
+  slots_[i].cell = cell;
+  ++used_slot_count_;
+  return i;
+}
+
+template <int N, class Rep>
+void SpatialHashGrid<N, Rep>::Rehash(size_t min_capacity) {
+  std::vector<Slot> old_slots = std::move(slots_);
+
+  size_t occupied_count = 0;
+  for (const Slot& slot : old_slots)
+    occupied_count += slot.head != spatial_hash_grid_internal::kNone;
+
+  // Size for 4x the occupied cells so there's room to move around before the
+  // next rehash.
+  size_t capacity = spatial_hash_grid_internal::kMinSlotCount;
+  while (capacity < occupied_count * 4 || capacity < min_capacity * 2)
+    capacity *= 2;
+
+  slots_ = std::vector<Slot>(capacity);
+  used_slot_count_ = 0;
+  size_t mask = capacity - 1;
+  for (const Slot& old_slot : old_slots) {
+    if (old_slot.head == spatial_hash_grid_internal::kNone)
+      continue;
+
+    size_t i = Hash(old_slot.cell) & mask;
+    while (slots_[i].used)
+      i = (i + 1) & mask;
+
+    slots_[i] = old_slot;
+    ++used_slot_count_;
+    for (int entry = old_slot.head; entry != spatial_hash_grid_internal::kNone;
+         entry = entries_[entry].next) {
+      entries_[entry].slot = i;
+    }
+  }
+}
+
+template <int N, class Rep>
+void SpatialHashGrid<N, Rep>::Link(int entry, int slot) {
+  Entry& e = entries_[entry];
+  e.slot = slot;
+  e.prev = spatial_hash_grid_internal::kNone;
+  e.next = slots_[slot].head;
+  if (e.next != spatial_hash_grid_internal::kNone)
+    entries_[e.next].prev = entry;
+  slots_[slot].head = entry;
+}
+
+template <int N, class Rep>
+void SpatialHashGrid<N, Rep>::Unlink(int entry) {
+  Entry& e = entries_[entry];
+  if (e.prev != spatial_hash_grid_internal::kNone)
+    entries_[e.prev].next = e.next;
+  else
+    slots_[e.slot].head = e.next;
+
+  if (e.next != spatial_hash_grid_internal::kNone)
+    entries_[e.next].prev = e.prev;
+
+  e.slot = spatial_hash_grid_internal::kNone;
+  e.prev = spatial_hash_grid_internal::kNone;
+  e.next = spatial_hash_grid_internal::kNone;
+}
+
+}  // namespace engine2
+
+#endif  // ENGINE2_IMPL_SPATIAL_HASH_GRID_H_
@@ -0,0 +1,197 @@
+#include "engine2/impl/spatial_hash_grid_test.h"
+#include "engine2/impl/spatial_hash_grid.h"
+#include "engine2/test/assert_macros.h"
+
+#include <random>
+#include <unordered_set>
+#include <vector>
+
+namespace engine2 {
+namespace test {
+namespace {
+
+using Grid = SpatialHashGrid<2, int>;
+
+std::unordered_set<int> FindNear(Grid* grid, const Rect<>& rect) {
+  std::unordered_set<int> found;
+  for (int i : grid->Near(rect))
+    found.insert(i);
+  return found;
+}
+
+}  // namespace
+
+void SpatialHashGridTest::TestCreateFromDepth() {
+  // Three splits: x, y, then x again.
+  auto grid = Grid::Create({0, 0, 100, 100}, 4);
+  ASSERT_NOT_NULL(grid.get());
+  EXPECT_EQ(25, grid->GetCellSize().x());
+  EXPECT_EQ(50, grid->GetCellSize().y());
+
+  // Lengths are divided by the scale, so y is split first.
+  grid = Grid::Create({0, 0, 100, 100}, 3, {4, 1});
+  EXPECT_EQ(100, grid->GetCellSize().x());
+  EXPECT_EQ(25, grid->GetCellSize().y());
+
+  EXPECT_TRUE(grid->begin() == grid->end());
+  EXPECT_EQ(0, grid->Size());
+}
+
+void SpatialHashGridTest::TestNear() {
+  auto grid = Grid::Create({0, 0, 100, 100}, {10, 10});
+  grid->Insert({1, 1, 8, 8}, 0);
+  grid->Insert({45, 45, 10, 10}, 1);
+  grid->Insert({90, 90, 2, 2}, 2);
+
+  std::unordered_set<int> found = FindNear(grid.get(), {40, 40, 10, 10});
+  EXPECT_EQ(1, found.size());
+  EXPECT_EQ(1, found.count(1));
+
+  // Object 1 starts in another cell but reaches into the query.
+  found = FindNear(grid.get(), {54, 54, 2, 2});
+  EXPECT_EQ(1, found.count(1));
+
+  EXPECT_EQ(0, FindNear(grid.get(), {20, 70, 5, 5}).size());
+}
+
+void SpatialHashGridTest::TestNegativeCells() {
+  auto grid = Grid::Create({0, 0, 100, 100}, {10, 10});
+  EXPECT_EQ(-1, grid->CellFor({-1, -10}).x());
+  EXPECT_EQ(-1, grid->CellFor({-1, -10}).y());
+  EXPECT_EQ(-2, grid->CellFor({-11, 0}).x());
+
+  grid->Insert({-15, -15, 5, 5}, 0);
+  std::unordered_set<int> found = FindNear(grid.get(), {-11, -11, 2, 2});
+  EXPECT_EQ(1, found.size());
+  EXPECT_EQ(1, found.count(0));
+}
+
+void SpatialHashGridTest::TestMove() {
+  auto grid = Grid::Create({0, 0, 100, 100}, {10, 10});
+  auto iter = grid->Insert({0, 0, 5, 5}, 1);
+  grid->Insert({50, 0, 5, 5}, 2);
+
+  // Within the same cell.
+  iter = grid->Move(std::move(iter), {2, 2, 5, 5});
+  EXPECT_EQ(1, *iter);
+  EXPECT_EQ(1, FindNear(grid.get(), {0, 0, 1, 1}).count(1));
+
+  iter = grid->Move(std::move(iter), {72, 72, 5, 5});
+  std::unordered_set<int> found = FindNear(grid.get(), {70, 70, 5, 5});
+  EXPECT_EQ(1, found.size());
+  EXPECT_EQ(1, found.count(1));
+  EXPECT_EQ(0, FindNear(grid.get(), {0, 0, 1, 1}).size());
+  EXPECT_EQ(2, grid->Size());
+
+  // Wandering through many cells reuses the slots of the ones left behind.
+  for (int64_t x = 0; x < 1000; ++x)
+    iter = grid->Move(std::move(iter), {x * 10, 500, 5, 5});
+  EXPECT_EQ(1, *iter);
+  found = FindNear(grid.get(), {9990, 500, 5, 5});
+  EXPECT_EQ(1, found.size());
+  EXPECT_EQ(1, found.count(1));
+  EXPECT_EQ(0, FindNear(grid.get(), {9980, 500, 5, 5}).size());
+  EXPECT_EQ(1, FindNear(grid.get(), {50, 0, 1, 1}).count(2));
+  int visited = 0;
+  for (int i : *grid)
+    visited += i;
+  EXPECT_EQ(3, visited);
+}
+
+void SpatialHashGridTest::TestRemove() {
+  auto grid = Grid::Create({0, 0, 100, 100}, {10, 10});
+  auto iter_a = grid->Insert({0, 0, 5, 5}, 1);
+  auto iter_b = grid->Insert({1, 1, 5, 5}, 2);
+  auto iter_c = grid->Insert({2, 2, 5, 5}, 3);
+
+  grid->Remove(std::move(iter_b));
+  std::unordered_set<int> found = FindNear(grid.get(), {0, 0, 5, 5});
+  EXPECT_EQ(2, found.size());
+  EXPECT_EQ(0, found.count(2));
+
+  grid->Remove(std::move(iter_a));
+  grid->Remove(std::move(iter_c));
+  EXPECT_EQ(0, grid->Size());
+  EXPECT_TRUE(grid->begin() == grid->end());
+
+  grid->Insert({1, 1, 1, 1}, 4);
+  found = FindNear(grid.get(), {0, 0, 5, 5});
+  EXPECT_EQ(1, found.size());
+  EXPECT_EQ(1, found.count(4));
+}
+
+void SpatialHashGridTest::TestAllIterator() {
+  auto grid = Grid::Create({0, 0, 100, 100}, {10, 10});
+  grid->Insert({1, 1, 5, 5}, 4);
+  grid->Insert({2, 2, 5, 5}, 5);
+  grid->Insert({90, 90, 2, 2}, 6);
+  grid->Insert({-200, -200, 2, 2}, 7);
+
+  std::unordered_set<int> found;
+  for (int i : *grid)
+    found.insert(i);
+
+  EXPECT_EQ(4, found.size());
+  EXPECT_EQ(1, found.count(4));
+  EXPECT_EQ(1, found.count(5));
+  EXPECT_EQ(1, found.count(6));
+  EXPECT_EQ(1, found.count(7));
+}
+
+void SpatialHashGridTest::TestLargeQuery() {
+  auto grid = Grid::Create({0, 0, 100, 100}, {1, 1});
+  grid->Insert({5, 5, 1, 1}, 0);
+  grid->Insert({5000, 5000, 1, 1}, 1);
+
+  // Covers far more cells than the table has slots.
+  std::unordered_set<int> found = FindNear(grid.get(), {0, 0, 1000, 1000});
+  EXPECT_EQ(1, found.size());
+  EXPECT_EQ(1, found.count(0));
+}
+
+void SpatialHashGridTest::TestMatchesBruteForce() {
+  auto grid = Grid::Create({0, 0, 1000, 1000}, {32, 32});
+  std::mt19937 random(1234);
+  std::uniform_int_distribution<int64_t> position(0, 1000);
+  std::uniform_int_distribution<int64_t> size(1, 50);
+  auto random_rect = [&]() -> Rect<> {
+    return {position(random), position(random), size(random), size(random)};
+  };
+
+  std::vector<Rect<>> rects;
+  std::vector<Grid::NearIterator> iterators;
+  for (int i = 0; i < 500; ++i) {
+    rects.push_back(random_rect());
+    iterators.push_back(grid->Insert(rects.back(), i));
+  }
+  for (int i = 0; i < 500; i += 2) {
+    rects[i] = random_rect();
+    iterators[i] = grid->Move(std::move(iterators[i]), rects[i]);
+  }
+
+  for (int query_index = 0; query_index < 50; ++query_index) {
+    Rect<> query = random_rect();
+    std::unordered_set<int> found = FindNear(grid.get(), query);
+    for (int i = 0; i < 500; ++i) {
+      if (query.Overlaps(rects[i]) || query.Touches(rects[i]))
+        ASSERT_EQ(1, found.count(i));
+    }
+  }
+}
+
+SpatialHashGridTest::SpatialHashGridTest()
+    : TestGroup("SpatialHashGridTest",
+                {
+                    std::bind(&SpatialHashGridTest::TestCreateFromDepth, this),
+                    std::bind(&SpatialHashGridTest::TestNear, this),
+                    std::bind(&SpatialHashGridTest::TestNegativeCells, this),
+                    std::bind(&SpatialHashGridTest::TestMove, this),
+                    std::bind(&SpatialHashGridTest::TestRemove, this),
+                    std::bind(&SpatialHashGridTest::TestAllIterator, this),
+                    std::bind(&SpatialHashGridTest::TestLargeQuery, this),
+                    std::bind(&SpatialHashGridTest::TestMatchesBruteForce,
+                              this),
+                }) {}
+
+}  // namespace test
+}  // namespace engine2
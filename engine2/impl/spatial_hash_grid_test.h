@@ -0,0 +1,26 @@
+#ifndef ENGINE2_IMPL_SPATIAL_HASH_GRID_TEST_H_
+#define ENGINE2_IMPL_SPATIAL_HASH_GRID_TEST_H_
+
+#include "engine2/test/test_group.h"
+
+namespace engine2 {
+namespace test {
+
+class SpatialHashGridTest : public TestGroup {
+ public:
+  void TestCreateFromDepth();
+  void TestNear();
+  void TestNegativeCells();
+  void TestMove();
+  void TestRemove();
+  void TestAllIterator();
+  void TestLargeQuery();
+  void TestMatchesBruteForce();
+
+  SpatialHashGridTest();
+};
+
+}  // namespace test
+}  // namespace engine2
+
+#endif  // ENGINE2_IMPL_SPATIAL_HASH_GRID_TEST_H_
@@ -0,0 +1,139 @@
+#include "engine2/map_generator.h"
+
+#include <algorithm>
+
+namespace engine2 {
+
+MapGenerator::MapGenerator(TileMap* map,
+                           std::unique_ptr<ChunkGenerator> generator,
+                           WorkerPool* pool)
+    : map_(map),
+      generator_(std::move(generator)),
+      pool_(pool),
+      grid_size_(map->GetGridSize()),
+      layer_count_(map->GetLayerCount()),
+      chunk_grid_size_((grid_size_ +
+                        Vec<int64_t, 2>::Fill(TileMap::kChunkSize - 1)) /
+                       Vec<int64_t, 2>::Fill(TileMap::kChunkSize)),
+      chunk_count_(chunk_grid_size_.x() * chunk_grid_size_.y()),
+      // Enough to keep the workers busy between updates.
+      max_running_jobs_(pool ? 2 * pool->GetThreadCount() : 0) {
+  for (int i = chunk_count_ - 1; i >= 0; --i)
+    pending_chunks_.push_back(i);
+}
+
+MapGenerator::~MapGenerator() {
+  std::unique_lock<std::mutex> lock(jobs_mutex_);
+  jobs_done_.wait(lock, [this] { return running_jobs_ == 0; });
+}
+
+void MapGenerator::SetFocus(const Rect<>& world_rect) {
+  Point<> center = world_rect.pos + world_rect.size / int64_t{2};
+  TileMap::GridPoint grid_center = map_->WorldToGrid(center);
+  Point<> focus_chunk{grid_center.x() / TileMap::kChunkSize,
+                      grid_center.y() / TileMap::kChunkSize};
+  if (focus_chunk == focus_chunk_)
+    return;
+  focus_chunk_ = focus_chunk;
+
+  // Farthest first, so the nearest can be popped off the back.
+  auto distance = [this](int index) {
+    int64_t dx = index % chunk_grid_size_.x() - focus_chunk_.x();
+    int64_t dy = index / chunk_grid_size_.x() - focus_chunk_.y();
+    return dx * dx + dy * dy;
+  };
+  std::sort(pending_chunks_.begin(), pending_chunks_.end(),
+            [&distance](int a, int b) {
+              int64_t distance_a = distance(a);
+              int64_t distance_b = distance(b);
+              return distance_a != distance_b ? distance_a > distance_b
+                                              : a > b;
+            });
+}
+
+void MapGenerator::Update() {
+  if (!started_) {
+    started_ = true;
+    start_time_ = Time::Now();
+  }
+
+  if (!pool_) {
+    if (!pending_chunks_.empty()) {
+      Job job{pending_chunks_.back()};
+      pending_chunks_.pop_back();
+      Generate(&job);
+      Publish(&job);
+    }
+    return;
+  }
+
+  std::vector<Job> finished;
+  {
+    std::lock_guard<std::mutex> lock(jobs_mutex_);
+    finished.swap(finished_jobs_);
+  }
+  for (Job& job : finished)
+    Publish(&job);
+  StartJobs();
+}
+
+bool MapGenerator::IsDone() const {
+  return published_chunk_count_ == chunk_count_;
+}
+
+MapGenerator::Progress MapGenerator::GetProgress() const {
+  Progress progress;
+  progress.finished_chunk_count = published_chunk_count_;
+  progress.chunk_count = chunk_count_;
+  if (!started_)
+    return progress;
+  progress.elapsed = (IsDone() ? end_time_ : Time::Now()) - start_time_;
+  double seconds = progress.elapsed.ToSeconds();
+  if (seconds > 0) {
+    progress.chunks_per_second = published_chunk_count_ / seconds;
+    progress.tiles_per_second = published_tile_count_ / seconds;
+  }
+  return progress;
+}
+
+void MapGenerator::StartJobs() {
+  std::lock_guard<std::mutex> lock(jobs_mutex_);
+  while (running_jobs_ < max_running_jobs_ && !pending_chunks_.empty()) {
+    // std::function needs a copyable task.
+    auto job = std::make_shared<Job>(Job{pending_chunks_.back()});
+    pending_chunks_.pop_back();
+    ++running_jobs_;
+    pool_->Post([this, job] {
+      Generate(job.get());
+      std::lock_guard<std::mutex> lock(jobs_mutex_);
+      finished_jobs_.push_back(std::move(*job));
+      --running_jobs_;
+      jobs_done_.notify_all();
+    });
+  }
+}
+
+void MapGenerator::Generate(Job* job) {
+  size_t tile_count =
+      TileMap::kChunkSize * TileMap::kChunkSize * layer_count_;
+  job->tiles = std::make_unique<uint16_t[]>(tile_count);
+  generator_->GenerateChunk(GetChunkGridRect(job->chunk_index), layer_count_,
+                            job->tiles.get());
+}
+
+void MapGenerator::Publish(Job* job) {
+  Rect<> grid_rect = GetChunkGridRect(job->chunk_index);
+  map_->SetChunkTiles({grid_rect.x(), grid_rect.y()}, std::move(job->tiles));
+  published_tile_count_ += grid_rect.w() * grid_rect.h();
+  if (++published_chunk_count_ == chunk_count_)
+    end_time_ = Time::Now();
+}
+
+Rect<> MapGenerator::GetChunkGridRect(int chunk_index) const {
+  Point<> corner{chunk_index % chunk_grid_size_.x() * TileMap::kChunkSize,
+                 chunk_index / chunk_grid_size_.x() * TileMap::kChunkSize};
+  Rect<> rect{corner, Vec<int64_t, 2>::Fill(TileMap::kChunkSize)};
+  return rect.GetOverlap({{0, 0}, grid_size_});
+}
+
+}  // namespace engine2
@@ -0,0 +1,109 @@
+#ifndef ENGINE2_MAP_GENERATOR_H_
+#define ENGINE2_MAP_GENERATOR_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "engine2/base/worker_pool.h"
+#include "engine2/tile_map.h"
+#include "engine2/time.h"
+
+namespace engine2 {
+
+// Makes the tiles of a map one chunk at a time, e.g. procedurally.
+class ChunkGenerator {
+ public:
+  virtual ~ChunkGenerator() = default;
+
+  // Fills |tiles|, which starts out as 0, with the indices in |grid_rect|,
+  // laid out as for TileMap::ChunkSource::LoadChunk(). Called on worker
+  // threads for several chunks at once, so it mustn't change shared state.
+  virtual void GenerateChunk(const Rect<>& grid_rect,
+                             int layer_count,
+                             uint16_t* tiles) = 0;
+};
+
+// Fills every chunk of a TileMap from a ChunkGenerator in the background.
+// Chunks are generated into their own buffers on a worker pool, and Update()
+// publishes each finished one into the map with TileMap::SetChunkTiles(), a
+// single swap, so the thread that owns the map never waits for generation.
+// Chunks nearest the focus go first.
+class MapGenerator {
+ public:
+  struct Progress {
+    int finished_chunk_count = 0;
+    int chunk_count = 0;
+    // Time since the first Update().
+    Time::Delta elapsed;
+    // Throughput since the first Update(), counting tiles on one layer.
+    double chunks_per_second = 0;
+    double tiles_per_second = 0;
+  };
+
+  // With a null |pool|, Update() generates one chunk on the calling thread.
+  // |map| and |pool| must outlive the generator.
+  MapGenerator(TileMap* map,
+               std::unique_ptr<ChunkGenerator> generator,
+               WorkerPool* pool);
+  // Waits for the chunks that are being generated, and drops them.
+  ~MapGenerator();
+  MapGenerator(const MapGenerator&) = delete;
+  MapGenerator& operator=(const MapGenerator&) = delete;
+
+  // Chunks are generated in order of distance from the centre of
+  // |world_rect|, e.g. the camera's rect. Until this is called, they go row by
+  // row.
+  void SetFocus(const Rect<>& world_rect);
+
+  // Publishes the finished chunks into the map and starts more, on the
+  // calling thread. Call once a frame.
+  void Update();
+  bool IsDone() const;
+  Progress GetProgress() const;
+
+ private:
+  struct Job {
+    int chunk_index;
+    std::unique_ptr<uint16_t[]> tiles;
+  };
+
+  // Starts jobs until enough are running or none are left.
+  void StartJobs();
+  void Generate(Job* job);
+  void Publish(Job* job);
+  Rect<> GetChunkGridRect(int chunk_index) const;
+
+  TileMap* map_;
+  std::unique_ptr<ChunkGenerator> generator_;
+  WorkerPool* pool_;
+  // Copied from the map, so workers don't touch it.
+  Vec<int64_t, 2> grid_size_;
+  int layer_count_;
+  Vec<int64_t, 2> chunk_grid_size_;
+  int chunk_count_;
+  // Chunks that haven't started, nearest the focus last.
+  std::vector<int> pending_chunks_;
+  Point<> focus_chunk_{-1, -1};
+  int max_running_jobs_;
+
+  // Guards the jobs handed to the worker pool.
+  mutable std::mutex jobs_mutex_;
+  std::condition_variable jobs_done_;
+  std::vector<Job> finished_jobs_;
+  int running_jobs_ = 0;
+
+  int published_chunk_count_ = 0;
+  // Tiles per layer in the published chunks.
+  int64_t published_tile_count_ = 0;
+  bool started_ = false;
+  Time start_time_;
+  // When the last chunk was published.
+  Time end_time_;
+};
+
+}  // namespace engine2
+
+#endif  // ENGINE2_MAP_GENERATOR_H_
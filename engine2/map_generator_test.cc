@@ -0,0 +1,144 @@
+#include "engine2/map_generator.h"
+#include "engine2/map_generator_test.h"
+
+#include <chrono>
+#include <thread>
+
+#include "engine2/test/assert_macros.h"
+#include "engine2/visibility.h"
+
+namespace engine2 {
+namespace test {
+namespace {
+
+const Vec<int64_t, 2> kTileSize{16, 16};
+// Three chunks across and two down, the last of each partly off the map.
+const Vec<int64_t, 2> kGridSize{150, 100};
+constexpr int kLayerCount = 2;
+constexpr int kWallTag = 0;
+constexpr uint16_t kWall = 1;
+
+// Never 0, so generated tiles can be told from empty ones.
+uint16_t GetExpectedIndex(int64_t x, int64_t y, int layer) {
+  return 1 + (x * 7 + y * 13 + layer) % 5;
+}
+
+class TestGenerator : public ChunkGenerator {
+ public:
+  void GenerateChunk(const Rect<>& grid_rect,
+                     int layer_count,
+                     uint16_t* tiles) override {
+    for (int64_t y = 0; y < grid_rect.h(); ++y) {
+      for (int64_t x = 0; x < grid_rect.w(); ++x) {
+        for (int layer = 0; layer < layer_count; ++layer) {
+          tiles[(y * TileMap::kChunkSize + x) * layer_count + layer] =
+              GetExpectedIndex(grid_rect.x() + x, grid_rect.y() + y, layer);
+        }
+      }
+    }
+  }
+};
+
+std::unique_ptr<TileMap> CreateMap() {
+  auto map = std::make_unique<TileMap>(kTileSize, kGridSize, kLayerCount,
+                                       Point<>{}, /*sprite_cache=*/nullptr);
+  std::vector<TileMap::Tile> tiles(6, TileMap::Tile{nullptr});
+  tiles[kWall].SetTag(kWallTag, true);
+  map->AddTiles(tiles);
+  return map;
+}
+
+bool MatchesGenerator(const TileMap& map) {
+  for (int64_t y = 0; y < kGridSize.y(); ++y) {
+    for (int64_t x = 0; x < kGridSize.x(); ++x) {
+      for (int layer = 0; layer < kLayerCount; ++layer) {
+        if (map.GetTileIndex({x, y}, layer) != GetExpectedIndex(x, y, layer))
+          return false;
+      }
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+void MapGeneratorTest::TestGenerate() {
+  auto map = CreateMap();
+  WorkerPool pool(2);
+  MapGenerator generator(map.get(), std::make_unique<TestGenerator>(), &pool);
+  MapGenerator::Progress progress = generator.GetProgress();
+  EXPECT_EQ(0, progress.finished_chunk_count);
+  EXPECT_EQ(6, progress.chunk_count);
+
+  for (int i = 0; i < 10000 && !generator.IsDone(); ++i) {
+    generator.Update();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  ASSERT_TRUE(generator.IsDone());
+  progress = generator.GetProgress();
+  EXPECT_EQ(6, progress.finished_chunk_count);
+  EXPECT_TRUE(progress.tiles_per_second >= progress.chunks_per_second);
+  bool matches = MatchesGenerator(*map);
+  EXPECT_TRUE(matches);
+}
+
+void MapGeneratorTest::TestFocus() {
+  auto map = CreateMap();
+  MapGenerator generator(map.get(), std::make_unique<TestGenerator>(),
+                         /*pool=*/nullptr);
+  // Without a pool, each update makes one chunk, nearest the focus first.
+  generator.SetFocus({{2200, 1500}, {32, 32}});
+  generator.Update();
+  uint16_t index = map->GetTileIndex({140, 90}, 0);
+  EXPECT_EQ(GetExpectedIndex(140, 90, 0), index);
+  index = map->GetTileIndex({0, 0}, 0);
+  EXPECT_EQ(0, index);
+
+  generator.SetFocus({{0, 0}, {32, 32}});
+  generator.Update();
+  index = map->GetTileIndex({0, 0}, 1);
+  EXPECT_EQ(GetExpectedIndex(0, 0, 1), index);
+  index = map->GetTileIndex({70, 0}, 0);
+  EXPECT_EQ(0, index);
+  MapGenerator::Progress progress = generator.GetProgress();
+  EXPECT_EQ(2, progress.finished_chunk_count);
+
+  for (int i = 0; i < 4; ++i)
+    generator.Update();
+  ASSERT_TRUE(generator.IsDone());
+  bool matches = MatchesGenerator(*map);
+  EXPECT_TRUE(matches);
+}
+
+void MapGeneratorTest::TestListeners() {
+  auto map = CreateMap();
+  map->SetTagIndexEnabled(true);
+  Visibility visibility(map.get(), kWallTag, /*pool=*/nullptr);
+  MapGenerator generator(map.get(), std::make_unique<TestGenerator>(),
+                         /*pool=*/nullptr);
+  while (!generator.IsDone())
+    generator.Update();
+
+  for (int64_t y = 0; y < kGridSize.y(); ++y) {
+    for (int64_t x = 0; x < kGridSize.x(); ++x) {
+      bool wall = GetExpectedIndex(x, y, 0) == kWall ||
+                  GetExpectedIndex(x, y, 1) == kWall;
+      bool tagged = map->GetTagGrid(kWallTag, 0)->Get({x, y}) ||
+                    map->GetTagGrid(kWallTag, 1)->Get({x, y});
+      ASSERT_EQ(wall, tagged);
+      bool opaque = visibility.IsOpaque({x, y});
+      ASSERT_EQ(wall, opaque);
+    }
+  }
+}
+
+MapGeneratorTest::MapGeneratorTest()
+    : TestGroup("MapGeneratorTest",
+                {
+                    std::bind(&MapGeneratorTest::TestGenerate, this),
+                    std::bind(&MapGeneratorTest::TestFocus, this),
+                    std::bind(&MapGeneratorTest::TestListeners, this),
+                }) {}
+
+}  // namespace test
+}  // namespace engine2
@@ -0,0 +1,20 @@
+#ifndef ENGINE2_MAP_GENERATOR_TEST_H_
+#define ENGINE2_MAP_GENERATOR_TEST_H_
+
+#include "engine2/test/test_group.h"
+
+namespace engine2 {
+namespace test {
+
+class MapGeneratorTest : public TestGroup {
+ public:
+  void TestGenerate();
+  void TestFocus();
+  void TestListeners();
+  MapGeneratorTest();
+};
+
+}  // namespace test
+}  // namespace engine2
+
+#endif  // ENGINE2_MAP_GENERATOR_TEST_H_
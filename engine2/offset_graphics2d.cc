@@ -66,6 +66,35 @@ Graphics2D* OffsetGraphics2D::DrawTexture(const Texture& texture,
   return this;
 }
 
+Graphics2D* OffsetGraphics2D::DrawGeometry(const Texture& texture,
+                                           const SDL_Vertex* vertices,
+                                           int vertex_count,
+                                           const int* indices,
+                                           int index_count) {
+  offset_vertices_.assign(vertices, vertices + vertex_count);
+  for (SDL_Vertex& vertex : offset_vertices_) {
+    vertex.position.x -= offset_->x();
+    vertex.position.y -= offset_->y();
+  }
+  graphics_->DrawGeometry(texture, offset_vertices_.data(), vertex_count,
+                          indices, index_count);
+  return this;
+}
+
+std::unique_ptr<Texture> OffsetGraphics2D::CreateTargetTexture(int width,
+                                                               int height) {
+  return graphics_->CreateTargetTexture(width, height);
+}
+
+Graphics2D* OffsetGraphics2D::SetRenderTarget(Texture* texture) {
+  graphics_->SetRenderTarget(texture);
+  return this;
+}
+
+Texture* OffsetGraphics2D::GetRenderTarget() {
+  return graphics_->GetRenderTarget();
+}
+
 Graphics2D* OffsetGraphics2D::Clear() {
   graphics_->Clear();
   return this;
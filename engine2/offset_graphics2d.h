@@ -1,6 +1,8 @@
 #ifndef ENGINE2_OFFSET_GRAPHICS2D_H_
 #define ENGINE2_OFFSET_GRAPHICS2D_H_
 
+#include <vector>
+
 #include "engine2/graphics2d.h"
 
 namespace engine2 {
@@ -27,6 +29,15 @@ class OffsetGraphics2D : public Graphics2D {
   Graphics2D* DrawTexture(const Texture& texture,
                           const Rect<>& src,
                           const Rect<>& dest) override;
+  Graphics2D* DrawGeometry(const Texture& texture,
+                           const SDL_Vertex* vertices,
+                           int vertex_count,
+                           const int* indices,
+                           int index_count) override;
+
+  std::unique_ptr<Texture> CreateTargetTexture(int width, int height) override;
+  Graphics2D* SetRenderTarget(Texture* texture) override;
+  Texture* GetRenderTarget() override;
 
   Graphics2D* Clear() override;
   Graphics2D* Present() override;
@@ -41,6 +52,8 @@ class OffsetGraphics2D : public Graphics2D {
   Rect<> OffsetRect(const Rect<>& rect) const;
   Graphics2D* graphics_;
   Point<>* offset_;
+  // Reused by DrawGeometry().
+  std::vector<SDL_Vertex> offset_vertices_;
 };
 
 }  // namespace engine2
@@ -0,0 +1,680 @@
+#include "engine2/pathfinder.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <queue>
+#include <unordered_map>
+#include <utility>
+
+namespace engine2 {
+namespace {
+
+constexpr double kInfinity = std::numeric_limits<double>::infinity();
+constexpr double kDiagonalCost = 1.4142135623730951;
+
+const Point<> kDirections[] = {{1, 0},  {-1, 0}, {0, 1},  {0, -1},
+                               {1, 1},  {1, -1}, {-1, 1}, {-1, -1}};
+
+// Bookkeeping for one tile during a search.
+struct SearchRecord {
+  double cost = 0;
+  int64_t parent = -1;
+  bool closed = false;
+};
+
+// A search's open list, cheapest estimate first, of tile keys.
+using OpenList = std::priority_queue<std::pair<double, int64_t>,
+                                     std::vector<std::pair<double, int64_t>>,
+                                     std::greater<std::pair<double, int64_t>>>;
+
+// The cost of the shortest way from |a| to |b| if there are no walls.
+double OctileDistance(const Point<>& a, const Point<>& b) {
+  int64_t dx = std::abs(a.x() - b.x());
+  int64_t dy = std::abs(a.y() - b.y());
+  return std::max(dx, dy) + (kDiagonalCost - 1) * std::min(dx, dy);
+}
+
+int64_t Sign(int64_t value) {
+  return (value > 0) - (value < 0);
+}
+
+}  // namespace
+
+Pathfinder::Pathfinder(TileMap* map, int blocking_tag, WorkerPool* pool)
+    : map_(map),
+      blocking_tag_(blocking_tag),
+      pool_(pool),
+      grid_size_(map->GetGridSize()),
+      cluster_grid_size_(
+          (grid_size_ + Vec<int64_t, 2>::Fill(kClusterSize - 1)) /
+          Vec<int64_t, 2>::Fill(kClusterSize)) {
+  if (!map_->IsTagIndexEnabled())
+    map_->SetTagIndexEnabled(true);
+  map_->AddChangeListener(this);
+  BuildBlocked();
+
+  int cluster_count = cluster_grid_size_.x() * cluster_grid_size_.y();
+  clusters_.resize(cluster_count);
+  right_borders_.resize(cluster_count);
+  bottom_borders_.resize(cluster_count);
+  for (int i = 0; i < cluster_count; ++i) {
+    Point<> corner{i % cluster_grid_size_.x() * kClusterSize,
+                   i / cluster_grid_size_.x() * kClusterSize};
+    Rect<> rect{corner, Vec<int64_t, 2>::Fill(kClusterSize)};
+    clusters_[i].rect = rect.GetOverlap({{0, 0}, grid_size_});
+  }
+}
+
+Pathfinder::~Pathfinder() {
+  map_->RemoveChangeListener(this);
+  std::unique_lock<std::mutex> lock(requests_mutex_);
+  requests_done_.wait(lock, [this] { return running_requests_ == 0; });
+}
+
+bool Pathfinder::IsBlocked(const TileMap::GridPoint& point) const {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  return !IsOpen(point, {{0, 0}, grid_size_});
+}
+
+Pathfinder::Path Pathfinder::FindPath(const TileMap::GridPoint& start,
+                                      const TileMap::GridPoint& goal) {
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  Repair();
+  return Search(start, goal);
+}
+
+void Pathfinder::RequestPath(const TileMap::GridPoint& start,
+                             const TileMap::GridPoint& goal,
+                             Callback callback) {
+  queued_requests_.push_back({start, goal, std::move(callback)});
+}
+
+void Pathfinder::Update() {
+  {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    Repair();
+  }
+
+  std::vector<Request> requests = std::move(queued_requests_);
+  queued_requests_.clear();
+  if (!pool_) {
+    for (Request& request : requests) {
+      std::shared_lock<std::shared_mutex> lock(mutex_);
+      request.path = Search(request.start, request.goal);
+    }
+    std::lock_guard<std::mutex> lock(requests_mutex_);
+    std::move(requests.begin(), requests.end(),
+              std::back_inserter(finished_requests_));
+  } else {
+    for (size_t first = 0; first < requests.size(); first += kBatchSize) {
+      auto begin = requests.begin() + first;
+      auto end = requests.begin() + std::min(first + kBatchSize,
+                                             requests.size());
+      auto batch = std::make_shared<std::vector<Request>>(
+          std::make_move_iterator(begin), std::make_move_iterator(end));
+      {
+        std::lock_guard<std::mutex> lock(requests_mutex_);
+        running_requests_ += batch->size();
+      }
+      pool_->Post([this, batch] {
+        // Edits can get in between requests, but not during one.
+        for (Request& request : *batch) {
+          std::shared_lock<std::shared_mutex> lock(mutex_);
+          request.path = Search(request.start, request.goal);
+        }
+        std::lock_guard<std::mutex> lock(requests_mutex_);
+        std::move(batch->begin(), batch->end(),
+                  std::back_inserter(finished_requests_));
+        running_requests_ -= batch->size();
+        requests_done_.notify_all();
+      });
+    }
+  }
+
+  std::vector<Request> finished;
+  {
+    std::lock_guard<std::mutex> lock(requests_mutex_);
+    finished.swap(finished_requests_);
+  }
+  for (Request& request : finished)
+    request.callback(std::move(request.path));
+}
+
+int Pathfinder::GetPendingRequestCount() const {
+  std::lock_guard<std::mutex> lock(requests_mutex_);
+  return queued_requests_.size() + running_requests_ +
+         finished_requests_.size();
+}
+
+void Pathfinder::OnTileChanged(const TileMap::GridPoint& point, int layer) {
+  bool blocked = false;
+  for (int i = 0; i < map_->GetLayerCount() && !blocked; ++i) {
+    const BitGrid* grid = map_->GetTagGrid(blocking_tag_, i);
+    blocked = grid && grid->Get(point);
+  }
+
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  if (blocked_.Get(point) == blocked)
+    return;
+  blocked_.Set(point, blocked);
+  clusters_[GetClusterIndex(point)].dirty = true;
+  any_dirty_ = true;
+}
+
+void Pathfinder::OnRectChanged(const Rect<>& grid_rect) {
+  std::vector<const BitGrid*> grids;
+  for (int layer = 0; layer < map_->GetLayerCount(); ++layer) {
+    if (const BitGrid* grid = map_->GetTagGrid(blocking_tag_, layer))
+      grids.push_back(grid);
+  }
+
+  // Locks once for the whole rect instead of once per tile.
+  Rect<> rect = grid_rect.GetOverlap({{0, 0}, grid_size_});
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  Point<> point;
+  for (point.y() = rect.y(); point.y() < rect.y() + rect.h(); ++point.y()) {
+    for (point.x() = rect.x(); point.x() < rect.x() + rect.w(); ++point.x()) {
+      bool blocked = false;
+      for (const BitGrid* grid : grids)
+        blocked = blocked || grid->Get(point);
+      if (blocked_.Get(point) == blocked)
+        continue;
+      blocked_.Set(point, blocked);
+      clusters_[GetClusterIndex(point)].dirty = true;
+      any_dirty_ = true;
+    }
+  }
+}
+
+void Pathfinder::OnTileSetChanged() {
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  BuildBlocked();
+  for (Cluster& cluster : clusters_)
+    cluster.dirty = true;
+  any_dirty_ = true;
+}
+
+void Pathfinder::BuildBlocked() {
+  blocked_ = BitGrid(grid_size_);
+  for (int layer = 0; layer < map_->GetLayerCount(); ++layer) {
+    if (const BitGrid* grid = map_->GetTagGrid(blocking_tag_, layer))
+      blocked_ |= *grid;
+  }
+}
+
+void Pathfinder::Repair() {
+  if (!any_dirty_)
+    return;
+
+  int64_t columns = cluster_grid_size_.x();
+  int64_t rows = cluster_grid_size_.y();
+  std::vector<int> rebuild;
+  std::vector<bool> queued(clusters_.size());
+  auto queue = [&rebuild, &queued](int index) {
+    if (!queued[index]) {
+      queued[index] = true;
+      rebuild.push_back(index);
+    }
+  };
+  for (int i = 0; i < clusters_.size(); ++i) {
+    if (!clusters_[i].dirty)
+      continue;
+    queue(i);
+    int64_t x = i % columns;
+    int64_t y = i / columns;
+    if (x + 1 < columns) {
+      right_borders_[i] = BuildBorder(i, /*right=*/true);
+      queue(i + 1);
+    }
+    if (x > 0) {
+      right_borders_[i - 1] = BuildBorder(i - 1, /*right=*/true);
+      queue(i - 1);
+    }
+    if (y + 1 < rows) {
+      bottom_borders_[i] = BuildBorder(i, /*right=*/false);
+      queue(i + columns);
+    }
+    if (y > 0) {
+      bottom_borders_[i - columns] = BuildBorder(i - columns, /*right=*/false);
+      queue(i - columns);
+    }
+  }
+
+  // Clusters only write to themselves, so they can be built in parallel.
+  auto build = [this, &rebuild](int64_t i) { BuildCluster(rebuild[i]); };
+  if (pool_) {
+    pool_->ParallelFor(rebuild.size(), build);
+  } else {
+    for (int64_t i = 0; i < rebuild.size(); ++i)
+      build(i);
+  }
+  any_dirty_ = false;
+}
+
+Pathfinder::Border Pathfinder::BuildBorder(int index, bool right) const {
+  const Rect<>& rect = clusters_[index].rect;
+  Point<> along = right ? Point<>{0, 1} : Point<>{1, 0};
+  Point<> across = right ? Point<>{1, 0} : Point<>{0, 1};
+  Point<> first = right ? Point<>{rect.x() + rect.w() - 1, rect.y()}
+                        : Point<>{rect.x(), rect.y() + rect.h() - 1};
+  int64_t length = right ? rect.h() : rect.w();
+  Rect<> map_rect{{0, 0}, grid_size_};
+
+  Border border;
+  auto add_entrance = [&](int64_t i) {
+    Point<> cell = first + along * i;
+    border.push_back({cell, cell + across});
+  };
+  int64_t run_start = -1;
+  for (int64_t i = 0; i <= length; ++i) {
+    Point<> cell = first + along * i;
+    bool open = i < length && IsOpen(cell, map_rect) &&
+                IsOpen(cell + across, map_rect);
+    if (open && run_start < 0) {
+      run_start = i;
+    } else if (!open && run_start >= 0) {
+      if (i - run_start >= kLongEntranceSize) {
+        add_entrance(run_start);
+        add_entrance(i - 1);
+      } else {
+        add_entrance(run_start + (i - run_start) / 2);
+      }
+      run_start = -1;
+    }
+  }
+  return border;
+}
+
+void Pathfinder::BuildCluster(int index) {
+  Cluster& cluster = clusters_[index];
+  cluster.nodes.clear();
+  auto add_node = [&cluster](const Point<>& cell, const Point<>& partner) {
+    for (Node& node : cluster.nodes) {
+      if (node.cell == cell) {
+        node.partners.push_back(partner);
+        return;
+      }
+    }
+    cluster.nodes.push_back({cell, {partner}});
+  };
+  int64_t columns = cluster_grid_size_.x();
+  for (const auto& entrance : right_borders_[index])
+    add_node(entrance.first, entrance.second);
+  for (const auto& entrance : bottom_borders_[index])
+    add_node(entrance.first, entrance.second);
+  if (index % columns > 0) {
+    for (const auto& entrance : right_borders_[index - 1])
+      add_node(entrance.second, entrance.first);
+  }
+  if (index >= columns) {
+    for (const auto& entrance : bottom_borders_[index - columns])
+      add_node(entrance.second, entrance.first);
+  }
+
+  const Rect<>& rect = cluster.rect;
+  int node_count = cluster.nodes.size();
+  cluster.distances.assign(node_count * node_count, kInfinity);
+  for (int i = 0; i < node_count; ++i) {
+    std::vector<double> distances = GetDistances(cluster.nodes[i].cell, rect);
+    for (int j = 0; j < node_count; ++j) {
+      const Point<>& cell = cluster.nodes[j].cell;
+      cluster.distances[i * node_count + j] =
+          distances[(cell.y() - rect.y()) * rect.w() + cell.x() - rect.x()];
+    }
+  }
+  cluster.dirty = false;
+}
+
+Pathfinder::Path Pathfinder::Search(const Point<>& start,
+                                    const Point<>& goal) const {
+  Rect<> map_rect{{0, 0}, grid_size_};
+  if (!IsOpen(start, map_rect) || !IsOpen(goal, map_rect))
+    return {};
+
+  std::vector<Point<>> cells{start};
+  bool found = false;
+  if (any_dirty_) {
+    // The map changed since the last repair, so the hierarchy may be wrong.
+    found = SearchGrid(start, goal, map_rect, &cells);
+  } else {
+    int start_cluster = GetClusterIndex(start);
+    if (start_cluster == GetClusterIndex(goal)) {
+      found =
+          SearchGrid(start, goal, clusters_[start_cluster].rect, &cells);
+    }
+    std::vector<Point<>> waypoints;
+    if (!found && SearchClusters(start, goal, &waypoints)) {
+      found = true;
+      for (size_t i = 1; found && i < waypoints.size(); ++i) {
+        int cluster = GetClusterIndex(waypoints[i - 1]);
+        if (cluster == GetClusterIndex(waypoints[i])) {
+          found = SearchGrid(waypoints[i - 1], waypoints[i],
+                             clusters_[cluster].rect, &cells);
+        } else {
+          cells.push_back(waypoints[i]);
+        }
+      }
+    }
+  }
+  if (!found)
+    return {};
+
+  Path path;
+  path.reserve(cells.size());
+  for (const Point<>& cell : cells)
+    path.push_back({cell.x(), cell.y()});
+  return path;
+}
+
+bool Pathfinder::SearchGrid(const Point<>& start,
+                            const Point<>& goal,
+                            const Rect<>& bounds,
+                            std::vector<Point<>>* path) const {
+  if (!IsOpen(start, bounds) || !IsOpen(goal, bounds))
+    return false;
+  if (start == goal)
+    return true;
+
+  std::unordered_map<int64_t, SearchRecord> records;
+  OpenList open;
+  int64_t start_key = GetKey(start);
+  int64_t goal_key = GetKey(goal);
+  records[start_key] = {};
+  open.push({OctileDistance(start, goal), start_key});
+  while (!open.empty()) {
+    int64_t key = open.top().second;
+    open.pop();
+    SearchRecord& record = records[key];
+    if (record.closed)
+      continue;
+    record.closed = true;
+    double cost = record.cost;
+
+    if (key == goal_key) {
+      // Walk back over the jump points, then fill in the tiles between them,
+      // which are always in a straight or diagonal line.
+      std::vector<Point<>> jump_points;
+      for (int64_t k = key; k != start_key; k = records[k].parent)
+        jump_points.push_back(GetPoint(k));
+      Point<> point = start;
+      for (auto it = jump_points.rbegin(); it != jump_points.rend(); ++it) {
+        Point<> step{Sign(it->x() - point.x()), Sign(it->y() - point.y())};
+        while (!(point == *it)) {
+          point = point + step;
+          path->push_back(point);
+        }
+      }
+      return true;
+    }
+
+    // Only look past the neighbours that a shortest path through this tile
+    // could go to next.
+    Point<> point = GetPoint(key);
+    int64_t x = point.x();
+    int64_t y = point.y();
+    auto is_open = [this, &bounds](int64_t x, int64_t y) {
+      return IsOpen({x, y}, bounds);
+    };
+    Point<> neighbours[8];
+    int neighbour_count = 0;
+    auto add = [&neighbours, &neighbour_count](int64_t x, int64_t y) {
+      neighbours[neighbour_count++] = {x, y};
+    };
+    if (record.parent < 0) {
+      for (const Point<>& d : kDirections) {
+        if (!d.x() || !d.y() ||
+            (is_open(x + d.x(), y) && is_open(x, y + d.y()))) {
+          add(x + d.x(), y + d.y());
+        }
+      }
+    } else {
+      Point<> parent = GetPoint(record.parent);
+      int64_t dx = Sign(x - parent.x());
+      int64_t dy = Sign(y - parent.y());
+      if (dx && dy) {
+        bool horizontal = is_open(x + dx, y);
+        bool vertical = is_open(x, y + dy);
+        if (vertical)
+          add(x, y + dy);
+        if (horizontal)
+          add(x + dx, y);
+        if (horizontal && vertical)
+          add(x + dx, y + dy);
+      } else if (dx) {
+        bool next = is_open(x + dx, y);
+        bool below = is_open(x, y + 1);
+        bool above = is_open(x, y - 1);
+        if (next) {
+          add(x + dx, y);
+          if (below)
+            add(x + dx, y + 1);
+          if (above)
+            add(x + dx, y - 1);
+        }
+        if (below)
+          add(x, y + 1);
+        if (above)
+          add(x, y - 1);
+      } else {
+        bool next = is_open(x, y + dy);
+        bool left = is_open(x - 1, y);
+        bool right = is_open(x + 1, y);
+        if (next) {
+          add(x, y + dy);
+          if (left)
+            add(x - 1, y + dy);
+          if (right)
+            add(x + 1, y + dy);
+        }
+        if (left)
+          add(x - 1, y);
+        if (right)
+          add(x + 1, y);
+      }
+    }
+
+    for (int i = 0; i < neighbour_count; ++i) {
+      const Point<>& neighbour = neighbours[i];
+      Point<> direction{neighbour.x() - x, neighbour.y() - y};
+      Point<> jump_point;
+      if (!Jump(neighbour, direction, goal, bounds, &jump_point))
+        continue;
+
+      double jump_cost = cost + OctileDistance(point, jump_point);
+      auto inserted = records.try_emplace(GetKey(jump_point));
+      SearchRecord& jump_record = inserted.first->second;
+      if (!inserted.second &&
+          (jump_record.closed || jump_record.cost <= jump_cost)) {
+        continue;
+      }
+      jump_record.cost = jump_cost;
+      jump_record.parent = key;
+      open.push({jump_cost + OctileDistance(jump_point, goal),
+                 inserted.first->first});
+    }
+  }
+  return false;
+}
+
+bool Pathfinder::SearchClusters(const Point<>& start,
+                                const Point<>& goal,
+                                std::vector<Point<>>* waypoints) const {
+  const Cluster& start_cluster = clusters_[GetClusterIndex(start)];
+  int goal_cluster_index = GetClusterIndex(goal);
+  const Cluster& goal_cluster = clusters_[goal_cluster_index];
+  std::vector<double> from_start = GetDistances(start, start_cluster.rect);
+  std::vector<double> to_goal = GetDistances(goal, goal_cluster.rect);
+  auto distance_at = [](const std::vector<double>& distances,
+                        const Rect<>& rect, const Point<>& cell) {
+    return distances[(cell.y() - rect.y()) * rect.w() + cell.x() - rect.x()];
+  };
+
+  std::unordered_map<int64_t, SearchRecord> records;
+  OpenList open;
+  auto relax = [&](int64_t from, double from_cost, const Point<>& to,
+                   double distance) {
+    if (distance == kInfinity)
+      return;
+    double cost = from_cost + distance;
+    auto inserted = records.try_emplace(GetKey(to));
+    SearchRecord& record = inserted.first->second;
+    if (!inserted.second && (record.closed || record.cost <= cost))
+      return;
+    record.cost = cost;
+    record.parent = from;
+    open.push({cost + OctileDistance(to, goal), inserted.first->first});
+  };
+
+  int64_t start_key = GetKey(start);
+  int64_t goal_key = GetKey(goal);
+  records[start_key] = {};
+  open.push({OctileDistance(start, goal), start_key});
+  while (!open.empty()) {
+    int64_t key = open.top().second;
+    open.pop();
+    SearchRecord& record = records[key];
+    if (record.closed)
+      continue;
+    record.closed = true;
+    double cost = record.cost;
+
+    if (key == goal_key) {
+      for (int64_t k = key; k != -1; k = records[k].parent)
+        waypoints->push_back(GetPoint(k));
+      std::reverse(waypoints->begin(), waypoints->end());
+      return true;
+    }
+
+    Point<> cell = GetPoint(key);
+    int cluster_index = GetClusterIndex(cell);
+    const Cluster& cluster = clusters_[cluster_index];
+    if (key == start_key) {
+      for (const Node& node : start_cluster.nodes) {
+        relax(key, cost, node.cell,
+              distance_at(from_start, start_cluster.rect, node.cell));
+      }
+    }
+    if (const Node* node = FindNode(cluster, cell)) {
+      int node_count = cluster.nodes.size();
+      int i = node - cluster.nodes.data();
+      for (int j = 0; j < node_count; ++j) {
+        relax(key, cost, cluster.nodes[j].cell,
+              cluster.distances[i * node_count + j]);
+      }
+      for (const Point<>& partner : node->partners)
+        relax(key, cost, partner, 1);
+    }
+    if (cluster_index == goal_cluster_index)
+      relax(key, cost, goal, distance_at(to_goal, goal_cluster.rect, cell));
+  }
+  return false;
+}
+
+bool Pathfinder::Jump(Point<> point,
+                      const Point<>& direction,
+                      const Point<>& goal,
+                      const Rect<>& bounds,
+                      Point<>* jump_point) const {
+  int64_t dx = direction.x();
+  int64_t dy = direction.y();
+  auto is_open = [this, &bounds](int64_t x, int64_t y) {
+    return IsOpen({x, y}, bounds);
+  };
+  while (true) {
+    int64_t x = point.x();
+    int64_t y = point.y();
+    if (!is_open(x, y))
+      return false;
+
+    // Stop where a path might turn, which is where a wall ends beside the
+    // way we're going, or where a straight jump from a diagonal finds one.
+    bool turn = point == goal;
+    if (dx && dy) {
+      Point<> unused;
+      turn = turn || Jump({x + dx, y}, {dx, 0}, goal, bounds, &unused) ||
+             Jump({x, y + dy}, {0, dy}, goal, bounds, &unused);
+    } else if (dx) {
+      turn = turn || (is_open(x, y - 1) && !is_open(x - dx, y - 1)) ||
+             (is_open(x, y + 1) && !is_open(x - dx, y + 1));
+    } else {
+      turn = turn || (is_open(x - 1, y) && !is_open(x - 1, y - dy)) ||
+             (is_open(x + 1, y) && !is_open(x + 1, y - dy));
+    }
+    if (turn) {
+      *jump_point = point;
+      return true;
+    }
+
+    if (!is_open(x + dx, y) || !is_open(x, y + dy))
+      return false;
+    point = {x + dx, y + dy};
+  }
+}
+
+std::vector<double> Pathfinder::GetDistances(const Point<>& from,
+                                             const Rect<>& bounds) const {
+  std::vector<double> distances(bounds.w() * bounds.h(), kInfinity);
+  if (!IsOpen(from, bounds))
+    return distances;
+
+  auto index_of = [&bounds](const Point<>& point) {
+    return (point.y() - bounds.y()) * bounds.w() + point.x() - bounds.x();
+  };
+  OpenList open;
+  distances[index_of(from)] = 0;
+  open.push({0, index_of(from)});
+  while (!open.empty()) {
+    double distance = open.top().first;
+    int64_t index = open.top().second;
+    open.pop();
+    if (distance > distances[index])
+      continue;
+
+    Point<> point{bounds.x() + index % bounds.w(),
+                  bounds.y() + index / bounds.w()};
+    for (const Point<>& d : kDirections) {
+      Point<> next = point + d;
+      if (!IsOpen(next, bounds))
+        continue;
+      bool diagonal = d.x() && d.y();
+      if (diagonal && (!IsOpen({point.x() + d.x(), point.y()}, bounds) ||
+                       !IsOpen({point.x(), point.y() + d.y()}, bounds))) {
+        continue;
+      }
+      double next_distance = distance + (diagonal ? kDiagonalCost : 1);
+      int64_t next_index = index_of(next);
+      if (next_distance < distances[next_index]) {
+        distances[next_index] = next_distance;
+        open.push({next_distance, next_index});
+      }
+    }
+  }
+  return distances;
+}
+
+int Pathfinder::GetClusterIndex(const Point<>& point) const {
+  return point.y() / kClusterSize * cluster_grid_size_.x() +
+         point.x() / kClusterSize;
+}
+
+const Pathfinder::Node* Pathfinder::FindNode(const Cluster& cluster,
+                                             const Point<>& cell) const {
+  for (const Node& node : cluster.nodes) {
+    if (node.cell == cell)
+      return &node;
+  }
+  return nullptr;
+}
+
+int64_t Pathfinder::GetKey(const Point<>& point) const {
+  return point.y() * grid_size_.x() + point.x();
+}
+
+Point<> Pathfinder::GetPoint(int64_t key) const {
+  return {key % grid_size_.x(), key / grid_size_.x()};
+}
+
+}  // namespace engine2
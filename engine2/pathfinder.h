@@ -0,0 +1,175 @@
+#ifndef ENGINE2_PATHFINDER_H_
+#define ENGINE2_PATHFINDER_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+
+#include "engine2/base/bit_grid.h"
+#include "engine2/base/worker_pool.h"
+#include "engine2/tile_map.h"
+
+namespace engine2 {
+
+// Finds paths between tiles of a TileMap, treating tiles with a blocking tag
+// on any layer as walls. Paths move to any of the 8 neighbouring tiles, but
+// never diagonally past the corner of a wall.
+//
+// Searches run on a two-level hierarchy (HPA*): the map is cut into square
+// clusters, the open stretches of each border between clusters become
+// entrances, and the distances between the entrances of each cluster are
+// kept. A path is found over the entrances first, then each step is refined
+// with jump point search inside one cluster. Paths are close to the
+// shortest, but not always the shortest.
+//
+// Edits to the map mark the clusters they touch, which are repaired by the
+// next FindPath() or Update().
+class Pathfinder : public TileMap::ChangeListener {
+ public:
+  // Clusters are square blocks of this many tiles per side.
+  static constexpr int kClusterSize = 16;
+  // Open stretches of a cluster border at least this long get an entrance at
+  // each end, instead of one in the middle.
+  static constexpr int kLongEntranceSize = 6;
+  // Update() hands requests to the worker pool in batches of this many.
+  static constexpr int kBatchSize = 16;
+
+  using Path = std::vector<TileMap::GridPoint>;
+  using Callback = std::function<void(Path path)>;
+
+  // Turns on |map|'s tag index, which must stay on. With a null |pool|,
+  // Update() finds paths on the calling thread. |map| and |pool| must outlive
+  // the pathfinder.
+  Pathfinder(TileMap* map, int blocking_tag, WorkerPool* pool);
+  // Waits for requests that are being worked on. Their callbacks aren't
+  // called.
+  ~Pathfinder() override;
+  Pathfinder(const Pathfinder&) = delete;
+  Pathfinder& operator=(const Pathfinder&) = delete;
+
+  // True for walls and points outside the map.
+  bool IsBlocked(const TileMap::GridPoint& point) const;
+
+  // Returns the tiles from |start| to |goal|, including both, or an empty
+  // path if there's no way through.
+  Path FindPath(const TileMap::GridPoint& start,
+                const TileMap::GridPoint& goal);
+
+  // Queues a request for a path, which Update() finds and then passes to
+  // |callback|.
+  void RequestPath(const TileMap::GridPoint& start,
+                   const TileMap::GridPoint& goal,
+                   Callback callback);
+  // Repairs the hierarchy, starts the queued requests and calls the callbacks
+  // of the finished ones, on the calling thread. Call once a frame.
+  void Update();
+  // Requests whose callbacks haven't been called yet.
+  int GetPendingRequestCount() const;
+
+  // TileMap::ChangeListener:
+  void OnTileChanged(const TileMap::GridPoint& point, int layer) override;
+  void OnTileSetChanged() override;
+  void OnRectChanged(const Rect<>& grid_rect) override;
+
+ private:
+  // An entrance tile of a cluster, and the tiles in other clusters it leads
+  // to.
+  struct Node {
+    Point<> cell;
+    std::vector<Point<>> partners;
+  };
+
+  struct Cluster {
+    Rect<> rect;
+    std::vector<Node> nodes;
+    // Distance from node i to node j at i * nodes.size() + j, or infinity if
+    // there's no way within the cluster.
+    std::vector<double> distances;
+    // Set when a tile in the cluster changes, until its borders and those of
+    // its neighbours are rebuilt.
+    bool dirty = true;
+  };
+
+  // Entrances on the border between two clusters, as pairs of tiles on
+  // either side.
+  using Border = std::vector<std::pair<Point<>, Point<>>>;
+
+  struct Request {
+    Point<> start;
+    Point<> goal;
+    Callback callback;
+    Path path;
+  };
+
+  // Reads the blocking tag of every layer into |blocked_|.
+  void BuildBlocked();
+  // Rebuilds the borders of dirty clusters, then the entrances and distances
+  // of the clusters next to them. Requires |mutex_| to be held exclusively.
+  void Repair();
+  // Finds the entrances on the right or bottom edge of cluster |index|.
+  Border BuildBorder(int index, bool right) const;
+  void BuildCluster(int index);
+
+  // Searches with |mutex_| held.
+  Path Search(const Point<>& start, const Point<>& goal) const;
+  // Jump point search confined to |bounds|. Appends the tiles after |start| up
+  // to |goal| to |path|.
+  bool SearchGrid(const Point<>& start,
+                  const Point<>& goal,
+                  const Rect<>& bounds,
+                  std::vector<Point<>>* path) const;
+  // Searches the hierarchy for a list of entrances from |start| to |goal|,
+  // including both.
+  bool SearchClusters(const Point<>& start,
+                      const Point<>& goal,
+                      std::vector<Point<>>* waypoints) const;
+  // Moves from |point| in |direction| until it reaches a jump point, which
+  // goes in |jump_point|. Returns false if it hits a wall or |bounds| first.
+  bool Jump(Point<> point,
+            const Point<>& direction,
+            const Point<>& goal,
+            const Rect<>& bounds,
+            Point<>* jump_point) const;
+  // Distances from |from| to every tile in |bounds|, row by row.
+  std::vector<double> GetDistances(const Point<>& from,
+                                   const Rect<>& bounds) const;
+
+  bool IsOpen(const Point<>& point, const Rect<>& bounds) const {
+    return bounds.Contains(point) && !blocked_.Get(point);
+  }
+  int GetClusterIndex(const Point<>& point) const;
+  // Returns the node of |cluster| at |cell|, or null if it isn't an entrance.
+  const Node* FindNode(const Cluster& cluster, const Point<>& cell) const;
+  int64_t GetKey(const Point<>& point) const;
+  Point<> GetPoint(int64_t key) const;
+
+  TileMap* map_;
+  int blocking_tag_;
+  WorkerPool* pool_;
+  Vec<int64_t, 2> grid_size_;
+  Vec<int64_t, 2> cluster_grid_size_;
+
+  // Guards everything the searches read. Workers share it while they search;
+  // edits and repairs take it exclusively.
+  mutable std::shared_mutex mutex_;
+  BitGrid blocked_;
+  std::vector<Cluster> clusters_;
+  // Borders between cluster i and the one to its right or below.
+  std::vector<Border> right_borders_;
+  std::vector<Border> bottom_borders_;
+  bool any_dirty_ = true;
+
+  std::vector<Request> queued_requests_;
+  // Guards the requests handed to the worker pool.
+  mutable std::mutex requests_mutex_;
+  std::condition_variable requests_done_;
+  std::vector<Request> finished_requests_;
+  int running_requests_ = 0;
+};
+
+}  // namespace engine2
+
+#endif  // ENGINE2_PATHFINDER_H_
@@ -0,0 +1,303 @@
+#include "engine2/pathfinder.h"
+#include "engine2/pathfinder_test.h"
+#include "engine2/test/assert_macros.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace engine2 {
+namespace test {
+namespace {
+
+const Vec<int64_t, 2> kTileSize{16, 16};
+constexpr int kWallTag = 0;
+constexpr uint16_t kFloor = 0;
+constexpr uint16_t kWall = 1;
+
+std::unique_ptr<TileMap> CreateMap(const Vec<int64_t, 2>& grid_size) {
+  auto map = std::make_unique<TileMap>(kTileSize, grid_size, /*layer_count=*/2,
+                                       Point<>{}, /*sprite_cache=*/nullptr);
+  TileMap::Tile wall{nullptr};
+  wall.SetTag(kWallTag, true);
+  map->AddTiles({{nullptr}, wall});
+  return map;
+}
+
+// Walls off column |x|, except for rows in [gap_begin, gap_end).
+void BuildWall(TileMap* map, int64_t x, int64_t gap_begin, int64_t gap_end) {
+  for (int64_t y = 0; y < map->GetGridSize().y(); ++y) {
+    if (y < gap_begin || y >= gap_end)
+      map->SetTileIndex({x, y}, /*layer=*/1, kWall);
+  }
+}
+
+// Returns the cost of |path|, or -1 if it isn't a valid path from |start| to
+// |goal|.
+double GetPathCost(TileMap* map,
+                   const Pathfinder::Path& path,
+                   const Point<>& start,
+                   const Point<>& goal) {
+  if (path.empty() || !(path.front() == start) || !(path.back() == goal))
+    return -1;
+  auto is_wall = [map](int64_t x, int64_t y) {
+    TileMap::GridPoint point{x, y};
+    for (int layer = 0; layer < map->GetLayerCount(); ++layer) {
+      TileMap::Tile* tile = map->GetTile(point, layer);
+      if (!tile || tile->HasTag(kWallTag))
+        return true;
+    }
+    return false;
+  };
+  double cost = 0;
+  for (size_t i = 0; i < path.size(); ++i) {
+    if (is_wall(path[i].x(), path[i].y()))
+      return -1;
+    if (i == 0)
+      continue;
+    int64_t dx = path[i].x() - path[i - 1].x();
+    int64_t dy = path[i].y() - path[i - 1].y();
+    if (std::abs(dx) > 1 || std::abs(dy) > 1 || (!dx && !dy))
+      return -1;
+    if (dx && dy) {
+      if (is_wall(path[i - 1].x() + dx, path[i - 1].y()) ||
+          is_wall(path[i - 1].x(), path[i - 1].y() + dy)) {
+        return -1;
+      }
+      cost += std::sqrt(2.0);
+    } else {
+      cost += 1;
+    }
+  }
+  return cost;
+}
+
+// The cost of the shortest path, by Dijkstra's algorithm over every tile, or
+// -1 if there isn't one.
+double GetShortestCost(Pathfinder* pathfinder,
+                       const Vec<int64_t, 2>& grid_size,
+                       const Point<>& start,
+                       const Point<>& goal) {
+  auto blocked = [pathfinder](int64_t x, int64_t y) {
+    return pathfinder->IsBlocked({x, y});
+  };
+  std::vector<double> costs(grid_size.x() * grid_size.y(), -1);
+  using Entry = std::pair<double, Point<>>;
+  auto greater = [](const Entry& a, const Entry& b) {
+    return a.first > b.first;
+  };
+  std::priority_queue<Entry, std::vector<Entry>, decltype(greater)> open(
+      greater);
+  open.push({0, start});
+  while (!open.empty()) {
+    Entry entry = open.top();
+    open.pop();
+    Point<> p = entry.second;
+    double& cost = costs[p.y() * grid_size.x() + p.x()];
+    if (cost >= 0)
+      continue;
+    cost = entry.first;
+    for (int64_t dy = -1; dy <= 1; ++dy) {
+      for (int64_t dx = -1; dx <= 1; ++dx) {
+        if ((!dx && !dy) || blocked(p.x() + dx, p.y() + dy))
+          continue;
+        if (dx && dy &&
+            (blocked(p.x() + dx, p.y()) || blocked(p.x(), p.y() + dy))) {
+          continue;
+        }
+        open.push({entry.first + (dx && dy ? std::sqrt(2.0) : 1),
+                   Point<>{p.x() + dx, p.y() + dy}});
+      }
+    }
+  }
+  return costs[goal.y() * grid_size.x() + goal.x()];
+}
+
+}  // namespace
+
+void PathfinderTest::TestFindPath() {
+  const Vec<int64_t, 2> kGridSize{40, 20};
+  auto map = CreateMap(kGridSize);
+  BuildWall(map.get(), 20, 18, 19);
+  Pathfinder pathfinder(map.get(), kWallTag, /*pool=*/nullptr);
+  bool blocked = pathfinder.IsBlocked({20, 0});
+  EXPECT_TRUE(blocked);
+  blocked = pathfinder.IsBlocked({20, 18});
+  EXPECT_FALSE(blocked);
+  blocked = pathfinder.IsBlocked({-1, 0});
+  EXPECT_TRUE(blocked);
+
+  Pathfinder::Path path = pathfinder.FindPath({5, 5}, {35, 5});
+  double cost = GetPathCost(map.get(), path, {5, 5}, {35, 5});
+  EXPECT_TRUE(cost > 0);
+  bool through_gap = false;
+  for (const TileMap::GridPoint& point : path)
+    through_gap = through_gap || (point.x() == 20 && point.y() == 18);
+  EXPECT_TRUE(through_gap);
+
+  // Within one cluster.
+  path = pathfinder.FindPath({1, 1}, {4, 3});
+  EXPECT_EQ(4, path.size());
+  cost = GetPathCost(map.get(), path, {1, 1}, {4, 3});
+  EXPECT_TRUE(std::abs(cost - (1 + 2 * std::sqrt(2.0))) < 1e-9);
+
+  path = pathfinder.FindPath({7, 7}, {7, 7});
+  EXPECT_EQ(1, path.size());
+}
+
+void PathfinderTest::TestNoPath() {
+  const Vec<int64_t, 2> kGridSize{40, 20};
+  auto map = CreateMap(kGridSize);
+  BuildWall(map.get(), 20, 0, 0);
+  Pathfinder pathfinder(map.get(), kWallTag, /*pool=*/nullptr);
+  EXPECT_EQ(0, pathfinder.FindPath({5, 5}, {35, 5}).size());
+  EXPECT_EQ(0, pathfinder.FindPath({5, 5}, {20, 5}).size());
+  EXPECT_EQ(0, pathfinder.FindPath({5, 5}, {40, 5}).size());
+
+  // Walls don't let paths squeeze diagonally between them.
+  map->SetTileIndex({20, 10}, 1, kFloor);
+  map->SetTileIndex({21, 10}, 1, kWall);
+  map->SetTileIndex({21, 9}, 1, kWall);
+  map->SetTileIndex({21, 11}, 1, kWall);
+  map->SetTileIndex({22, 10}, 1, kWall);
+  EXPECT_EQ(0, pathfinder.FindPath({5, 5}, {35, 5}).size());
+}
+
+void PathfinderTest::TestRepair() {
+  const Vec<int64_t, 2> kGridSize{64, 48};
+  auto map = CreateMap(kGridSize);
+  BuildWall(map.get(), 31, 40, 48);
+  Pathfinder pathfinder(map.get(), kWallTag, /*pool=*/nullptr);
+  Pathfinder::Path path = pathfinder.FindPath({2, 2}, {60, 2});
+  EXPECT_TRUE(GetPathCost(map.get(), path, {2, 2}, {60, 2}) > 0);
+
+  // Closing the gap on the cluster border, on either layer, cuts the map in
+  // two.
+  for (int64_t y = 40; y < 44; ++y)
+    map->SetTileIndex({31, y}, 0, kWall);
+  for (int64_t y = 44; y < 48; ++y)
+    map->SetTileIndex({31, y}, 1, kWall);
+  EXPECT_EQ(0, pathfinder.FindPath({2, 2}, {60, 2}).size());
+
+  // Opening one in the middle of a cluster joins it again.
+  map->SetTileIndex({31, 20}, 1, kFloor);
+  path = pathfinder.FindPath({2, 2}, {60, 2});
+  double cost = GetPathCost(map.get(), path, {2, 2}, {60, 2});
+  EXPECT_TRUE(cost > 0);
+  double shortest = GetShortestCost(&pathfinder, kGridSize, {2, 2}, {60, 2});
+  EXPECT_TRUE(cost < shortest * 1.2);
+
+  // So does replacing a whole chunk, here with one that walls off column 31.
+  auto tiles = std::make_unique<uint16_t[]>(TileMap::kChunkSize *
+                                            TileMap::kChunkSize * 2);
+  for (int64_t y = 0; y < kGridSize.y(); ++y)
+    tiles[(y * TileMap::kChunkSize + 31) * 2 + 1] = kWall;
+  map->SetChunkTiles({0, 0}, std::move(tiles));
+  EXPECT_EQ(0, pathfinder.FindPath({2, 2}, {60, 2}).size());
+
+  // Changing the tile set counts too.
+  TileMap::Tile floor{nullptr};
+  floor.SetTag(kWallTag, true);
+  map->SetTile(kFloor, floor);
+  EXPECT_EQ(0, pathfinder.FindPath({2, 2}, {60, 2}).size());
+}
+
+void PathfinderTest::TestNearShortest() {
+  const Vec<int64_t, 2> kGridSize{80, 80};
+  auto map = CreateMap(kGridSize);
+  // Short wall segments in a fixed pseudo-random pattern.
+  uint32_t seed = 12345;
+  auto random = [&seed](int n) {
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 16) % n;
+  };
+  for (int i = 0; i < 300; ++i) {
+    int64_t x = random(kGridSize.x());
+    int64_t y = random(kGridSize.y());
+    bool horizontal = random(2);
+    for (int j = 0; j < 6; ++j) {
+      map->SetTileIndex({x + (horizontal ? j : 0), y + (horizontal ? 0 : j)},
+                        1, kWall);
+    }
+  }
+
+  Pathfinder pathfinder(map.get(), kWallTag, /*pool=*/nullptr);
+  int found_count = 0;
+  bool all_match = true;
+  double total_cost = 0;
+  double total_shortest = 0;
+  for (int i = 0; i < 50; ++i) {
+    Point<> start{random(kGridSize.x()), random(kGridSize.y())};
+    Point<> goal{random(kGridSize.x()), random(kGridSize.y())};
+    Pathfinder::Path path =
+        pathfinder.FindPath({start.x(), start.y()}, {goal.x(), goal.y()});
+    double shortest = GetShortestCost(&pathfinder, kGridSize, start, goal);
+    if (pathfinder.IsBlocked({start.x(), start.y()}))
+      shortest = -1;
+    double cost = GetPathCost(map.get(), path, start, goal);
+    all_match = all_match && (cost >= 0) == (shortest >= 0) &&
+                cost >= shortest - 1e-9;
+    if (cost >= 0) {
+      ++found_count;
+      total_cost += cost;
+      total_shortest += shortest;
+    }
+  }
+  EXPECT_TRUE(all_match);
+  // About a quarter of the tiles are walls.
+  EXPECT_TRUE(found_count > 20);
+  EXPECT_TRUE(total_cost < total_shortest * 1.1);
+}
+
+void PathfinderTest::TestRequests() {
+  const Vec<int64_t, 2> kGridSize{64, 64};
+  auto map = CreateMap(kGridSize);
+  BuildWall(map.get(), 40, 10, 12);
+  WorkerPool pool(2);
+  Pathfinder pathfinder(map.get(), kWallTag, &pool);
+  std::vector<double> costs(40, 0);
+  for (int i = 0; i < costs.size(); ++i) {
+    Point<> start{i, 0};
+    Point<> goal{63, i};
+    auto callback = [&costs, &map, i, start, goal](Pathfinder::Path path) {
+      costs[i] = GetPathCost(map.get(), path, start, goal);
+    };
+    pathfinder.RequestPath({start.x(), start.y()}, {goal.x(), goal.y()},
+                           callback);
+  }
+  EXPECT_EQ(40, pathfinder.GetPendingRequestCount());
+  for (int i = 0; i < 1000 && pathfinder.GetPendingRequestCount() > 0; ++i) {
+    pathfinder.Update();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_EQ(0, pathfinder.GetPendingRequestCount());
+  bool all_found = true;
+  for (double cost : costs)
+    all_found = all_found && cost > 0;
+  EXPECT_TRUE(all_found);
+
+  // Without a pool, Update() finds paths right away.
+  Pathfinder inline_pathfinder(map.get(), kWallTag, /*pool=*/nullptr);
+  bool found = false;
+  auto callback = [&found](Pathfinder::Path path) { found = !path.empty(); };
+  inline_pathfinder.RequestPath({0, 0}, {63, 63}, callback);
+  inline_pathfinder.Update();
+  EXPECT_TRUE(found);
+  EXPECT_EQ(0, inline_pathfinder.GetPendingRequestCount());
+}
+
+PathfinderTest::PathfinderTest()
+    : TestGroup("PathfinderTest",
+                {
+                    std::bind(&PathfinderTest::TestFindPath, this),
+                    std::bind(&PathfinderTest::TestNoPath, this),
+                    std::bind(&PathfinderTest::TestRepair, this),
+                    std::bind(&PathfinderTest::TestNearShortest, this),
+                    std::bind(&PathfinderTest::TestRequests, this),
+                }) {}
+
+}  // namespace test
+}  // namespace engine2
@@ -0,0 +1,22 @@
+#ifndef ENGINE2_PATHFINDER_TEST_H_
+#define ENGINE2_PATHFINDER_TEST_H_
+
+#include "engine2/test/test_group.h"
+
+namespace engine2 {
+namespace test {
+
+class PathfinderTest : public TestGroup {
+ public:
+  void TestFindPath();
+  void TestNoPath();
+  void TestRepair();
+  void TestNearShortest();
+  void TestRequests();
+  PathfinderTest();
+};
+
+}  // namespace test
+}  // namespace engine2
+
+#endif  // ENGINE2_PATHFINDER_TEST_H_
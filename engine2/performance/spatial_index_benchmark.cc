@@ -0,0 +1,193 @@
+// Compares spatial index implementations on synthetic workloads.
+//
+// Usage: spatial_index_benchmark [object_count]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "engine2/impl/aabb_tree.h"
+#include "engine2/impl/rect_search_tree.h"
+#include "engine2/impl/spatial_hash_grid.h"
+#include "engine2/rect.h"
+
+namespace engine2 {
+namespace {
+
+constexpr Rect<> kWorldRect{0, 0, 8192, 8192};
+constexpr int kTreeDepth = 16;
+constexpr int kFrameCount = 10;
+constexpr int kQueryCount = 2000;
+constexpr int64_t kQuerySize = 256;
+constexpr int kClusterCount = 8;
+
+struct Workload {
+  std::string name;
+  std::vector<Rect<>> objects;
+  // Per-frame displacement for each object.
+  std::vector<Vec<int64_t, 2>> velocities;
+  std::vector<Rect<>> queries;
+};
+
+Workload MakeUniformWorkload(int object_count, std::mt19937* random) {
+  std::uniform_int_distribution<int64_t> position(0, kWorldRect.w() - 64);
+  std::uniform_int_distribution<int64_t> size(8, 32);
+  std::uniform_int_distribution<int64_t> velocity(-4, 4);
+
+  Workload workload{"uniform"};
+  for (int i = 0; i < object_count; ++i) {
+    workload.objects.push_back(
+        {position(*random), position(*random), size(*random), size(*random)});
+    workload.velocities.push_back({velocity(*random), velocity(*random)});
+  }
+  for (int i = 0; i < kQueryCount; ++i) {
+    workload.queries.push_back(
+        {position(*random), position(*random), kQuerySize, kQuerySize});
+  }
+  return workload;
+}
+
+// Objects are packed around a few points and vary from tiny to very large.
+Workload MakeClusteredWorkload(int object_count, std::mt19937* random) {
+  std::uniform_int_distribution<int64_t> center(1024, kWorldRect.w() - 1024);
+  std::vector<Point<>> centers;
+  for (int i = 0; i < kClusterCount; ++i)
+    centers.push_back({center(*random), center(*random)});
+
+  std::normal_distribution<double> offset(0, 128);
+  std::uniform_int_distribution<int> cluster(0, kClusterCount - 1);
+  std::uniform_int_distribution<int> size_exponent(1, 9);
+  std::uniform_int_distribution<int64_t> velocity(-4, 4);
+
+  Workload workload{"clustered"};
+  for (int i = 0; i < object_count; ++i) {
+    const Point<>& c = centers[cluster(*random)];
+    int64_t size = int64_t(1) << size_exponent(*random);
+    workload.objects.push_back({c.x() + int64_t(offset(*random)),
+                                c.y() + int64_t(offset(*random)), size, size});
+    workload.velocities.push_back({velocity(*random), velocity(*random)});
+  }
+  for (int i = 0; i < kQueryCount; ++i) {
+    const Point<>& c = centers[cluster(*random)];
+    workload.queries.push_back({c.x() + int64_t(offset(*random)),
+                                c.y() + int64_t(offset(*random)), kQuerySize,
+                                kQuerySize});
+  }
+  return workload;
+}
+
+// Where the objects are after RunWorkload() has moved them for kFrameCount
+// frames, which is what every row's queries run against.
+std::vector<Rect<>> GetMovedObjects(const Workload& workload) {
+  std::vector<Rect<>> rects = workload.objects;
+  for (int i = 0; i < rects.size(); ++i) {
+    for (int frame = 0; frame < kFrameCount; ++frame)
+      rects[i].pos += workload.velocities[i];
+  }
+  return rects;
+}
+
+double MillisecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+template <template <int, class> class Index>
+void RunWorkload(const char* index_name, const Workload& workload) {
+  using Tree = Index<2, int>;
+  std::vector<Rect<>> rects = workload.objects;
+  std::vector<typename Tree::NearIterator> iterators;
+  iterators.reserve(rects.size());
+
+  auto start = std::chrono::steady_clock::now();
+  auto tree = Tree::Create(kWorldRect, kTreeDepth);
+  for (int i = 0; i < rects.size(); ++i)
+    iterators.push_back(tree->InsertTrimmed(rects[i], i));
+  double insert_ms = MillisecondsSince(start);
+
+  start = std::chrono::steady_clock::now();
+  for (int frame = 0; frame < kFrameCount; ++frame) {
+    for (int i = 0; i < rects.size(); ++i) {
+      rects[i].pos += workload.velocities[i];
+      iterators[i] = tree->Move(std::move(iterators[i]),
+                                rects[i].GetOverlap(kWorldRect));
+    }
+  }
+  double move_ms = MillisecondsSince(start) / kFrameCount;
+
+  start = std::chrono::steady_clock::now();
+  int64_t candidates = 0;
+  int64_t hits = 0;
+  for (const Rect<>& query : workload.queries) {
+    for (int i : tree->Near(query)) {
+      ++candidates;
+      hits += query.Overlaps(rects[i]);
+    }
+  }
+  double query_ms = MillisecondsSince(start);
+
+  std::printf("%-10s %-16s %10.2f %12.2f %10.2f %12.1f %10.1f\n",
+              workload.name.c_str(), index_name, insert_ms, move_ms, query_ms,
+              double(candidates) / workload.queries.size(),
+              double(hits) / workload.queries.size());
+}
+
+// Same queries as RunWorkload(), but through RectSearchTree::NearMany() on a
+// tree bulk-loaded with the objects where RunWorkload() moved them to.
+void RunBatchedQueries(const Workload& workload) {
+  using Tree = RectSearchTree<2, int>;
+  std::vector<Rect<>> rects = GetMovedObjects(workload);
+  std::vector<std::pair<Rect<>, int>> objects;
+  for (int i = 0; i < rects.size(); ++i)
+    objects.push_back({rects[i].GetOverlap(kWorldRect), i});
+
+  auto start = std::chrono::steady_clock::now();
+  auto tree = Tree::BuildFrom(kWorldRect, kTreeDepth, objects);
+  double insert_ms = MillisecondsSince(start);
+
+  start = std::chrono::steady_clock::now();
+  int64_t candidates = 0;
+  int64_t hits = 0;
+  tree->NearMany(workload.queries, [&](int query_index, int i) {
+    ++candidates;
+    hits += workload.queries[query_index].Overlaps(rects[i]);
+  });
+  double query_ms = MillisecondsSince(start);
+
+  std::printf("%-10s %-16s %10.2f %12s %10.2f %12.1f %10.1f\n",
+              workload.name.c_str(), "  (batched)", insert_ms, "-", query_ms,
+              double(candidates) / workload.queries.size(),
+              double(hits) / workload.queries.size());
+}
+
+}  // namespace
+}  // namespace engine2
+
+int main(int argc, char** argv) {
+  using namespace engine2;
+
+  int object_count = 20000;
+  if (argc > 1)
+    object_count = std::atoi(argv[1]);
+
+  std::mt19937 random(42);
+  std::vector<Workload> workloads = {
+      MakeUniformWorkload(object_count, &random),
+      MakeClusteredWorkload(object_count, &random),
+  };
+
+  std::printf("%-10s %-16s %10s %12s %10s %12s %10s\n", "workload", "index",
+              "insert ms", "move ms/frame", "query ms", "candidates/q",
+              "hits/q");
+  for (const Workload& workload : workloads) {
+    RunWorkload<RectSearchTree>("RectSearchTree", workload);
+    RunBatchedQueries(workload);
+    RunWorkload<AabbTree>("AabbTree", workload);
+    RunWorkload<SpatialHashGrid>("SpatialHashGrid", workload);
+  }
+  return 0;
+}
@@ -2,6 +2,7 @@
 #define ENGINE2_SPACE_H_
 
 #include <list>
+#include <memory>
 #include <queue>
 #include <type_traits>
 #include <variant>
@@ -14,13 +15,25 @@
 
 namespace engine2 {
 
-template <int N, class... ObjectTypes>
-class Space {
+// BasicSpace stores its objects in a spatial index of type Index<N + 1, Rep>,
+// where the extra dimension is time. Index must provide the same interface as
+// RectSearchTree (e.g. AabbTree).
+template <template <int, class> class Index, int N, class... ObjectTypes>
+class BasicSpace {
  private:
   struct Motion;
+  using Tree = Index<N + 1, Motion*>;
 
  public:
-  Space(const Rect<int64_t, N>& rect);
+  // Creates the index with a depth of N * 2, and with time scaled so that a
+  // second spans about as much as the average side of |rect|.
+  BasicSpace(const Rect<int64_t, N>& rect);
+  // Creates the index with the given parameters, e.g. ones picked by
+  // RectSearchTree::AutoTune() for a recorded workload. |breakdown_scale| has
+  // an extra dimension for time, measured in microseconds.
+  BasicSpace(const Rect<int64_t, N>& rect,
+             int tree_depth,
+             const Point<double, N + 1>& breakdown_scale);
 
   using Variant = std::variant<ObjectTypes*...>;
   struct Iterator {
@@ -29,7 +42,7 @@ class Space {
     bool operator==(const Iterator& other) const;
     bool operator!=(const Iterator& other) const;
 
-    typename RectSearchTree<N + 1, Motion*>::NearIterator tree_iterator;
+    typename Tree::NearIterator tree_iterator;
   };
 
   template <class T>
@@ -40,12 +53,55 @@ class Space {
   void AdvanceTime(const Time::Delta& delta);
 
   struct NearView {
-    typename RectSearchTree<N + 1, Motion*>::NearIterable tree_view;
+    typename Tree::NearIterable tree_view;
     Iterator begin();
     Iterator end();
   };
   NearView Near(const Rect<int64_t, N>& rect);
 
+  // An immutable copy of where the objects in a space were when it was taken.
+  // Snapshots can be queried from another thread (e.g. for culling on the
+  // video thread) while the space keeps changing. The object pointers are
+  // only copied, so dereferencing them still requires the usual locking.
+  class Snapshot {
+   public:
+    // Calls callback(const Variant&) for each object that touches or overlaps
+    // |rect|.
+    template <class Callback>
+    void Near(const Rect<int64_t, N>& rect, Callback callback) const;
+
+    int Size() const { return tree_snapshot_.Size(); }
+
+   private:
+    friend class BasicSpace;
+    using TreeSnapshot = typename Index<N + 1, Variant>::Snapshot;
+
+    TreeSnapshot tree_snapshot_;
+  };
+
+  // Returns up to |k| objects of type T for which filter(T*) is true, nearest
+  // to |point| first. Distance is measured to the area each object covered
+  // during the last AdvanceTime(). Only available when Index is
+  // RectSearchTree.
+  template <class T, class Filter>
+  std::vector<T*> Nearest(const Point<int64_t, N>& point,
+                          int k,
+                          Filter filter) const;
+  template <class T>
+  std::vector<T*> Nearest(const Point<int64_t, N>& point, int k) const {
+    return Nearest<T>(point, k, [](T*) { return true; });
+  }
+
+  // Only available when Index is RectSearchTree. Lookups are given without
+  // the time dimension, as for Near().
+  auto GetIndexStats(
+      const std::vector<Rect<int64_t, N>>& sample_lookups = {}) const;
+
+  // Only available when Index is RectSearchTree. Publish the result with
+  // Published<Snapshot> to share it with other threads; see published.h for
+  // where a game does that.
+  std::shared_ptr<const Snapshot> TakeSnapshot() const;
+
  private:
   friend class Iterator;
 
@@ -53,7 +109,7 @@ class Space {
     Variant variant;
     Object<N>* object;
     Rect<int64_t, N + 1> enclosing_rect{};
-    typename RectSearchTree<N + 1, Motion*>::NearIterator tree_iterator;
+    typename Tree::NearIterator tree_iterator;
     typename std::list<Motion>::iterator list_iterator;
     bool marked_for_removal = false;
 
@@ -73,7 +129,7 @@ class Space {
       return Time::FromMicroseconds(enclosing_rect.pos[N]);
     }
 
-    void UpdateEnclosingRect(RectSearchTree<N + 1, Motion*>* tree,
+    void UpdateEnclosingRect(Tree* tree,
                              const Time& start_time,
                              const Time& finish_time) {
       Rect<int64_t, N> start_rect =
@@ -132,8 +188,7 @@ class Space {
       motion_a->UpdatePositionToTime(time);
       motion_b->UpdatePositionToTime(time);
     }
-    void UpdateEnclosingRects(RectSearchTree<N + 1, Motion*>* tree,
-                              Time new_time) {
+    void UpdateEnclosingRects(Tree* tree, Time new_time) {
       motion_a->UpdateEnclosingRect(tree, time, new_time);
       motion_b->UpdateEnclosingRect(tree, time, new_time);
     }
@@ -155,6 +210,16 @@ class Space {
 
   void FindCollisions(CollisionQueue* queue, Motion* motion_a);
 
+  // The length of the time dimension, in microseconds.
+  static constexpr int64_t kTimeMax = 1'000'000;
+
+  static Point<double, N + 1> GetDefaultBreakdownScale(
+      const Rect<int64_t, N>& rect);
+
+  // Returns |rect| extended into the time dimension, covering the start of an
+  // update.
+  static Rect<int64_t, N + 1> AddTimeDimension(const Rect<int64_t, N>& rect);
+
   typename std::list<Motion>::iterator RemoveInternal(
       typename std::list<Motion>::iterator iterator) {
     (*iterator).tree_iterator.Erase();
@@ -162,65 +227,118 @@ class Space {
   }
 
   std::list<Motion> motions_;
-  std::unique_ptr<RectSearchTree<N + 1, Motion*>> tree_;
+  std::unique_ptr<Tree> tree_;
   int advance_time_call_depth_ = 0;
 
   // TODO set in constructor
   Time time_ = Time::FromSeconds(0);
 };
 
-template <int N, class... ObjectTypes>
-Space<N, ObjectTypes...>::Space(const Rect<int64_t, N>& rect) {
+template <template <int, class> class Index, int N, class... ObjectTypes>
+BasicSpace<Index, N, ObjectTypes...>::BasicSpace(const Rect<int64_t, N>& rect)
+    : BasicSpace(rect, N * 2, GetDefaultBreakdownScale(rect)) {}
+
+template <template <int, class> class Index, int N, class... ObjectTypes>
+BasicSpace<Index, N, ObjectTypes...>::BasicSpace(
+    const Rect<int64_t, N>& rect,
+    int tree_depth,
+    const Point<double, N + 1>& breakdown_scale) {
   Rect<int64_t, N + 1> rect_with_time;
-  int64_t avg_size = 0;
   for (int i = 0; i < N; ++i) {
     rect_with_time.pos[i] = rect.pos[i];
     rect_with_time.size[i] = rect.size[i];
-    avg_size += rect.size[i];
   }
-  avg_size /= N;
 
   // The "time" dimension is represented as microseconds since the beginning of
   // an update.
-  const int64_t time_max = 1'000'000;
   rect_with_time.pos[N] = 0;
-  rect_with_time.size[N] = time_max;
+  rect_with_time.size[N] = kTimeMax;
+
+  tree_ = Tree::Create(rect_with_time, tree_depth, breakdown_scale);
+}
+
+// static
+template <template <int, class> class Index, int N, class... ObjectTypes>
+Point<double, N + 1>
+BasicSpace<Index, N, ObjectTypes...>::GetDefaultBreakdownScale(
+    const Rect<int64_t, N>& rect) {
+  int64_t avg_size = 0;
+  for (int i = 0; i < N; ++i)
+    avg_size += rect.size[i];
+  avg_size /= N;
 
   Point<double, N + 1> breakdown_scale = Point<double, N + 1>::Ones();
-  breakdown_scale[N] = time_max / avg_size;
-  tree_ = RectSearchTree<N + 1, Motion*>::Create(rect_with_time, N * 2,
-                                                 breakdown_scale);
+  breakdown_scale[N] = kTimeMax / avg_size;
+  return breakdown_scale;
 }
 
-template <int N, class... ObjectTypes>
-typename Space<N, ObjectTypes...>::Variant&
-Space<N, ObjectTypes...>::Iterator::operator*() {
+template <template <int, class> class Index, int N, class... ObjectTypes>
+template <class T, class Filter>
+std::vector<T*> BasicSpace<Index, N, ObjectTypes...>::Nearest(
+    const Point<int64_t, N>& point,
+    int k,
+    Filter filter) const {
+  Point<int64_t, N + 1> point_with_time{};
+  for (int i = 0; i < N; ++i)
+    point_with_time[i] = point[i];
+
+  // Ignore the time dimension.
+  Point<double, N + 1> dimension_weights = Point<double, N + 1>::Ones();
+  dimension_weights[N] = 0;
+
+  std::vector<Motion*> motions = tree_->Nearest(
+      point_with_time, k,
+      [&filter](Motion* motion) {
+        T* const* object = std::get_if<T*>(&motion->variant);
+        return object && !motion->marked_for_removal && filter(*object);
+      },
+      dimension_weights);
+
+  std::vector<T*> objects;
+  objects.reserve(motions.size());
+  for (Motion* motion : motions)
+    objects.push_back(std::get<T*>(motion->variant));
+  return objects;
+}
+
+template <template <int, class> class Index, int N, class... ObjectTypes>
+auto BasicSpace<Index, N, ObjectTypes...>::GetIndexStats(
+    const std::vector<Rect<int64_t, N>>& sample_lookups) const {
+  std::vector<Rect<int64_t, N + 1>> lookups;
+  for (const Rect<int64_t, N>& rect : sample_lookups)
+    lookups.push_back(AddTimeDimension(rect));
+  return tree_->GetStats(lookups);
+}
+
+template <template <int, class> class Index, int N, class... ObjectTypes>
+typename BasicSpace<Index, N, ObjectTypes...>::Variant&
+BasicSpace<Index, N, ObjectTypes...>::Iterator::operator*() {
   return (*tree_iterator)->variant;
 }
 
-template <int N, class... ObjectTypes>
-typename Space<N, ObjectTypes...>::Iterator&
-Space<N, ObjectTypes...>::Iterator::operator++() {
+template <template <int, class> class Index, int N, class... ObjectTypes>
+typename BasicSpace<Index, N, ObjectTypes...>::Iterator&
+BasicSpace<Index, N, ObjectTypes...>::Iterator::operator++() {
   ++tree_iterator;
   return *this;
 }
 
-template <int N, class... ObjectTypes>
-bool Space<N, ObjectTypes...>::Iterator::operator==(
+template <template <int, class> class Index, int N, class... ObjectTypes>
+bool BasicSpace<Index, N, ObjectTypes...>::Iterator::operator==(
     const Iterator& other) const {
   return tree_iterator == other.tree_iterator;
 }
 
-template <int N, class... ObjectTypes>
-bool Space<N, ObjectTypes...>::Iterator::operator!=(
+template <template <int, class> class Index, int N, class... ObjectTypes>
+bool BasicSpace<Index, N, ObjectTypes...>::Iterator::operator!=(
     const Iterator& other) const {
   return tree_iterator != other.tree_iterator;
 }
 
-template <int N, class... ObjectTypes>
+template <template <int, class> class Index, int N, class... ObjectTypes>
 template <class T>
-typename Space<N, ObjectTypes...>::Iterator Space<N, ObjectTypes...>::Add(
-    T* obj) {
+typename BasicSpace<Index, N, ObjectTypes...>::Iterator
+BasicSpace<Index, N, ObjectTypes...>::Add(T* obj) {
   static_assert(
       std::is_base_of<Object<N>, T>::value,
       "All objects being added to Space<N> must inherit from Object<N>.");
@@ -245,8 +363,8 @@ typename Space<N, ObjectTypes...>::Iterator Space<N, ObjectTypes...>::Add(
   return Iterator{motion.tree_iterator};
 }
 
-template <int N, class... ObjectTypes>
-void Space<N, ObjectTypes...>::Remove(Iterator iterator) {
+template <template <int, class> class Index, int N, class... ObjectTypes>
+void BasicSpace<Index, N, ObjectTypes...>::Remove(Iterator iterator) {
   Motion* motion = *(iterator.tree_iterator);
   if (advance_time_call_depth_ > 0) {
     motion->marked_for_removal = true;
@@ -255,9 +373,10 @@ void Space<N, ObjectTypes...>::Remove(Iterator iterator) {
   }
 }
 
-template <int N, class... ObjectTypes>
-void Space<N, ObjectTypes...>::FindCollisions(CollisionQueue* queue,
-                                              Motion* motion_a) {
+template <template <int, class> class Index, int N, class... ObjectTypes>
+void BasicSpace<Index, N, ObjectTypes...>::FindCollisions(
+    CollisionQueue* queue,
+    Motion* motion_a) {
   for (Motion* motion_b : tree_->Near(motion_a->enclosing_rect)) {
     if (motion_a == motion_b ||
         !motion_a->enclosing_rect.Overlaps(motion_b->enclosing_rect)) {
@@ -283,14 +402,14 @@ void Space<N, ObjectTypes...>::FindCollisions(CollisionQueue* queue,
 }
 
 // TODO collect requirements for objects
-template <int N, class... ObjectTypes>
-void Space<N, ObjectTypes...>::AdvanceTime(const Time::Delta& delta) {
+template <template <int, class> class Index, int N, class... ObjectTypes>
+void BasicSpace<Index, N, ObjectTypes...>::AdvanceTime(
+    const Time::Delta& delta) {
   Time start_time = Time::FromMicroseconds(0);
   Time end_time = start_time + delta;
 
   // TODO use or remove
   ++advance_time_call_depth_;
-  // TODO use custom breakdown for search tree
 
   // Find object final positions ignoring collisions.
   for (auto motion_iterator = motions_.begin();
@@ -360,10 +479,37 @@ void Space<N, ObjectTypes...>::AdvanceTime(const Time::Delta& delta) {
   --advance_time_call_depth_;
 }
 
-template <int N, class... ObjectTypes>
-typename Space<N, ObjectTypes...>::NearView Space<N, ObjectTypes...>::Near(
+template <template <int, class> class Index, int N, class... ObjectTypes>
+typename BasicSpace<Index, N, ObjectTypes...>::NearView
+BasicSpace<Index, N, ObjectTypes...>::Near(const Rect<int64_t, N>& rect) {
+  return NearView{tree_->Near(AddTimeDimension(rect))};
+}
+
+template <template <int, class> class Index, int N, class... ObjectTypes>
+std::shared_ptr<const typename BasicSpace<Index, N, ObjectTypes...>::Snapshot>
+BasicSpace<Index, N, ObjectTypes...>::TakeSnapshot() const {
+  auto snapshot = std::make_shared<Snapshot>();
+  snapshot->tree_snapshot_ =
+      tree_->TakeSnapshot([](Motion* motion) { return motion->variant; });
+  return snapshot;
+}
+
+template <template <int, class> class Index, int N, class... ObjectTypes>
+template <class Callback>
+void BasicSpace<Index, N, ObjectTypes...>::Snapshot::Near(
+    const Rect<int64_t, N>& rect,
+    Callback callback) const {
+  tree_snapshot_.Near(
+      AddTimeDimension(rect),
+      [&callback](const Rect<int64_t, N + 1>&, const Variant& variant) {
+        callback(variant);
+      });
+}
+
+// static
+template <template <int, class> class Index, int N, class... ObjectTypes>
+Rect<int64_t, N + 1> BasicSpace<Index, N, ObjectTypes...>::AddTimeDimension(
     const Rect<int64_t, N>& rect) {
-  // TODO this is done a few places now, refactor
   Rect<int64_t, N + 1> rect_with_time;
   for (int i = 0; i < N; ++i) {
     rect_with_time.pos[i] = rect.pos[i];
@@ -371,21 +517,25 @@ typename Space<N, ObjectTypes...>::NearView Space<N, ObjectTypes...>::Near(
   }
   rect_with_time.pos[N] = 0;
   rect_with_time.size[N] = 1;
-  return NearView{tree_->Near(rect_with_time)};
+  return rect_with_time;
 }
 
-template <int N, class... ObjectTypes>
-typename Space<N, ObjectTypes...>::Iterator
-Space<N, ObjectTypes...>::NearView::begin() {
+template <template <int, class> class Index, int N, class... ObjectTypes>
+typename BasicSpace<Index, N, ObjectTypes...>::Iterator
+BasicSpace<Index, N, ObjectTypes...>::NearView::begin() {
   return Iterator{tree_view.begin()};
 }
 
-template <int N, class... ObjectTypes>
-typename Space<N, ObjectTypes...>::Iterator
-Space<N, ObjectTypes...>::NearView::end() {
+template <template <int, class> class Index, int N, class... ObjectTypes>
+typename BasicSpace<Index, N, ObjectTypes...>::Iterator
+BasicSpace<Index, N, ObjectTypes...>::NearView::end() {
   return Iterator{tree_view.end()};
 }
 
+// Space stores its objects in a RectSearchTree.
+template <int N, class... ObjectTypes>
+using Space = BasicSpace<RectSearchTree, N, ObjectTypes...>;
+
 }  // namespace engine2
 
 #endif  // ENGINE2_SPACE_H_
\ No newline at end of file
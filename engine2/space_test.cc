@@ -1,4 +1,7 @@
 #include "engine2/space.h"
+#include "engine2/base/published.h"
+#include "engine2/impl/aabb_tree.h"
+#include "engine2/impl/spatial_hash_grid.h"
 #include "engine2/physics_object.h"
 #include "engine2/rect_object.h"
 #include "engine2/space_test.h"
@@ -368,6 +371,140 @@ void SpaceTest::TestFarFutureNoCollide() {
   EXPECT_EQ(0, a.collide_count);
 }
 
+void SpaceTest::TestNearest() {
+  Space<2, Foo, Bar> space(kSpaceRect);
+  Foo far_foo(500, 500, 10, 10, 1);
+  Foo near_foo(130, 100, 10, 10, 1);
+  Foo nearest_foo(100, 120, 10, 10, 1);
+  Bar bar(100, 100, 10, 10, 1);
+  space.Add(&far_foo);
+  space.Add(&near_foo);
+  auto nearest_foo_iterator = space.Add(&nearest_foo);
+  space.Add(&bar);
+
+  std::vector<Foo*> foos = space.Nearest<Foo>({100, 100}, 2);
+  ASSERT_EQ(2, foos.size());
+  EXPECT_EQ(&nearest_foo, foos[0]);
+  EXPECT_EQ(&near_foo, foos[1]);
+
+  std::vector<Bar*> bars = space.Nearest<Bar>({900, 900}, 5);
+  ASSERT_EQ(1, bars.size());
+  EXPECT_EQ(&bar, bars[0]);
+
+  foos = space.Nearest<Foo>({100, 100}, 1,
+                            [&](Foo* foo) { return foo != &nearest_foo; });
+  ASSERT_EQ(1, foos.size());
+  EXPECT_EQ(&near_foo, foos[0]);
+
+  space.Remove(nearest_foo_iterator);
+  foos = space.Nearest<Foo>({100, 100}, 3);
+  ASSERT_EQ(2, foos.size());
+  EXPECT_EQ(&near_foo, foos[0]);
+  EXPECT_EQ(&far_foo, foos[1]);
+}
+
+void SpaceTest::TestSnapshot() {
+  using TestSpace = Space<2, ObjectInSpace>;
+  TestSpace space(kSpaceRect);
+  ObjectInSpace a(100, 100, 10, 10, 1);
+  a.SetVelocity(1000, 0);
+  space.Add(&a);
+  ObjectInSpace b(900, 900, 10, 10, 1);
+  auto b_iterator = space.Add(&b);
+
+  Published<TestSpace::Snapshot> published;
+  EXPECT_NULL(published.Get().get());
+  published.Publish(space.TakeSnapshot());
+
+  // The space moves on without affecting the published snapshot.
+  space.Remove(b_iterator);
+  space.AdvanceTime(Time::Delta::FromSeconds(.5));
+
+  std::shared_ptr<const TestSpace::Snapshot> snapshot = published.Get();
+  ASSERT_NOT_NULL(snapshot.get());
+  EXPECT_EQ(2, snapshot->Size());
+
+  int count = 0;
+  snapshot->Near({95, 95, 10, 10}, [&](const TestSpace::Variant& variant) {
+    EXPECT_EQ(&a, std::get<ObjectInSpace*>(variant));
+    ++count;
+  });
+  EXPECT_EQ(1, count);
+
+  count = 0;
+  snapshot->Near({900, 900, 1, 1},
+                 [&](const TestSpace::Variant& variant) { ++count; });
+  EXPECT_EQ(1, count);
+
+  // A new snapshot sees the changes.
+  published.Publish(space.TakeSnapshot());
+  count = 0;
+  published.Get()->Near({595, 95, 10, 10},
+                        [&](const TestSpace::Variant& variant) { ++count; });
+  EXPECT_EQ(1, count);
+  EXPECT_EQ(1, published.Get()->Size());
+}
+
+void SpaceTest::TestIndexParameters() {
+  Space<2, ObjectInSpace> space(kSpaceRect, 6, {1, 1, 1000});
+  ObjectInSpace a(100, 100, 10, 10, 1);
+  a.SetVelocity(1000, 0);
+  space.Add(&a);
+  ObjectInSpace b(120, 100, 10, 10, 1);
+  space.Add(&b);
+
+  space.AdvanceTime(Time::Delta::FromSeconds(.02));
+  EXPECT_EQ(1, a.collide_count);
+  EXPECT_EQ(130, b.GetRect().x());
+
+  auto stats = space.GetIndexStats({{100, 100, 40, 10}});
+  EXPECT_EQ(6, stats.nodes_per_depth.size());
+  EXPECT_EQ(2., stats.average_candidates);
+}
+
+template <template <int, class> class Index>
+void SpaceTest::CheckIndex() {
+  BasicSpace<Index, 2, ObjectInSpace> space(kSpaceRect);
+  ObjectInSpace a(100, 100, 10, 10, 1);
+  a.SetVelocity(1000, 0);
+  space.Add(&a);
+
+  ObjectInSpace b(120, 100, 10, 10, 1);
+  b.SetVelocity(0, 0);
+  space.Add(&b);
+
+  ObjectInSpace c(900, 900, 10, 10, 1);
+  space.Add(&c);
+
+  space.AdvanceTime(Time::Delta::FromSeconds(.02));
+
+  EXPECT_EQ(1, a.collide_count);
+  EXPECT_EQ(1, b.collide_count);
+  EXPECT_EQ(0, c.collide_count);
+  EXPECT_EQ(110, a.GetRect().x());
+  EXPECT_EQ(130, b.GetRect().x());
+  EXPECT_EQ(1000., b.GetVelocity().x());
+
+  int count = 0;
+  for (auto& variant : space.Near({900, 900, 10, 10})) {
+    std::visit(
+        [&](ObjectInSpace* object) {
+          EXPECT_EQ(&c, object);
+          ++count;
+        },
+        variant);
+  }
+  EXPECT_EQ(1, count);
+}
+
+void SpaceTest::TestAabbTreeIndex() {
+  CheckIndex<AabbTree>();
+}
+
+void SpaceTest::TestSpatialHashGridIndex() {
+  CheckIndex<SpatialHashGrid>();
+}
+
 SpaceTest::SpaceTest()
     : TestGroup("SpaceTest",
                 {
@@ -381,6 +518,11 @@ SpaceTest::SpaceTest()
                     std::bind(&SpaceTest::TestTrolleyCollide, this),
                     std::bind(&SpaceTest::TestFarFutureNoCollide, this),
                     std::bind(&SpaceTest::TestMultipleDispatchCollide, this),
+                    std::bind(&SpaceTest::TestSnapshot, this),
+                    std::bind(&SpaceTest::TestIndexParameters, this),
+                    std::bind(&SpaceTest::TestNearest, this),
+                    std::bind(&SpaceTest::TestAabbTreeIndex, this),
+                    std::bind(&SpaceTest::TestSpatialHashGridIndex, this),
                 }) {}
 
 }  // namespace test
@@ -22,7 +22,19 @@ class SpaceTest : public TestGroup {
   void TestFarFutureNoCollide();
   void TestMultipleDispatchCollide();
 
+  void TestSnapshot();
+  void TestIndexParameters();
+  void TestNearest();
+
+  void TestAabbTreeIndex();
+  void TestSpatialHashGridIndex();
+
   SpaceTest();
+
+ private:
+  // Runs a collision and lookup through a space using |Index|.
+  template <template <int, class> class Index>
+  void CheckIndex();
 };
 
 }  // namespace test
@@ -26,10 +26,7 @@ Sprite::Sprite(Texture* texture, std::vector<AnimationFrame> frames)
 }
 
 void Sprite::Draw(Graphics2D* graphics, const Rect<int64_t, 2>& dest) {
-  AnimationFrame& frame = CurrentFrame();
-  graphics->DrawTexture(
-      *texture_, frame.source_rect,
-      Rect<int64_t, 2>{dest.pos + frame.dest_offset, dest.size});
+  DrawFrame(graphics, current_frame_, dest);
 }
 
 void Sprite::Draw(Graphics2D* graphics, const Point<int64_t, 2>& dest) {
@@ -49,6 +46,15 @@ void Sprite::Draw(Graphics2D* graphics,
       Rect<int64_t, 2>{dest + frame.dest_offset, scaled.ConvertTo<int64_t>()});
 }
 
+void Sprite::DrawFrame(Graphics2D* graphics,
+                       int index,
+                       const Rect<int64_t, 2>& dest) {
+  AnimationFrame& frame = frames_[index];
+  graphics->DrawTexture(
+      *texture_, frame.source_rect,
+      Rect<int64_t, 2>{dest.pos + frame.dest_offset, dest.size});
+}
+
 void Sprite::Update(const Time& time) {
   if (time <= last_update_time_ || cycle_duration_ == kZero)
     return;
@@ -65,6 +71,20 @@ void Sprite::Update(const Time& time) {
   last_update_time_ = time;
 }
 
+int Sprite::GetFrameAt(Time::Delta time) const {
+  if (cycle_duration_ == kZero)
+    return current_frame_;
+  time %= cycle_duration_;
+  if (time < kZero)
+    time += cycle_duration_;
+  int index = 0;
+  while (time >= frames_[index].duration) {
+    time -= frames_[index].duration;
+    ++index;
+  }
+  return index;
+}
+
 void Sprite::AddFrame(const AnimationFrame& frame) {
   frames_.push_back(frame);
   cycle_duration_ += frame.duration;
@@ -76,6 +96,9 @@ void Sprite::AdvanceFrame() {
 
 void Sprite::SetFrames(std::vector<AnimationFrame> frames) {
   frames_ = std::move(frames);
+  cycle_duration_ = kZero;
+  for (const auto& frame : frames_)
+    cycle_duration_ += frame.duration;
 }
 
 }  // namespace engine2
\ No newline at end of file
@@ -36,8 +36,15 @@ class Sprite {
   virtual void Draw(Graphics2D* graphics,
                     const Point<int64_t, 2>& dest,
                     double scale);
+  // Draws frame |index| instead of the current one.
+  void DrawFrame(Graphics2D* graphics,
+                 int index,
+                 const Rect<int64_t, 2>& dest);
 
   void Update(const Time& time);
+  // The index of the frame shown |time| into the animation, which repeats, so
+  // sprites can share one clock instead of each keeping its own.
+  int GetFrameAt(Time::Delta time) const;
 
   void AddFrame(const AnimationFrame& frame);
 
@@ -48,6 +55,8 @@ class Sprite {
   void SetFrames(std::vector<AnimationFrame> frames);
 
   Texture* texture() { return texture_; }
+  // E.g. to move the frames into a TextureAtlas.
+  void SetTexture(Texture* texture) { texture_ = texture; }
 
  private:
   void AdvanceFrame();
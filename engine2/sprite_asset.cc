@@ -0,0 +1,59 @@
+#include "engine2/sprite_asset.h"
+
+#include <algorithm>
+
+namespace engine2 {
+
+SpriteAsset::SpriteAsset(Texture* texture,
+                         std::vector<Sprite::AnimationFrame> frames)
+    : texture_(texture), frames_(std::move(frames)) {
+  frame_ends_.reserve(frames_.size());
+  for (const auto& frame : frames_) {
+    cycle_duration_ += frame.duration;
+    frame_ends_.push_back(cycle_duration_);
+  }
+}
+
+int SpriteAsset::GetFrameAt(Time::Delta time) const {
+  const Time::Delta kZero;
+  if (cycle_duration_ <= kZero)
+    return 0;
+  time %= cycle_duration_;
+  if (time < kZero)
+    time += cycle_duration_;
+  // The first frame that ends after |time|.
+  return std::upper_bound(frame_ends_.begin(), frame_ends_.end(), time) -
+         frame_ends_.begin();
+}
+
+void SpriteAsset::DrawFrame(Graphics2D* graphics,
+                            int index,
+                            const Point<>& dest) const {
+  const Sprite::AnimationFrame& frame = frames_[index];
+  graphics->DrawTexture(
+      *texture_, frame.source_rect,
+      Rect<int64_t, 2>{dest + frame.dest_offset, frame.source_rect.size});
+}
+
+SpriteAssetId SpriteAssets::Add(SpriteAsset asset) {
+  assets_.push_back(std::move(asset));
+  return assets_.size() - 1;
+}
+
+void SpriteAssets::AnimateAll(const Time& time,
+                              SpriteInstance* instances,
+                              int64_t count) const {
+  for (int64_t i = 0; i < count; ++i) {
+    SpriteInstance& instance = instances[i];
+    instance.frame = assets_[instance.asset].GetFrameAt(
+        (time - instance.start_time) * instance.speed);
+  }
+}
+
+void SpriteAssets::Draw(Graphics2D* graphics,
+                        const SpriteInstance& instance,
+                        const Point<>& dest) const {
+  assets_[instance.asset].DrawFrame(graphics, instance.frame, dest);
+}
+
+}  // namespace engine2
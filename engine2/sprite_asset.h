@@ -0,0 +1,82 @@
+#ifndef ENGINE2_SPRITE_ASSET_H_
+#define ENGINE2_SPRITE_ASSET_H_
+
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include "engine2/graphics2d.h"
+#include "engine2/point.h"
+#include "engine2/sprite.h"
+#include "engine2/texture.h"
+#include "engine2/time.h"
+
+namespace engine2 {
+
+// The frames of an animation, which never change once it's made, so any
+// number of SpriteInstances can share them. Unlike a Sprite, it keeps no
+// playback state.
+class SpriteAsset {
+ public:
+  SpriteAsset(Texture* texture, std::vector<Sprite::AnimationFrame> frames);
+
+  int FrameCount() const { return frames_.size(); }
+  const Sprite::AnimationFrame& Frame(int index) const {
+    return frames_[index];
+  }
+  Time::Delta cycle_duration() const { return cycle_duration_; }
+  Texture* texture() const { return texture_; }
+
+  // The index of the frame shown |time| into the animation, which repeats.
+  int GetFrameAt(Time::Delta time) const;
+  // Draws frame |index| at |dest| plus the frame's offset, at its own size.
+  void DrawFrame(Graphics2D* graphics, int index, const Point<>& dest) const;
+
+ private:
+  Texture* texture_;
+  std::vector<Sprite::AnimationFrame> frames_;
+  // When each frame ends, from the start of the cycle, for binary search.
+  std::vector<Time::Delta> frame_ends_;
+  Time::Delta cycle_duration_;
+};
+
+using SpriteAssetId = int;
+
+// One playing copy of a SpriteAsset, small enough to keep thousands of them
+// in an array and animate them in one pass with SpriteAssets::AnimateAll().
+struct SpriteInstance {
+  SpriteAssetId asset = 0;
+  // When frame 0 started.
+  Time start_time;
+  // Playback rate, e.g. 2 for double speed.
+  double speed = 1;
+  // The frame to draw, as of the last AnimateAll().
+  int frame = 0;
+};
+static_assert(std::is_trivially_copyable<SpriteInstance>::value,
+              "SpriteInstances are meant to be copied around in arrays");
+
+// Owns the SpriteAssets of a game, by id.
+class SpriteAssets {
+ public:
+  SpriteAssetId Add(SpriteAsset asset);
+  const SpriteAsset& Get(SpriteAssetId id) const { return assets_[id]; }
+  int size() const { return assets_.size(); }
+
+  // Sets the frame of each of the |count| instances at |instances| for
+  // |time|. Instances only read their asset, so any number can share one.
+  void AnimateAll(const Time& time,
+                  SpriteInstance* instances,
+                  int64_t count) const;
+  // Draws |instance|'s frame as of the last AnimateAll() at |dest|.
+  void Draw(Graphics2D* graphics,
+            const SpriteInstance& instance,
+            const Point<>& dest) const;
+
+ private:
+  std::vector<SpriteAsset> assets_;
+};
+
+}  // namespace engine2
+
+#endif  // ENGINE2_SPRITE_ASSET_H_
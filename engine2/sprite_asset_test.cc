@@ -0,0 +1,96 @@
+#include "engine2/sprite_asset.h"
+#include "engine2/sprite_asset_test.h"
+#include "engine2/test/assert_macros.h"
+#include "engine2/test_graphics2d.h"
+
+namespace engine2 {
+namespace test {
+namespace {
+
+// Frames of 1, 0 and 2 seconds.
+SpriteAsset CreateAsset(Texture* texture) {
+  return SpriteAsset(
+      texture, {{{0, 0, 16, 16}, {}, Time::Delta::FromSeconds(1)},
+                {{16, 0, 16, 16}, {}, Time::Delta::FromSeconds(0)},
+                {{32, 0, 16, 16}, {3, 4}, Time::Delta::FromSeconds(2)}});
+}
+
+}  // namespace
+
+void SpriteAssetTest::TestGetFrameAt() {
+  SpriteAsset asset = CreateAsset(/*texture=*/nullptr);
+  EXPECT_EQ(3, asset.FrameCount());
+  EXPECT_EQ(3, asset.cycle_duration().ToSeconds());
+  EXPECT_EQ(0, asset.GetFrameAt(Time::Delta::FromSeconds(0)));
+  EXPECT_EQ(0, asset.GetFrameAt(Time::Delta::FromSeconds(0.999)));
+  // Frames with no duration are never shown.
+  EXPECT_EQ(2, asset.GetFrameAt(Time::Delta::FromSeconds(1)));
+  EXPECT_EQ(2, asset.GetFrameAt(Time::Delta::FromSeconds(2.999)));
+  EXPECT_EQ(0, asset.GetFrameAt(Time::Delta::FromSeconds(3)));
+  EXPECT_EQ(2, asset.GetFrameAt(Time::Delta::FromSeconds(-1)));
+  EXPECT_EQ(0, asset.GetFrameAt(Time::Delta::FromSeconds(-2.5)));
+
+  SpriteAsset still(nullptr, {{{0, 0, 16, 16}, {}, Time::Delta()}});
+  EXPECT_EQ(0, still.GetFrameAt(Time::Delta::FromSeconds(5)));
+}
+
+void SpriteAssetTest::TestAnimateAll() {
+  SpriteAssets assets;
+  SpriteAssetId still = assets.Add(
+      SpriteAsset(nullptr, {{{0, 0, 16, 16}, {}, Time::Delta()}}));
+  SpriteAssetId animated = assets.Add(CreateAsset(nullptr));
+  EXPECT_EQ(0, still);
+  EXPECT_EQ(1, animated);
+  EXPECT_EQ(2, assets.size());
+
+  std::vector<SpriteInstance> instances(1000);
+  for (int i = 0; i < instances.size(); ++i) {
+    instances[i].asset = animated;
+    instances[i].start_time = Time::FromSeconds(i);
+  }
+  instances[1].speed = 2;
+  instances[2].asset = still;
+  assets.AnimateAll(Time::FromSeconds(1.5), instances.data(),
+                    instances.size());
+  EXPECT_EQ(2, instances[0].frame);
+  // 1 second in at double speed.
+  EXPECT_EQ(2, instances[1].frame);
+  EXPECT_EQ(0, instances[2].frame);
+  // Instances that haven't started yet count back from the end of the cycle.
+  EXPECT_EQ(2, instances[3].frame);
+  EXPECT_EQ(0, instances[4].frame);
+  bool all_match = true;
+  for (int i = 3; i < instances.size(); ++i) {
+    all_match = all_match && instances[i].frame ==
+                                 assets.Get(animated).GetFrameAt(
+                                     Time::FromSeconds(1.5) -
+                                     Time::FromSeconds(i));
+  }
+  EXPECT_TRUE(all_match);
+}
+
+void SpriteAssetTest::TestDraw() {
+  Texture texture(nullptr);
+  SpriteAssets assets;
+  SpriteInstance instance;
+  instance.asset = assets.Add(CreateAsset(&texture));
+  TestGraphics2D graphics;
+  assets.Draw(&graphics, instance, {10, 20});
+  EXPECT_TRUE((Rect<int64_t, 2>{10, 20, 16, 16}) == graphics.draw_texture_dest);
+
+  assets.AnimateAll(Time::FromSeconds(1), &instance, 1);
+  assets.Draw(&graphics, instance, {10, 20});
+  EXPECT_TRUE((Rect<int64_t, 2>{13, 24, 16, 16}) == graphics.draw_texture_dest);
+  EXPECT_EQ(&texture, graphics.draw_texture_texture);
+}
+
+SpriteAssetTest::SpriteAssetTest()
+    : TestGroup("SpriteAssetTest",
+                {
+                    std::bind(&SpriteAssetTest::TestGetFrameAt, this),
+                    std::bind(&SpriteAssetTest::TestAnimateAll, this),
+                    std::bind(&SpriteAssetTest::TestDraw, this),
+                }) {}
+
+}  // namespace test
+}  // namespace engine2
@@ -0,0 +1,20 @@
+#ifndef ENGINE2_SPRITE_ASSET_TEST_H_
+#define ENGINE2_SPRITE_ASSET_TEST_H_
+
+#include "engine2/test/test_group.h"
+
+namespace engine2 {
+namespace test {
+
+class SpriteAssetTest : public TestGroup {
+ public:
+  void TestGetFrameAt();
+  void TestAnimateAll();
+  void TestDraw();
+  SpriteAssetTest();
+};
+
+}  // namespace test
+}  // namespace engine2
+
+#endif  // ENGINE2_SPRITE_ASSET_TEST_H_
@@ -62,8 +62,11 @@ bool SpriteCache::LoadSpriteSheet(SpriteSheetInfo info) {
 
   for (SpriteInfo& sprite : info.sprites) {
     std::string sprite_name(sprite.name.data(), sprite.name.size());
-    map_.emplace(MakeSpriteKey(image_path, sprite_name),
-                 Sprite(texture, std::move(sprite.frames)));
+    auto [iter, did_insert] =
+        map_.emplace(MakeSpriteKey(image_path, sprite_name),
+                     Sprite(texture, std::move(sprite.frames)));
+    if (did_insert && atlas_)
+      atlas_->Add(&iter->second);
   }
   return true;
 }
@@ -133,6 +136,8 @@ Sprite* SpriteCache::LoadInternal(const std::string& path) {
            LuaDataUtil::GetVec2(*frame, "dest_offset", {0, 0}),
            Time::Delta::FromMicroseconds(frame->GetInt("duration_ms") * 1000)});
     }
+    if (atlas_)
+      atlas_->Add(sprite);
   }
 
   return result;
@@ -6,6 +6,7 @@
 #include <string>
 
 #include "engine2/sprite.h"
+#include "engine2/texture_atlas.h"
 #include "engine2/texture_cache.h"
 
 // TODO: Separate into cache and loader
@@ -79,6 +80,11 @@ class SpriteCache {
   bool LoadSpriteSheet(SpriteSheetInfo info);
   bool LoadSpriteSheet(const std::string& sprite_sheet_luadata_file);
 
+  // Sprites loaded from sprite sheets from now on are packed into |atlas| as
+  // they're loaded, so sprites from different sheets can share a texture.
+  // Null turns packing off. |atlas| must outlive the cache.
+  void SetAtlas(TextureAtlas* atlas) { atlas_ = atlas; }
+
   std::map<std::string, Sprite>::iterator begin() { return map_.begin(); }
   std::map<std::string, Sprite>::iterator end() { return map_.end(); }
 
@@ -86,6 +92,7 @@ class SpriteCache {
   Sprite* LoadInternal(const std::string& path);
 
   TextureCache* texture_cache_;
+  TextureAtlas* atlas_ = nullptr;
   std::map<std::string, Sprite> map_;
 };
 
@@ -78,6 +78,26 @@ void SpriteTest::TestUpdate() {
   EXPECT_EQ(&(sprite.Frame(1)), &(sprite.CurrentFrame()));
 }
 
+void SpriteTest::TestGetFrameAt() {
+  Sprite sprite(/*texture=*/nullptr,
+                /*source_rect=*/Rect<int64_t, 2>{5, 6, 7, 8},
+                /*dest_offset=*/Point<int64_t, 2>{},
+                /*duration=*/Time::Delta::FromSeconds(1));
+  sprite.AddFrame({Rect<int64_t, 2>{9, 10, 11, 12}, Point<int64_t, 2>{},
+                   Time::Delta::FromSeconds(2)});
+
+  EXPECT_EQ(0, sprite.GetFrameAt(Time::Delta::FromSeconds(0)));
+  EXPECT_EQ(0, sprite.GetFrameAt(Time::Delta::FromSeconds(0.999)));
+  EXPECT_EQ(1, sprite.GetFrameAt(Time::Delta::FromSeconds(1)));
+  EXPECT_EQ(1, sprite.GetFrameAt(Time::Delta::FromSeconds(2.5)));
+  // The animation repeats, both ways.
+  EXPECT_EQ(0, sprite.GetFrameAt(Time::Delta::FromSeconds(3.5)));
+  EXPECT_EQ(1, sprite.GetFrameAt(Time::Delta::FromSeconds(-0.5)));
+  EXPECT_EQ(0, sprite.GetFrameAt(Time::Delta::FromSeconds(-2.5)));
+  // It doesn't change the current frame.
+  EXPECT_EQ(&(sprite.Frame(0)), &(sprite.CurrentFrame()));
+}
+
 SpriteTest::SpriteTest()
     : TestGroup("SpriteTest",
                 {
@@ -85,6 +105,7 @@ SpriteTest::SpriteTest()
                     std::bind(&SpriteTest::TestDraw, this),
                     std::bind(&SpriteTest::TestOffsetDraw, this),
                     std::bind(&SpriteTest::TestUpdate, this),
+                    std::bind(&SpriteTest::TestGetFrameAt, this),
                 }) {}
 
 }  // namespace test
@@ -12,6 +12,7 @@ class SpriteTest : public TestGroup {
   void TestDraw();
   void TestOffsetDraw();
   void TestUpdate();
+  void TestGetFrameAt();
   SpriteTest();
 };
 
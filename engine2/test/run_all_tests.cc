@@ -1,17 +1,29 @@
 #include <functional>
 
+#include "engine2/base/bit_grid_test.h"
+#include "engine2/base/compression_test.h"
 #include "engine2/base/list_test.h"
+#include "engine2/base/pool_test.h"
+#include "engine2/base/worker_pool_test.h"
+#include "engine2/flow_field_test.h"
+#include "engine2/impl/aabb_tree_test.h"
 #include "engine2/impl/rect_search_tree_test.h"
+#include "engine2/impl/spatial_hash_grid_test.h"
+#include "engine2/map_generator_test.h"
 #include "engine2/memory/weak_pointer_test.h"
+#include "engine2/pathfinder_test.h"
 #include "engine2/physics_object_test.h"
 #include "engine2/rect_test.h"
 #include "engine2/space_test.h"
+#include "engine2/sprite_asset_test.h"
 #include "engine2/sprite_cache_test.h"
 #include "engine2/sprite_test.h"
+#include "engine2/texture_atlas_test.h"
 #include "engine2/texture_cache_test.h"
 #include "engine2/tile_map_test.h"
 #include "engine2/time_test.h"
 #include "engine2/vec_test.h"
+#include "engine2/visibility_test.h"
 
 namespace engine2 {
 namespace test {
@@ -19,18 +31,30 @@ namespace test {
 void RunAllTests() {
   std::cerr << "\n";
   /* clang-format off */
-  TestGroup::Result result = ListTest().RunTests() +
+  TestGroup::Result result = AabbTreeTest().RunTests() +
+                             BitGridTest().RunTests() +
+                             CompressionTest().RunTests() +
+                             FlowFieldTest().RunTests() +
+                             ListTest().RunTests() +
+                             MapGeneratorTest().RunTests() +
+                             PathfinderTest().RunTests() +
                              PhysicsObjectTest().RunTests() +
+                             PoolTest().RunTests() +
                              RectTest().RunTests() +
                              RectSearchTreeTest().RunTests() +
                              SpaceTest().RunTests() +
+                             SpatialHashGridTest().RunTests() +
+                             SpriteAssetTest().RunTests() +
                              SpriteCacheTest().RunTests() +
                              SpriteTest().RunTests() + 
+                             TextureAtlasTest().RunTests() +
                              TextureCacheTest().RunTests() +
                              TileMapTest().RunTests() +
                              TimeTest().RunTests() +
                              VecTest().RunTests() +
-                             WeakPointerTest().RunTests();
+                             VisibilityTest().RunTests() +
+                             WeakPointerTest().RunTests() +
+                             WorkerPoolTest().RunTests();
   /* clang-format on */
   std::cerr << "\nTOTAL: " << result.passed << " passed, " << result.failed
             << " failed\n";
@@ -53,9 +53,38 @@ Graphics2D* TestGraphics2D::DrawTexture(const Texture& texture,
                                         const Rect<>& src,
                                         const Rect<>& dest) {
   draw_texture_dest = dest;
+  draw_texture_texture = const_cast<Texture*>(&texture);
+  ++draw_texture_count;
   return this;
 }
 
+Graphics2D* TestGraphics2D::DrawGeometry(const Texture& texture,
+                                         const SDL_Vertex* vertices,
+                                         int vertex_count,
+                                         const int* indices,
+                                         int index_count) {
+  draw_texture_texture = const_cast<Texture*>(&texture);
+  ++draw_geometry_count;
+  geometry_vertices.assign(vertices, vertices + vertex_count);
+  geometry_indices.assign(indices, indices + index_count);
+  return this;
+}
+
+std::unique_ptr<Texture> TestGraphics2D::CreateTargetTexture(int width,
+                                                             int height) {
+  ++created_texture_count;
+  return std::make_unique<Texture>(nullptr);
+}
+
+Graphics2D* TestGraphics2D::SetRenderTarget(Texture* texture) {
+  render_target = texture;
+  return this;
+}
+
+Texture* TestGraphics2D::GetRenderTarget() {
+  return render_target;
+}
+
 Graphics2D* TestGraphics2D::Clear() {
   return this;
 }
@@ -1,6 +1,8 @@
 #ifndef ENGINE2_TEST_GRAPHICS2D_H_
 #define ENGINE2_TEST_GRAPHICS2D_H_
 
+#include <vector>
+
 #include "engine2/graphics2d.h"
 
 namespace engine2 {
@@ -26,6 +28,16 @@ class TestGraphics2D : public Graphics2D {
   Graphics2D* DrawTexture(const Texture& texture,
                           const Rect<>& src,
                           const Rect<>& dest) override;
+  Graphics2D* DrawGeometry(const Texture& texture,
+                           const SDL_Vertex* vertices,
+                           int vertex_count,
+                           const int* indices,
+                           int index_count) override;
+
+  std::unique_ptr<Texture> CreateTargetTexture(int width, int height) override;
+  Graphics2D* SetRenderTarget(Texture* texture) override;
+  Texture* GetRenderTarget() override;
+
   Graphics2D* Clear() override;
   Graphics2D* Present() override;
 
@@ -37,6 +49,12 @@ class TestGraphics2D : public Graphics2D {
   // Things to check after calls
   Rect<int64_t, 2> draw_texture_dest;
   Texture* draw_texture_texture;
+  int draw_texture_count = 0;
+  int draw_geometry_count = 0;
+  std::vector<SDL_Vertex> geometry_vertices;
+  std::vector<int> geometry_indices;
+  int created_texture_count = 0;
+  Texture* render_target = nullptr;
 };
 
 }  // namespace test
@@ -50,6 +50,14 @@ bool Texture::SetAlphaMod(uint8_t alpha) {
   return SDL_SetTextureAlphaMod(texture_, alpha) >= 0;
 }
 
+bool Texture::SetBlendMode(SDL_BlendMode mode) {
+  return SDL_SetTextureBlendMode(texture_, mode) >= 0;
+}
+
+bool Texture::GetBlendMode(SDL_BlendMode* mode) const {
+  return SDL_GetTextureBlendMode(texture_, mode) >= 0;
+}
+
 Rect<> Texture::GetSize() const {
   int w, h;
   if (SDL_QueryTexture(texture_, /*format=*/nullptr, /*access=*/nullptr, &w,
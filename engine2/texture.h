@@ -31,6 +31,8 @@ class Texture {
 
   bool SetColorMod(RgbaColor color);
   bool SetAlphaMod(uint8_t alpha);
+  bool SetBlendMode(SDL_BlendMode mode);
+  bool GetBlendMode(SDL_BlendMode* mode) const;
   Rect<> GetSize() const;
 
  private:
@@ -0,0 +1,210 @@
+#include "engine2/texture_atlas.h"
+
+#include <algorithm>
+
+namespace engine2 {
+
+SkylinePacker::SkylinePacker(const Vec<int64_t, 2>& size)
+    : size_(size), skyline_{{0, 0, size.x()}} {}
+
+bool SkylinePacker::Insert(const Vec<int64_t, 2>& size, Point<>* position) {
+  int best_index = -1;
+  int64_t best_bottom = 0;
+  for (int i = 0; i < skyline_.size(); ++i) {
+    int64_t y = GetFitY(i, size);
+    if (y >= 0 && (best_index < 0 || y + size.y() < best_bottom)) {
+      best_index = i;
+      best_bottom = y + size.y();
+    }
+  }
+  if (best_index < 0)
+    return false;
+  *position = {skyline_[best_index].x, best_bottom - size.y()};
+
+  // The new segment covers the ones under the rect, which are cut back or
+  // removed.
+  int64_t right = position->x() + size.x();
+  skyline_.insert(skyline_.begin() + best_index,
+                  {position->x(), best_bottom, size.x()});
+  int next = best_index + 1;
+  while (next < skyline_.size() && skyline_[next].x < right) {
+    Segment& segment = skyline_[next];
+    if (segment.x + segment.w <= right) {
+      skyline_.erase(skyline_.begin() + next);
+    } else {
+      segment.w -= right - segment.x;
+      segment.x = right;
+      break;
+    }
+  }
+  // Neighbours at the same height become one segment.
+  for (int i = 0; i + 1 < skyline_.size();) {
+    if (skyline_[i].y == skyline_[i + 1].y) {
+      skyline_[i].w += skyline_[i + 1].w;
+      skyline_.erase(skyline_.begin() + i + 1);
+    } else {
+      ++i;
+    }
+  }
+  return true;
+}
+
+int64_t SkylinePacker::GetFitY(int index, const Vec<int64_t, 2>& size) const {
+  if (skyline_[index].x + size.x() > size_.x())
+    return -1;
+  // The rect rests on the highest segment under it.
+  int64_t y = 0;
+  int64_t width_left = size.x();
+  for (int i = index; width_left > 0; ++i) {
+    y = std::max(y, skyline_[i].y);
+    width_left -= skyline_[i].w;
+  }
+  return y + size.y() <= size_.y() ? y : -1;
+}
+
+TextureAtlas::TextureAtlas(Graphics2D* graphics,
+                           const Vec<int64_t, 2>& page_size,
+                           int padding)
+    : graphics_(graphics), page_size_(page_size), padding_(padding) {}
+
+bool TextureAtlas::Add(Sprite* sprite) {
+  Texture* source = sprite->texture();
+  if (!source)
+    return false;
+  for (const Page& page : pages_) {
+    if (page.texture.get() == source)
+      return true;
+  }
+  source_textures_.insert(source);
+  for (int i = 0; i < pages_.size(); ++i) {
+    if (AddToPage(i, sprite)) {
+      ++packed_sprite_count_;
+      return true;
+    }
+  }
+
+  auto texture =
+      graphics_->CreateTargetTexture(page_size_.x(), page_size_.y());
+  if (texture) {
+    ClearPage(texture.get());
+    pages_.push_back({std::move(texture), SkylinePacker(page_size_)});
+    if (AddToPage(pages_.size() - 1, sprite)) {
+      ++packed_sprite_count_;
+      return true;
+    }
+    // Nothing fits on a page that stays empty.
+    pages_.pop_back();
+  }
+  ++unpacked_sprite_count_;
+  unpacked_textures_.insert(source);
+  return false;
+}
+
+void TextureAtlas::Restore() {
+  for (const Page& page : pages_)
+    ClearPage(page.texture.get());
+  // |regions_| is sorted by source texture first.
+  std::vector<Copy> copies;
+  for (auto it = regions_.begin(); it != regions_.end(); ++it) {
+    copies.push_back(*it);
+    auto next = std::next(it);
+    Texture* source = std::get<0>(it->first);
+    if (next == regions_.end() || std::get<0>(next->first) != source) {
+      CopyFrames(source, copies);
+      copies.clear();
+    }
+  }
+}
+
+TextureAtlas::Report TextureAtlas::GetReport() const {
+  Report report;
+  report.page_count = pages_.size();
+  double page_area = page_size_.x() * page_size_.y();
+  for (const Page& page : pages_)
+    report.page_utilization.push_back(page.used_area / page_area);
+  report.packed_sprite_count = packed_sprite_count_;
+  report.unpacked_sprite_count = unpacked_sprite_count_;
+  report.source_texture_count = source_textures_.size();
+  report.texture_count = pages_.size() + unpacked_textures_.size();
+  return report;
+}
+
+bool TextureAtlas::AddToPage(int page_index, Sprite* sprite) {
+  Page& page = pages_[page_index];
+  Texture* source = sprite->texture();
+  // Packs onto a copy, so nothing changes unless every frame fits.
+  SkylinePacker packer = page.packer;
+  std::map<FrameKey, Rect<>> copies;
+  std::vector<Rect<>> rects(sprite->FrameCount());
+  for (int i = 0; i < sprite->FrameCount(); ++i) {
+    const Rect<>& source_rect = sprite->Frame(i).source_rect;
+    if (source_rect.w() <= 0 || source_rect.h() <= 0)
+      continue;
+    FrameKey key{source, source_rect.x(), source_rect.y(), source_rect.w(),
+                 source_rect.h()};
+    auto region = regions_.find(key);
+    if (region != regions_.end() && region->second.page == page_index) {
+      rects[i] = region->second.rect;
+      continue;
+    }
+    auto copy = copies.find(key);
+    if (copy != copies.end()) {
+      rects[i] = copy->second;
+      continue;
+    }
+    Point<> position;
+    if (!packer.Insert(source_rect.size + Vec<int64_t, 2>::Fill(2 * padding_),
+                       &position)) {
+      return false;
+    }
+    rects[i] = {position + Vec<int64_t, 2>::Fill(padding_), source_rect.size};
+    copies.emplace(key, rects[i]);
+  }
+
+  std::vector<Copy> new_regions;
+  for (const auto& [key, rect] : copies) {
+    auto [texture, x, y, w, h] = key;
+    page.used_area += w * h;
+    new_regions.push_back({key, Region{page_index, rect}});
+  }
+  CopyFrames(source, new_regions);
+  regions_.insert(new_regions.begin(), new_regions.end());
+  page.packer = packer;
+
+  for (int i = 0; i < sprite->FrameCount(); ++i)
+    sprite->Frame(i).source_rect = rects[i];
+  sprite->SetTexture(page.texture.get());
+  return true;
+}
+
+void TextureAtlas::ClearPage(Texture* page) {
+  Texture* previous_target = graphics_->GetRenderTarget();
+  RgbaColor previous_color = graphics_->GetDrawColor();
+  graphics_->SetRenderTarget(page);
+  graphics_->SetDrawColor({0, 0, 0, kTransparent})->Clear();
+  graphics_->SetRenderTarget(previous_target);
+  graphics_->SetDrawColor(previous_color);
+}
+
+void TextureAtlas::CopyFrames(Texture* source,
+                              const std::vector<Copy>& copies) {
+  SDL_BlendMode blend_mode;
+  bool has_blend_mode = source->GetBlendMode(&blend_mode);
+  source->SetBlendMode(SDL_BLENDMODE_NONE);
+  Texture* previous_target = graphics_->GetRenderTarget();
+  Texture* target = previous_target;
+  for (const auto& [key, region] : copies) {
+    Texture* page = pages_[region.page].texture.get();
+    if (page != target) {
+      graphics_->SetRenderTarget(page);
+      target = page;
+    }
+    auto [texture, x, y, w, h] = key;
+    graphics_->DrawTexture(*source, Rect<>{x, y, w, h}, region.rect);
+  }
+  graphics_->SetRenderTarget(previous_target);
+  if (has_blend_mode)
+    source->SetBlendMode(blend_mode);
+}
+
+}  // namespace engine2
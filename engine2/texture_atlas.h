@@ -0,0 +1,127 @@
+#ifndef ENGINE2_TEXTURE_ATLAS_H_
+#define ENGINE2_TEXTURE_ATLAS_H_
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "engine2/graphics2d.h"
+#include "engine2/rect.h"
+#include "engine2/sprite.h"
+#include "engine2/texture.h"
+
+namespace engine2 {
+
+// Packs rects into a page of a fixed size with the skyline algorithm. The top
+// of the packed area is kept as a list of horizontal segments, and each rect
+// goes where its bottom edge ends up highest, ties going left.
+class SkylinePacker {
+ public:
+  explicit SkylinePacker(const Vec<int64_t, 2>& size);
+
+  // Finds room for a rect of |size| and sets |position| to its top left
+  // corner. Returns false if it doesn't fit.
+  bool Insert(const Vec<int64_t, 2>& size, Point<>* position);
+  const Vec<int64_t, 2>& size() const { return size_; }
+
+ private:
+  struct Segment {
+    int64_t x;
+    // The top of the free space above the segment.
+    int64_t y;
+    int64_t w;
+  };
+
+  // The y a rect of |size| would go at on segment |index|, or -1 if it
+  // doesn't fit there.
+  int64_t GetFitY(int index, const Vec<int64_t, 2>& size) const;
+
+  Vec<int64_t, 2> size_;
+  std::vector<Segment> skyline_;
+};
+
+// Copies sprites' frames out of their own textures into a few large pages,
+// so draws that mix sprite sheets use the same texture and can be batched,
+// e.g. by TileMap::SetBatchDrawing(). Frames that sprites share are copied
+// once per page.
+class TextureAtlas {
+ public:
+  struct Report {
+    int page_count = 0;
+    // The share of each page's area covered by frames.
+    std::vector<double> page_utilization;
+    int packed_sprite_count = 0;
+    // Sprites with frames too big for a page keep their own texture.
+    int unpacked_sprite_count = 0;
+    // Distinct textures the sprites drew from before and after packing.
+    // Drawing a mix of every sprite takes at least this many batches.
+    int source_texture_count = 0;
+    int texture_count = 0;
+  };
+
+  // Pages are |page_size| pixels. |padding| transparent pixels go around each
+  // frame so filtering doesn't pick up its neighbours. |graphics| must
+  // outlive the atlas.
+  explicit TextureAtlas(Graphics2D* graphics,
+                        const Vec<int64_t, 2>& page_size = {2048, 2048},
+                        int padding = 1);
+  TextureAtlas(const TextureAtlas&) = delete;
+  TextureAtlas& operator=(const TextureAtlas&) = delete;
+
+  // Copies |sprite|'s frames into one page and points the sprite and its
+  // frames' source rects at it. Returns false, leaving the sprite alone, if
+  // its frames don't fit in an empty page or a page can't be made. The atlas
+  // must outlive the sprite, and the sprite's texture must outlive the atlas
+  // so Restore() can copy from it again.
+  bool Add(Sprite* sprite);
+
+  // Pages are render targets, which lose their contents on
+  // SDL_RENDER_TARGETS_RESET. Call this then to copy every frame back.
+  void Restore();
+
+  int GetPageCount() const { return pages_.size(); }
+  Texture* GetPage(int index) const { return pages_[index].texture.get(); }
+  Report GetReport() const;
+
+ private:
+  struct Page {
+    std::unique_ptr<Texture> texture;
+    SkylinePacker packer;
+    int64_t used_area = 0;
+  };
+  // A source texture and rect.
+  using FrameKey = std::tuple<Texture*, int64_t, int64_t, int64_t, int64_t>;
+  // Where a frame was copied to.
+  struct Region {
+    int page;
+    Rect<> rect;
+  };
+  using Copy = std::pair<FrameKey, Region>;
+
+  // Copies |sprite|'s frames into page |page_index|. Returns false, changing
+  // nothing, if they don't all fit.
+  bool AddToPage(int page_index, Sprite* sprite);
+  // Fills |page| with transparent pixels.
+  void ClearPage(Texture* page);
+  // Copies the frames in |copies|, which all come from |source|, to their
+  // pages as they are, instead of blending them onto the pages.
+  void CopyFrames(Texture* source, const std::vector<Copy>& copies);
+
+  Graphics2D* graphics_;
+  Vec<int64_t, 2> page_size_;
+  int padding_;
+  std::vector<Page> pages_;
+  std::map<FrameKey, Region> regions_;
+  std::set<Texture*> source_textures_;
+  std::set<Texture*> unpacked_textures_;
+  int packed_sprite_count_ = 0;
+  int unpacked_sprite_count_ = 0;
+};
+
+}  // namespace engine2
+
+#endif  // ENGINE2_TEXTURE_ATLAS_H_
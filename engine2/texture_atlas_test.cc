@@ -0,0 +1,167 @@
+#include "engine2/texture_atlas.h"
+#include "engine2/texture_atlas_test.h"
+#include "engine2/test/assert_macros.h"
+#include "engine2/test_graphics2d.h"
+
+namespace engine2 {
+namespace test {
+namespace {
+
+Sprite::AnimationFrame MakeFrame(const Rect<>& source_rect) {
+  return {source_rect, {}, Time::Delta::FromSeconds(1)};
+}
+
+}  // namespace
+
+void TextureAtlasTest::TestSkylinePacker() {
+  SkylinePacker packer({64, 64});
+  // Sixteen 16x16 rects fill the page exactly, without overlapping.
+  std::vector<Rect<>> rects;
+  bool all_fit = true;
+  for (int i = 0; i < 16; ++i) {
+    Point<> position;
+    all_fit = all_fit && packer.Insert({16, 16}, &position);
+    rects.push_back({position, {16, 16}});
+  }
+  EXPECT_TRUE(all_fit);
+  bool overlap = false;
+  bool inside = true;
+  for (int i = 0; i < rects.size(); ++i) {
+    inside = inside && Rect<>{{0, 0}, {64, 64}}.Contains(rects[i].pos) &&
+             rects[i].x() + 16 <= 64 && rects[i].y() + 16 <= 64;
+    for (int j = 0; j < i; ++j)
+      overlap = overlap || rects[i].Overlaps(rects[j]);
+  }
+  EXPECT_FALSE(overlap);
+  EXPECT_TRUE(inside);
+  Point<> position;
+  bool fit = packer.Insert({1, 1}, &position);
+  EXPECT_FALSE(fit);
+
+  // Short rects fill in next to tall ones.
+  SkylinePacker mixed({64, 64});
+  mixed.Insert({32, 48}, &position);
+  EXPECT_TRUE((Point<>{0, 0}) == position);
+  mixed.Insert({32, 16}, &position);
+  EXPECT_TRUE((Point<>{32, 0}) == position);
+  mixed.Insert({32, 16}, &position);
+  EXPECT_TRUE((Point<>{32, 16}) == position);
+  mixed.Insert({64, 16}, &position);
+  EXPECT_TRUE((Point<>{0, 48}) == position);
+  fit = mixed.Insert({65, 1}, &position);
+  EXPECT_FALSE(fit);
+}
+
+void TextureAtlasTest::TestAdd() {
+  TestGraphics2D graphics;
+  TextureAtlas atlas(&graphics, {64, 64}, /*padding=*/1);
+  Texture sheet0(nullptr);
+  Texture sheet1(nullptr);
+  Sprite tree(&sheet0, {MakeFrame({0, 0, 16, 16}), MakeFrame({16, 0, 16, 16}),
+                        MakeFrame({0, 0, 16, 16})});
+  Sprite rock(&sheet1, {MakeFrame({0, 0, 8, 8})});
+  // Shares a frame with |tree|.
+  Sprite stump(&sheet0, {MakeFrame({16, 0, 16, 16})});
+
+  bool added = atlas.Add(&tree);
+  EXPECT_TRUE(added);
+  EXPECT_EQ(1, graphics.created_texture_count);
+  Texture* page = atlas.GetPage(0);
+  EXPECT_EQ(page, tree.texture());
+  // Repeated frames are copied once.
+  EXPECT_EQ(2, graphics.draw_texture_count);
+  EXPECT_TRUE((Rect<>{1, 1, 16, 16}) == tree.Frame(0).source_rect);
+  EXPECT_TRUE(tree.Frame(0).source_rect == tree.Frame(2).source_rect);
+  EXPECT_FALSE(tree.Frame(1).source_rect.Overlaps(tree.Frame(0).source_rect));
+  EXPECT_NULL(graphics.GetRenderTarget());
+
+  added = atlas.Add(&rock);
+  EXPECT_TRUE(added);
+  added = atlas.Add(&stump);
+  EXPECT_TRUE(added);
+  EXPECT_EQ(page, rock.texture());
+  EXPECT_EQ(page, stump.texture());
+  EXPECT_EQ(3, graphics.draw_texture_count);
+  EXPECT_TRUE(tree.Frame(1).source_rect == stump.Frame(0).source_rect);
+  // Adding a packed sprite again does nothing.
+  added = atlas.Add(&stump);
+  EXPECT_TRUE(added);
+  EXPECT_EQ(3, graphics.draw_texture_count);
+
+  TextureAtlas::Report report = atlas.GetReport();
+  EXPECT_EQ(1, report.page_count);
+  EXPECT_EQ(3, report.packed_sprite_count);
+  EXPECT_EQ(0, report.unpacked_sprite_count);
+  EXPECT_EQ(2, report.source_texture_count);
+  EXPECT_EQ(1, report.texture_count);
+  ASSERT_EQ(1, report.page_utilization.size());
+  EXPECT_EQ((2 * 16 * 16 + 8 * 8) / (64. * 64.), report.page_utilization[0]);
+}
+
+void TextureAtlasTest::TestPages() {
+  TestGraphics2D graphics;
+  TextureAtlas atlas(&graphics, {32, 32}, /*padding=*/0);
+  Texture sheet(nullptr);
+  // Each fills half a page, and a sprite's frames stay on one page.
+  Sprite a(&sheet, {MakeFrame({0, 0, 32, 16})});
+  Sprite b(&sheet, {MakeFrame({0, 16, 32, 16}), MakeFrame({0, 32, 32, 16})});
+  Sprite c(&sheet, {MakeFrame({0, 48, 32, 16})});
+  Sprite huge(&sheet, {MakeFrame({0, 0, 64, 64})});
+
+  atlas.Add(&a);
+  atlas.Add(&b);
+  atlas.Add(&c);
+  EXPECT_EQ(2, atlas.GetPageCount());
+  EXPECT_EQ(atlas.GetPage(0), a.texture());
+  EXPECT_EQ(atlas.GetPage(1), b.texture());
+  EXPECT_EQ(atlas.GetPage(0), c.texture());
+
+  bool added = atlas.Add(&huge);
+  EXPECT_FALSE(added);
+  EXPECT_EQ(&sheet, huge.texture());
+  EXPECT_TRUE((Rect<>{0, 0, 64, 64}) == huge.Frame(0).source_rect);
+  EXPECT_EQ(2, atlas.GetPageCount());
+
+  TextureAtlas::Report report = atlas.GetReport();
+  EXPECT_EQ(2, report.page_count);
+  EXPECT_EQ(3, report.packed_sprite_count);
+  EXPECT_EQ(1, report.unpacked_sprite_count);
+  EXPECT_EQ(1, report.source_texture_count);
+  EXPECT_EQ(3, report.texture_count);
+  EXPECT_EQ(1., report.page_utilization[0]);
+  EXPECT_EQ(1., report.page_utilization[1]);
+}
+
+void TextureAtlasTest::TestRestore() {
+  TestGraphics2D graphics;
+  TextureAtlas atlas(&graphics, {32, 32}, /*padding=*/0);
+  Texture sheet(nullptr);
+  Texture other_sheet(nullptr);
+  Sprite a(&sheet, {MakeFrame({0, 0, 32, 16}), MakeFrame({0, 0, 32, 16})});
+  Sprite b(&sheet, {MakeFrame({0, 16, 32, 16}), MakeFrame({0, 32, 32, 16})});
+  Sprite c(&other_sheet, {MakeFrame({0, 0, 16, 16})});
+  atlas.Add(&a);
+  atlas.Add(&b);
+  atlas.Add(&c);
+  ASSERT_EQ(2, atlas.GetPageCount());
+
+  // Every unique frame is copied again, and the target is put back.
+  int draw_count = graphics.draw_texture_count;
+  atlas.Restore();
+  EXPECT_EQ(draw_count + 4, graphics.draw_texture_count);
+  EXPECT_NULL(graphics.render_target);
+  EXPECT_EQ(atlas.GetPage(0), a.texture());
+  EXPECT_EQ(atlas.GetPage(1), b.texture());
+}
+
+TextureAtlasTest::TextureAtlasTest()
+    : TestGroup("TextureAtlasTest",
+                {
+                    std::bind(&TextureAtlasTest::TestSkylinePacker, this),
+                    std::bind(&TextureAtlasTest::TestAdd, this),
+                    std::bind(&TextureAtlasTest::TestPages, this),
+                    std::bind(&TextureAtlasTest::TestRestore, this),
+                }) {}
+
+}  // namespace test
+}  // namespace engine2
@@ -0,0 +1,21 @@
+#ifndef ENGINE2_TEXTURE_ATLAS_TEST_H_
+#define ENGINE2_TEXTURE_ATLAS_TEST_H_
+
+#include "engine2/test/test_group.h"
+
+namespace engine2 {
+namespace test {
+
+class TextureAtlasTest : public TestGroup {
+ public:
+  void TestSkylinePacker();
+  void TestAdd();
+  void TestPages();
+  void TestRestore();
+  TextureAtlasTest();
+};
+
+}  // namespace test
+}  // namespace engine2
+
+#endif  // ENGINE2_TEXTURE_ATLAS_TEST_H_
@@ -1,10 +1,12 @@
-#include <cstring>
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <map>
 #include <sstream>
 
-extern "C" {
-#include <endian.h>
-}
-
+#include "engine2/base/binary_io.h"
+#include "engine2/base/compression.h"
+#include "engine2/base/mapped_file.h"
 #include "engine2/camera2d.h"
 #include "engine2/sprite_cache.h"
 #include "engine2/tile_map.h"
@@ -12,97 +14,211 @@ extern "C" {
 namespace engine2 {
 namespace {
 
-// The endianness conversion functions are wrapped like this because I can't
-// seem to pass them as function pointers directly.
-uint16_t Le16ToH(uint16_t val) {
-  return le16toh(val);
-}
-uint32_t Le32ToH(uint32_t val) {
-  return le32toh(val);
-}
-uint64_t Le64ToH(uint64_t val) {
-  return le64toh(val);
-}
-uint16_t HToLe16(uint16_t val) {
-  return htole16(val);
-}
-uint32_t HToLe32(uint32_t val) {
-  return htole32(val);
-}
-uint64_t HToLe64(uint64_t val) {
-  return htole64(val);
+// Files from version 2 on start with this, which can't be the start of a
+// version 1 file's tile width.
+constexpr uint32_t kMagic = 0x504d3245;  // "E2MP"
+constexpr uint32_t kFormatVersion = 3;
+// A raw grid starts at a multiple of this, so it can be mapped straight into
+// memory.
+constexpr int64_t kGridAlignment = 4096;
+
+constexpr bool kLittleEndian = __BYTE_ORDER == __LITTLE_ENDIAN;
+
+constexpr int kChunkTileCount = TileMap::kChunkSize * TileMap::kChunkSize;
+// Sparse chunks keep a row of tiles in one word.
+static_assert(TileMap::kChunkSize == 64, "Sparse tiles need 64-tile rows");
+
+// Reads |count| little-endian tile indices into |tiles|.
+bool ReadIndices(std::istream& stream, uint16_t* tiles, int64_t count) {
+  stream.read(reinterpret_cast<char*>(tiles), count * sizeof(uint16_t));
+  for (int64_t i = 0; i < count; ++i)
+    tiles[i] = le16toh(tiles[i]);
+  return stream.good();
 }
 
-template <class T>
-bool ReadInt(std::istream& stream, T& out, T (*conv)(T)) {
-  out = 0;
-  for (int i = 0; i < sizeof(T); ++i)
-    out |= (T(stream.get()) << (i * 8));
-  out = conv(out);
+bool WriteIndices(std::ostream& stream, const uint16_t* tiles, int64_t count) {
+  std::vector<uint16_t> little_endian(tiles, tiles + count);
+  for (uint16_t& index : little_endian)
+    index = htole16(index);
+  stream.write(reinterpret_cast<const char*>(little_endian.data()),
+               count * sizeof(uint16_t));
   return stream.good();
 }
 
-bool ReadInt16(std::istream& stream, uint16_t& out) {
-  return ReadInt(stream, out, Le16ToH);
-}
-bool ReadInt32(std::istream& stream, uint32_t& out) {
-  return ReadInt(stream, out, Le32ToH);
-}
-bool ReadInt64(std::istream& stream, uint64_t& out) {
-  return ReadInt(stream, out, Le64ToH);
+// Reads the table at the start of a compressed grid. Chunk i is stored in bytes
+// [table[i], table[i + 1]) from the start of the grid.
+bool ReadBlockTable(std::istream& stream,
+                    int64_t chunk_count,
+                    std::vector<uint64_t>* table) {
+  table->resize(chunk_count + 1);
+  for (uint64_t& offset : *table) {
+    if (!ReadInt64(stream, offset))
+      return false;
+  }
+  return (*table)[0] == table->size() * sizeof(uint64_t) &&
+         std::is_sorted(table->begin(), table->end());
 }
 
-bool ReadVec2Int64(std::istream& stream, Vec<int64_t, 2>& out) {
-  uint64_t x, y;
-  if (!ReadInt64(stream, x) || !ReadInt64(stream, y))
+// Reads a |size| byte block of a compressed grid and decompresses it into
+// |count| indices. An empty block is a chunk of tile 0.
+bool ReadBlock(std::istream& stream,
+               uint64_t size,
+               uint16_t* tiles,
+               int64_t count) {
+  if (size == 0) {
+    std::fill_n(tiles, count, 0);
+    return true;
+  }
+  // Compressed chunks are never much bigger than raw ones, so anything larger
+  // is corrupt.
+  if (size > 2 * count * sizeof(uint16_t) + 64)
     return false;
-  out[0] = x;
-  out[1] = y;
-  return true;
+  std::vector<uint8_t> block(size);
+  stream.read(reinterpret_cast<char*>(block.data()), size);
+  return stream.good() && DecompressUint16(block.data(), size, tiles, count);
 }
 
-bool ReadString(std::istream& stream, std::string& str) {
-  uint32_t length;
-  if (!ReadInt32(stream, length))
-    return false;
-
-  auto data = std::make_unique<char[]>(length + 1);
-  data.get()[length] = '\0';
-
-  stream.read(data.get(), length);
-  str.assign(data.get(), length);
-
-  return stream.good();
+// Converts a chunk's |layer_count| layers of tiles from the interleaved layout
+// to the layer-major one, or back.
+void ConvertLayout(uint16_t* tiles, int layer_count, bool to_layer_major) {
+  if (layer_count == 1)
+    return;
+  constexpr int kLayerSize = TileMap::kChunkSize * TileMap::kChunkSize;
+  std::vector<uint16_t> original(tiles, tiles + kLayerSize * layer_count);
+  for (int tile = 0; tile < kLayerSize; ++tile) {
+    for (int layer = 0; layer < layer_count; ++layer) {
+      int interleaved = tile * layer_count + layer;
+      int layer_major = layer * kLayerSize + tile;
+      if (to_layer_major)
+        tiles[layer_major] = original[interleaved];
+      else
+        tiles[interleaved] = original[layer_major];
+    }
+  }
 }
 
-template <class T>
-bool WriteInt(std::ostream& stream, T val, T (*conv)(T)) {
-  T le_val = conv(val);
-  for (int i = 0; i < sizeof(T); ++i)
-    stream.put((le_val >> (i * 8)) & 0xff);
-  return stream.good();
+// Returns the most common of |count| tile indices. Ties go to the first,
+// unless it's tile 0.
+uint16_t MostCommonIndex(const uint16_t* indices, int count) {
+  uint16_t best = 0;
+  int best_count = 0;
+  for (int i = 0; i < count; ++i) {
+    int n = std::count(indices, indices + count, indices[i]);
+    if (n > best_count || (n == best_count && best == 0)) {
+      best = indices[i];
+      best_count = n;
+    }
+  }
+  return best;
 }
 
-bool WriteInt16(std::ostream& stream, uint16_t val) {
-  return WriteInt(stream, val, HToLe16);
-}
-bool WriteInt32(std::ostream& stream, uint32_t val) {
-  return WriteInt(stream, val, HToLe32);
-}
-bool WriteInt64(std::ostream& stream, uint64_t val) {
-  return WriteInt(stream, val, HToLe64);
+// Position of tile |tile| of a chunk, numbered row by row, in a tile array of
+// |layer_count| layers where its layer is |slot|.
+int DenseTileIndex(int tile, int slot, int layer_count, bool layer_major) {
+  return layer_major ? slot * kChunkTileCount + tile
+                     : tile * layer_count + slot;
 }
 
-bool WriteVec2Int64(std::ostream& stream, const Vec<int64_t, 2>& val) {
-  return WriteInt64(stream, val[0]) && WriteInt64(stream, val[1]);
+int64_t ChunkIndex(const Rect<>& grid_rect, int64_t chunk_columns) {
+  return grid_rect.y() / TileMap::kChunkSize * chunk_columns +
+         grid_rect.x() / TileMap::kChunkSize;
 }
 
-bool WriteString(std::ostream& stream, const std::string& str) {
-  if (!WriteInt32(stream, str.length()))
-    return false;
-  stream.write(str.data(), str.length());
-  return stream.good();
-}
+// Loads chunks from a version 1 map file, which stores each tile's indices for
+// all layers, row by row.
+class RowMajorChunkSource : public TileMap::ChunkSource {
+ public:
+  RowMajorChunkSource(std::unique_ptr<std::istream> stream,
+                      std::streamoff grid_offset,
+                      int64_t grid_width)
+      : stream_(std::move(stream)),
+        grid_offset_(grid_offset),
+        grid_width_(grid_width) {}
+
+  bool LoadChunk(const Rect<>& grid_rect,
+                 int layer_count,
+                 uint16_t* tiles) override {
+    for (int64_t y = 0; y < grid_rect.h(); ++y) {
+      int64_t first_tile = (grid_rect.y() + y) * grid_width_ + grid_rect.x();
+      stream_->seekg(grid_offset_ +
+                     first_tile * layer_count * sizeof(uint16_t));
+      if (!ReadIndices(*stream_, tiles + y * TileMap::kChunkSize * layer_count,
+                       grid_rect.w() * layer_count)) {
+        stream_->clear();
+        return false;
+      }
+    }
+    return true;
+  }
+
+ private:
+  std::unique_ptr<std::istream> stream_;
+  std::streamoff grid_offset_;
+  int64_t grid_width_;
+};
+
+// Loads chunks from a raw grid, which stores each chunk in one piece, laid out
+// the same way as in memory.
+class ChunkMajorChunkSource : public TileMap::ChunkSource {
+ public:
+  ChunkMajorChunkSource(std::unique_ptr<std::istream> stream,
+                        std::streamoff grid_offset,
+                        int64_t chunk_columns)
+      : stream_(std::move(stream)),
+        grid_offset_(grid_offset),
+        chunk_columns_(chunk_columns) {}
+
+  bool LoadChunk(const Rect<>& grid_rect,
+                 int layer_count,
+                 uint16_t* tiles) override {
+    int64_t chunk_index = ChunkIndex(grid_rect, chunk_columns_);
+    int64_t count = TileMap::kChunkSize * TileMap::kChunkSize * layer_count;
+    stream_->seekg(grid_offset_ + chunk_index * count * sizeof(uint16_t));
+    if (!ReadIndices(*stream_, tiles, count)) {
+      stream_->clear();
+      return false;
+    }
+    return true;
+  }
+
+ private:
+  std::unique_ptr<std::istream> stream_;
+  std::streamoff grid_offset_;
+  int64_t chunk_columns_;
+};
+
+// Loads chunks from a compressed grid.
+class CompressedChunkSource : public TileMap::ChunkSource {
+ public:
+  CompressedChunkSource(std::unique_ptr<std::istream> stream,
+                        std::streamoff grid_offset,
+                        int64_t chunk_columns,
+                        std::vector<uint64_t> block_table)
+      : stream_(std::move(stream)),
+        grid_offset_(grid_offset),
+        chunk_columns_(chunk_columns),
+        block_table_(std::move(block_table)) {}
+
+  bool LoadChunk(const Rect<>& grid_rect,
+                 int layer_count,
+                 uint16_t* tiles) override {
+    int64_t chunk_index = ChunkIndex(grid_rect, chunk_columns_);
+    uint64_t begin = block_table_[chunk_index];
+    stream_->seekg(grid_offset_ + begin);
+    if (!ReadBlock(*stream_, block_table_[chunk_index + 1] - begin, tiles,
+                   TileMap::kChunkSize * TileMap::kChunkSize * layer_count)) {
+      stream_->clear();
+      return false;
+    }
+    return true;
+  }
+
+ private:
+  std::unique_ptr<std::istream> stream_;
+  std::streamoff grid_offset_;
+  int64_t chunk_columns_;
+  std::vector<uint64_t> block_table_;
+};
 
 }  // namespace
 
@@ -113,12 +229,156 @@ std::unique_ptr<TileMap> TileMap::FromString(const std::string& data,
   return Read(stream, sprite_cache);
 }
 
+// static
+std::unique_ptr<TileMap> TileMap::FromFile(const std::string& path,
+                                           SpriteCache* sprite_cache) {
+  // A raw grid is already in the in-memory layout, so its chunks can point
+  // straight into a mapping of the file.
+  std::unique_ptr<MappedFile> file =
+      kLittleEndian ? MappedFile::Open(path) : nullptr;
+  if (file) {
+    MemoryInputStream stream(file->data(), file->size());
+    FileLayout layout;
+    auto map = ReadHeader(stream, sprite_cache, &layout);
+    if (!map)
+      return nullptr;
+    if (layout.version >= 2 && layout.encoding == GridEncoding::kRaw) {
+      if (!map->MapGrid(std::move(file), layout.grid_offset))
+        return nullptr;
+      return map;
+    }
+  }
+
+  auto stream = std::make_unique<std::ifstream>(path, std::ios::binary);
+  if (stream->fail())
+    return nullptr;
+  return Open(std::move(stream), sprite_cache);
+}
+
+// static
 std::unique_ptr<TileMap> TileMap::Read(std::istream& stream,
                                        SpriteCache* sprite_cache) {
+  FileLayout layout;
+  auto map = ReadHeader(stream, sprite_cache, &layout);
+  if (!map)
+    return nullptr;
+
+  if (layout.version == 1) {
+    // Each row of the grid is split across a row of chunks.
+    GridPoint p;
+    for (p.y() = 0; p.y() < map->grid_size_.y(); ++p.y()) {
+      for (p.x() = 0; p.x() < map->grid_size_.x(); p.x() += kChunkSize) {
+        int64_t width =
+            std::min<int64_t>(kChunkSize, map->grid_size_.x() - p.x());
+        // New maps are interleaved, like the file.
+        uint16_t* row = map->GetChunk(p, /*create=*/true)->tiles +
+                        map->ChunkTileIndex(p, 0);
+        if (!ReadIndices(stream, row, width * map->layer_count_))
+          return nullptr;
+      }
+    }
+    return map;
+  }
+
+  stream.ignore(layout.grid_offset - stream.tellg());
+  int64_t count = kChunkSize * kChunkSize * map->layer_count_;
+  if (layout.encoding == GridEncoding::kCompressed) {
+    std::vector<uint64_t> table;
+    if (!ReadBlockTable(stream, map->chunks_.size(), &table))
+      return nullptr;
+    for (int i = 0; i < map->chunks_.size(); ++i) {
+      uint64_t size = table[i + 1] - table[i];
+      // Chunks of tile 0 don't need to be allocated.
+      if (size == 0)
+        continue;
+      GridPoint chunk_origin{map->GetChunkGridRect(i).pos};
+      Chunk* chunk = map->GetChunk(chunk_origin, /*create=*/true);
+      if (!ReadBlock(stream, size, chunk->tiles, count))
+        return nullptr;
+    }
+    return map;
+  }
+
+  for (int i = 0; i < map->chunks_.size(); ++i) {
+    GridPoint chunk_origin{map->GetChunkGridRect(i).pos};
+    Chunk* chunk = map->GetChunk(chunk_origin, /*create=*/true);
+    if (!ReadIndices(stream, chunk->tiles, count))
+      return nullptr;
+  }
+  return map;
+}
+
+// static
+std::unique_ptr<TileMap> TileMap::Open(std::unique_ptr<std::istream> stream,
+                                       SpriteCache* sprite_cache) {
+  FileLayout layout;
+  auto map = ReadHeader(*stream, sprite_cache, &layout);
+  if (!map)
+    return nullptr;
+
+  // Make sure the whole grid is there, so chunks only fail to load if the
+  // file changes.
+  std::streamoff grid_bytes;
+  std::vector<uint64_t> block_table;
+  if (layout.version == 1) {
+    grid_bytes = map->grid_size_.x() * map->grid_size_.y() *
+                 map->layer_count_ * sizeof(uint16_t);
+  } else if (layout.encoding == GridEncoding::kCompressed) {
+    stream->seekg(layout.grid_offset);
+    if (!ReadBlockTable(*stream, map->chunks_.size(), &block_table))
+      return nullptr;
+    grid_bytes = block_table.back();
+  } else {
+    grid_bytes = map->chunks_.size() * map->GetChunkBytes();
+  }
+  stream->seekg(0, std::ios::end);
+  if (!stream->good() || stream->tellg() - layout.grid_offset < grid_bytes)
+    return nullptr;
+
+  if (layout.version == 1) {
+    map->SetChunkSource(std::make_unique<RowMajorChunkSource>(
+        std::move(stream), layout.grid_offset, map->grid_size_.x()));
+  } else if (layout.encoding == GridEncoding::kCompressed) {
+    map->SetChunkSource(std::make_unique<CompressedChunkSource>(
+        std::move(stream), layout.grid_offset, map->chunk_grid_size_.x(),
+        std::move(block_table)));
+  } else {
+    map->SetChunkSource(std::make_unique<ChunkMajorChunkSource>(
+        std::move(stream), layout.grid_offset, map->chunk_grid_size_.x()));
+  }
+  return map;
+}
+
+// static
+std::unique_ptr<TileMap> TileMap::ReadHeader(std::istream& stream,
+                                             SpriteCache* sprite_cache,
+                                             FileLayout* layout) {
   Vec<int64_t, 2> tile_size, grid_size, position_in_world;
+  uint32_t first_word;
+  if (!ReadInt32(stream, first_word))
+    return nullptr;
+
+  if (first_word == kMagic) {
+    if (!ReadInt32(stream, layout->version) ||
+        layout->version < 2 || layout->version > kFormatVersion ||
+        !ReadVecInt64(stream, tile_size)) {
+      return nullptr;
+    }
+  } else {
+    // Version 1 files have no magic, so |first_word| is the low half of the
+    // tile width.
+    layout->version = 1;
+    uint32_t high_word;
+    uint64_t tile_height;
+    if (!ReadInt32(stream, high_word) || !ReadInt64(stream, tile_height))
+      return nullptr;
+    tile_size = {int64_t(uint64_t(high_word) << 32 | first_word),
+                 int64_t(tile_height)};
+  }
+
   uint32_t layer_count, tile_vector_size;
-  if (!ReadVec2Int64(stream, tile_size) || !ReadVec2Int64(stream, grid_size) ||
-      !ReadVec2Int64(stream, position_in_world) ||
+  if (!ReadVecInt64(stream, grid_size) ||
+      !ReadVecInt64(stream, position_in_world) ||
       !ReadInt32(stream, layer_count)) {
     return nullptr;
   }
@@ -167,38 +427,90 @@ std::unique_ptr<TileMap> TileMap::Read(std::istream& stream,
                   tile_tags});
   }
 
-  TileMap::GridPoint p;
-  for (p.y() = 0; p.y() < grid_size.y(); ++p.y()) {
-    for (p.x() = 0; p.x() < grid_size.x(); ++p.x()) {
-      for (int layer = 0; layer < layer_count; ++layer) {
-        uint16_t index;
-        if (!ReadInt16(stream, index))
-          return nullptr;
+  if (layout->version == 1) {
+    layout->grid_offset = stream.tellg();
+    return map;
+  }
 
-        map->SetTileIndex(p, layer, index);
-      }
+  uint32_t chunk_size;
+  if (!ReadInt32(stream, chunk_size) || chunk_size != kChunkSize)
+    return nullptr;
+  // Version 2 grids are always raw.
+  if (layout->version >= 3) {
+    uint32_t encoding;
+    if (!ReadInt32(stream, encoding) ||
+        encoding > uint32_t(GridEncoding::kCompressed)) {
+      return nullptr;
     }
+    layout->encoding = GridEncoding(encoding);
+  }
+  // The grid can't start inside the header, or past where a streamoff can
+  // seek.
+  uint64_t grid_offset;
+  if (!ReadInt64(stream, grid_offset) ||
+      grid_offset < uint64_t(stream.tellg()) ||
+      grid_offset > uint64_t(std::numeric_limits<std::streamoff>::max())) {
+    return nullptr;
+  }
+  layout->grid_offset = grid_offset;
+  return map;
+}
+
+bool TileMap::MapGrid(std::unique_ptr<MappedFile> file,
+                      std::streamoff grid_offset) {
+  size_t chunk_bytes = GetChunkBytes();
+  size_t grid_bytes;
+  if (grid_offset % kGridAlignment != 0 || grid_offset > file->size() ||
+      __builtin_mul_overflow(chunks_.size(), chunk_bytes, &grid_bytes) ||
+      grid_bytes > file->size() - grid_offset) {
+    return false;
   }
 
-  return std::move(map);
+  for (int i = 0; i < chunks_.size(); ++i) {
+    chunks_[i].tiles = reinterpret_cast<uint16_t*>(file->data() + grid_offset +
+                                                   i * chunk_bytes);
+  }
+  mapped_file_ = std::move(file);
+  return true;
 }
 
-bool TileMap::Write(std::ostream& stream) const {
-  if (!WriteVec2Int64(stream, tile_size_) ||
-      !WriteVec2Int64(stream, grid_size_) ||
-      !WriteVec2Int64(stream, world_rect_.pos) ||
-      !WriteInt32(stream, layer_count_)) {
+// Format version 3 (little-endian):
+//  u32 magic, u32 version, i64[2] tile size, i64[2] grid size,
+//  i64[2] position in world, u32 layer count,
+//  u32 tag count, then each tag as a u32 length and its characters,
+//  u32 tile count, then for each tile:
+//    sprite name as a u32 length and its characters, u32 animation offset in
+//    ms, u64 tags,
+//  u32 chunk size, u32 grid encoding, u64 grid offset, zeros up to the grid
+//  offset, then the grid.
+// A raw grid holds each chunk in row order as chunk size * chunk size * layer
+// count u16 indices, laid out as in memory, and starts at a multiple of
+// kGridAlignment. A compressed grid starts with a u64 offset from the grid
+// offset for each chunk and one for the end of the last chunk, followed by
+// each chunk's indices passed through CompressUint16(). Chunks of tile 0 are
+// stored as nothing.
+// Version 2 files have no grid encoding, and always store a raw grid. Version
+// 1 files have no magic, version, chunk size or grid offset, and store the grid
+// row by row right after the tiles.
+bool TileMap::Write(std::ostream& stream, GridEncoding encoding) const {
+  // The header is written separately so its size is known.
+  std::ostringstream header;
+  if (!WriteInt32(header, kMagic) || !WriteInt32(header, kFormatVersion) ||
+      !WriteVecInt64(header, tile_size_) ||
+      !WriteVecInt64(header, grid_size_) ||
+      !WriteVecInt64(header, world_rect_.pos) ||
+      !WriteInt32(header, layer_count_)) {
     return false;
   }
 
-  if (!WriteInt32(stream, tags_.size()))
+  if (!WriteInt32(header, tags_.size()))
     return false;
   for (const std::string& tag : tags_) {
-    if (!WriteString(stream, tag))
+    if (!WriteString(header, tag))
       return false;
   }
 
-  if (!WriteInt32(stream, tiles_.size()))
+  if (!WriteInt32(header, tiles_.size()))
     return false;
 
   for (const Tile& tile : tiles_) {
@@ -210,23 +522,70 @@ bool TileMap::Write(std::ostream& stream) const {
         return false;
     }
 
-    if (!WriteString(stream, sprite_name.value()) ||
-        !WriteInt32(stream, tile.animation_offset.ToMicroseconds() / 1000)) {
+    if (!WriteString(header, sprite_name.value()) ||
+        !WriteInt32(header, tile.animation_offset.ToMicroseconds() / 1000)) {
       return false;
     }
 
-    if (!WriteInt64(stream, tile.tags.to_ullong()))
+    if (!WriteInt64(header, tile.tags.to_ullong()))
       return false;
   }
 
-  TileMap::GridPoint p;
-  for (p.y() = 0; p.y() < grid_size_.y(); ++p.y()) {
-    for (p.x() = 0; p.x() < grid_size_.x(); ++p.x()) {
-      for (int layer = 0; layer < layer_count_; ++layer) {
-        if (!WriteInt16(stream, GetTileIndex(p, layer)))
-          return false;
+  if (!WriteInt32(header, kChunkSize) ||
+      !WriteInt32(header, uint32_t(encoding))) {
+    return false;
+  }
+  std::string header_data = header.str();
+  int64_t header_end = header_data.size() + sizeof(uint64_t);
+  int64_t alignment = encoding == GridEncoding::kRaw ? kGridAlignment : 1;
+  int64_t grid_offset = (header_end + alignment - 1) / alignment * alignment;
+
+  stream.write(header_data.data(), header_data.size());
+  if (!WriteInt64(stream, grid_offset))
+    return false;
+  std::string padding(grid_offset - header_end, '\0');
+  stream.write(padding.data(), padding.size());
+
+  int64_t count = kChunkSize * kChunkSize * layer_count_;
+  if (encoding == GridEncoding::kCompressed) {
+    // Every chunk is compressed first, since the offsets come before them.
+    std::vector<std::vector<uint8_t>> blocks(chunks_.size());
+    std::vector<uint16_t> tiles(count);
+    for (int i = 0; i < chunks_.size(); ++i) {
+      GridPoint chunk_origin{GetChunkGridRect(i).pos};
+      Chunk* chunk = GetChunk(chunk_origin, /*create=*/false);
+      if (!chunk)
+        continue;
+      GetInterleavedChunkTiles(*chunk, tiles.data());
+      if (std::any_of(tiles.begin(), tiles.end(),
+                      [](uint16_t index) { return index != 0; })) {
+        blocks[i] = CompressUint16(tiles.data(), count);
       }
     }
+
+    uint64_t offset = (blocks.size() + 1) * sizeof(uint64_t);
+    for (const std::vector<uint8_t>& block : blocks) {
+      if (!WriteInt64(stream, offset))
+        return false;
+      offset += block.size();
+    }
+    if (!WriteInt64(stream, offset))
+      return false;
+    for (const std::vector<uint8_t>& block : blocks) {
+      stream.write(reinterpret_cast<const char*>(block.data()), block.size());
+    }
+    return stream.good();
+  }
+
+  std::vector<uint16_t> tiles(count);
+  for (int i = 0; i < chunks_.size(); ++i) {
+    GridPoint chunk_origin{GetChunkGridRect(i).pos};
+    if (Chunk* chunk = GetChunk(chunk_origin, /*create=*/false))
+      GetInterleavedChunkTiles(*chunk, tiles.data());
+    else
+      std::fill(tiles.begin(), tiles.end(), 0);
+    if (!WriteIndices(stream, tiles.data(), count))
+      return false;
   }
   return true;
 }
@@ -242,11 +601,15 @@ TileMap::TileMap(const Vec<int64_t, 2>& tile_size,
       grid_size_(grid_size),
       layer_count_(layer_count) {
   world_rect_ = Rect<int64_t, 2>{position_in_world, grid_size * tile_size_};
-  size_t num_tiles = grid_size.x() * grid_size.y() * layer_count_;
-  grid_ = std::make_unique<uint16_t[]>(num_tiles);
 
-  if (empty_initialize)
-    std::memset(grid_.get(), 0, num_tiles * sizeof(uint16_t));
+  // Chunks always start out filled with tile 0, so |empty_initialize| is no
+  // longer needed.
+  chunk_grid_size_ = (grid_size + Vec<int64_t, 2>::Fill(kChunkSize - 1)) /
+                     Vec<int64_t, 2>::Fill(kChunkSize);
+  // Chunks can't be moved once they're linked into |loaded_chunks_|.
+  chunks_ = std::vector<Chunk>(chunk_grid_size_.x() * chunk_grid_size_.y());
+  layer_storage_.assign(layer_count_, LayerStorage::kDense);
+  UpdateDenseSlots();
 }
 
 void TileMap::Draw(Graphics2D* graphics,
@@ -262,6 +625,12 @@ void TileMap::Draw(Graphics2D* graphics,
     after_last_layer = layer + 1;
   }
 
+  // Streamed chunks near the view are loaded before it scrolls onto them.
+  if (chunk_source_) {
+    Vec<int64_t, 2> margin = tile_size_ * Vec<int64_t, 2>::Fill(kChunkSize);
+    Prefetch({world_rect.pos - margin, world_rect.size + margin + margin});
+  }
+
   GridPoint corner0 = WorldToGrid(world_rect.pos);
   GridPoint corner1 = WorldToGrid(world_rect.pos + world_rect.size);
   GridPoint start_corner = corner0;
@@ -294,32 +663,539 @@ void TileMap::Draw(Graphics2D* graphics,
 
   const Vec<double, 2> scale =
       window_rect.size.ConvertTo<double>() / world_rect.size;
-  Rect<int, 2> tile_draw_rect{{}, tile_size_ * scale};
-
-  // grid point to screen:
-  // ((point - corner0) * tile_size - offset) * scale_
   Vec<int64_t, 2> offset = (world_rect.pos - world_rect_.pos) % tile_size_;
+  ScreenMapping mapping{corner0, offset, scale};
+  Rect<> grid_rect{start_corner,
+                   end_corner - start_corner + Vec<int64_t, 2>::Ones()};
+  if (grid_rect.w() <= 0 || grid_rect.h() <= 0)
+    return;
 
+  int lod_level = ChooseLodLevel(scale);
+  if (lod_level > 0)
+    BuildLod(lod_level, grid_rect);
+  ++draw_clock_;
   for (int i = first_layer; i < after_last_layer; ++i) {
-    GridPoint point;
-    for (point.y() = start_corner.y(); point.y() <= end_corner.y();
-         ++point.y()) {
-      for (point.x() = start_corner.x(); point.x() <= end_corner.x();
-           ++point.x()) {
-        Tile* tile = GetTile(point, i);
-        if (tile && tile->sprite) {
-          tile_draw_rect.pos =
-              ((point - corner0) * tile_size_ - offset) * scale;
-
-          tile->sprite->Draw(graphics, tile_draw_rect);
-          if (observer_)
-            observer_->OnDrawTile(tile, tile_draw_rect);
+    if (lod_level > 0)
+      DrawLod(graphics, i, lod_level, grid_rect, mapping);
+    else if (render_cache_size_ > 0)
+      DrawCachedTiles(graphics, i, grid_rect, mapping);
+    else
+      DrawTiles(graphics, i, grid_rect, mapping, /*animated_only=*/false);
+  }
+}
+
+void TileMap::SetRenderCacheSize(int max_textures) {
+  render_cache_size_ = max_textures;
+  if (max_textures <= 0) {
+    render_chunks_.clear();
+    baked_render_chunks_.clear();
+    return;
+  }
+
+  if (render_chunks_.empty()) {
+    render_grid_size_ =
+        (grid_size_ + Vec<int64_t, 2>::Fill(kRenderChunkSize - 1)) /
+        Vec<int64_t, 2>::Fill(kRenderChunkSize);
+    render_chunks_.resize(render_grid_size_.x() * render_grid_size_.y() *
+                          layer_count_);
+  }
+  while (baked_render_chunks_.size() > max_textures)
+    EvictRenderChunk(/*used_since=*/draw_clock_ + 1);
+}
+
+void TileMap::InvalidateRenderCache() {
+  for (RenderChunk& chunk : render_chunks_)
+    chunk.valid = false;
+}
+
+void TileMap::DrawTiles(Graphics2D* graphics,
+                        int layer,
+                        const Rect<>& grid_rect,
+                        const ScreenMapping& mapping,
+                        bool animated_only) {
+  // grid point to screen:
+  // ((point - corner0) * tile_size - offset) * scale
+  Rect<int, 2> tile_draw_rect{{}, tile_size_ * mapping.scale};
+  std::vector<uint16_t> row(grid_rect.w());
+  GridPoint point;
+  for (point.y() = grid_rect.y(); point.y() < grid_rect.y() + grid_rect.h();
+       ++point.y()) {
+    point.x() = grid_rect.x();
+    GetRowTileIndices(point, layer, row.size(), row.data());
+    for (int64_t x = 0; x < row.size(); ++x) {
+      if (row[x] >= tiles_.size())
+        continue;
+      Tile* tile = &tiles_[row[x]];
+      if (!tile->sprite)
+        continue;
+
+      point.x() = grid_rect.x() + x;
+      tile_draw_rect.pos = ((point - mapping.corner0) * tile_size_ -
+                            mapping.offset) *
+                           mapping.scale;
+      if (animated_only && tile->sprite->FrameCount() <= 1)
+        continue;
+      DrawTile(graphics, row[x], tile_draw_rect);
+      if (observer_) {
+        if (batch_drawing_)
+          batched_tiles_.push_back({tile, tile_draw_rect});
+        else
+          observer_->OnDrawTile(tile, tile_draw_rect);
+      }
+    }
+  }
+  if (batch_drawing_)
+    FlushBatches(graphics);
+}
+
+void TileMap::SetLodEnabled(bool enabled) {
+  lod_levels_.clear();
+  if (!enabled)
+    return;
+
+  Vec<int64_t, 2> size = grid_size_;
+  while (lod_levels_.size() < kMaxLodLevel && (size.x() > 1 || size.y() > 1)) {
+    size = (size + Vec<int64_t, 2>::Ones()) / Vec<int64_t, 2>::Fill(2);
+    lod_levels_.push_back(
+        {size, std::vector<uint16_t>(size.x() * size.y() * layer_count_)});
+  }
+  for (Chunk& chunk : chunks_)
+    chunk.lod_built = false;
+  if (lod_levels_.empty())
+    return;
+
+  // Chunks that are neither in memory nor streamed hold only tile 0, which
+  // the pyramid starts out as.
+  for (int i = 0; i < chunks_.size(); ++i) {
+    if (chunks_[i].tiles || !chunks_[i].compressed.empty())
+      BuildChunkLod(i);
+  }
+}
+
+void TileMap::BuildChunkLod(int chunk_index) {
+  chunks_[chunk_index].lod_built = true;
+  Rect<> rect = GetChunkGridRect(chunk_index);
+  Point<> last = rect.pos + rect.size - Vec<int64_t, 2>::Ones();
+
+  // Level 1 is read from the chunk two rows at a time, and each level after
+  // that from the one below. Chunks start on even rows and columns.
+  int64_t width = rect.w();
+  std::vector<uint16_t> rows(2 * width);
+  for (int layer = 0; layer < layer_count_; ++layer) {
+    Point<> block;
+    for (block.y() = rect.y() / 2; block.y() <= last.y() / 2; ++block.y()) {
+      int64_t row_count = std::min<int64_t>(2, last.y() + 1 - 2 * block.y());
+      for (int64_t row = 0; row < row_count; ++row) {
+        GetRowTileIndices({rect.x(), 2 * block.y() + row}, layer, width,
+                          &rows[row * width]);
+      }
+      for (block.x() = rect.x() / 2; block.x() <= last.x() / 2; ++block.x()) {
+        uint16_t children[4];
+        int count = 0;
+        int64_t first_x = 2 * block.x() - rect.x();
+        int64_t end_x = std::min(first_x + 2, width);
+        for (int64_t row = 0; row < row_count; ++row) {
+          for (int64_t x = first_x; x < end_x; ++x)
+            children[count++] = rows[row * width + x];
+        }
+        LodTile(1, layer, block) = MostCommonIndex(children, count);
+      }
+    }
+
+    for (int level = 2; level <= lod_levels_.size(); ++level) {
+      for (block.y() = rect.y() >> level; block.y() <= last.y() >> level;
+           ++block.y()) {
+        for (block.x() = rect.x() >> level; block.x() <= last.x() >> level;
+             ++block.x()) {
+          UpdateLodBlock(level, layer, block);
         }
       }
     }
   }
 }
 
+void TileMap::BuildLod(int level, const Rect<>& grid_rect) {
+  // Blocks of |level| can reach past |grid_rect| into other chunks.
+  int64_t block_size = std::max<int64_t>(int64_t(1) << level, kChunkSize);
+  Point<> first, last;
+  for (int i = 0; i < 2; ++i) {
+    first[i] = grid_rect.pos[i] / block_size * block_size / kChunkSize;
+    int64_t end = (grid_rect.pos[i] + grid_rect.size[i] + block_size - 1) /
+                  block_size * block_size;
+    last[i] = std::min(end / kChunkSize, chunk_grid_size_[i]) - 1;
+  }
+  Point<> chunk;
+  for (chunk.y() = first.y(); chunk.y() <= last.y(); ++chunk.y()) {
+    for (chunk.x() = first.x(); chunk.x() <= last.x(); ++chunk.x()) {
+      int index = chunk.y() * chunk_grid_size_.x() + chunk.x();
+      const Chunk& data = chunks_[index];
+      if (!data.lod_built && (data.tiles || !data.compressed.empty()))
+        BuildChunkLod(index);
+    }
+  }
+}
+
+uint16_t TileMap::GetLodTileIndex(const GridPoint& point,
+                                  int layer,
+                                  int level) const {
+  if (level == 0)
+    return GetTileIndex(point, layer);
+  if (!PositionInMap(point) || layer < 0 || layer >= layer_count_ ||
+      level < 0 || level > lod_levels_.size()) {
+    return 0;
+  }
+  const LodLevel& lod = lod_levels_[level - 1];
+  return lod.tiles[(layer * lod.size.y() + (point.y() >> level)) *
+                       lod.size.x() +
+                   (point.x() >> level)];
+}
+
+void TileMap::DrawLod(Graphics2D* graphics,
+                      int layer,
+                      int level,
+                      const Rect<>& grid_rect,
+                      const ScreenMapping& mapping) {
+  int64_t block_size = int64_t(1) << level;
+  Rect<> map_rect{{0, 0}, grid_size_};
+  Point<> first = grid_rect.pos / Vec<int64_t, 2>::Fill(block_size);
+  Point<> last = (grid_rect.pos + grid_rect.size - Vec<int64_t, 2>::Ones()) /
+                 Vec<int64_t, 2>::Fill(block_size);
+  Point<> block;
+  for (block.y() = first.y(); block.y() <= last.y(); ++block.y()) {
+    for (block.x() = first.x(); block.x() <= last.x(); ++block.x()) {
+      uint16_t index = LodTile(level, layer, block);
+      if (index >= tiles_.size() || !tiles_[index].sprite)
+        continue;
+
+      Rect<> block_rect{block * block_size,
+                        Vec<int64_t, 2>::Fill(block_size)};
+      Rect<int, 2> dest =
+          GridToScreen(block_rect.GetOverlap(map_rect), mapping);
+      DrawTile(graphics, index, dest);
+      if (observer_) {
+        if (batch_drawing_)
+          batched_tiles_.push_back({&tiles_[index], dest});
+        else
+          observer_->OnDrawTile(&tiles_[index], dest);
+      }
+    }
+  }
+  if (batch_drawing_)
+    FlushBatches(graphics);
+}
+
+int TileMap::ChooseLodLevel(const Vec<double, 2>& scale) const {
+  double pixels =
+      std::min(tile_size_.x() * scale.x(), tile_size_.y() * scale.y());
+  int level = 0;
+  while (level < lod_levels_.size() && pixels < kMinLodTilePixels) {
+    pixels *= 2;
+    ++level;
+  }
+  return level;
+}
+
+bool TileMap::UpdateLodBlock(int level, int layer, const Point<>& block) {
+  const Vec<int64_t, 2>& below =
+      level == 1 ? grid_size_ : lod_levels_[level - 2].size;
+  uint16_t children[4];
+  int count = 0;
+  for (int64_t y = 2 * block.y(); y < std::min(2 * block.y() + 2, below.y());
+       ++y) {
+    for (int64_t x = 2 * block.x();
+         x < std::min(2 * block.x() + 2, below.x()); ++x) {
+      GridPoint child{x << (level - 1), y << (level - 1)};
+      children[count++] = GetLodTileIndex(child, layer, level - 1);
+    }
+  }
+
+  uint16_t representative = MostCommonIndex(children, count);
+  uint16_t& tile = LodTile(level, layer, block);
+  if (tile == representative)
+    return false;
+  tile = representative;
+  return true;
+}
+
+uint16_t& TileMap::LodTile(int level, int layer, const Point<>& block) {
+  LodLevel& lod = lod_levels_[level - 1];
+  return lod.tiles[(layer * lod.size.y() + block.y()) * lod.size.x() +
+                   block.x()];
+}
+
+void TileMap::DrawTile(Graphics2D* graphics,
+                       uint16_t index,
+                       const Rect<int, 2>& dest) {
+  Sprite* sprite = tiles_[index].sprite;
+  int frame = GetTileFrame(index);
+  if (batch_drawing_ && sprite->texture())
+    AddToBatch(sprite, frame, dest);
+  else if (frame >= 0 && sprite->texture())
+    sprite->DrawFrame(graphics, frame, dest);
+  else
+    sprite->Draw(graphics, dest);
+}
+
+void TileMap::UpdateAnimations(const Time& time) {
+  animation_time_ = time;
+  if (!animation_clock_) {
+    animation_clock_ = true;
+    BuildAnimations();
+    return;
+  }
+  Time::Delta since_start = time - Time();
+  for (Animation& animation : animations_)
+    animation.frame = animation.sprite->GetFrameAt(since_start +
+                                                   animation.offset);
+}
+
+void TileMap::BuildAnimations() {
+  animations_.clear();
+  tile_animations_.assign(tiles_.size(), -1);
+  std::map<std::pair<Sprite*, int64_t>, int> indices;
+  Time::Delta since_start = animation_time_ - Time();
+  for (int i = 0; i < tiles_.size(); ++i) {
+    const Tile& tile = tiles_[i];
+    if (!tile.sprite || tile.sprite->FrameCount() <= 1)
+      continue;
+    auto inserted = indices.insert(
+        {{tile.sprite, tile.animation_offset.ToMicroseconds()},
+         static_cast<int>(animations_.size())});
+    if (inserted.second) {
+      animations_.push_back(
+          {tile.sprite, tile.animation_offset,
+           tile.sprite->GetFrameAt(since_start + tile.animation_offset)});
+    }
+    tile_animations_[i] = inserted.first->second;
+  }
+}
+
+int TileMap::GetTileFrame(uint16_t index) const {
+  if (index >= tile_animations_.size() || tile_animations_[index] < 0)
+    return -1;
+  const Animation& animation = animations_[tile_animations_[index]];
+  // The tile may have been changed through GetTile().
+  if (animation.sprite != tiles_[index].sprite ||
+      animation.frame >= animation.sprite->FrameCount()) {
+    return -1;
+  }
+  return animation.frame;
+}
+
+void TileMap::AddToBatch(Sprite* sprite,
+                         int frame,
+                         const Rect<int, 2>& dest) {
+  Texture* texture = sprite->texture();
+  auto batch = std::find_if(
+      batches_.begin(), batches_.end(),
+      [texture](const GeometryBatch& b) { return b.texture == texture; });
+  if (batch == batches_.end()) {
+    batches_.emplace_back();
+    batch = batches_.end() - 1;
+    batch->texture = texture;
+  }
+  if (batch->vertices.empty()) {
+    // The texture may have been replaced since the last draw.
+    Rect<> size = texture->GetSize();
+    batch->texture_scale = {size.w() > 0 ? 1. / size.w() : 0.,
+                            size.h() > 0 ? 1. / size.h() : 0.};
+  }
+
+  const Sprite::AnimationFrame& animation_frame =
+      frame >= 0 ? sprite->Frame(frame) : sprite->CurrentFrame();
+  float left = dest.x() + animation_frame.dest_offset.x();
+  float top = dest.y() + animation_frame.dest_offset.y();
+  float right = left + dest.w();
+  float bottom = top + dest.h();
+  const Rect<>& source = animation_frame.source_rect;
+  float u0 = source.x() * batch->texture_scale.x();
+  float v0 = source.y() * batch->texture_scale.y();
+  float u1 = (source.x() + source.w()) * batch->texture_scale.x();
+  float v1 = (source.y() + source.h()) * batch->texture_scale.y();
+  constexpr SDL_Color kNoTint{255, 255, 255, kOpaque};
+
+  int first = batch->vertices.size();
+  batch->vertices.push_back({{left, top}, kNoTint, {u0, v0}});
+  batch->vertices.push_back({{right, top}, kNoTint, {u1, v0}});
+  batch->vertices.push_back({{left, bottom}, kNoTint, {u0, v1}});
+  batch->vertices.push_back({{right, bottom}, kNoTint, {u1, v1}});
+  batch->indices.insert(batch->indices.end(),
+                        {first, first + 1, first + 2, first + 2, first + 1,
+                         first + 3});
+}
+
+void TileMap::FlushBatches(Graphics2D* graphics) {
+  for (GeometryBatch& batch : batches_) {
+    if (batch.vertices.empty())
+      continue;
+    graphics->DrawGeometry(*batch.texture, batch.vertices.data(),
+                           batch.vertices.size(), batch.indices.data(),
+                           batch.indices.size());
+    batch.vertices.clear();
+    batch.indices.clear();
+  }
+
+  if (!observer_)
+    return;
+  for (const auto& [tile, screen_rect] : batched_tiles_)
+    observer_->OnDrawTile(tile, screen_rect);
+  batched_tiles_.clear();
+}
+
+void TileMap::DrawCachedTiles(Graphics2D* graphics,
+                              int layer,
+                              const Rect<>& grid_rect,
+                              const ScreenMapping& mapping) {
+  GridPoint point;
+  for (point.y() = grid_rect.y() / kRenderChunkSize * kRenderChunkSize;
+       point.y() < grid_rect.y() + grid_rect.h();
+       point.y() += kRenderChunkSize) {
+    for (point.x() = grid_rect.x() / kRenderChunkSize * kRenderChunkSize;
+         point.x() < grid_rect.x() + grid_rect.w();
+         point.x() += kRenderChunkSize) {
+      int index = GetRenderChunkIndex(point, layer);
+      RenderChunk& chunk = render_chunks_[index];
+      Rect<> chunk_rect = GetRenderChunkGridRect(index);
+      Rect<> visible = chunk_rect.GetOverlap(grid_rect);
+      chunk.last_used = draw_clock_;
+      if (!chunk.valid && !BakeRenderChunk(graphics, index)) {
+        // Out of textures, so draw this block the slow way.
+        DrawTiles(graphics, layer, visible, mapping, /*animated_only=*/false);
+        continue;
+      }
+
+      if (chunk.texture) {
+        Rect<> source{(visible.pos - chunk_rect.pos) * tile_size_,
+                      visible.size * tile_size_};
+        graphics->DrawTexture(*chunk.texture, source,
+                              GridToScreen(visible, mapping));
+      }
+      if (chunk.has_animated_tiles)
+        DrawTiles(graphics, layer, visible, mapping, /*animated_only=*/true);
+    }
+  }
+}
+
+bool TileMap::BakeRenderChunk(Graphics2D* graphics, int index) {
+  RenderChunk& chunk = render_chunks_[index];
+  int layer = index % layer_count_;
+  Rect<> grid_rect = GetRenderChunkGridRect(index);
+
+  std::vector<uint16_t> indices(grid_rect.w() * grid_rect.h());
+  for (int64_t y = 0; y < grid_rect.h(); ++y) {
+    GridPoint row_start{grid_rect.x(), grid_rect.y() + y};
+    GetRowTileIndices(row_start, layer, grid_rect.w(),
+                      &indices[y * grid_rect.w()]);
+  }
+  auto is_static = [this](uint16_t index) {
+    return index < tiles_.size() && tiles_[index].sprite &&
+           tiles_[index].sprite->FrameCount() <= 1;
+  };
+  auto is_animated = [this](uint16_t index) {
+    return index < tiles_.size() && tiles_[index].sprite &&
+           tiles_[index].sprite->FrameCount() > 1;
+  };
+  chunk.has_animated_tiles =
+      std::any_of(indices.begin(), indices.end(), is_animated);
+
+  // Blocks with nothing to bake don't need a texture.
+  if (std::none_of(indices.begin(), indices.end(), is_static)) {
+    if (chunk.texture) {
+      chunk.texture.reset();
+      auto baked = std::find(baked_render_chunks_.begin(),
+                             baked_render_chunks_.end(), index);
+      *baked = baked_render_chunks_.back();
+      baked_render_chunks_.pop_back();
+    }
+    chunk.valid = true;
+    return true;
+  }
+
+  if (!chunk.texture) {
+    if (baked_render_chunks_.size() >= render_cache_size_ &&
+        !EvictRenderChunk(/*used_since=*/draw_clock_)) {
+      return false;
+    }
+    chunk.texture = graphics->CreateTargetTexture(
+        kRenderChunkSize * tile_size_.x(), kRenderChunkSize * tile_size_.y());
+    if (!chunk.texture)
+      return false;
+    baked_render_chunks_.push_back(index);
+  }
+
+  Texture* previous_target = graphics->GetRenderTarget();
+  RgbaColor previous_color = graphics->GetDrawColor();
+  graphics->SetRenderTarget(chunk.texture.get());
+  graphics->SetDrawColor({0, 0, 0, kTransparent})->Clear();
+  Rect<> tile_rect{{}, tile_size_};
+  for (int64_t y = 0; y < grid_rect.h(); ++y) {
+    for (int64_t x = 0; x < grid_rect.w(); ++x) {
+      uint16_t tile_index = indices[y * grid_rect.w() + x];
+      if (!is_static(tile_index))
+        continue;
+      tile_rect.pos = Point<>{x, y} * tile_size_;
+      tiles_[tile_index].sprite->Draw(graphics, tile_rect);
+      if (observer_)
+        observer_->OnDrawTile(&tiles_[tile_index], tile_rect);
+    }
+  }
+  graphics->SetRenderTarget(previous_target);
+  graphics->SetDrawColor(previous_color);
+  chunk.valid = true;
+  return true;
+}
+
+bool TileMap::EvictRenderChunk(uint64_t used_since) {
+  int lru = -1;
+  for (int i = 0; i < baked_render_chunks_.size(); ++i) {
+    const RenderChunk& chunk = render_chunks_[baked_render_chunks_[i]];
+    if (chunk.last_used >= used_since)
+      continue;
+    if (lru == -1 ||
+        chunk.last_used < render_chunks_[baked_render_chunks_[lru]].last_used) {
+      lru = i;
+    }
+  }
+  if (lru == -1)
+    return false;
+
+  RenderChunk& chunk = render_chunks_[baked_render_chunks_[lru]];
+  chunk.texture.reset();
+  chunk.valid = false;
+  baked_render_chunks_[lru] = baked_render_chunks_.back();
+  baked_render_chunks_.pop_back();
+  return true;
+}
+
+int TileMap::GetRenderChunkIndex(const GridPoint& grid_point,
+                                 int layer) const {
+  int64_t block = grid_point.y() / kRenderChunkSize * render_grid_size_.x() +
+                  grid_point.x() / kRenderChunkSize;
+  return block * layer_count_ + layer;
+}
+
+Rect<> TileMap::GetRenderChunkGridRect(int index) const {
+  int64_t block = index / layer_count_;
+  Point<> pos{block % render_grid_size_.x() * kRenderChunkSize,
+              block / render_grid_size_.x() * kRenderChunkSize};
+  Vec<int64_t, 2> size{
+      std::min<int64_t>(kRenderChunkSize, grid_size_.x() - pos.x()),
+      std::min<int64_t>(kRenderChunkSize, grid_size_.y() - pos.y())};
+  return {pos, size};
+}
+
+Rect<> TileMap::GridToScreen(const Rect<>& grid_rect,
+                             const ScreenMapping& mapping) const {
+  Point<> start =
+      ((grid_rect.pos - mapping.corner0) * tile_size_ - mapping.offset) *
+      mapping.scale;
+  Point<> end = ((grid_rect.pos + grid_rect.size - mapping.corner0) *
+                     tile_size_ -
+                 mapping.offset) *
+                mapping.scale;
+  return {start, end - start};
+}
+
 bool TileMap::PositionInMap(const GridPoint& grid_position) const {
   for (int i = 0; i < 2; ++i) {
     if (grid_position[i] < 0 || grid_position[i] >= grid_size_[i])
@@ -360,7 +1236,13 @@ TileMap::Tile* TileMap::GetTileByIndex(uint16_t tile_index) {
 }
 
 uint16_t TileMap::GetTileIndex(const GridPoint& grid_point, int layer) const {
-  return grid_[GridIndex(grid_point, layer)];
+  if (!PositionInMap(grid_point) || layer < 0 || layer >= layer_count_)
+    return 0;
+
+  Chunk* chunk = GetChunk(grid_point, /*create=*/false);
+  if (!chunk)
+    return 0;
+  return GetChunkTile(*chunk, grid_point, layer);
 }
 
 void TileMap::SetTileIndex(const GridPoint& grid_point,
@@ -371,31 +1253,766 @@ void TileMap::SetTileIndex(const GridPoint& grid_point,
     return;
   }
 
-  grid_[GridIndex(grid_point, layer)] = tile_index;
+  Chunk* chunk = GetChunk(grid_point, /*create=*/true);
+  uint16_t index = GetChunkTile(*chunk, grid_point, layer);
+  if (index == tile_index)
+    return;
+  chunk->modified = true;
+
+  std::bitset<kMaxTags> old_tags = GetTileTags(index);
+  SetChunkTile(chunk, grid_point, layer, tile_index);
+  if (!chunk->tile_counts.empty()) {
+    int delta = (tile_index != 0) - (index != 0);
+    chunk->tile_counts[layer] += delta;
+    layer_tile_counts_[layer] += delta;
+  }
+  if (!render_chunks_.empty())
+    render_chunks_[GetRenderChunkIndex(grid_point, layer)].valid = false;
+  for (int level = 1; level <= lod_levels_.size(); ++level) {
+    Point<> block{grid_point.x() >> level, grid_point.y() >> level};
+    if (!UpdateLodBlock(level, layer, block))
+      break;
+  }
+
+  std::bitset<kMaxTags> new_tags = GetTileTags(tile_index);
+  std::bitset<kMaxTags> changed = old_tags ^ new_tags;
+  for (int tag = 0; !tag_grids_.empty() && tag < kMaxTags; ++tag) {
+    if (!changed[tag])
+      continue;
+    BitGrid& grid = tag_grids_[tag * layer_count_ + layer];
+    // Empty grids stand for tags no tile had.
+    if (grid.empty())
+      grid = BitGrid(grid_size_);
+    grid.Set(grid_point, new_tags[tag]);
+  }
+
+  for (ChangeListener* listener : change_listeners_)
+    listener->OnTileChanged(grid_point, layer);
+}
+
+void TileMap::GetRowTileIndices(const GridPoint& first,
+                                int layer,
+                                int64_t count,
+                                uint16_t* indices) const {
+  std::fill_n(indices, count, 0);
+  if (first.y() < 0 || first.y() >= grid_size_.y() || layer < 0 ||
+      layer >= layer_count_) {
+    return;
+  }
+
+  int stride = ChunkTileStride();
+  int64_t end = std::min(first.x() + count, grid_size_.x());
+  GridPoint point{first};
+  point.x() = std::max<int64_t>(point.x(), 0);
+  while (point.x() < end) {
+    // Copy the part of the row in this chunk.
+    int64_t span_end =
+        std::min(end, (point.x() / kChunkSize + 1) * kChunkSize);
+    uint16_t* out = indices + (point.x() - first.x());
+    Chunk* chunk = GetChunk(point, /*create=*/false);
+    if (chunk && dense_slots_[layer] >= 0) {
+      const uint16_t* tiles = chunk->tiles + ChunkTileIndex(point, layer);
+      if (stride == 1) {
+        std::copy(tiles, tiles + (span_end - point.x()), out);
+      } else {
+        for (int64_t x = 0; x < span_end - point.x(); ++x)
+          out[x] = tiles[x * stride];
+      }
+    } else if (chunk && layer < chunk->sparse_tiles.size() &&
+               chunk->sparse_tiles[layer]) {
+      // Only visit the tiles that aren't 0.
+      const SparseTiles& sparse = *chunk->sparse_tiles[layer];
+      int y = point.y() % kChunkSize;
+      int begin = point.x() % kChunkSize;
+      int end = begin + (span_end - point.x());
+      uint64_t word = sparse.occupied[y] & (~uint64_t{0} << begin);
+      if (end < kChunkSize)
+        word &= (uint64_t{1} << end) - 1;
+      int position = sparse.row_starts[y] +
+                     __builtin_popcountll(sparse.occupied[y] &
+                                          ((uint64_t{1} << begin) - 1));
+      for (; word; word &= word - 1)
+        out[__builtin_ctzll(word) - begin] = sparse.indices[position++];
+    }
+    point.x() = span_end;
+  }
+}
+
+void TileMap::SetChunkTiles(const GridPoint& grid_point,
+                            std::unique_ptr<uint16_t[]> tiles) {
+  if (!PositionInMap(grid_point))
+    return;
+  int chunk_index = chunk_grid_size_.x() * (grid_point.y() / kChunkSize) +
+                    grid_point.x() / kChunkSize;
+  Rect<> grid_rect = GetChunkGridRect(chunk_index);
+  std::vector<uint16_t> tile_counts(layer_count_);
+  for (int tile = 0; tile < kChunkTileCount * layer_count_; ++tile) {
+    int position = tile / layer_count_;
+    if (position % kChunkSize >= grid_rect.w() ||
+        position / kChunkSize >= grid_rect.h()) {
+      tiles[tile] = 0;
+    } else if (tiles[tile] != 0 && tiles[tile] >= tiles_.size()) {
+      return;
+    } else {
+      tile_counts[tile % layer_count_] += tiles[tile] != 0;
+    }
+  }
+
+  Chunk& chunk = chunks_[chunk_index];
+  if (!layer_tile_counts_.empty()) {
+    // Swap the old chunk's counts for the new one's, without loading it.
+    if (chunk.tile_counts.empty()) {
+      counted_tiles_ += grid_rect.w() * grid_rect.h();
+    } else {
+      for (int layer = 0; layer < layer_count_; ++layer)
+        layer_tile_counts_[layer] -= chunk.tile_counts[layer];
+    }
+    chunk.tile_counts = std::move(tile_counts);
+    for (int layer = 0; layer < layer_count_; ++layer)
+      layer_tile_counts_[layer] += chunk.tile_counts[layer];
+  }
+
+  chunk.modified = true;
+  TouchLoadedChunk(&chunk);
+  if (!chunk.compressed.empty()) {
+    compressed_bytes_ -= chunk.compressed.size();
+    std::vector<uint8_t>().swap(chunk.compressed);
+  }
+  if (dense_layer_count_ == layer_count_ &&
+      grid_layout_ == GridLayout::kInterleaved) {
+    chunk.owned_tiles = std::move(tiles);
+    chunk.tiles = chunk.owned_tiles.get();
+  } else {
+    if (!chunk.owned_tiles) {
+      chunk.owned_tiles =
+          std::make_unique<uint16_t[]>(kChunkTileCount * dense_layer_count_);
+    }
+    chunk.tiles = chunk.owned_tiles.get();
+    StoreChunkTiles(&chunk, tiles.get());
+  }
+  EvictChunks(chunk_index);
+  UpdateRect(grid_rect);
+}
+
+void TileMap::UpdateRect(const Rect<>& grid_rect) {
+  Point<> last = grid_rect.pos + grid_rect.size - Vec<int64_t, 2>::Ones();
+  for (int layer = 0; layer < layer_count_; ++layer) {
+    if (!render_chunks_.empty()) {
+      for (int64_t y = grid_rect.y() / kRenderChunkSize * kRenderChunkSize;
+           y <= last.y(); y += kRenderChunkSize) {
+        for (int64_t x = grid_rect.x() / kRenderChunkSize * kRenderChunkSize;
+             x <= last.x(); x += kRenderChunkSize) {
+          render_chunks_[GetRenderChunkIndex({x, y}, layer)].valid = false;
+        }
+      }
+    }
+    Point<> block;
+    for (int level = 1; level <= lod_levels_.size(); ++level) {
+      for (block.y() = grid_rect.y() >> level; block.y() <= last.y() >> level;
+           ++block.y()) {
+        for (block.x() = grid_rect.x() >> level;
+             block.x() <= last.x() >> level; ++block.x()) {
+          UpdateLodBlock(level, layer, block);
+        }
+      }
+    }
+  }
+
+  std::vector<uint16_t> row(grid_rect.w());
+  for (int layer = 0; !tag_grids_.empty() && layer < layer_count_; ++layer) {
+    // Clear the tags tiles had, and set the ones they have now.
+    std::bitset<kMaxTags> used;
+    for (int tag = 0; tag < kMaxTags; ++tag)
+      used[tag] = !tag_grids_[tag * layer_count_ + layer].empty();
+    for (GridPoint p{grid_rect.pos}; p.y() <= last.y(); ++p.y()) {
+      GetRowTileIndices({grid_rect.x(), p.y()}, layer, row.size(),
+                        row.data());
+      for (int64_t x = 0; x < row.size(); ++x) {
+        p.x() = grid_rect.x() + x;
+        std::bitset<kMaxTags> tags = GetTileTags(row[x]);
+        uint64_t bits = (used | tags).to_ullong();
+        for (; bits; bits &= bits - 1) {
+          int tag = __builtin_ctzll(bits);
+          BitGrid& grid = tag_grids_[tag * layer_count_ + layer];
+          if (grid.empty()) {
+            grid = BitGrid(grid_size_);
+            used.set(tag);
+          }
+          grid.Set(p, tags[tag]);
+        }
+      }
+    }
+  }
+
+  for (ChangeListener* listener : change_listeners_)
+    listener->OnRectChanged(grid_rect);
+}
+
+void TileMap::SetGridLayout(GridLayout layout) {
+  if (layout == grid_layout_)
+    return;
+  grid_layout_ = layout;
+
+  bool to_layer_major = layout == GridLayout::kLayerMajor;
+  size_t tile_count = kChunkTileCount * dense_layer_count_;
+  for (Chunk& chunk : chunks_) {
+    if (chunk.tiles) {
+      ConvertLayout(chunk.tiles, dense_layer_count_, to_layer_major);
+    } else if (!chunk.compressed.empty()) {
+      std::vector<uint16_t> tiles(tile_count);
+      DecompressUint16(chunk.compressed.data(), chunk.compressed.size(),
+                       tiles.data(), tile_count);
+      ConvertLayout(tiles.data(), dense_layer_count_, to_layer_major);
+      compressed_bytes_ -= chunk.compressed.size();
+      chunk.compressed = CompressUint16(tiles.data(), tile_count);
+      chunk.compressed.shrink_to_fit();
+      compressed_bytes_ += chunk.compressed.size();
+    }
+  }
+}
+
+void TileMap::SetLayerStorage(int layer, LayerStorage storage) {
+  if (layer < 0 || layer >= layer_count_ || layer_storage_[layer] == storage)
+    return;
+  std::vector<int> old_slots = dense_slots_;
+  int old_count = dense_layer_count_;
+  layer_storage_[layer] = storage;
+  UpdateDenseSlots();
+
+  // Only |layer| moves, but the others change places in the tile arrays.
+  bool layer_major = grid_layout_ == GridLayout::kLayerMajor;
+  size_t tile_count = kChunkTileCount * dense_layer_count_;
+  std::vector<uint16_t> decompressed(kChunkTileCount * old_count);
+  for (int i = 0; i < chunks_.size(); ++i) {
+    Chunk& chunk = chunks_[i];
+    const uint16_t* old_tiles = chunk.tiles;
+    if (!old_tiles && chunk.compressed.empty())
+      continue;
+    if (!old_tiles) {
+      DecompressUint16(chunk.compressed.data(), chunk.compressed.size(),
+                       decompressed.data(), decompressed.size());
+      old_tiles = decompressed.data();
+    }
+
+    auto tiles = std::make_unique<uint16_t[]>(tile_count);
+    if (chunk.sparse_tiles.size() < layer_count_)
+      chunk.sparse_tiles.resize(layer_count_);
+    for (int l = 0; l < layer_count_; ++l) {
+      int old_slot = old_slots[l];
+      int slot = dense_slots_[l];
+      const SparseTiles* sparse = chunk.sparse_tiles[l].get();
+      for (int tile = 0; tile < kChunkTileCount; ++tile) {
+        uint16_t index;
+        if (old_slot >= 0) {
+          index = old_tiles[DenseTileIndex(tile, old_slot, old_count,
+                                           layer_major)];
+        } else {
+          index = sparse ? sparse->Get(tile % kChunkSize, tile / kChunkSize)
+                         : 0;
+        }
+        if (slot >= 0) {
+          tiles[DenseTileIndex(tile, slot, dense_layer_count_, layer_major)] =
+              index;
+        } else if (old_slot >= 0 && index != 0) {
+          SetChunkTile(&chunk, {tile % kChunkSize, tile / kChunkSize}, l,
+                       index);
+        }
+      }
+      if (slot >= 0)
+        chunk.sparse_tiles[l].reset();
+    }
+
+    if (chunk.tiles) {
+      // Mapped chunks become loaded ones.
+      if (!chunk.owned_tiles)
+        TouchLoadedChunk(&chunk);
+      chunk.owned_tiles = std::move(tiles);
+      chunk.tiles = chunk.owned_tiles.get();
+      CountChunkTiles(i);
+    } else {
+      compressed_bytes_ -= chunk.compressed.size();
+      chunk.compressed = CompressUint16(tiles.get(), tile_count);
+      chunk.compressed.shrink_to_fit();
+      compressed_bytes_ += chunk.compressed.size();
+    }
+  }
+  EvictChunks(/*keep_index=*/-1);
+}
+
+void TileMap::SetAutoLayerStorage(bool enabled) {
+  if (!enabled) {
+    layer_tile_counts_.clear();
+    return;
+  }
+
+  layer_tile_counts_.assign(layer_count_, 0);
+  counted_tiles_ = 0;
+  for (Chunk& chunk : chunks_)
+    chunk.tile_counts.clear();
+  // Only count what can be read without loading anything, which includes
+  // mapped chunks. Chunks that were never created hold only tile 0.
+  for (int i = 0; i < chunks_.size(); ++i) {
+    const Chunk& chunk = chunks_[i];
+    bool never_created =
+        !chunk.tiles && chunk.compressed.empty() && !chunk_source_;
+    if (chunk.tiles || never_created)
+      CountChunkTiles(i);
+  }
+  UpdateLayerStorage();
+}
+
+void TileMap::UpdateLayerStorage() {
+  for (int layer = 0; !layer_tile_counts_.empty() && layer < layer_count_;
+       ++layer) {
+    UpdateAutoLayerStorage(layer);
+  }
+}
+
+size_t TileMap::GetSparseTileBytes() const {
+  size_t bytes = 0;
+  for (const Chunk& chunk : chunks_) {
+    for (const std::unique_ptr<SparseTiles>& sparse : chunk.sparse_tiles) {
+      if (sparse)
+        bytes += sparse->GetBytes();
+    }
+  }
+  return bytes;
 }
 
 uint16_t TileMap::AddTile(const Tile& tile) {
+  // Indices past the end used to draw nothing, and had no tags.
+  InvalidateRenderCache();
   tiles_.push_back(tile);
+  if (animation_clock_)
+    BuildAnimations();
+  if (!tag_grids_.empty() && tile.tags.any())
+    UpdateTagGrids(tiles_.size() - 1, tiles_.size(), tile.tags);
+  for (ChangeListener* listener : change_listeners_)
+    listener->OnTileSetChanged();
   return tiles_.size() - 1;
 }
 
 void TileMap::AddTiles(const std::vector<Tile>& tiles) {
+  InvalidateRenderCache();
+  int first = tiles_.size();
   tiles_.insert(tiles_.end(), tiles.begin(), tiles.end());
+  if (animation_clock_)
+    BuildAnimations();
+  std::bitset<kMaxTags> tags;
+  for (const Tile& tile : tiles)
+    tags |= tile.tags;
+  if (!tag_grids_.empty() && tags.any())
+    UpdateTagGrids(first, tiles_.size(), tags);
+  for (ChangeListener* listener : change_listeners_)
+    listener->OnTileSetChanged();
 }
 
 void TileMap::SetTile(uint16_t index, const Tile& tile) {
+  InvalidateRenderCache();
+  std::bitset<kMaxTags> changed = GetTileTags(index) ^ tile.tags;
   if (index >= tiles_.size())
     tiles_.resize(index + 1);
   tiles_[index] = tile;
+  if (animation_clock_)
+    BuildAnimations();
+  if (!tag_grids_.empty() && changed.any())
+    UpdateTagGrids(index, index + 1, changed);
+  for (ChangeListener* listener : change_listeners_)
+    listener->OnTileSetChanged();
+}
+
+void TileMap::ChangeListener::OnRectChanged(const Rect<>& grid_rect) {
+  GridPoint point;
+  for (point.y() = grid_rect.y(); point.y() < grid_rect.y() + grid_rect.h();
+       ++point.y()) {
+    for (point.x() = grid_rect.x(); point.x() < grid_rect.x() + grid_rect.w();
+         ++point.x()) {
+      OnTileChanged(point, kAllLayers);
+    }
+  }
+}
+
+void TileMap::AddChangeListener(ChangeListener* listener) {
+  change_listeners_.push_back(listener);
+}
+
+void TileMap::RemoveChangeListener(ChangeListener* listener) {
+  change_listeners_.erase(std::remove(change_listeners_.begin(),
+                                      change_listeners_.end(), listener),
+                          change_listeners_.end());
+}
+
+void TileMap::SetTagIndexEnabled(bool enabled) {
+  tag_grids_.clear();
+  if (!enabled)
+    return;
+  tag_grids_.resize(kMaxTags * layer_count_);
+  BuildTagGrids(std::bitset<kMaxTags>().set());
+}
+
+const BitGrid* TileMap::GetTagGrid(int tag_id, int layer) const {
+  if (tag_grids_.empty() || tag_id < 0 || tag_id >= kMaxTags || layer < 0 ||
+      layer >= layer_count_) {
+    return nullptr;
+  }
+  return &tag_grids_[tag_id * layer_count_ + layer];
+}
+
+void TileMap::BuildTagGrids(const std::bitset<kMaxTags>& tags) {
+  std::bitset<kMaxTags> used;
+  for (const Tile& tile : tiles_)
+    used |= tile.tags;
+  for (int tag = 0; tag < kMaxTags; ++tag) {
+    if (!tags[tag])
+      continue;
+    for (int layer = 0; layer < layer_count_; ++layer) {
+      tag_grids_[tag * layer_count_ + layer] =
+          used[tag] ? BitGrid(grid_size_) : BitGrid();
+    }
+  }
+  used &= tags;
+  if (used.none())
+    return;
+
+  int64_t width = grid_size_.x();
+  std::vector<uint16_t> row(width);
+  for (int layer = 0; layer < layer_count_; ++layer) {
+    for (GridPoint p{0, 0}; p.y() < grid_size_.y(); ++p.y()) {
+      GetRowTileIndices({0, p.y()}, layer, width, row.data());
+      for (p.x() = 0; p.x() < width; ++p.x()) {
+        uint64_t bits = (GetTileTags(row[p.x()]) & used).to_ullong();
+        for (; bits; bits &= bits - 1) {
+          int tag = __builtin_ctzll(bits);
+          tag_grids_[tag * layer_count_ + layer].Set(p, true);
+        }
+      }
+    }
+  }
+}
+
+void TileMap::UpdateTagGrids(int first,
+                             int end,
+                             const std::bitset<kMaxTags>& tags) {
+  int64_t width = grid_size_.x();
+  std::vector<uint16_t> row(width);
+  for (int layer = 0; layer < layer_count_; ++layer) {
+    for (GridPoint p{0, 0}; p.y() < grid_size_.y(); ++p.y()) {
+      GetRowTileIndices({0, p.y()}, layer, width, row.data());
+      for (p.x() = 0; p.x() < width; ++p.x()) {
+        uint16_t index = row[p.x()];
+        if (index < first || index >= end)
+          continue;
+        std::bitset<kMaxTags> tile_tags = GetTileTags(index);
+        for (uint64_t bits = tags.to_ullong(); bits; bits &= bits - 1) {
+          int tag = __builtin_ctzll(bits);
+          BitGrid& grid = tag_grids_[tag * layer_count_ + layer];
+          // Empty grids stand for tags no tile had.
+          if (grid.empty()) {
+            if (!tile_tags[tag])
+              continue;
+            grid = BitGrid(grid_size_);
+          }
+          grid.Set(p, tile_tags[tag]);
+        }
+      }
+    }
+  }
+}
+
+std::bitset<TileMap::kMaxTags> TileMap::GetTileTags(uint16_t index) const {
+  return index < tiles_.size() ? tiles_[index].tags : std::bitset<kMaxTags>();
 }
 
 uint16_t TileMap::GetTileCount() const {
   return tiles_.size();
 }
 
-uint64_t TileMap::GridIndex(const GridPoint& grid_point, int layer) const {
-  return layer_count_ * (grid_size_.x() * grid_point.y() + grid_point.x()) +
-         layer;
+void TileMap::SetChunkSource(std::unique_ptr<ChunkSource> source) {
+  chunk_source_ = std::move(source);
+}
+
+void TileMap::SetMemoryBudget(size_t bytes) {
+  memory_budget_ = bytes;
+  EvictChunks(/*keep_index=*/-1);
+}
+
+void TileMap::SetCompressInactiveChunks(bool compress) {
+  compress_inactive_chunks_ = compress;
+  EvictChunks(/*keep_index=*/-1);
+}
+
+void TileMap::Prefetch(const Rect<>& world_rect) {
+  if (!chunk_source_)
+    return;
+
+  GridPoint first = WorldToGrid(world_rect.pos);
+  GridPoint last = WorldToGrid(world_rect.pos + world_rect.size);
+  GridPoint point;
+  for (int i = 0; i < 2; ++i) {
+    first[i] = std::max<int64_t>(first[i], 0) / kChunkSize * kChunkSize;
+    last[i] = std::min<int64_t>(last[i], grid_size_[i] - 1);
+  }
+  for (point.y() = first.y(); point.y() <= last.y(); point.y() += kChunkSize) {
+    for (point.x() = first.x(); point.x() <= last.x();
+         point.x() += kChunkSize) {
+      GetChunk(point, /*create=*/true);
+    }
+  }
+}
+
+size_t TileMap::GetChunkBytes() const {
+  return kChunkTileCount * dense_layer_count_ * sizeof(uint16_t);
+}
+
+TileMap::Chunk* TileMap::GetChunk(const GridPoint& grid_point,
+                                  bool create) const {
+  int chunk_index = chunk_grid_size_.x() * (grid_point.y() / kChunkSize) +
+                    grid_point.x() / kChunkSize;
+  Chunk& chunk = chunks_[chunk_index];
+  if (chunk.tiles) {
+    // Mapped chunks aren't counted as loaded, but their tiles are counted.
+    if (chunk.IsLinked())
+      TouchLoadedChunk(&chunk);
+    else
+      CountChunkTiles(chunk_index);
+    return &chunk;
+  }
+
+  bool compressed = !chunk.compressed.empty();
+  if (!compressed && !chunk_source_ && !create)
+    return nullptr;
+
+  size_t tile_count = kChunkTileCount * dense_layer_count_;
+  chunk.owned_tiles = std::make_unique<uint16_t[]>(tile_count);
+  chunk.tiles = chunk.owned_tiles.get();
+  if (compressed) {
+    // The data came from CompressUint16(), so this can't fail.
+    DecompressUint16(chunk.compressed.data(), chunk.compressed.size(),
+                     chunk.tiles, tile_count);
+    compressed_bytes_ -= chunk.compressed.size();
+    std::vector<uint8_t>().swap(chunk.compressed);
+  } else {
+    chunk.modified = false;
+    if (chunk_source_ && dense_layer_count_ < layer_count_) {
+      // Sparse layers are split out of the source's layout.
+      std::vector<uint16_t> tiles(kChunkTileCount * layer_count_);
+      if (!chunk_source_->LoadChunk(GetChunkGridRect(chunk_index),
+                                    layer_count_, tiles.data())) {
+        std::fill(tiles.begin(), tiles.end(), 0);
+      }
+      StoreChunkTiles(&chunk, tiles.data());
+    } else if (chunk_source_) {
+      if (!chunk_source_->LoadChunk(GetChunkGridRect(chunk_index),
+                                    layer_count_, chunk.tiles)) {
+        std::fill_n(chunk.tiles, tile_count, 0);
+      } else if (grid_layout_ == GridLayout::kLayerMajor) {
+        ConvertLayout(chunk.tiles, layer_count_, /*to_layer_major=*/true);
+      }
+    }
+  }
+  TouchLoadedChunk(&chunk);
+  CountChunkTiles(chunk_index);
+  EvictChunks(chunk_index);
+  return &chunk;
+}
+
+void TileMap::EvictChunks(int keep_index) const {
+  if (memory_budget_ == 0)
+    return;
+
+  // Evict from the least recently used end, skipping chunks that can't be
+  // reloaded or compressed.
+  auto it = loaded_chunks_.begin();
+  while (loaded_chunk_count_ * GetChunkBytes() > memory_budget_ &&
+         it != loaded_chunks_.end()) {
+    Chunk& chunk = *it;
+    ++it;
+    bool reloadable = chunk_source_ && !chunk.modified;
+    if ((keep_index >= 0 && &chunk == &chunks_[keep_index]) ||
+        !(reloadable || compress_inactive_chunks_)) {
+      continue;
+    }
+
+    if (!reloadable) {
+      chunk.compressed =
+          CompressUint16(chunk.tiles, kChunkTileCount * dense_layer_count_);
+      chunk.compressed.shrink_to_fit();
+      compressed_bytes_ += chunk.compressed.size();
+    } else {
+      chunk.sparse_tiles.clear();
+    }
+    chunk.owned_tiles.reset();
+    chunk.tiles = nullptr;
+    chunk.UnlinkSelf();
+    --loaded_chunk_count_;
+  }
+}
+
+void TileMap::TouchLoadedChunk(Chunk* chunk) const {
+  if (chunk->IsLinked())
+    chunk->UnlinkSelf();
+  else
+    ++loaded_chunk_count_;
+  loaded_chunks_.AddToTail(chunk);
+}
+
+Rect<> TileMap::GetChunkGridRect(int chunk_index) const {
+  Point<> pos{chunk_index % chunk_grid_size_.x() * kChunkSize,
+              chunk_index / chunk_grid_size_.x() * kChunkSize};
+  Vec<int64_t, 2> size{std::min<int64_t>(kChunkSize, grid_size_.x() - pos.x()),
+                       std::min<int64_t>(kChunkSize, grid_size_.y() - pos.y())};
+  return {pos, size};
+}
+
+uint16_t TileMap::GetChunkTile(const Chunk& chunk,
+                               const GridPoint& grid_point,
+                               int layer) const {
+  if (dense_slots_[layer] >= 0)
+    return chunk.tiles[ChunkTileIndex(grid_point, layer)];
+  if (layer >= chunk.sparse_tiles.size() || !chunk.sparse_tiles[layer])
+    return 0;
+  return chunk.sparse_tiles[layer]->Get(grid_point.x() % kChunkSize,
+                                        grid_point.y() % kChunkSize);
+}
+
+void TileMap::SetChunkTile(Chunk* chunk,
+                           const GridPoint& grid_point,
+                           int layer,
+                           uint16_t tile_index) const {
+  if (dense_slots_[layer] >= 0) {
+    chunk->tiles[ChunkTileIndex(grid_point, layer)] = tile_index;
+    return;
+  }
+  if (chunk->sparse_tiles.size() < layer_count_)
+    chunk->sparse_tiles.resize(layer_count_);
+  std::unique_ptr<SparseTiles>& sparse = chunk->sparse_tiles[layer];
+  if (!sparse) {
+    if (tile_index == 0)
+      return;
+    sparse = std::make_unique<SparseTiles>();
+  }
+  sparse->Set(grid_point.x() % kChunkSize, grid_point.y() % kChunkSize,
+              tile_index);
+  if (sparse->indices.empty())
+    sparse.reset();
+}
+
+void TileMap::StoreChunkTiles(Chunk* chunk, const uint16_t* tiles) const {
+  bool layer_major = grid_layout_ == GridLayout::kLayerMajor;
+  chunk->sparse_tiles.clear();
+  for (int layer = 0; layer < layer_count_; ++layer) {
+    int slot = dense_slots_[layer];
+    for (int tile = 0; tile < kChunkTileCount; ++tile) {
+      uint16_t index = tiles[tile * layer_count_ + layer];
+      if (slot >= 0) {
+        chunk->tiles[DenseTileIndex(tile, slot, dense_layer_count_,
+                                    layer_major)] = index;
+      } else if (index != 0) {
+        SetChunkTile(chunk, {tile % kChunkSize, tile / kChunkSize}, layer,
+                     index);
+      }
+    }
+  }
+}
+
+void TileMap::GetInterleavedChunkTiles(const Chunk& chunk,
+                                       uint16_t* tiles) const {
+  int count = kChunkTileCount * layer_count_;
+  if (dense_layer_count_ == layer_count_) {
+    std::copy(chunk.tiles, chunk.tiles + count, tiles);
+    if (grid_layout_ == GridLayout::kLayerMajor)
+      ConvertLayout(tiles, layer_count_, /*to_layer_major=*/false);
+    return;
+  }
+  for (int tile = 0; tile < kChunkTileCount; ++tile) {
+    GridPoint point{tile % kChunkSize, tile / kChunkSize};
+    for (int layer = 0; layer < layer_count_; ++layer)
+      tiles[tile * layer_count_ + layer] = GetChunkTile(chunk, point, layer);
+  }
+}
+
+void TileMap::UpdateDenseSlots() {
+  dense_slots_.assign(layer_count_, -1);
+  dense_layer_count_ = 0;
+  for (int layer = 0; layer < layer_count_; ++layer) {
+    if (layer_storage_[layer] == LayerStorage::kDense)
+      dense_slots_[layer] = dense_layer_count_++;
+  }
+}
+
+void TileMap::UpdateAutoLayerStorage(int layer) {
+  if (counted_tiles_ == 0)
+    return;
+  double density = double(layer_tile_counts_[layer]) / counted_tiles_;
+  if (layer_storage_[layer] == LayerStorage::kDense &&
+      density < kSparseLayerDensity) {
+    SetLayerStorage(layer, LayerStorage::kSparse);
+  } else if (layer_storage_[layer] == LayerStorage::kSparse &&
+             density > 2 * kSparseLayerDensity) {
+    SetLayerStorage(layer, LayerStorage::kDense);
+  }
+}
+
+void TileMap::CountChunkTiles(int chunk_index) const {
+  Chunk& chunk = chunks_[chunk_index];
+  if (layer_tile_counts_.empty() || !chunk.tile_counts.empty())
+    return;
+  chunk.tile_counts.assign(layer_count_, 0);
+  Rect<> rect = GetChunkGridRect(chunk_index);
+  counted_tiles_ += rect.w() * rect.h();
+  if (!chunk.tiles)
+    return;
+
+  GridPoint point;
+  for (int layer = 0; layer < layer_count_; ++layer) {
+    for (point.y() = 0; point.y() < rect.h(); ++point.y()) {
+      for (point.x() = 0; point.x() < rect.w(); ++point.x())
+        chunk.tile_counts[layer] += GetChunkTile(chunk, point, layer) != 0;
+    }
+    layer_tile_counts_[layer] += chunk.tile_counts[layer];
+  }
+}
+
+int TileMap::ChunkTileIndex(const GridPoint& grid_point, int layer) const {
+  int tile =
+      grid_point.y() % kChunkSize * kChunkSize + grid_point.x() % kChunkSize;
+  return DenseTileIndex(tile, dense_slots_[layer], dense_layer_count_,
+                        grid_layout_ == GridLayout::kLayerMajor);
+}
+
+int TileMap::ChunkTileStride() const {
+  return grid_layout_ == GridLayout::kLayerMajor ? 1 : dense_layer_count_;
+}
+
+uint16_t TileMap::SparseTiles::Get(int x, int y) const {
+  uint64_t bit = uint64_t{1} << x;
+  if (!(occupied[y] & bit))
+    return 0;
+  return indices[row_starts[y] + __builtin_popcountll(occupied[y] & (bit - 1))];
+}
+
+void TileMap::SparseTiles::Set(int x, int y, uint16_t index) {
+  uint64_t bit = uint64_t{1} << x;
+  int position = row_starts[y] + __builtin_popcountll(occupied[y] & (bit - 1));
+  if (occupied[y] & bit) {
+    if (index != 0) {
+      indices[position] = index;
+      return;
+    }
+    indices.erase(indices.begin() + position);
+    occupied[y] &= ~bit;
+    for (int row = y + 1; row < kChunkSize; ++row)
+      --row_starts[row];
+  } else if (index != 0) {
+    indices.insert(indices.begin() + position, index);
+    occupied[y] |= bit;
+    for (int row = y + 1; row < kChunkSize; ++row)
+      ++row_starts[row];
+  }
+}
+
+size_t TileMap::SparseTiles::GetBytes() const {
+  return sizeof(SparseTiles) + indices.capacity() * sizeof(uint16_t);
 }
 
 uint32_t TileMap::GetTagId(const std::string& tag) const {
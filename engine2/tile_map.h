@@ -2,10 +2,15 @@
 #define ENGINE2_TILE_MAP_H_
 
 #include <bitset>
+#include <istream>
 #include <list>
 #include <memory>
+#include <utility>
 #include <vector>
 
+#include "engine2/base/bit_grid.h"
+#include "engine2/base/list.h"
+#include "engine2/base/mapped_file.h"
 #include "engine2/camera2d.h"
 #include "engine2/sprite.h"
 #include "engine2/sprite_cache.h"
@@ -16,15 +21,70 @@ namespace engine2 {
 class TileMap {
  public:
   static constexpr int kAllLayers = -1;
+  // The grid is stored in square chunks with this many tiles per side.
+  static constexpr int kChunkSize = 64;
+  // The render cache bakes square blocks of tiles with this many per side.
+  static constexpr int kRenderChunkSize = 16;
+  // With level of detail on, Draw() uses coarser levels once tiles would be
+  // smaller than this many pixels across.
+  static constexpr double kMinLodTilePixels = 4;
+  // Blocks at the coarsest level of detail have 2^kMaxLodLevel tiles per side.
+  static constexpr int kMaxLodLevel = 10;
+  static constexpr int kMaxTags = 64;
+  // With automatic layer storage, dense layers with fewer than this share of
+  // their tiles other than 0 turn sparse, and sparse layers with more than
+  // twice this share turn dense.
+  static constexpr double kSparseLayerDensity = 1.0 / 16;
+
+  // How a map file stores its grid.
+  enum class GridEncoding : uint32_t {
+    // Chunks are stored as in memory, so FromFile() can map them.
+    kRaw = 0,
+    // Each chunk is compressed separately with CompressUint16(). Much smaller
+    // for typical maps, but chunks are decompressed as they're loaded.
+    kCompressed = 1,
+  };
+
+  // How each chunk arranges its tiles in memory.
+  enum class GridLayout {
+    // All layers of a tile are next to each other, so reading every layer at
+    // a point is fast.
+    kInterleaved,
+    // Each layer is a contiguous plane, so scanning one layer is fast.
+    kLayerMajor,
+  };
+
+  // How a layer keeps its tiles in memory.
+  enum class LayerStorage {
+    // In its chunks' tile arrays, two bytes a tile.
+    kDense,
+    // As a bitmap per chunk of the tiles other than 0 and a packed list of
+    // their indices, so chunks with nothing on the layer take no memory for
+    // it. Slower to read and write.
+    kSparse,
+  };
 
   static std::unique_ptr<TileMap> FromString(const std::string& data,
                                              SpriteCache* sprite_cache);
+  // Opens the map at |path|. Files with a raw grid are mapped into memory
+  // copy-on-write, so the grid is read from disk as it's touched and edits
+  // never reach the file. Other files stream chunks as they're used (see
+  // Open()). The file must not change while the map is open.
   static std::unique_ptr<TileMap> FromFile(const std::string& path,
                                            SpriteCache* sprite_cache);
 
+  // Reads the whole map from |stream|.
   static std::unique_ptr<TileMap> Read(std::istream& stream,
                                        SpriteCache* sprite_cache);
-  bool Write(std::ostream& stream) const;
+  // Reads only the map's header and tile set from |stream|, then loads chunks
+  // of the grid from it when they're first used. |stream| must be seekable.
+  static std::unique_ptr<TileMap> Open(std::unique_ptr<std::istream> stream,
+                                       SpriteCache* sprite_cache);
+  // Writes the current file format version. Loads every chunk that isn't in
+  // memory, so this may evict chunks under a memory budget. Don't write to the
+  // file the map was opened from.
+  bool Write(std::ostream& stream,
+             GridEncoding encoding = GridEncoding::kRaw) const;
 
   TileMap(const Vec<int64_t, 2>& tile_size,
           const Vec<int64_t, 2>& grid_size,
@@ -33,6 +93,8 @@ class TileMap {
           SpriteCache* sprite_cache,
           bool empty_initialize = false);
 
+  // Draws the part of the map in |world_rect| to |window_rect|. With a chunk
+  // source, also prefetches the chunks within a chunk of |world_rect|.
   void Draw(Graphics2D* graphics,
             const Rect<>& world_rect,
             const Rect<>& window_rect,
@@ -42,7 +104,7 @@ class TileMap {
     Sprite* sprite;
     Time::Delta animation_offset{};
 
-    std::bitset<64> tags;
+    std::bitset<kMaxTags> tags;
 
     bool HasTag(int tag_id) const;
     void SetTag(int tag_id, bool value);
@@ -61,8 +123,53 @@ class TileMap {
   Tile* GetTile(const GridPoint& point, int layer);
   Tile* GetTileByIndex(uint16_t tile_index);
 
+  // Returns 0 if point/layer are out of bounds.
   uint16_t GetTileIndex(const GridPoint& point, int layer) const;
   void SetTileIndex(const GridPoint& point, int layer, uint16_t tile_index);
+  // Copies the indices of |count| tiles on |layer|, starting at |first| and
+  // going right, into |indices|. Tiles outside the map read as 0. Much faster
+  // than calling GetTileIndex() for each tile, especially with
+  // GridLayout::kLayerMajor.
+  void GetRowTileIndices(const GridPoint& first,
+                         int layer,
+                         int64_t count,
+                         uint16_t* indices) const;
+  // Replaces every tile of the chunk holding |grid_point| with |tiles|, laid
+  // out as for ChunkSource::LoadChunk(). With the interleaved layout and no
+  // sparse layers, |tiles| becomes the chunk's tile array without a copy.
+  // Much faster than calling SetTileIndex() for each tile. Like it, does
+  // nothing if an index inside the map is past the end of the tile set.
+  // Tiles past the edge of the map are set to 0. Listeners hear about it
+  // through OnRectChanged().
+  void SetChunkTiles(const GridPoint& grid_point,
+                     std::unique_ptr<uint16_t[]> tiles);
+
+  // Rearranges every chunk in memory, including mapped ones, which are then
+  // copied as they're written to. Map files always use kInterleaved, so
+  // chunks are converted as they're loaded and written. Defaults to
+  // kInterleaved.
+  void SetGridLayout(GridLayout layout);
+  GridLayout GetGridLayout() const { return grid_layout_; }
+
+  // Moves |layer| to |storage|, rearranging every chunk in memory like
+  // SetGridLayout(). Layers start out dense. Reading, drawing and writing work
+  // the same either way.
+  void SetLayerStorage(int layer, LayerStorage storage);
+  LayerStorage GetLayerStorage(int layer) const {
+    return layer_storage_[layer];
+  }
+  // When on, the map counts the tiles on each layer, and UpdateLayerStorage()
+  // moves layers between dense and sparse storage as they fill up and empty
+  // out (see kSparseLayerDensity). Turning this on counts the chunks already
+  // in memory or mapped and picks each layer's storage from them. Streamed
+  // chunks are counted when they're loaded.
+  void SetAutoLayerStorage(bool enabled);
+  // Moves the layers whose density has crossed a threshold since the last
+  // call, which rearranges every chunk in memory. Edits only update the
+  // counts, so call this at a convenient point, e.g. after a batch of edits.
+  void UpdateLayerStorage();
+  // Memory used by the tiles of sparse layers.
+  size_t GetSparseTileBytes() const;
 
   // Add a tile to the map's set of tiles and return the index.
   uint16_t AddTile(const Tile& tile);
@@ -83,16 +190,326 @@ class TileMap {
   void SetTags(std::vector<std::string> tags) { tags_ = std::move(tags); }
   std::vector<std::string>* tags() { return &tags_; }
 
+  // Keeps a BitGrid per tag and layer marking the tiles that have the tag, so
+  // finding or counting tagged tiles in a rect checks 64 tiles at a time
+  // instead of calling GetTile() and HasTag() for each. Building reads every
+  // chunk. SetTileIndex() keeps the grids up to date. AddTile(), AddTiles()
+  // and SetTile() update the bits of the tiles that use the indices they
+  // change, which reads every chunk again. Calling this again rebuilds the
+  // grids, which is needed after changing tags through GetTile() or
+  // GetTileByIndex().
+  void SetTagIndexEnabled(bool enabled);
+  bool IsTagIndexEnabled() const { return !tag_grids_.empty(); }
+  // Returns the tiles on |layer| with tag |tag_id|, in grid coordinates, or
+  // null if the tag index is off or |tag_id|/|layer| are out of bounds. The
+  // grid is empty if no tile has the tag.
+  const BitGrid* GetTagGrid(int tag_id, int layer) const;
+
+  // Hears about each tile Draw() draws, e.g. to draw overlays on top. With the
+  // render cache on, tiles with single-frame sprites are reported when their
+  // block is baked instead, with the block's texture as the render target and
+  // |screen_rect| relative to it, so what the observer draws is baked too.
   class Observer {
    public:
     virtual void OnDrawTile(Tile* tile, const Rect<int, 2>& screen_rect) = 0;
   };
   void SetObserver(Observer* observer) { observer_ = observer; }
 
+  // Hears about edits, e.g. to keep data derived from the map up to date.
+  class ChangeListener {
+   public:
+    virtual ~ChangeListener() = default;
+    // SetTileIndex() changed the tile at |point| on |layer|, which is
+    // kAllLayers if every layer may have changed.
+    virtual void OnTileChanged(const GridPoint& point, int layer) = 0;
+    // AddTile(), AddTiles() or SetTile() changed the tile set, so any tile
+    // in the grid may have changed.
+    virtual void OnTileSetChanged() = 0;
+    // SetChunkTiles() changed the tiles in |grid_rect| on every layer. Calls
+    // OnTileChanged() for each of them, with kAllLayers, by default.
+    virtual void OnRectChanged(const Rect<>& grid_rect);
+  };
+  void AddChangeListener(ChangeListener* listener);
+  void RemoveChangeListener(ChangeListener* listener);
+
+  // When on, Draw() collects the tiles of each layer into a list of textured
+  // quads per texture and draws each list with one DrawGeometry() call,
+  // instead of calling Sprite::Draw() for every tile. Overrides of
+  // Sprite::Draw() are bypassed, except for sprites without a texture.
+  void SetBatchDrawing(bool batch) { batch_drawing_ = batch; }
+
+  // Runs every animated tile off one clock. Picks the frame for |time| once
+  // per distinct sprite and animation offset, however many tiles share them,
+  // and Draw() then looks each tile's frame up. Tiles' animation offsets only
+  // apply this way, and overrides of Sprite::Draw() are bypassed for sprites
+  // with a texture. Until this is first called, tiles draw their sprite's
+  // current frame. Call once a frame.
+  void UpdateAnimations(const Time& time);
+
+  // Builds a level of detail pyramid. Level k holds a representative tile
+  // index for each 2^k x 2^k block of each layer: the most common of the
+  // level below, with ties going against tile 0. When zoomed out, Draw()
+  // stretches each representative tile over its block, so the cost of drawing
+  // stays about the same however far out it goes, and reports it to the
+  // observer with the block's screen rect. Only chunks in memory are read
+  // now; streamed chunks are taken in when Draw() loads them, and count as
+  // tile 0 until then.
+  void SetLodEnabled(bool enabled);
+  int GetLodLevelCount() const { return lod_levels_.size(); }
+  // Returns the representative of the block holding |point| at |level|, where
+  // level 0 is the map itself, or 0 if point/layer/level are out of bounds.
+  uint16_t GetLodTileIndex(const GridPoint& point, int layer, int level) const;
+
+  // Turns the render cache on if |max_textures| is above 0. Draw() then bakes
+  // the tiles with single-frame sprites in each kRenderChunkSize block of a
+  // layer into a texture, and draws the visible blocks' textures instead of
+  // their tiles. Tiles with animated sprites are drawn over them as usual. A
+  // block is baked again after SetTileIndex() changes one of its tiles. At
+  // most |max_textures| textures are kept; the least recently drawn go first.
+  void SetRenderCacheSize(int max_textures);
+  // Bakes every block again the next time it's drawn. Call this after changing
+  // a tile's sprite through GetTile() or GetTileByIndex(), when the observer's
+  // output changes, and on SDL_RENDER_TARGETS_RESET, which clears the baked
+  // textures.
+  void InvalidateRenderCache();
+  int GetRenderCacheTextureCount() const {
+    return baked_render_chunks_.size();
+  }
+
+  // Supplies the tile indices of chunks that aren't in memory.
+  class ChunkSource {
+   public:
+    virtual ~ChunkSource() = default;
+
+    // Fills |tiles| with the indices in |grid_rect|, which covers one chunk,
+    // clipped to the edge of the map. Tile (x, y) of the chunk on |layer| goes
+    // in tiles[(y * kChunkSize + x) * layer_count + layer]. If this returns
+    // false, the chunk is treated as empty.
+    virtual bool LoadChunk(const Rect<>& grid_rect,
+                           int layer_count,
+                           uint16_t* tiles) = 0;
+  };
+  // Chunks that aren't in memory are loaded from |source| when they're used.
+  // Without a source, they're empty until a tile is set.
+  void SetChunkSource(std::unique_ptr<ChunkSource> source);
+
+  // Limits the memory used by uncompressed chunks. When loading a chunk goes
+  // over budget, the least recently used chunks that can be reloaded from the
+  // chunk source are dropped. Other chunks stay in memory unless
+  // SetCompressInactiveChunks() is on. 0 means no limit.
+  void SetMemoryBudget(size_t bytes);
+  // When on, chunks over the memory budget that can't be reloaded, such as
+  // modified chunks or those of a map without a chunk source, are compressed
+  // in memory instead of being kept as they are. They're decompressed the
+  // next time they're used.
+  void SetCompressInactiveChunks(bool compress);
+  // Loads the chunks overlapping |world_rect|, e.g. the camera's rect grown by
+  // a margin, so they're in memory before they're drawn. Draw() does this for
+  // a margin of one chunk.
+  void Prefetch(const Rect<>& world_rect);
+  int GetLoadedChunkCount() const { return loaded_chunk_count_; }
+  // Memory used by a loaded chunk's tile array, which holds the dense layers.
+  // The memory budget only counts these.
+  size_t GetChunkBytes() const;
+  // Memory used by chunks compressed by SetCompressInactiveChunks().
+  size_t GetCompressedChunkBytes() const { return compressed_bytes_; }
+
  private:
+  // The tiles of a chunk on a sparse layer.
+  struct SparseTiles {
+    uint16_t Get(int x, int y) const;
+    void Set(int x, int y, uint16_t index);
+    size_t GetBytes() const;
+
+    // Bit x of occupied[y] is set if tile (x, y) isn't 0.
+    uint64_t occupied[kChunkSize] = {};
+    // Number of set bits in the rows above each row.
+    uint16_t row_starts[kChunkSize] = {};
+    // Indices of the tiles other than 0, row by row.
+    std::vector<uint16_t> indices;
+  };
+
+  // Linked into |loaded_chunks_| while it has |owned_tiles|.
+  struct Chunk : public ListNode<Chunk> {
+    // Points to |owned_tiles| or into |mapped_file_|. Holds the dense layers
+    // only, arranged by |grid_layout_|.
+    uint16_t* tiles = nullptr;
+    std::unique_ptr<uint16_t[]> owned_tiles;
+    // Holds the tiles while the chunk is inactive and |tiles| is null.
+    std::vector<uint8_t> compressed;
+    // Set when a tile changes, since the chunk source can't restore it.
+    bool modified = false;
+    // Set once the level of detail pyramid has read the chunk. Edits keep it
+    // up to date after that, and eviction doesn't change it.
+    bool lod_built = false;
+    // Tiles other than 0 on each layer, once the chunk has been counted for
+    // automatic layer storage. Empty until then.
+    std::vector<uint16_t> tile_counts;
+    // Tiles of the sparse layers, by layer, while the chunk is loaded or
+    // compressed. Null for dense layers and layers with no tiles here.
+    std::vector<std::unique_ptr<SparseTiles>> sparse_tiles;
+  };
+
+  // Where a map file stores its grid.
+  struct FileLayout {
+    uint32_t version = 0;
+    std::streamoff grid_offset = 0;
+    GridEncoding encoding = GridEncoding::kRaw;
+  };
+
+  // A block of tiles on one layer, baked into a texture by the render cache.
+  struct RenderChunk {
+    std::unique_ptr<Texture> texture;
+    // Cleared when a tile in the block changes.
+    bool valid = false;
+    bool has_animated_tiles = false;
+    // draw_clock_ when the block was last drawn.
+    uint64_t last_used = 0;
+  };
+
+  // Quads for the tiles drawn with one texture when batch drawing. Kept
+  // between draws so their buffers are reused.
+  struct GeometryBatch {
+    Texture* texture = nullptr;
+    // Converts source rects to texture coordinates.
+    Vec<double, 2> texture_scale;
+    std::vector<SDL_Vertex> vertices;
+    std::vector<int> indices;
+  };
+
+  // The tiles with one animated sprite and animation offset.
+  struct Animation {
+    Sprite* sprite;
+    Time::Delta offset;
+    int frame = 0;
+  };
+
+  // One level of the level of detail pyramid.
+  struct LodLevel {
+    Vec<int64_t, 2> size;
+    // Representative indices, a row-major plane per layer.
+    std::vector<uint16_t> tiles;
+  };
+
+  // Where Draw() puts tiles on the screen.
+  struct ScreenMapping {
+    GridPoint corner0;
+    Vec<int64_t, 2> offset;
+    Vec<double, 2> scale;
+  };
+
+  // Reads everything up to the grid.
+  static std::unique_ptr<TileMap> ReadHeader(std::istream& stream,
+                                             SpriteCache* sprite_cache,
+                                             FileLayout* layout);
+  // Points every chunk into the raw grid at |grid_offset| in |file|.
+  bool MapGrid(std::unique_ptr<MappedFile> file, std::streamoff grid_offset);
+
   bool PositionInMap(const GridPoint& grid_position) const;
 
-  uint64_t GridIndex(const GridPoint& grid_point, int layer) const;
+  // Returns the chunk holding |grid_point|, which must be in the map, loading
+  // it from the chunk source if needed. Without a chunk source, returns null
+  // for chunks that were never written to unless |create| is true.
+  Chunk* GetChunk(const GridPoint& grid_point, bool create) const;
+  // Drops or compresses least recently used chunks until the memory budget is
+  // met. Never touches chunk |keep_index|.
+  void EvictChunks(int keep_index) const;
+  // Moves |chunk| to the most recently used end of |loaded_chunks_|, linking
+  // it if it wasn't loaded.
+  void TouchLoadedChunk(Chunk* chunk) const;
+  Rect<> GetChunkGridRect(int chunk_index) const;
+
+  // Draws the tiles of |layer| in |grid_rect|. With |animated_only|, only
+  // tiles with animated sprites are drawn and reported to the observer, since
+  // the rest are baked.
+  void DrawTiles(Graphics2D* graphics,
+                 int layer,
+                 const Rect<>& grid_rect,
+                 const ScreenMapping& mapping,
+                 bool animated_only);
+  // Draws the tiles of |layer| in |grid_rect| from the render cache, baking
+  // blocks that aren't there.
+  void DrawCachedTiles(Graphics2D* graphics,
+                       int layer,
+                       const Rect<>& grid_rect,
+                       const ScreenMapping& mapping);
+  // Draws |layer| from the level of detail pyramid.
+  void DrawLod(Graphics2D* graphics,
+               int layer,
+               int level,
+               const Rect<>& grid_rect,
+               const ScreenMapping& mapping);
+  // Draws tile |index| at |dest|, with its shared animation frame if there
+  // is one.
+  void DrawTile(Graphics2D* graphics, uint16_t index, const Rect<int, 2>& dest);
+  // Groups the animated tiles into |animations_| and picks their frames.
+  void BuildAnimations();
+  // The frame to draw tile |index| with, or -1 for its sprite's current one.
+  int GetTileFrame(uint16_t index) const;
+  // Picks the level of detail for drawing at |scale|. 0 is the map itself.
+  int ChooseLodLevel(const Vec<double, 2>& scale) const;
+  // Recomputes block |block| of |level| from the level below. Returns false if
+  // it didn't change.
+  bool UpdateLodBlock(int level, int layer, const Point<>& block);
+  // Reads chunk |chunk_index| into the level of detail pyramid.
+  void BuildChunkLod(int chunk_index);
+  // Reads the chunks in memory under the blocks of |level| covering
+  // |grid_rect| that haven't been read yet.
+  void BuildLod(int level, const Rect<>& grid_rect);
+  uint16_t& LodTile(int level, int layer, const Point<>& block);
+  // Adds frame |frame| of |sprite| at |dest| to its texture's batch, or the
+  // current frame if |frame| is -1.
+  void AddToBatch(Sprite* sprite, int frame, const Rect<int, 2>& dest);
+  // Draws and empties the batches, then reports their tiles to the observer.
+  void FlushBatches(Graphics2D* graphics);
+  // Bakes render chunk |index|. Returns false if there's no texture for it.
+  bool BakeRenderChunk(Graphics2D* graphics, int index);
+  // Frees the texture of the least recently drawn render chunk that hasn't
+  // been drawn since |used_since|. Returns false if there isn't one.
+  bool EvictRenderChunk(uint64_t used_since);
+  int GetRenderChunkIndex(const GridPoint& grid_point, int layer) const;
+  Rect<> GetRenderChunkGridRect(int index) const;
+  Rect<> GridToScreen(const Rect<>& grid_rect,
+                      const ScreenMapping& mapping) const;
+
+  // Rebuilds the tag index for |tags|.
+  void BuildTagGrids(const std::bitset<kMaxTags>& tags);
+  // Sets the bits of |tags| for the tiles whose index is in [|first|,
+  // |end|) to what those indices' tiles have now.
+  void UpdateTagGrids(int first, int end, const std::bitset<kMaxTags>& tags);
+  // Returns the tags of tile |index|, which may be past the end of |tiles_|.
+  std::bitset<kMaxTags> GetTileTags(uint16_t index) const;
+
+  // Reads or writes a tile of |chunk| on either kind of layer.
+  uint16_t GetChunkTile(const Chunk& chunk,
+                        const GridPoint& grid_point,
+                        int layer) const;
+  void SetChunkTile(Chunk* chunk,
+                    const GridPoint& grid_point,
+                    int layer,
+                    uint16_t tile_index) const;
+  // Fills |chunk|'s tiles, which must be allocated, from |tiles|, laid out
+  // like a ChunkSource's, or the other way.
+  void StoreChunkTiles(Chunk* chunk, const uint16_t* tiles) const;
+  void GetInterleavedChunkTiles(const Chunk& chunk, uint16_t* tiles) const;
+  // Recomputes |dense_slots_| from |layer_storage_|.
+  void UpdateDenseSlots();
+  // Switches |layer| between dense and sparse as its density calls for.
+  void UpdateAutoLayerStorage(int layer);
+  // Adds chunk |chunk_index|, which must be in memory or never have been
+  // created, to the tile counts, unless it's already counted or automatic
+  // layer storage is off.
+  void CountChunkTiles(int chunk_index) const;
+  // Brings the render cache, level of detail pyramid and tag index up to date
+  // after the tiles in |grid_rect| changed on every layer, then tells the
+  // listeners.
+  void UpdateRect(const Rect<>& grid_rect);
+
+  // Position of a tile on a dense layer within its chunk's tile array.
+  int ChunkTileIndex(const GridPoint& grid_point, int layer) const;
+  // Distance between horizontally adjacent tiles on the same layer in a
+  // chunk's tile array.
+  int ChunkTileStride() const;
 
   SpriteCache* sprite_cache_;
   Vec<int64_t, 2> tile_size_;
@@ -101,10 +518,55 @@ class TileMap {
   int layer_count_;
   // Storage for tiles.
   std::vector<Tile> tiles_;
-  // Stores indices of tiles.
-  std::unique_ptr<uint16_t[]> grid_;
+  // Stores indices of tiles, in kChunkSize x kChunkSize chunks ordered by row.
+  // Chunks are loaded on demand, even from const methods.
+  Vec<int64_t, 2> chunk_grid_size_;
+  mutable std::vector<Chunk> chunks_;
+  // Loaded chunks, least recently used first.
+  mutable List<Chunk> loaded_chunks_;
+  mutable int loaded_chunk_count_ = 0;
+  GridLayout grid_layout_ = GridLayout::kInterleaved;
+  std::vector<LayerStorage> layer_storage_;
+  // The place of each dense layer among the layers in chunk tile arrays, or
+  // -1 for sparse layers.
+  std::vector<int> dense_slots_;
+  int dense_layer_count_;
+  // Tiles other than 0 on each layer in the counted chunks, while automatic
+  // layer storage is on. Empty while it's off.
+  mutable std::vector<int64_t> layer_tile_counts_;
+  // Tiles in the counted chunks, on one layer.
+  mutable int64_t counted_tiles_ = 0;
+  std::unique_ptr<ChunkSource> chunk_source_;
+  std::unique_ptr<MappedFile> mapped_file_;
+  size_t memory_budget_ = 0;
+  bool compress_inactive_chunks_ = false;
+  mutable size_t compressed_bytes_ = 0;
   std::vector<std::string> tags_;
   Observer* observer_ = nullptr;
+  std::vector<ChangeListener*> change_listeners_;
+  // Render chunks of each layer, indexed by GetRenderChunkIndex(). Empty while
+  // the render cache is off.
+  std::vector<RenderChunk> render_chunks_;
+  std::vector<int> baked_render_chunks_;
+  Vec<int64_t, 2> render_grid_size_;
+  int render_cache_size_ = 0;
+  uint64_t draw_clock_ = 0;
+  bool batch_drawing_ = false;
+  std::vector<GeometryBatch> batches_;
+  // Tiles in the batches, for the observer, which hears about them after
+  // they're drawn.
+  std::vector<std::pair<Tile*, Rect<int, 2>>> batched_tiles_;
+  // Whether UpdateAnimations() has been called.
+  bool animation_clock_ = false;
+  Time animation_time_;
+  std::vector<Animation> animations_;
+  // The index in |animations_| of each tile's animation, or -1.
+  std::vector<int> tile_animations_;
+  // Level k of the level of detail pyramid is lod_levels_[k - 1].
+  std::vector<LodLevel> lod_levels_;
+  // Tag index grids, indexed by tag * layer_count_ + layer. Empty while the
+  // tag index is off. Tags no tile has get an empty BitGrid.
+  std::vector<BitGrid> tag_grids_;
 };
 
 }  // namespace engine2
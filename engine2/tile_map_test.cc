@@ -1,6 +1,9 @@
+#include <cstdio>
+#include <fstream>
 #include <sstream>
 #include <unordered_set>
 
+#include "engine2/base/binary_io.h"
 #include "engine2/camera2d.h"
 #include "engine2/test/assert_macros.h"
 #include "engine2/test/test_group.h"
@@ -44,6 +47,98 @@ TestSprite CreateSprite() {
   return TestSprite(nullptr, /*frame_count=*/1);
 }
 
+class CountingObserver : public TileMap::Observer {
+ public:
+  int draw_count = 0;
+
+  void OnDrawTile(TileMap::Tile* tile,
+                  const Rect<int, 2>& screen_rect) override {
+    ++draw_count;
+  }
+};
+
+// A map spanning several chunks in each direction, with a different tile
+// index pattern on each layer.
+constexpr Vec<int64_t, 2> kChunkedGridSize{150, 130};
+constexpr int kTileCount = 7;
+
+uint16_t ExpectedIndex(const TileMap::GridPoint& p, int layer) {
+  return (p.x() * 3 + p.y() * 5 + layer) % kTileCount;
+}
+
+std::string MakeChunkedMapData(
+    TileMap::GridEncoding encoding = TileMap::GridEncoding::kRaw) {
+  TileMap map(kTileSize, kChunkedGridSize, /*layer_count=*/2,
+              kPositionInWorld, /*sprite_cache=*/nullptr);
+  for (int i = 0; i < kTileCount; ++i)
+    map.AddTile({nullptr});
+
+  TileMap::GridPoint p;
+  for (p.y() = 0; p.y() < kChunkedGridSize.y(); ++p.y()) {
+    for (p.x() = 0; p.x() < kChunkedGridSize.x(); ++p.x()) {
+      for (int layer = 0; layer < 2; ++layer)
+        map.SetTileIndex(p, layer, ExpectedIndex(p, layer));
+    }
+  }
+  std::ostringstream stream;
+  map.Write(stream, encoding);
+  return stream.str();
+}
+
+// The same map in the original file format, which has no header and stores
+// the grid row by row.
+std::string MakeVersion1MapData() {
+  std::ostringstream stream;
+  WriteVecInt64(stream, kTileSize);
+  WriteVecInt64(stream, kChunkedGridSize);
+  WriteVecInt64(stream, kPositionInWorld);
+  WriteInt32(stream, /*layer_count=*/2);
+  WriteInt32(stream, /*tag_count=*/0);
+  WriteInt32(stream, kTileCount);
+  for (int i = 0; i < kTileCount; ++i) {
+    WriteString(stream, "");
+    WriteInt32(stream, /*animation_offset_ms=*/0);
+    WriteInt64(stream, /*tags=*/0);
+  }
+
+  TileMap::GridPoint p;
+  for (p.y() = 0; p.y() < kChunkedGridSize.y(); ++p.y()) {
+    for (p.x() = 0; p.x() < kChunkedGridSize.x(); ++p.x()) {
+      for (int layer = 0; layer < 2; ++layer)
+        WriteInt16(stream, ExpectedIndex(p, layer));
+    }
+  }
+  return stream.str();
+}
+
+bool HasChunkedMapIndices(const TileMap& map) {
+  TileMap::GridPoint p;
+  for (p.y() = 0; p.y() < kChunkedGridSize.y(); ++p.y()) {
+    for (p.x() = 0; p.x() < kChunkedGridSize.x(); ++p.x()) {
+      for (int layer = 0; layer < 2; ++layer) {
+        if (map.GetTileIndex(p, layer) != ExpectedIndex(p, layer))
+          return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Replaces the grid offset in the header of |data|, a raw map from
+// MakeChunkedMapData().
+void SetGridOffset(std::string* data, uint64_t grid_offset) {
+  uint64_t old_offset = data->size() - 9 * TileMap::kChunkSize *
+                                           TileMap::kChunkSize * 2 *
+                                           sizeof(uint16_t);
+  std::string old_bytes, new_bytes;
+  for (int i = 0; i < 8; ++i) {
+    old_bytes.push_back(char(old_offset >> (8 * i)));
+    new_bytes.push_back(char(grid_offset >> (8 * i)));
+  }
+  size_t at = data->rfind(old_bytes, old_offset);
+  data->replace(at, 8, new_bytes);
+}
+
 }  // namespace
 
 void TileMapTest::TestDraw() {
@@ -160,11 +255,911 @@ void TileMapTest::TestSaveAndLoad() {
   }
 }
 
+void TileMapTest::TestChunks() {
+  TileMap map(kTileSize, kChunkedGridSize, /*layer_count=*/2,
+              kPositionInWorld, /*sprite_cache=*/nullptr);
+  map.AddTiles({{nullptr}, {nullptr}, {nullptr}});
+
+  // Unwritten chunks read as empty without being allocated.
+  EXPECT_EQ(0, map.GetTileIndex({149, 129}, 1));
+  EXPECT_EQ(0, map.GetTileIndex({150, 0}, 0));
+  EXPECT_EQ(0, map.GetLoadedChunkCount());
+
+  map.SetTileIndex({63, 0}, 0, 1);
+  map.SetTileIndex({64, 0}, 1, 2);
+  map.SetTileIndex({149, 129}, 1, 2);
+  EXPECT_EQ(3, map.GetLoadedChunkCount());
+  EXPECT_EQ(1, map.GetTileIndex({63, 0}, 0));
+  EXPECT_EQ(0, map.GetTileIndex({63, 0}, 1));
+  EXPECT_EQ(2, map.GetTileIndex({64, 0}, 1));
+  EXPECT_EQ(2, map.GetTileIndex({149, 129}, 1));
+  EXPECT_EQ(0, map.GetTileIndex({148, 129}, 1));
+}
+
+void TileMapTest::TestOpen() {
+  std::string data = MakeChunkedMapData();
+  auto map = TileMap::Open(std::make_unique<std::istringstream>(data),
+                           /*sprite_cache=*/nullptr);
+  ASSERT_NOT_NULL(map.get());
+  EXPECT_EQ(kTileCount, map->GetTileCount());
+  EXPECT_EQ(0, map->GetLoadedChunkCount());
+
+  EXPECT_EQ(ExpectedIndex({70, 65}, 1), map->GetTileIndex({70, 65}, 1));
+  EXPECT_EQ(1, map->GetLoadedChunkCount());
+
+  // The last row and column of chunks are partial.
+  EXPECT_TRUE(HasChunkedMapIndices(*map));
+  EXPECT_EQ(9, map->GetLoadedChunkCount());
+
+  // Streamed maps write out the same data.
+  std::ostringstream stream;
+  bool written = map->Write(stream);
+  EXPECT_TRUE(written);
+  EXPECT_TRUE(data == stream.str());
+
+  // The whole grid must be present.
+  data.resize(data.size() - 1);
+  EXPECT_NULL(TileMap::Open(std::make_unique<std::istringstream>(data),
+                            /*sprite_cache=*/nullptr)
+                  .get());
+}
+
+void TileMapTest::TestMemoryBudget() {
+  auto map =
+      TileMap::Open(std::make_unique<std::istringstream>(MakeChunkedMapData()),
+                    /*sprite_cache=*/nullptr);
+  ASSERT_NOT_NULL(map.get());
+  map->SetMemoryBudget(2 * map->GetChunkBytes());
+
+  // Load a 2x2 block of chunks.
+  map->Prefetch({kPositionInWorld, kTileSize * Vec<int64_t, 2>{100, 100}});
+  EXPECT_EQ(2, map->GetLoadedChunkCount());
+
+  TileMap::GridPoint p;
+  for (p.y() = 0; p.y() < kChunkedGridSize.y(); ++p.y()) {
+    for (p.x() = 0; p.x() < kChunkedGridSize.x(); ++p.x())
+      ASSERT_EQ(ExpectedIndex(p, 0), map->GetTileIndex(p, 0));
+  }
+  EXPECT_EQ(2, map->GetLoadedChunkCount());
+
+  // Modified chunks are never evicted.
+  map->SetTileIndex({1, 1}, 0, 6);
+  map->SetTileIndex({140, 1}, 0, 6);
+  map->SetTileIndex({1, 120}, 0, 6);
+  for (p.y() = 0; p.y() < kChunkedGridSize.y(); p.y() += 10) {
+    for (p.x() = 0; p.x() < kChunkedGridSize.x(); p.x() += 10)
+      map->GetTileIndex(p, 0);
+  }
+  EXPECT_EQ(6, map->GetTileIndex({1, 1}, 0));
+  EXPECT_EQ(6, map->GetTileIndex({140, 1}, 0));
+  EXPECT_EQ(6, map->GetTileIndex({1, 120}, 0));
+  EXPECT_EQ(4, map->GetLoadedChunkCount());
+
+  // Setting a tile to the index it already has doesn't count as a change.
+  map->SetTileIndex({70, 70}, 0, ExpectedIndex({70, 70}, 0));
+
+  // Lowering the budget evicts right away.
+  map->SetMemoryBudget(1);
+  EXPECT_EQ(3, map->GetLoadedChunkCount());
+
+  // Drawing loads the chunks around the view too.
+  map =
+      TileMap::Open(std::make_unique<std::istringstream>(MakeChunkedMapData()),
+                    /*sprite_cache=*/nullptr);
+  ASSERT_NOT_NULL(map.get());
+  TestGraphics2D graphics;
+  map->Draw(&graphics, {kPositionInWorld, kTileSize * Vec<int64_t, 2>{10, 10}},
+            {0, 0, 100, 100});
+  EXPECT_EQ(4, map->GetLoadedChunkCount());
+}
+
+void TileMapTest::TestReadVersion1() {
+  std::string data = MakeVersion1MapData();
+  std::istringstream stream(data);
+  auto map = TileMap::Read(stream, /*sprite_cache=*/nullptr);
+  ASSERT_NOT_NULL(map.get());
+  EXPECT_EQ(kTileSize.x(), map->GetTileSize().x());
+  EXPECT_EQ(kTileCount, map->GetTileCount());
+  EXPECT_TRUE(HasChunkedMapIndices(*map));
+
+  auto streamed = TileMap::Open(std::make_unique<std::istringstream>(data),
+                                /*sprite_cache=*/nullptr);
+  ASSERT_NOT_NULL(streamed.get());
+  EXPECT_EQ(0, streamed->GetLoadedChunkCount());
+  EXPECT_TRUE(HasChunkedMapIndices(*streamed));
+
+  // Writing upgrades to the current version.
+  std::ostringstream upgraded;
+  bool written = map->Write(upgraded);
+  EXPECT_TRUE(written);
+  EXPECT_TRUE(MakeChunkedMapData() == upgraded.str());
+}
+
+void TileMapTest::TestMappedFile() {
+  const std::string path = "/tmp/engine2_tile_map_test.map";
+  std::string data = MakeChunkedMapData();
+  {
+    std::ofstream file(path, std::ios::binary);
+    file.write(data.data(), data.size());
+  }
+
+  auto map = TileMap::FromFile(path, /*sprite_cache=*/nullptr);
+  ASSERT_NOT_NULL(map.get());
+  // Mapped chunks don't count as loaded, since they aren't copied.
+  EXPECT_TRUE(HasChunkedMapIndices(*map));
+  EXPECT_EQ(0, map->GetLoadedChunkCount());
+
+  // Edits stay in memory.
+  map->SetTileIndex({100, 100}, 1, 6);
+  EXPECT_EQ(6, map->GetTileIndex({100, 100}, 1));
+  auto reopened = TileMap::FromFile(path, /*sprite_cache=*/nullptr);
+  ASSERT_NOT_NULL(reopened.get());
+  EXPECT_EQ(ExpectedIndex({100, 100}, 1),
+            reopened->GetTileIndex({100, 100}, 1));
+
+  // Version 1 files are streamed instead.
+  {
+    std::string version1 = MakeVersion1MapData();
+    std::ofstream file(path, std::ios::binary);
+    file.write(version1.data(), version1.size());
+  }
+  auto streamed = TileMap::FromFile(path, /*sprite_cache=*/nullptr);
+  ASSERT_NOT_NULL(streamed.get());
+  EXPECT_TRUE(HasChunkedMapIndices(*streamed));
+  EXPECT_EQ(9, streamed->GetLoadedChunkCount());
+
+  // Grid offsets that would wrap around or point into the header.
+  for (uint64_t grid_offset :
+       {~uint64_t(0) - 4095, uint64_t(1) << 62, uint64_t(8)}) {
+    std::string corrupt = MakeChunkedMapData();
+    SetGridOffset(&corrupt, grid_offset);
+    {
+      std::ofstream file(path, std::ios::binary);
+      file.write(corrupt.data(), corrupt.size());
+    }
+    EXPECT_NULL(TileMap::FromFile(path, /*sprite_cache=*/nullptr).get());
+    std::istringstream stream(corrupt);
+    auto read_map = TileMap::Read(stream, /*sprite_cache=*/nullptr);
+    EXPECT_NULL(read_map.get());
+  }
+
+  std::remove(path.c_str());
+  EXPECT_NULL(TileMap::FromFile(path, /*sprite_cache=*/nullptr).get());
+}
+
+void TileMapTest::TestCompressedGrid() {
+  std::string data = MakeChunkedMapData(TileMap::GridEncoding::kCompressed);
+  EXPECT_TRUE(data.size() < MakeChunkedMapData().size() / 10);
+
+  std::istringstream stream(data);
+  auto map = TileMap::Read(stream, /*sprite_cache=*/nullptr);
+  ASSERT_NOT_NULL(map.get());
+  EXPECT_TRUE(HasChunkedMapIndices(*map));
+
+  auto streamed = TileMap::Open(std::make_unique<std::istringstream>(data),
+                                /*sprite_cache=*/nullptr);
+  ASSERT_NOT_NULL(streamed.get());
+  EXPECT_EQ(0, streamed->GetLoadedChunkCount());
+  EXPECT_TRUE(HasChunkedMapIndices(*streamed));
+  std::ostringstream rewritten;
+  bool written =
+      streamed->Write(rewritten, TileMap::GridEncoding::kCompressed);
+  EXPECT_TRUE(written);
+  EXPECT_TRUE(data == rewritten.str());
+
+  // Chunks of tile 0 aren't stored, or allocated when read.
+  TileMap sparse(kTileSize, kChunkedGridSize, /*layer_count=*/2,
+                 kPositionInWorld, /*sprite_cache=*/nullptr);
+  sparse.AddTiles({{nullptr}, {nullptr}});
+  sparse.SetTileIndex({100, 100}, 1, 1);
+  sparse.SetTileIndex({0, 0}, 0, 0);
+  std::stringstream sparse_stream;
+  written = sparse.Write(sparse_stream, TileMap::GridEncoding::kCompressed);
+  EXPECT_TRUE(written);
+  auto sparse_read = TileMap::Read(sparse_stream, /*sprite_cache=*/nullptr);
+  ASSERT_NOT_NULL(sparse_read.get());
+  EXPECT_EQ(1, sparse_read->GetLoadedChunkCount());
+  EXPECT_EQ(1, sparse_read->GetTileIndex({100, 100}, 1));
+  EXPECT_EQ(0, sparse_read->GetTileIndex({0, 0}, 0));
+
+  // The whole grid must be present.
+  data.resize(data.size() - 1);
+  EXPECT_NULL(TileMap::Open(std::make_unique<std::istringstream>(data),
+                            /*sprite_cache=*/nullptr)
+                  .get());
+  std::istringstream truncated(data);
+  EXPECT_NULL(TileMap::Read(truncated, /*sprite_cache=*/nullptr).get());
+}
+
+void TileMapTest::TestCompressInactiveChunks() {
+  std::istringstream stream(MakeChunkedMapData());
+  auto map = TileMap::Read(stream, /*sprite_cache=*/nullptr);
+  ASSERT_NOT_NULL(map.get());
+
+  // Without a chunk source, nothing can be evicted unless it's compressed.
+  map->SetMemoryBudget(2 * map->GetChunkBytes());
+  EXPECT_EQ(9, map->GetLoadedChunkCount());
+  EXPECT_EQ(0, map->GetCompressedChunkBytes());
+
+  map->SetCompressInactiveChunks(true);
+  EXPECT_EQ(2, map->GetLoadedChunkCount());
+  EXPECT_TRUE(map->GetCompressedChunkBytes() > 0);
+  EXPECT_TRUE(map->GetCompressedChunkBytes() < map->GetChunkBytes());
+  EXPECT_TRUE(HasChunkedMapIndices(*map));
+  EXPECT_EQ(2, map->GetLoadedChunkCount());
+
+  // Modified chunks of a streamed map are compressed rather than kept, and
+  // unmodified ones are still reloaded from the file.
+  auto streamed =
+      TileMap::Open(std::make_unique<std::istringstream>(MakeChunkedMapData()),
+                    /*sprite_cache=*/nullptr);
+  ASSERT_NOT_NULL(streamed.get());
+  streamed->SetMemoryBudget(streamed->GetChunkBytes());
+  streamed->SetCompressInactiveChunks(true);
+  streamed->SetTileIndex({1, 1}, 0, 6);
+  streamed->SetTileIndex({140, 1}, 0, 6);
+  EXPECT_EQ(1, streamed->GetLoadedChunkCount());
+  EXPECT_TRUE(streamed->GetCompressedChunkBytes() > 0);
+  EXPECT_EQ(6, streamed->GetTileIndex({1, 1}, 0));
+  EXPECT_EQ(6, streamed->GetTileIndex({140, 1}, 0));
+  EXPECT_EQ(ExpectedIndex({70, 70}, 1), streamed->GetTileIndex({70, 70}, 1));
+  EXPECT_EQ(1, streamed->GetLoadedChunkCount());
+}
+
+void TileMapTest::TestGetRowTileIndices() {
+  std::istringstream stream(MakeChunkedMapData());
+  auto map = TileMap::Read(stream, /*sprite_cache=*/nullptr);
+  ASSERT_NOT_NULL(map.get());
+
+  // Crosses chunk boundaries and both edges of the map.
+  std::vector<uint16_t> row(kChunkedGridSize.x() + 20);
+  map->GetRowTileIndices({-10, 70}, 1, row.size(), row.data());
+  for (int64_t i = 0; i < row.size(); ++i) {
+    TileMap::GridPoint p{i - 10, 70};
+    bool in_map = p.x() >= 0 && p.x() < kChunkedGridSize.x();
+    ASSERT_EQ(in_map ? ExpectedIndex(p, 1) : 0, row[i]);
+  }
+
+  std::fill(row.begin(), row.end(), 1);
+  map->GetRowTileIndices({0, kChunkedGridSize.y()}, 0, 3, row.data());
+  EXPECT_EQ(0, row[0]);
+  EXPECT_EQ(0, row[2]);
+  EXPECT_EQ(1, row[3]);
+}
+
+void TileMapTest::TestGridLayout() {
+  std::istringstream stream(MakeChunkedMapData());
+  auto map = TileMap::Read(stream, /*sprite_cache=*/nullptr);
+  ASSERT_NOT_NULL(map.get());
+
+  map->SetGridLayout(TileMap::GridLayout::kLayerMajor);
+  EXPECT_TRUE(TileMap::GridLayout::kLayerMajor == map->GetGridLayout());
+  EXPECT_TRUE(HasChunkedMapIndices(*map));
+  map->SetTileIndex({100, 100}, 1, 6);
+  EXPECT_EQ(6, map->GetTileIndex({100, 100}, 1));
+  EXPECT_EQ(ExpectedIndex({100, 100}, 0), map->GetTileIndex({100, 100}, 0));
+  map->SetTileIndex({100, 100}, 1, ExpectedIndex({100, 100}, 1));
+
+  // Files are written in the interleaved layout either way.
+  std::ostringstream raw, compressed;
+  bool written = map->Write(raw);
+  EXPECT_TRUE(written);
+  EXPECT_TRUE(MakeChunkedMapData() == raw.str());
+  written = map->Write(compressed, TileMap::GridEncoding::kCompressed);
+  EXPECT_TRUE(written);
+  EXPECT_TRUE(MakeChunkedMapData(TileMap::GridEncoding::kCompressed) ==
+              compressed.str());
+
+  // Chunks loaded from a chunk source, and compressed chunks, are converted.
+  auto streamed =
+      TileMap::Open(std::make_unique<std::istringstream>(MakeChunkedMapData()),
+                    /*sprite_cache=*/nullptr);
+  ASSERT_NOT_NULL(streamed.get());
+  streamed->SetMemoryBudget(streamed->GetChunkBytes());
+  streamed->SetCompressInactiveChunks(true);
+  streamed->SetTileIndex({1, 1}, 0, 6);
+  streamed->SetTileIndex({140, 1}, 1, 6);
+  streamed->SetGridLayout(TileMap::GridLayout::kLayerMajor);
+  EXPECT_EQ(6, streamed->GetTileIndex({1, 1}, 0));
+  EXPECT_EQ(6, streamed->GetTileIndex({140, 1}, 1));
+  streamed->SetTileIndex({1, 1}, 0, ExpectedIndex({1, 1}, 0));
+  streamed->SetTileIndex({140, 1}, 1, ExpectedIndex({140, 1}, 1));
+  EXPECT_TRUE(HasChunkedMapIndices(*streamed));
+
+  map->SetGridLayout(TileMap::GridLayout::kInterleaved);
+  EXPECT_TRUE(HasChunkedMapIndices(*map));
+}
+
+void TileMapTest::TestRenderCache() {
+  const Vec<int64_t, 2> kGridSize{40, 40};
+  TileMap map(kTileSize, kGridSize, /*layer_count=*/1, kPositionInWorld,
+              /*sprite_cache=*/nullptr);
+  TestSprite still = CreateSprite();
+  TestSprite animated = CreateSprite();
+  animated.AddFrame({{0, 0, 16, 16}, {}, Time::Delta::FromSeconds(1)});
+  animated.AddFrame({{16, 0, 16, 16}, {}, Time::Delta::FromSeconds(1)});
+  map.AddTiles({{nullptr}, {&still}, {&animated}});
+
+  // Two blocks have tiles with single-frame sprites.
+  map.SetTileIndex({1, 1}, 0, 1);
+  map.SetTileIndex({2, 1}, 0, 1);
+  map.SetTileIndex({20, 1}, 0, 1);
+  map.SetTileIndex({3, 3}, 0, 2);
+  map.SetRenderCacheSize(8);
+
+  Rect<> world_rect = map.GetWorldRect();
+  Rect<> window_rect{{}, world_rect.size};
+  TestGraphics2D graphics;
+  map.Draw(&graphics, world_rect, window_rect);
+  EXPECT_EQ(2, graphics.created_texture_count);
+  EXPECT_EQ(2, map.GetRenderCacheTextureCount());
+  EXPECT_NULL(graphics.render_target);
+  // Baked tiles are drawn relative to their block.
+  EXPECT_EQ(3, still.draw_calls.size());
+  EXPECT_EQ(1, still.CountDraws({16, 16}));
+  EXPECT_EQ(1, still.CountDraws({64, 16}));
+  EXPECT_EQ(1, animated.draw_calls.size());
+  EXPECT_EQ(1, animated.CountDraws({48, 48}));
+  EXPECT_EQ(2, graphics.draw_texture_count);
+
+  // Later frames draw the textures, and animated tiles on top.
+  map.Draw(&graphics, world_rect, window_rect);
+  EXPECT_EQ(3, still.draw_calls.size());
+  EXPECT_EQ(2, animated.draw_calls.size());
+  EXPECT_EQ(4, graphics.draw_texture_count);
+
+  // Changing a tile rebakes only its block.
+  map.SetTileIndex({2, 1}, 0, 0);
+  map.SetTileIndex({20, 1}, 0, 1);
+  map.Draw(&graphics, world_rect, window_rect);
+  EXPECT_EQ(4, still.draw_calls.size());
+  EXPECT_EQ(2, graphics.created_texture_count);
+
+  // The observer hears about baked tiles when they're baked, and about
+  // animated ones every time they're drawn.
+  CountingObserver observer;
+  map.SetObserver(&observer);
+  map.Draw(&graphics, world_rect, window_rect);
+  EXPECT_EQ(1, observer.draw_count);
+  map.InvalidateRenderCache();
+  map.Draw(&graphics, world_rect, window_rect);
+  EXPECT_EQ(4, observer.draw_count);
+  map.SetObserver(nullptr);
+
+  // Blocks that don't fit in the cache are drawn tile by tile.
+  map.SetRenderCacheSize(1);
+  EXPECT_EQ(1, map.GetRenderCacheTextureCount());
+  map.Draw(&graphics, world_rect, window_rect);
+  EXPECT_EQ(1, map.GetRenderCacheTextureCount());
+  EXPECT_EQ(8, still.draw_calls.size());
+
+  map.SetRenderCacheSize(0);
+  EXPECT_EQ(0, map.GetRenderCacheTextureCount());
+  map.Draw(&graphics, world_rect, window_rect);
+  EXPECT_EQ(10, still.draw_calls.size());
+}
+
+void TileMapTest::TestBatchDrawing() {
+  const Vec<int64_t, 2> kGridSize{10, 10};
+  TileMap map(kTileSize, kGridSize, /*layer_count=*/2, kPositionInWorld,
+              /*sprite_cache=*/nullptr);
+  Texture texture(nullptr);
+  Sprite sprite(&texture, {16, 0, 16, 16});
+  TestSprite untextured = CreateSprite();
+  map.AddTiles({{nullptr}, {&sprite}, {&untextured}});
+  map.SetTileIndex({1, 0}, 0, 1);
+  map.SetTileIndex({2, 1}, 0, 1);
+  map.SetTileIndex({3, 3}, 0, 2);
+  map.SetTileIndex({4, 4}, 1, 1);
+  map.SetBatchDrawing(true);
+
+  Rect<> world_rect = map.GetWorldRect();
+  Rect<> window_rect{{}, world_rect.size};
+  TestGraphics2D graphics;
+  map.Draw(&graphics, world_rect, window_rect, /*layer=*/0);
+  EXPECT_EQ(1, graphics.draw_geometry_count);
+  EXPECT_EQ(&texture, graphics.draw_texture_texture);
+  ASSERT_EQ(8, graphics.geometry_vertices.size());
+  EXPECT_EQ(12, graphics.geometry_indices.size());
+  EXPECT_EQ(16.f, graphics.geometry_vertices[0].position.x);
+  EXPECT_EQ(0.f, graphics.geometry_vertices[0].position.y);
+  EXPECT_EQ(32.f, graphics.geometry_vertices[3].position.x);
+  EXPECT_EQ(16.f, graphics.geometry_vertices[3].position.y);
+  EXPECT_EQ(32.f, graphics.geometry_vertices[4].position.x);
+  EXPECT_EQ(16.f, graphics.geometry_vertices[4].position.y);
+  // Sprites without a texture are drawn on their own.
+  EXPECT_EQ(1, untextured.CountDraws({48, 48}));
+
+  // One call per layer, and the buffers start over each time.
+  CountingObserver observer;
+  map.SetObserver(&observer);
+  map.Draw(&graphics, world_rect, window_rect);
+  EXPECT_EQ(3, graphics.draw_geometry_count);
+  EXPECT_EQ(4, graphics.geometry_vertices.size());
+  EXPECT_EQ(4, observer.draw_count);
+}
+
+void TileMapTest::TestLod() {
+  const Vec<int64_t, 2> kGridSize{64, 64};
+  TileMap map(kTileSize, kGridSize, /*layer_count=*/1, kPositionInWorld,
+              /*sprite_cache=*/nullptr);
+  TestSprite grass = CreateSprite();
+  TestSprite rock = CreateSprite();
+  map.AddTiles({{nullptr}, {&grass}, {&rock}});
+  TileMap::GridPoint point;
+  for (point.y() = 0; point.y() < kGridSize.y(); ++point.y()) {
+    for (point.x() = 0; point.x() < kGridSize.x(); ++point.x())
+      map.SetTileIndex(point, 0, 1);
+  }
+  map.SetTileIndex({0, 0}, 0, 2);
+  map.SetTileIndex({1, 0}, 0, 2);
+  map.SetTileIndex({0, 1}, 0, 2);
+
+  map.SetLodEnabled(true);
+  EXPECT_EQ(6, map.GetLodLevelCount());
+  EXPECT_EQ(2, map.GetLodTileIndex({0, 0}, 0, 0));
+  EXPECT_EQ(2, map.GetLodTileIndex({1, 1}, 0, 1));
+  EXPECT_EQ(1, map.GetLodTileIndex({2, 0}, 0, 1));
+  EXPECT_EQ(1, map.GetLodTileIndex({0, 0}, 0, 2));
+  EXPECT_EQ(0, map.GetLodTileIndex({0, 0}, 0, 7));
+  EXPECT_EQ(0, map.GetLodTileIndex({64, 0}, 0, 1));
+
+  // 64 pixels for 64 tiles a side is level 2, 4 pixels per 4x4 block.
+  Rect<> world_rect = map.GetWorldRect();
+  Rect<> window_rect{{}, {64, 64}};
+  TestGraphics2D graphics;
+  CountingObserver observer;
+  map.SetObserver(&observer);
+  map.Draw(&graphics, world_rect, window_rect);
+  EXPECT_EQ(256, grass.draw_calls.size());
+  EXPECT_EQ(0, rock.draw_calls.size());
+  EXPECT_EQ(1, grass.CountDraws({4, 0}));
+  // The observer hears about each block.
+  EXPECT_EQ(256, observer.draw_count);
+  map.SetObserver(nullptr);
+
+  // Edits work their way up the levels.
+  for (Point<> p : {Point<>{2, 0}, Point<>{3, 0}, Point<>{2, 1},
+                    Point<>{0, 2}, Point<>{1, 2}, Point<>{0, 3}}) {
+    map.SetTileIndex({p.x(), p.y()}, 0, 2);
+  }
+  EXPECT_EQ(2, map.GetLodTileIndex({0, 0}, 0, 2));
+  EXPECT_EQ(1, map.GetLodTileIndex({0, 0}, 0, 3));
+  map.SetTileIndex({4, 0}, 0, 0);
+  map.SetTileIndex({5, 0}, 0, 0);
+  EXPECT_EQ(1, map.GetLodTileIndex({4, 0}, 0, 1));
+  map.SetTileIndex({4, 1}, 0, 0);
+  EXPECT_EQ(0, map.GetLodTileIndex({4, 0}, 0, 1));
+
+  map.Draw(&graphics, world_rect, window_rect);
+  EXPECT_EQ(1, rock.draw_calls.size());
+  EXPECT_EQ(1, rock.CountDraws({0, 0}));
+  EXPECT_EQ(511, grass.draw_calls.size());
+
+  // Close up, tiles are drawn one by one.
+  map.Draw(&graphics, {world_rect.pos, {64, 64}}, window_rect);
+  EXPECT_EQ(10, rock.draw_calls.size());
+
+  map.SetLodEnabled(false);
+  EXPECT_EQ(0, map.GetLodLevelCount());
+  EXPECT_EQ(0, map.GetLodTileIndex({0, 0}, 0, 1));
+
+  // Streamed chunks are read when they're drawn, not when it's enabled.
+  std::string data = MakeChunkedMapData();
+  std::istringstream stream(data);
+  auto read = TileMap::Read(stream, /*sprite_cache=*/nullptr);
+  ASSERT_NOT_NULL(read.get());
+  read->SetLodEnabled(true);
+  auto streamed = TileMap::Open(std::make_unique<std::istringstream>(data),
+                                /*sprite_cache=*/nullptr);
+  ASSERT_NOT_NULL(streamed.get());
+  streamed->SetLodEnabled(true);
+  EXPECT_EQ(0, streamed->GetLoadedChunkCount());
+  Rect<> chunk_rect{streamed->GetWorldRect().pos,
+                    kTileSize * Vec<int64_t, 2>::Fill(TileMap::kChunkSize)};
+  streamed->Draw(&graphics, chunk_rect, {{}, {16, 16}});
+  EXPECT_NE(0, streamed->GetLoadedChunkCount());
+  bool same = true;
+  for (point.y() = 0; point.y() < TileMap::kChunkSize; point.y() += 2) {
+    for (point.x() = 0; point.x() < TileMap::kChunkSize; point.x() += 2) {
+      for (int layer = 0; layer < 2; ++layer) {
+        same &= read->GetLodTileIndex(point, layer, 1) ==
+                streamed->GetLodTileIndex(point, layer, 1);
+      }
+    }
+  }
+  EXPECT_TRUE(same);
+}
+
+void TileMapTest::TestTagIndex() {
+  const Vec<int64_t, 2> kGridSize{100, 70};
+  TileMap map(kTileSize, kGridSize, /*layer_count=*/2, kPositionInWorld,
+              /*sprite_cache=*/nullptr);
+  TestSprite sprite = CreateSprite();
+  TileMap::Tile floor{&sprite};
+  TileMap::Tile wall{&sprite};
+  wall.SetTag(0, true);
+  TileMap::Tile spawn{&sprite};
+  spawn.SetTag(1, true);
+  map.AddTiles({floor, wall, spawn});
+  map.SetTileIndex({3, 4}, 0, 1);
+  map.SetTileIndex({70, 4}, 0, 1);
+  map.SetTileIndex({99, 69}, 1, 1);
+  EXPECT_NULL(map.GetTagGrid(0, 0));
+  EXPECT_FALSE(map.IsTagIndexEnabled());
+
+  map.SetTagIndexEnabled(true);
+  EXPECT_TRUE(map.IsTagIndexEnabled());
+  const BitGrid* walls = map.GetTagGrid(0, 0);
+  ASSERT_NOT_NULL(walls);
+  Rect<> all{{0, 0}, kGridSize};
+  EXPECT_EQ(2, walls->Count(all));
+  EXPECT_EQ(1, map.GetTagGrid(0, 1)->Count(all));
+  EXPECT_EQ(0, map.GetTagGrid(1, 0)->Count(all));
+  // Nothing has tag 2, so it takes no memory.
+  bool empty = map.GetTagGrid(2, 0)->empty();
+  EXPECT_TRUE(empty);
+  EXPECT_NULL(map.GetTagGrid(TileMap::kMaxTags, 0));
+  EXPECT_NULL(map.GetTagGrid(0, 2));
+  Point<> found;
+  bool result = walls->Find({{10, 0}, {90, 70}}, &found);
+  EXPECT_TRUE(result);
+  EXPECT_TRUE((Point<>{70, 4}) == found);
+
+  // Setting tiles updates the grids.
+  map.SetTileIndex({3, 4}, 0, 2);
+  map.SetTileIndex({50, 60}, 0, 1);
+  map.SetTileIndex({50, 60}, 0, 1);
+  EXPECT_EQ(2, walls->Count(all));
+  result = walls->Find(all, &found);
+  EXPECT_TRUE(result);
+  EXPECT_TRUE((Point<>{70, 4}) == found);
+  std::vector<Point<>> spawns;
+  map.GetTagGrid(1, 0)->FindAll(all, &spawns);
+  ASSERT_EQ(1, spawns.size());
+  EXPECT_TRUE((Point<>{3, 4}) == spawns[0]);
+
+  // So does changing which tags a tile has.
+  floor.SetTag(2, true);
+  map.SetTile(0, floor);
+  int64_t floor_count =
+      map.GetTagGrid(2, 0)->Count(all) + map.GetTagGrid(2, 1)->Count(all);
+  EXPECT_EQ(kGridSize.x() * kGridSize.y() * 2 - 4, floor_count);
+  wall.SetTag(0, false);
+  map.SetTile(1, wall);
+  EXPECT_EQ(0, map.GetTagGrid(0, 0)->Count(all));
+  EXPECT_EQ(1, map.GetTagGrid(1, 0)->Count(all));
+
+  // Only the tiles that use the changed index are touched.
+  spawn.SetTag(3, true);
+  map.SetTile(2, spawn);
+  EXPECT_EQ(1, map.GetTagGrid(3, 0)->Count(all));
+  bool spawn_found = map.GetTagGrid(3, 0)->Get({3, 4});
+  EXPECT_TRUE(spawn_found);
+  empty = map.GetTagGrid(3, 1)->empty();
+  EXPECT_TRUE(empty);
+
+  map.SetTagIndexEnabled(false);
+  EXPECT_NULL(map.GetTagGrid(0, 0));
+  EXPECT_FALSE(map.IsTagIndexEnabled());
+}
+
+void TileMapTest::TestLayerStorage() {
+  std::istringstream stream(MakeChunkedMapData());
+  auto map = TileMap::Read(stream, /*sprite_cache=*/nullptr);
+  ASSERT_NOT_NULL(map.get());
+  EXPECT_TRUE(TileMap::LayerStorage::kDense == map->GetLayerStorage(1));
+  size_t dense_bytes = map->GetChunkBytes();
+  EXPECT_EQ(0, map->GetSparseTileBytes());
+
+  map->SetLayerStorage(1, TileMap::LayerStorage::kSparse);
+  EXPECT_TRUE(TileMap::LayerStorage::kSparse == map->GetLayerStorage(1));
+  EXPECT_EQ(dense_bytes / 2, map->GetChunkBytes());
+  EXPECT_TRUE(map->GetSparseTileBytes() > 0);
+  EXPECT_TRUE(HasChunkedMapIndices(*map));
+  std::vector<uint16_t> row(kChunkedGridSize.x() + 20);
+  map->GetRowTileIndices({-10, 70}, 1, row.size(), row.data());
+  bool rows_match = true;
+  for (int64_t i = 0; i < row.size(); ++i)
+    rows_match = rows_match && row[i] == map->GetTileIndex({i - 10, 70}, 1);
+  EXPECT_TRUE(rows_match);
+
+  // Files don't change.
+  std::ostringstream raw, compressed;
+  bool written = map->Write(raw);
+  EXPECT_TRUE(written);
+  EXPECT_TRUE(MakeChunkedMapData() == raw.str());
+  written = map->Write(compressed, TileMap::GridEncoding::kCompressed);
+  EXPECT_TRUE(written);
+  EXPECT_TRUE(MakeChunkedMapData(TileMap::GridEncoding::kCompressed) ==
+              compressed.str());
+
+  // Layouts and storage mix.
+  map->SetGridLayout(TileMap::GridLayout::kLayerMajor);
+  map->SetTileIndex({100, 100}, 1, 0);
+  map->SetTileIndex({100, 100}, 0, 6);
+  EXPECT_EQ(0, map->GetTileIndex({100, 100}, 1));
+  EXPECT_EQ(6, map->GetTileIndex({100, 100}, 0));
+  map->SetTileIndex({100, 100}, 0, ExpectedIndex({100, 100}, 0));
+  map->SetTileIndex({100, 100}, 1, ExpectedIndex({100, 100}, 1));
+  map->SetLayerStorage(0, TileMap::LayerStorage::kSparse);
+  EXPECT_EQ(0, map->GetChunkBytes());
+  EXPECT_TRUE(HasChunkedMapIndices(*map));
+  map->SetLayerStorage(1, TileMap::LayerStorage::kDense);
+  map->SetGridLayout(TileMap::GridLayout::kInterleaved);
+  map->SetLayerStorage(0, TileMap::LayerStorage::kDense);
+  EXPECT_EQ(0, map->GetSparseTileBytes());
+  EXPECT_TRUE(HasChunkedMapIndices(*map));
+
+  // Chunks loaded from a chunk source, and compressed chunks, are converted.
+  auto streamed =
+      TileMap::Open(std::make_unique<std::istringstream>(MakeChunkedMapData()),
+                    /*sprite_cache=*/nullptr);
+  ASSERT_NOT_NULL(streamed.get());
+  streamed->SetMemoryBudget(streamed->GetChunkBytes());
+  streamed->SetCompressInactiveChunks(true);
+  streamed->SetTileIndex({1, 1}, 1, 6);
+  streamed->SetTileIndex({140, 1}, 1, 6);
+  streamed->SetLayerStorage(1, TileMap::LayerStorage::kSparse);
+  EXPECT_EQ(6, streamed->GetTileIndex({1, 1}, 1));
+  EXPECT_EQ(6, streamed->GetTileIndex({140, 1}, 1));
+  streamed->SetTileIndex({1, 1}, 1, ExpectedIndex({1, 1}, 1));
+  streamed->SetTileIndex({140, 1}, 1, ExpectedIndex({140, 1}, 1));
+  EXPECT_TRUE(HasChunkedMapIndices(*streamed));
+  // Chunks are half the size, so twice as many fit in the budget.
+  EXPECT_EQ(2, streamed->GetLoadedChunkCount());
+
+  // Mapped chunks are copied.
+  const std::string path = "/tmp/engine2_tile_map_storage_test.map";
+  {
+    std::string data = MakeChunkedMapData();
+    std::ofstream file(path, std::ios::binary);
+    file.write(data.data(), data.size());
+  }
+  auto mapped = TileMap::FromFile(path, /*sprite_cache=*/nullptr);
+  ASSERT_NOT_NULL(mapped.get());
+  mapped->SetLayerStorage(0, TileMap::LayerStorage::kSparse);
+  EXPECT_EQ(9, mapped->GetLoadedChunkCount());
+  EXPECT_TRUE(HasChunkedMapIndices(*mapped));
+  std::remove(path.c_str());
+}
+
+void TileMapTest::TestAutoLayerStorage() {
+  const Vec<int64_t, 2> kGridSize{256, 192};
+  TileMap map(kTileSize, kGridSize, /*layer_count=*/3, kPositionInWorld,
+              /*sprite_cache=*/nullptr);
+  for (int i = 0; i < 3; ++i)
+    map.AddTile({nullptr});
+  map.SetAutoLayerStorage(true);
+  EXPECT_TRUE(TileMap::LayerStorage::kSparse == map.GetLayerStorage(0));
+  EXPECT_EQ(0, map.GetChunkBytes());
+
+  // A full ground layer turns dense, and scattered decorations stay sparse.
+  TileMap::GridPoint p;
+  for (p.y() = 0; p.y() < kGridSize.y(); ++p.y()) {
+    for (p.x() = 0; p.x() < kGridSize.x(); ++p.x()) {
+      map.SetTileIndex(p, 0, 1);
+      if ((p.x() * 7 + p.y() * 13) % 31 == 0)
+        map.SetTileIndex(p, 2, 2);
+    }
+  }
+  // Edits only count tiles until the storage is updated.
+  EXPECT_TRUE(TileMap::LayerStorage::kSparse == map.GetLayerStorage(0));
+  map.UpdateLayerStorage();
+  EXPECT_TRUE(TileMap::LayerStorage::kDense == map.GetLayerStorage(0));
+  EXPECT_TRUE(TileMap::LayerStorage::kSparse == map.GetLayerStorage(1));
+  EXPECT_TRUE(TileMap::LayerStorage::kSparse == map.GetLayerStorage(2));
+  // A third of the memory of three dense layers, plus a little.
+  size_t bytes = map.GetChunkBytes() * 12 + map.GetSparseTileBytes();
+  EXPECT_TRUE(bytes < 3 * 12 * map.GetChunkBytes() / 2);
+  bool all_match = true;
+  for (p.y() = 0; p.y() < kGridSize.y(); ++p.y()) {
+    for (p.x() = 0; p.x() < kGridSize.x(); ++p.x()) {
+      uint16_t expected = (p.x() * 7 + p.y() * 13) % 31 == 0 ? 2 : 0;
+      all_match = all_match && map.GetTileIndex(p, 0) == 1 &&
+                  map.GetTileIndex(p, 1) == 0 &&
+                  map.GetTileIndex(p, 2) == expected;
+    }
+  }
+  EXPECT_TRUE(all_match);
+
+  // Clearing most of it turns it sparse again.
+  for (p.y() = 0; p.y() < kGridSize.y() - 8; ++p.y()) {
+    for (p.x() = 0; p.x() < kGridSize.x(); ++p.x())
+      map.SetTileIndex(p, 0, 0);
+  }
+  map.UpdateLayerStorage();
+  EXPECT_TRUE(TileMap::LayerStorage::kSparse == map.GetLayerStorage(0));
+  EXPECT_EQ(1, map.GetTileIndex({10, kGridSize.y() - 1}, 0));
+  EXPECT_EQ(0, map.GetTileIndex({10, 10}, 0));
+
+  // Turning it on picks storage for the tiles already there.
+  map.SetAutoLayerStorage(false);
+  map.SetLayerStorage(2, TileMap::LayerStorage::kDense);
+  map.SetAutoLayerStorage(true);
+  EXPECT_TRUE(TileMap::LayerStorage::kSparse == map.GetLayerStorage(2));
+
+  // Streamed chunks aren't loaded just to count them.
+  auto streamed =
+      TileMap::Open(std::make_unique<std::istringstream>(MakeChunkedMapData()),
+                    /*sprite_cache=*/nullptr);
+  ASSERT_NOT_NULL(streamed.get());
+  streamed->SetAutoLayerStorage(true);
+  EXPECT_EQ(0, streamed->GetLoadedChunkCount());
+
+  // Mapped chunks are counted.
+  const std::string path = "/tmp/engine2_tile_map_auto_storage_test.map";
+  {
+    std::string data = MakeChunkedMapData();
+    std::ofstream file(path, std::ios::binary);
+    file.write(data.data(), data.size());
+  }
+  auto mapped = TileMap::FromFile(path, /*sprite_cache=*/nullptr);
+  ASSERT_NOT_NULL(mapped.get());
+  mapped->SetAutoLayerStorage(true);
+  EXPECT_TRUE(TileMap::LayerStorage::kDense == mapped->GetLayerStorage(1));
+  for (p.y() = 0; p.y() < kChunkedGridSize.y(); ++p.y()) {
+    for (p.x() = 0; p.x() < kChunkedGridSize.x(); ++p.x())
+      mapped->SetTileIndex(p, 1, 0);
+  }
+  mapped->UpdateLayerStorage();
+  EXPECT_TRUE(TileMap::LayerStorage::kSparse == mapped->GetLayerStorage(1));
+  EXPECT_TRUE(TileMap::LayerStorage::kDense == mapped->GetLayerStorage(0));
+  EXPECT_EQ(ExpectedIndex({140, 120}, 0), mapped->GetTileIndex({140, 120}, 0));
+  std::remove(path.c_str());
+
+  // Only tiles inside the map count, so a chunk on the edge of the map
+  // whose tiles are all past the edge leaves the layer sparse.
+  TileMap edge_map(kTileSize, {100, 100}, /*layer_count=*/1,
+                   kPositionInWorld, /*sprite_cache=*/nullptr);
+  edge_map.AddTiles({{nullptr}, {nullptr}});
+  edge_map.SetAutoLayerStorage(true);
+  auto tiles = std::make_unique<uint16_t[]>(TileMap::kChunkSize *
+                                            TileMap::kChunkSize);
+  for (int i = 0; i < TileMap::kChunkSize * TileMap::kChunkSize; ++i) {
+    bool past_edge = i % TileMap::kChunkSize >= 36 ||
+                     i / TileMap::kChunkSize >= 36;
+    tiles[i] = past_edge ? 1 : 0;
+  }
+  edge_map.SetChunkTiles({64, 64}, std::move(tiles));
+  edge_map.UpdateLayerStorage();
+  EXPECT_TRUE(TileMap::LayerStorage::kSparse == edge_map.GetLayerStorage(0));
+}
+
+void TileMapTest::TestSetChunkTiles() {
+  auto fill_chunks = [](TileMap* map) {
+    for (int64_t y = 0; y < kChunkedGridSize.y(); y += TileMap::kChunkSize) {
+      for (int64_t x = 0; x < kChunkedGridSize.x(); x += TileMap::kChunkSize) {
+        auto tiles = std::make_unique<uint16_t[]>(
+            TileMap::kChunkSize * TileMap::kChunkSize * 2);
+        for (int i = 0; i < TileMap::kChunkSize * TileMap::kChunkSize; ++i) {
+          TileMap::GridPoint p{x + i % TileMap::kChunkSize,
+                               y + i / TileMap::kChunkSize};
+          if (p.x() >= kChunkedGridSize.x() || p.y() >= kChunkedGridSize.y())
+            continue;
+          for (int layer = 0; layer < 2; ++layer)
+            tiles[i * 2 + layer] = ExpectedIndex(p, layer);
+        }
+        map->SetChunkTiles({x, y}, std::move(tiles));
+      }
+    }
+  };
+  auto create_map = [] {
+    auto map =
+        std::make_unique<TileMap>(kTileSize, kChunkedGridSize,
+                                  /*layer_count=*/2, kPositionInWorld,
+                                  /*sprite_cache=*/nullptr);
+    std::vector<TileMap::Tile> tiles(kTileCount, TileMap::Tile{nullptr});
+    tiles[3].SetTag(0, true);
+    map->AddTiles(tiles);
+    map->SetTagIndexEnabled(true);
+    return map;
+  };
+
+  auto map = create_map();
+  fill_chunks(map.get());
+  EXPECT_TRUE(HasChunkedMapIndices(*map));
+  EXPECT_EQ(9, map->GetLoadedChunkCount());
+  bool tagged = map->GetTagGrid(0, 1)->Get({2, 0});
+  EXPECT_EQ(ExpectedIndex({2, 0}, 1) == 3, tagged);
+  tagged = map->GetTagGrid(0, 0)->Get({0, 0});
+  EXPECT_FALSE(tagged);
+
+  // Other layouts and sparse layers copy the tiles in.
+  map = create_map();
+  map->SetGridLayout(TileMap::GridLayout::kLayerMajor);
+  map->SetLayerStorage(1, TileMap::LayerStorage::kSparse);
+  fill_chunks(map.get());
+  EXPECT_TRUE(HasChunkedMapIndices(*map));
+  EXPECT_TRUE(map->GetSparseTileBytes() > 0);
+
+  // Like SetTileIndex(), indices past the end of the tile set are rejected.
+  auto tiles = std::make_unique<uint16_t[]>(TileMap::kChunkSize *
+                                            TileMap::kChunkSize * 2);
+  tiles[0] = kTileCount;
+  map->SetChunkTiles({0, 0}, std::move(tiles));
+  EXPECT_TRUE(HasChunkedMapIndices(*map));
+}
+
+void TileMapTest::TestAnimationClock() {
+  TileMap map(kTileSize, {10, 10}, /*layer_count=*/1, kPositionInWorld,
+              /*sprite_cache=*/nullptr);
+  Texture texture(nullptr);
+  // Frame 1 is drawn 100 pixels lower.
+  Sprite sprite(&texture,
+                {{{0, 0, 16, 16}, {0, 0}, Time::Delta::FromSeconds(1)},
+                 {{16, 0, 16, 16}, {0, 100}, Time::Delta::FromSeconds(1)}});
+  const Time::Delta kNoOffset;
+  map.AddTiles({{nullptr},
+                {&sprite, kNoOffset},
+                {&sprite, Time::Delta::FromSeconds(1)},
+                {&sprite, kNoOffset}});
+  for (int64_t x = 0; x < 3; ++x)
+    map.SetTileIndex({x, 0}, 0, x + 1);
+  map.SetBatchDrawing(true);
+  Rect<> world_rect = map.GetWorldRect();
+  Rect<> window_rect{{}, world_rect.size};
+  TestGraphics2D graphics;
+  auto frame_drawn = [&graphics](int tile) {
+    return graphics.geometry_vertices[tile * 4].position.y == 100.f ? 1 : 0;
+  };
+
+  // Without the clock, every tile draws the sprite's current frame.
+  map.Draw(&graphics, world_rect, window_rect);
+  ASSERT_EQ(12, graphics.geometry_vertices.size());
+  int frame = frame_drawn(1);
+  EXPECT_EQ(0, frame);
+
+  map.UpdateAnimations(Time::FromSeconds(10));
+  map.Draw(&graphics, world_rect, window_rect);
+  frame = frame_drawn(0);
+  EXPECT_EQ(0, frame);
+  frame = frame_drawn(1);
+  EXPECT_EQ(1, frame);
+  frame = frame_drawn(2);
+  EXPECT_EQ(0, frame);
+
+  map.UpdateAnimations(Time::FromSeconds(11.5));
+  map.Draw(&graphics, world_rect, window_rect);
+  frame = frame_drawn(0);
+  EXPECT_EQ(1, frame);
+  frame = frame_drawn(1);
+  EXPECT_EQ(0, frame);
+  frame = frame_drawn(2);
+  EXPECT_EQ(1, frame);
+  // The sprite's own frame isn't touched.
+  EXPECT_EQ(&sprite.Frame(0), &sprite.CurrentFrame());
+
+  // New tiles join the clock.
+  map.AddTile({&sprite, Time::Delta::FromSeconds(1)});
+  map.SetTileIndex({3, 0}, 0, 4);
+  map.Draw(&graphics, world_rect, window_rect);
+  frame = frame_drawn(3);
+  EXPECT_EQ(0, frame);
+}
+
 TileMapTest::TileMapTest()
     : TestGroup("TileMapTest",
                 {
                     std::bind(&TileMapTest::TestDraw, this),
                     std::bind(&TileMapTest::TestSaveAndLoad, this),
+                    std::bind(&TileMapTest::TestChunks, this),
+                    std::bind(&TileMapTest::TestOpen, this),
+                    std::bind(&TileMapTest::TestMemoryBudget, this),
+                    std::bind(&TileMapTest::TestReadVersion1, this),
+                    std::bind(&TileMapTest::TestMappedFile, this),
+                    std::bind(&TileMapTest::TestCompressedGrid, this),
+                    std::bind(&TileMapTest::TestCompressInactiveChunks, this),
+                    std::bind(&TileMapTest::TestGetRowTileIndices, this),
+                    std::bind(&TileMapTest::TestGridLayout, this),
+                    std::bind(&TileMapTest::TestRenderCache, this),
+                    std::bind(&TileMapTest::TestBatchDrawing, this),
+                    std::bind(&TileMapTest::TestLod, this),
+                    std::bind(&TileMapTest::TestTagIndex, this),
+                    std::bind(&TileMapTest::TestLayerStorage, this),
+                    std::bind(&TileMapTest::TestAutoLayerStorage, this),
+                    std::bind(&TileMapTest::TestSetChunkTiles, this),
+                    std::bind(&TileMapTest::TestAnimationClock, this),
                 }) {}
 
 }  // namespace test
@@ -10,6 +10,23 @@ class TileMapTest : public TestGroup {
  public:
   void TestDraw();
   void TestSaveAndLoad();
+  void TestChunks();
+  void TestOpen();
+  void TestMemoryBudget();
+  void TestReadVersion1();
+  void TestMappedFile();
+  void TestCompressedGrid();
+  void TestCompressInactiveChunks();
+  void TestGetRowTileIndices();
+  void TestGridLayout();
+  void TestRenderCache();
+  void TestBatchDrawing();
+  void TestLod();
+  void TestTagIndex();
+  void TestLayerStorage();
+  void TestAutoLayerStorage();
+  void TestSetChunkTiles();
+  void TestAnimationClock();
 
   TileMapTest();
 };
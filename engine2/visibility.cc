@@ -0,0 +1,289 @@
+#include "engine2/visibility.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace engine2 {
+namespace {
+
+// The x and y axes of the eight octants around a viewer, as directions on the
+// map.
+const Point<> kOctantAxes[][2] = {
+    {{1, 0}, {0, 1}},   {{0, 1}, {1, 0}},   {{0, 1}, {-1, 0}},
+    {{-1, 0}, {0, 1}},  {{-1, 0}, {0, -1}}, {{0, -1}, {-1, 0}},
+    {{0, -1}, {1, 0}},  {{1, 0}, {0, -1}},
+};
+
+// Divides |value| by |divisor|, which must be positive, rounding halves up.
+int64_t DivideRounded(int64_t value, int64_t divisor) {
+  int64_t twice = 2 * value + divisor;
+  int64_t quotient = twice / (2 * divisor);
+  return twice % (2 * divisor) < 0 ? quotient - 1 : quotient;
+}
+
+}  // namespace
+
+Visibility::Visibility(TileMap* map, int opaque_tag, WorkerPool* pool)
+    : map_(map), opaque_tag_(opaque_tag), pool_(pool) {
+  if (!map_->IsTagIndexEnabled())
+    map_->SetTagIndexEnabled(true);
+  map_->AddChangeListener(this);
+  BuildOpaque();
+}
+
+Visibility::~Visibility() {
+  map_->RemoveChangeListener(this);
+}
+
+bool Visibility::IsOpaque(const TileMap::GridPoint& point) const {
+  return !Rect<>{{0, 0}, opaque_.size()}.Contains(point) ||
+         opaque_.Get(point);
+}
+
+void Visibility::ComputeFov(const TileMap::GridPoint& center,
+                            int radius,
+                            BitGrid* visible) const {
+  Vec<int64_t, 2> size = Vec<int64_t, 2>::Fill(2 * radius + 1);
+  if (visible->size() == size)
+    visible->Fill(false);
+  else
+    *visible = BitGrid(size);
+  if (!Rect<>{{0, 0}, opaque_.size()}.Contains(center))
+    return;
+
+  visible->Set(Vec<int64_t, 2>::Fill(radius), true);
+  for (const auto& axes : kOctantAxes)
+    CastLight(center, radius, 1, 1.0, 0.0, axes[0], axes[1], visible);
+}
+
+bool Visibility::HasLineOfSight(const TileMap::GridPoint& from,
+                                const TileMap::GridPoint& to) const {
+  // Steps one tile at a time along the longer axis, rounding the other. The
+  // tiles are computed exactly from whichever end, so the line is the same
+  // both ways.
+  Point<> delta = to - from;
+  int64_t steps = std::max(std::abs(delta.x()), std::abs(delta.y()));
+  for (int64_t i = 1; i < steps; ++i) {
+    Point<> point{
+        DivideRounded(from.x() * steps + delta.x() * i, steps),
+        DivideRounded(from.y() * steps + delta.y() * i, steps)};
+    if (IsOpaque({point.x(), point.y()}))
+      return false;
+  }
+  return true;
+}
+
+Visibility::ViewerId Visibility::AddViewer(const TileMap::GridPoint& position,
+                                           int radius) {
+  ViewerId id;
+  if (free_ids_.empty()) {
+    id = viewers_.size();
+    viewers_.emplace_back();
+  } else {
+    id = free_ids_.back();
+    free_ids_.pop_back();
+  }
+  Viewer& viewer = viewers_[id];
+  viewer.position = position;
+  viewer.radius = radius;
+  viewer.dirty = true;
+  viewer.removed = false;
+  return id;
+}
+
+void Visibility::RemoveViewer(ViewerId id) {
+  viewers_[id].removed = true;
+  viewers_[id].visible = BitGrid();
+  free_ids_.push_back(id);
+}
+
+void Visibility::SetViewer(ViewerId id,
+                           const TileMap::GridPoint& position,
+                           int radius) {
+  Viewer& viewer = viewers_[id];
+  if (viewer.position == position && viewer.radius == radius)
+    return;
+  viewer.position = position;
+  viewer.radius = radius;
+  viewer.dirty = true;
+}
+
+int Visibility::Update() {
+  std::vector<Viewer*> dirty;
+  for (Viewer& viewer : viewers_) {
+    if (viewer.dirty && !viewer.removed)
+      dirty.push_back(&viewer);
+  }
+  // Viewers only write to their own grids, so they can be computed in
+  // parallel.
+  auto compute = [this, &dirty](int64_t i) {
+    Viewer* viewer = dirty[i];
+    ComputeFov({viewer->position.x(), viewer->position.y()}, viewer->radius,
+               &viewer->visible);
+    viewer->dirty = false;
+  };
+  if (pool_) {
+    pool_->ParallelFor(dirty.size(), compute);
+  } else {
+    for (int64_t i = 0; i < dirty.size(); ++i)
+      compute(i);
+  }
+  return dirty.size();
+}
+
+const BitGrid& Visibility::GetVisible(ViewerId id) const {
+  return viewers_[id].visible;
+}
+
+Rect<> Visibility::GetViewerRect(ViewerId id) const {
+  const Viewer& viewer = viewers_[id];
+  return {viewer.position - Vec<int64_t, 2>::Fill(viewer.radius),
+          Vec<int64_t, 2>::Fill(2 * viewer.radius + 1)};
+}
+
+bool Visibility::CanSee(ViewerId id, const TileMap::GridPoint& point) const {
+  Rect<> rect = GetViewerRect(id);
+  return viewers_[id].visible.Get(point - rect.pos);
+}
+
+void Visibility::MarkSeen(BitGrid* seen) const {
+  std::vector<Point<>> visible;
+  for (ViewerId id = 0; id < viewers_.size(); ++id) {
+    if (viewers_[id].removed)
+      continue;
+    Rect<> rect = GetViewerRect(id);
+    visible.clear();
+    viewers_[id].visible.FindAll({{0, 0}, rect.size}, &visible);
+    for (const Point<>& point : visible)
+      seen->Set(point + rect.pos, true);
+  }
+}
+
+void Visibility::OnTileChanged(const TileMap::GridPoint& point, int layer) {
+  bool opaque = false;
+  for (int i = 0; i < map_->GetLayerCount() && !opaque; ++i) {
+    const BitGrid* grid = map_->GetTagGrid(opaque_tag_, i);
+    opaque = grid && grid->Get(point);
+  }
+  if (opaque_.Get(point) == opaque)
+    return;
+  opaque_.Set(point, opaque);
+
+  for (Viewer& viewer : viewers_) {
+    Point<> offset = point - viewer.position;
+    if (std::abs(offset.x()) <= viewer.radius &&
+        std::abs(offset.y()) <= viewer.radius) {
+      viewer.dirty = true;
+    }
+  }
+}
+
+void Visibility::OnRectChanged(const Rect<>& grid_rect) {
+  std::vector<const BitGrid*> grids;
+  for (int layer = 0; layer < map_->GetLayerCount(); ++layer) {
+    if (const BitGrid* grid = map_->GetTagGrid(opaque_tag_, layer))
+      grids.push_back(grid);
+  }
+
+  // Tracks the bounds of the tiles that changed, so each viewer is checked
+  // once for the whole rect.
+  Rect<> rect = grid_rect.GetOverlap({{0, 0}, opaque_.size()});
+  Point<> changed_min = rect.pos + rect.size;
+  Point<> changed_max = rect.pos - Point<>{1, 1};
+  Point<> point;
+  for (point.y() = rect.y(); point.y() < rect.y() + rect.h(); ++point.y()) {
+    for (point.x() = rect.x(); point.x() < rect.x() + rect.w(); ++point.x()) {
+      bool opaque = false;
+      for (const BitGrid* grid : grids)
+        opaque = opaque || grid->Get(point);
+      if (opaque_.Get(point) == opaque)
+        continue;
+      opaque_.Set(point, opaque);
+      for (int i = 0; i < 2; ++i) {
+        changed_min[i] = std::min(changed_min[i], point[i]);
+        changed_max[i] = std::max(changed_max[i], point[i]);
+      }
+    }
+  }
+  if (changed_max.x() < changed_min.x())
+    return;
+
+  for (Viewer& viewer : viewers_) {
+    const Point<>& position = viewer.position;
+    if (changed_min.x() <= position.x() + viewer.radius &&
+        changed_max.x() >= position.x() - viewer.radius &&
+        changed_min.y() <= position.y() + viewer.radius &&
+        changed_max.y() >= position.y() - viewer.radius) {
+      viewer.dirty = true;
+    }
+  }
+}
+
+void Visibility::OnTileSetChanged() {
+  BuildOpaque();
+  for (Viewer& viewer : viewers_)
+    viewer.dirty = true;
+}
+
+void Visibility::BuildOpaque() {
+  opaque_ = BitGrid(map_->GetGridSize());
+  for (int layer = 0; layer < map_->GetLayerCount(); ++layer) {
+    if (const BitGrid* grid = map_->GetTagGrid(opaque_tag_, layer))
+      opaque_ |= *grid;
+  }
+}
+
+void Visibility::CastLight(const Point<>& center,
+                           int radius,
+                           int row,
+                           double start,
+                           double end,
+                           const Point<>& x_axis,
+                           const Point<>& y_axis,
+                           BitGrid* visible) const {
+  if (start < end)
+    return;
+
+  // Rows run away from the viewer, and each row from the slope |start| down
+  // to |end|. Opaque tiles narrow the slopes later rows can see through, and
+  // each gap between them is lit by a recursive call.
+  Point<> corner = center - Vec<int64_t, 2>::Fill(radius);
+  int64_t radius_squared = radius * (radius + 1);
+  double next_start = start;
+  for (int64_t distance = row; distance <= radius; ++distance) {
+    bool blocked = false;
+    int64_t dy = -distance;
+    for (int64_t dx = -distance; dx <= 0; ++dx) {
+      double left_slope = (dx - 0.5) / (dy + 0.5);
+      double right_slope = (dx + 0.5) / (dy - 0.5);
+      if (start < right_slope)
+        continue;
+      if (end > left_slope)
+        break;
+
+      Point<> point = center + x_axis * dx + y_axis * dy;
+      bool opaque = IsOpaque({point.x(), point.y()});
+      if (dx * dx + dy * dy <= radius_squared &&
+          Rect<>{{0, 0}, opaque_.size()}.Contains(point)) {
+        visible->Set(point - corner, true);
+      }
+      if (blocked) {
+        if (opaque) {
+          next_start = right_slope;
+        } else {
+          blocked = false;
+          start = next_start;
+        }
+      } else if (opaque && distance < radius) {
+        blocked = true;
+        CastLight(center, radius, distance + 1, start, left_slope, x_axis,
+                  y_axis, visible);
+        next_start = right_slope;
+      }
+    }
+    if (blocked)
+      break;
+  }
+}
+
+}  // namespace engine2
@@ -0,0 +1,107 @@
+#ifndef ENGINE2_VISIBILITY_H_
+#define ENGINE2_VISIBILITY_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "engine2/base/bit_grid.h"
+#include "engine2/base/worker_pool.h"
+#include "engine2/tile_map.h"
+
+namespace engine2 {
+
+// Field of view and line of sight over a TileMap, where tiles with an opaque
+// tag on any layer block sight. Opaque tiles themselves can be seen, and the
+// edges of the map block sight like opaque tiles.
+//
+// Fields of view use recursive shadowcasting, which visits each visible tile
+// about once instead of walking a ray to each tile. They're written into
+// square BitGrids centred on the viewer, 2 * radius + 1 tiles across, so a
+// viewer's grid is reused while its radius stays the same.
+class Visibility : public TileMap::ChangeListener {
+ public:
+  using ViewerId = int;
+
+  // Turns on |map|'s tag index, which must stay on. With a null |pool|,
+  // Update() works on the calling thread. |map| and |pool| must outlive the
+  // visibility.
+  Visibility(TileMap* map, int opaque_tag, WorkerPool* pool);
+  ~Visibility() override;
+  Visibility(const Visibility&) = delete;
+  Visibility& operator=(const Visibility&) = delete;
+
+  // True for opaque tiles and points outside the map.
+  bool IsOpaque(const TileMap::GridPoint& point) const;
+
+  // Sets |visible| to the tiles that can be seen from |center| within
+  // |radius| tiles. Map tile p is at p - center + {radius, radius} in
+  // |visible|, which is only reallocated if it's the wrong size.
+  void ComputeFov(const TileMap::GridPoint& center,
+                  int radius,
+                  BitGrid* visible) const;
+  // Whether the line between the centres of |from| and |to| passes no opaque
+  // tiles between them. Symmetric, but near the edges of shadows it can
+  // disagree with ComputeFov().
+  bool HasLineOfSight(const TileMap::GridPoint& from,
+                      const TileMap::GridPoint& to) const;
+
+  // Viewers keep their fields of view between calls to Update(), which only
+  // recomputes those that moved to another tile, changed radius or had an
+  // opaque tile change within their radius.
+  ViewerId AddViewer(const TileMap::GridPoint& position, int radius);
+  void RemoveViewer(ViewerId id);
+  // Cheap if the viewer stays on the same tile with the same radius.
+  void SetViewer(ViewerId id, const TileMap::GridPoint& position, int radius);
+  // Recomputes the viewers that need it, spread over the worker pool, and
+  // returns how many it did. Call once a frame.
+  int Update();
+  // The field of view of viewer |id| as of the last Update(), laid out as by
+  // ComputeFov(). GetViewerRect() is the part of the map it covers.
+  const BitGrid& GetVisible(ViewerId id) const;
+  Rect<> GetViewerRect(ViewerId id) const;
+  // Whether viewer |id| saw |point| as of the last Update().
+  bool CanSee(ViewerId id, const TileMap::GridPoint& point) const;
+  // Sets the tiles any viewer sees in |seen|, a grid the size of the map, for
+  // fog of war.
+  void MarkSeen(BitGrid* seen) const;
+
+  // TileMap::ChangeListener:
+  void OnTileChanged(const TileMap::GridPoint& point, int layer) override;
+  void OnTileSetChanged() override;
+  void OnRectChanged(const Rect<>& grid_rect) override;
+
+ private:
+  struct Viewer {
+    Point<> position;
+    int radius = 0;
+    BitGrid visible;
+    bool dirty = true;
+    bool removed = false;
+  };
+
+  // Reads the opaque tag of every layer into |opaque_|.
+  void BuildOpaque();
+  // Lights row |row| onward of one octant, between slopes |start| and |end|.
+  // The octant's tile at (dx, dy) is at center + dx * |x_axis| + dy * |y_axis|
+  // on the map.
+  void CastLight(const Point<>& center,
+                 int radius,
+                 int row,
+                 double start,
+                 double end,
+                 const Point<>& x_axis,
+                 const Point<>& y_axis,
+                 BitGrid* visible) const;
+
+  TileMap* map_;
+  int opaque_tag_;
+  WorkerPool* pool_;
+  BitGrid opaque_;
+  std::vector<Viewer> viewers_;
+  // Removed viewers' ids, for reuse.
+  std::vector<ViewerId> free_ids_;
+};
+
+}  // namespace engine2
+
+#endif  // ENGINE2_VISIBILITY_H_
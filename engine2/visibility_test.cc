@@ -0,0 +1,231 @@
+#include "engine2/visibility.h"
+#include "engine2/visibility_test.h"
+#include "engine2/test/assert_macros.h"
+
+namespace engine2 {
+namespace test {
+namespace {
+
+const Vec<int64_t, 2> kTileSize{16, 16};
+constexpr int kOpaqueTag = 0;
+constexpr uint16_t kFloor = 0;
+constexpr uint16_t kWall = 1;
+
+std::unique_ptr<TileMap> CreateMap(const Vec<int64_t, 2>& grid_size) {
+  auto map = std::make_unique<TileMap>(kTileSize, grid_size, /*layer_count=*/2,
+                                       Point<>{}, /*sprite_cache=*/nullptr);
+  TileMap::Tile wall{nullptr};
+  wall.SetTag(kOpaqueTag, true);
+  map->AddTiles({{nullptr}, wall});
+  return map;
+}
+
+// Whether |visible|, computed around |center| with |radius|, has |point|.
+bool IsVisible(const BitGrid& visible,
+               const Point<>& center,
+               int radius,
+               const Point<>& point) {
+  return visible.Get(point - center + Vec<int64_t, 2>::Fill(radius));
+}
+
+}  // namespace
+
+void VisibilityTest::TestFov() {
+  auto map = CreateMap({30, 30});
+  // A wall across row 10, from column 10 to 20.
+  for (int64_t x = 10; x <= 20; ++x)
+    map->SetTileIndex({x, 10}, 1, kWall);
+  Visibility visibility(map.get(), kOpaqueTag, /*pool=*/nullptr);
+  bool opaque = visibility.IsOpaque({15, 10});
+  EXPECT_TRUE(opaque);
+  opaque = visibility.IsOpaque({15, 11});
+  EXPECT_FALSE(opaque);
+  opaque = visibility.IsOpaque({-1, 0});
+  EXPECT_TRUE(opaque);
+
+  BitGrid visible;
+  const Point<> center{15, 15};
+  visibility.ComputeFov({15, 15}, 8, &visible);
+  EXPECT_TRUE((Vec<int64_t, 2>{17, 17}) == visible.size());
+  bool seen = IsVisible(visible, center, 8, {15, 15});
+  EXPECT_TRUE(seen);
+  seen = IsVisible(visible, center, 8, {15, 11});
+  EXPECT_TRUE(seen);
+  seen = IsVisible(visible, center, 8, {22, 15});
+  EXPECT_TRUE(seen);
+  seen = IsVisible(visible, center, 8, {9, 11});
+  EXPECT_TRUE(seen);
+  // The wall, but not what's behind it.
+  seen = IsVisible(visible, center, 8, {15, 10});
+  EXPECT_TRUE(seen);
+  seen = IsVisible(visible, center, 8, {15, 9});
+  EXPECT_FALSE(seen);
+  seen = IsVisible(visible, center, 8, {12, 8});
+  EXPECT_FALSE(seen);
+  // Outside the radius.
+  seen = IsVisible(visible, center, 8, {9, 22});
+  EXPECT_FALSE(seen);
+  seen = IsVisible(visible, center, 8, {15, 23});
+  EXPECT_TRUE(seen);
+
+  // Past the edge of the map.
+  visibility.ComputeFov({2, 2}, 5, &visible);
+  EXPECT_TRUE((Vec<int64_t, 2>{11, 11}) == visible.size());
+  seen = IsVisible(visible, {2, 2}, 5, {0, 0});
+  EXPECT_TRUE(seen);
+  seen = IsVisible(visible, {2, 2}, 5, {-1, 2});
+  EXPECT_FALSE(seen);
+
+  // Shut in on every side.
+  for (const Point<>& point :
+       {Point<>{1, 0}, Point<>{-1, 0}, Point<>{0, 1}, Point<>{0, -1},
+        Point<>{1, 1}, Point<>{1, -1}, Point<>{-1, 1}, Point<>{-1, -1}}) {
+    map->SetTileIndex({5 + point.x(), 20 + point.y()}, 0, kWall);
+  }
+  visibility.ComputeFov({5, 20}, 5, &visible);
+  EXPECT_EQ(9, visible.Count({{0, 0}, visible.size()}));
+}
+
+void VisibilityTest::TestLineOfSight() {
+  auto map = CreateMap({30, 30});
+  map->SetTileIndex({10, 10}, 1, kWall);
+  Visibility visibility(map.get(), kOpaqueTag, /*pool=*/nullptr);
+  bool clear = visibility.HasLineOfSight({5, 10}, {15, 10});
+  EXPECT_FALSE(clear);
+  clear = visibility.HasLineOfSight({15, 10}, {5, 10});
+  EXPECT_FALSE(clear);
+  clear = visibility.HasLineOfSight({5, 5}, {15, 15});
+  EXPECT_FALSE(clear);
+  clear = visibility.HasLineOfSight({5, 11}, {15, 11});
+  EXPECT_TRUE(clear);
+  clear = visibility.HasLineOfSight({7, 7}, {7, 7});
+  EXPECT_TRUE(clear);
+  // The ends don't block.
+  clear = visibility.HasLineOfSight({5, 10}, {10, 10});
+  EXPECT_TRUE(clear);
+
+  // Lines give the same answer both ways.
+  bool symmetric = true;
+  for (int64_t y = 0; y < 30; y += 3) {
+    for (int64_t x = 0; x < 30; x += 2) {
+      symmetric = symmetric && visibility.HasLineOfSight({3, 17}, {x, y}) ==
+                                   visibility.HasLineOfSight({x, y}, {3, 17});
+    }
+  }
+  EXPECT_TRUE(symmetric);
+}
+
+void VisibilityTest::TestViewers() {
+  auto map = CreateMap({100, 40});
+  Visibility visibility(map.get(), kOpaqueTag, /*pool=*/nullptr);
+  Visibility::ViewerId a = visibility.AddViewer({10, 10}, 5);
+  Visibility::ViewerId b = visibility.AddViewer({80, 30}, 5);
+  int updated = visibility.Update();
+  EXPECT_EQ(2, updated);
+  updated = visibility.Update();
+  EXPECT_EQ(0, updated);
+  bool seen = visibility.CanSee(a, {14, 10});
+  EXPECT_TRUE(seen);
+  seen = visibility.CanSee(a, {16, 10});
+  EXPECT_FALSE(seen);
+  EXPECT_TRUE((Rect<>{{5, 5}, {11, 11}}) == visibility.GetViewerRect(a));
+  EXPECT_TRUE((Vec<int64_t, 2>{11, 11}) == visibility.GetVisible(b).size());
+
+  // Staying on the same tile is free; moving isn't.
+  visibility.SetViewer(a, {10, 10}, 5);
+  updated = visibility.Update();
+  EXPECT_EQ(0, updated);
+  visibility.SetViewer(a, {12, 10}, 5);
+  updated = visibility.Update();
+  EXPECT_EQ(1, updated);
+  seen = visibility.CanSee(a, {16, 10});
+  EXPECT_TRUE(seen);
+
+  // Opaque edits only recompute the viewers near them.
+  map->SetTileIndex({14, 10}, 1, kWall);
+  updated = visibility.Update();
+  EXPECT_EQ(1, updated);
+  seen = visibility.CanSee(a, {16, 10});
+  EXPECT_FALSE(seen);
+  map->SetTileIndex({50, 20}, 1, kWall);
+  map->SetTileIndex({14, 12}, 0, kFloor);
+  updated = visibility.Update();
+  EXPECT_EQ(0, updated);
+
+  BitGrid seen_grid(map->GetGridSize());
+  visibility.MarkSeen(&seen_grid);
+  bool marked = seen_grid.Get({12, 10}) && seen_grid.Get({80, 30}) &&
+                !seen_grid.Get({16, 10}) && !seen_grid.Get({50, 20});
+  EXPECT_TRUE(marked);
+
+  // Replacing a chunk only recomputes the viewers near the tiles it changed.
+  auto tiles = std::make_unique<uint16_t[]>(TileMap::kChunkSize *
+                                            TileMap::kChunkSize * 2);
+  tiles[(30 * TileMap::kChunkSize + 82 - 64) * 2] = kWall;
+  map->SetChunkTiles({64, 0}, std::move(tiles));
+  updated = visibility.Update();
+  EXPECT_EQ(1, updated);
+  seen = visibility.CanSee(b, {84, 30});
+  EXPECT_FALSE(seen);
+
+  // Removed viewers' ids are reused.
+  visibility.RemoveViewer(b);
+  updated = visibility.Update();
+  EXPECT_EQ(0, updated);
+  Visibility::ViewerId c = visibility.AddViewer({50, 25}, 3);
+  EXPECT_EQ(b, c);
+  updated = visibility.Update();
+  EXPECT_EQ(1, updated);
+  TileMap::Tile floor{nullptr};
+  map->SetTile(kFloor, floor);
+  updated = visibility.Update();
+  EXPECT_EQ(2, updated);
+}
+
+void VisibilityTest::TestParallel() {
+  const Vec<int64_t, 2> kGridSize{200, 200};
+  auto map = CreateMap(kGridSize);
+  // Scattered walls in a fixed pseudo-random pattern.
+  uint32_t seed = 12345;
+  auto random = [&seed](int n) {
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 16) % n;
+  };
+  for (int i = 0; i < 4000; ++i)
+    map->SetTileIndex({random(200), random(200)}, 1, kWall);
+
+  WorkerPool pool(3);
+  Visibility visibility(map.get(), kOpaqueTag, &pool);
+  std::vector<Visibility::ViewerId> ids;
+  for (int i = 0; i < 100; ++i)
+    ids.push_back(visibility.AddViewer({random(200), random(200)}, 12));
+  int updated = visibility.Update();
+  EXPECT_EQ(100, updated);
+
+  bool all_match = true;
+  BitGrid visible;
+  for (Visibility::ViewerId id : ids) {
+    Rect<> rect = visibility.GetViewerRect(id);
+    visibility.ComputeFov({rect.x() + 12, rect.y() + 12}, 12, &visible);
+    const BitGrid& viewer_visible = visibility.GetVisible(id);
+    for (int64_t y = 0; y < visible.size().y(); ++y) {
+      for (int64_t x = 0; x < visible.size().x(); ++x) {
+        all_match = all_match &&
+                    visible.Get({x, y}) == viewer_visible.Get({x, y});
+      }
+    }
+  }
+  EXPECT_TRUE(all_match);
+}
+
+VisibilityTest::VisibilityTest()
+    : TestGroup("VisibilityTest",
+                {
+                    std::bind(&VisibilityTest::TestFov, this),
+                    std::bind(&VisibilityTest::TestLineOfSight, this),
+                    std::bind(&VisibilityTest::TestViewers, this),
+                    std::bind(&VisibilityTest::TestParallel, this),
+                }) {}
+
+}  // namespace test
+}  // namespace engine2
@@ -0,0 +1,21 @@
+#ifndef ENGINE2_VISIBILITY_TEST_H_
+#define ENGINE2_VISIBILITY_TEST_H_
+
+#include "engine2/test/test_group.h"
+
+namespace engine2 {
+namespace test {
+
+class VisibilityTest : public TestGroup {
+ public:
+  void TestFov();
+  void TestLineOfSight();
+  void TestViewers();
+  void TestParallel();
+  VisibilityTest();
+};
+
+}  // namespace test
+}  // namespace engine2
+
+#endif  // ENGINE2_VISIBILITY_TEST_H_
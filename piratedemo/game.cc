@@ -1,5 +1,6 @@
 #include <fstream>
 #include <iostream>
+#include <vector>
 
 #include "engine2/performance/perf_span.h"
 #include "engine2/performance/scoped_stopwatch.h"
@@ -37,6 +38,7 @@ Game::Game(Window* window, Graphics2D* graphics, Font* font)
       window_(window),
       graphics_(graphics),
       texture_cache_(graphics),
+      texture_atlas_(graphics),
       sprite_cache_(&texture_cache_),
       player_(this, /*start_point=*/{0, 0}, graphics, &camera_),
       camera_({}, {}),
@@ -58,6 +60,7 @@ Game::Game(Window* window, Graphics2D* graphics, Font* font)
 }
 
 bool Game::Load() {
+  sprite_cache_.SetAtlas(&texture_atlas_);
   if (!sprite_cache_.LoadSpriteSheet(MakeShipSpriteSheet())) {
     std::cerr << "Failed to load sprites\n";
     return false;
@@ -76,11 +79,14 @@ bool Game::Load() {
               << " exists but isn't a valid tile map file.\n";
     return false;
   }
+  map_->SetBatchDrawing(true);
+  map_->SetAutoLayerStorage(true);
 
-  if (!Player::Load(graphics_)) {
+  if (!Player::Load(graphics_, &sprite_assets_)) {
     std::cerr << "Failed to load player resources.\n";
     return false;
   }
+  player_.SetSprite();
 
   // Create walls
   uint32_t wall_tag_id = map_->GetTagId("wall");
@@ -89,17 +95,19 @@ bool Game::Load() {
     return false;
   }
 
-  TileMap::GridPoint p;
-  auto map_size = map_->GetGridSize();
-  for (p.y() = 0; p.y() < map_size.y(); ++p.y()) {
-    for (p.x() = 0; p.x() < map_size.x(); ++p.x()) {
-      TileMap::Tile* tile = map_->GetTile(p, 0);
-      if (tile && tile->HasTag(wall_tag_id)) {
-        walls_.emplace_back(this,
-                            Rect<>{map_->GridToWorld(p), map_->GetTileSize()});
-        space_.Add(&walls_.back());
-      }
-    }
+  map_->SetTagIndexEnabled(true);
+  const BitGrid* wall_grid = map_->GetTagGrid(wall_tag_id, 0);
+  if (!wall_grid) {
+    std::cerr << "Tile map has too many tags\n";
+    return false;
+  }
+  std::vector<Point<>> wall_points;
+  wall_grid->FindAll({{0, 0}, map_->GetGridSize()}, &wall_points);
+  for (const Point<>& p : wall_points) {
+    TileMap::GridPoint grid_point{p.x(), p.y()};
+    walls_.emplace_back(
+        this, Rect<>{map_->GridToWorld(grid_point), map_->GetTileSize()});
+    space_.Add(&walls_.back());
   }
 
   return true;
@@ -110,8 +118,11 @@ void Game::EveryFrame() {
 
   graphics_->SetDrawColor(kWhite)->Clear();
 
+  map_->UpdateAnimations(last_update_time_);
   map_->Draw(graphics_, camera_.GetRect(), camera_.GetWindowRect());
 
+  sprite_assets_.AnimateAll(last_update_time_, sprite_instances_.data(),
+                            sprite_instances_.size());
   // TODO this probably belongs in camera2d.h
   for (auto& variant : space_.Near(camera_.GetRect())) {
     std::visit(
@@ -143,6 +154,13 @@ void Game::EveryFrame() {
   }
 }
 
+int Game::AddSpriteInstance(SpriteAssetId asset) {
+  SpriteInstance instance;
+  instance.asset = asset;
+  sprite_instances_.push_back(instance);
+  return sprite_instances_.size() - 1;
+}
+
 void Game::OnKeyDown(const SDL_KeyboardEvent& event) {
   if (event.repeat)
     return;
@@ -187,6 +205,10 @@ void Game::OnKeyUp(const SDL_KeyboardEvent& event) {
   }
 }
 
+void Game::OnRenderTargetsReset() {
+  texture_atlas_.Restore();
+}
+
 void Game::MovePlayer(Direction direction, bool key_down) {
   if (key_down) {
     move_keypress_stack_.push_back(direction);
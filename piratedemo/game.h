@@ -2,12 +2,15 @@
 #define PIRATEDEMO_GAME_H_
 
 #include <memory>
+#include <vector>
 
 #include "engine2/camera2d.h"
 #include "engine2/event_handler.h"
 #include "engine2/font.h"
 #include "engine2/frame_loop.h"
 #include "engine2/space.h"
+#include "engine2/sprite_asset.h"
+#include "engine2/texture_atlas.h"
 #include "engine2/tile_map.h"
 #include "engine2/time.h"
 #include "engine2/timing.h"
@@ -45,18 +48,32 @@ class Game : public engine2::FrameLoop, public engine2::EventHandler {
   // EventHandler
   void OnKeyDown(const SDL_KeyboardEvent& event) override;
   void OnKeyUp(const SDL_KeyboardEvent& event) override;
+  void OnRenderTargetsReset() override;
 
   engine2::Time last_update_time() const { return last_update_time_; }
   engine2::Graphics2D* graphics() const { return graphics_; }
   engine2::Camera2D<Thing>* camera() { return &camera_; }
 
+  // Things' sprites. Their instances live in one array, so EveryFrame()
+  // animates them all in one pass; things keep an index into it.
+  const engine2::SpriteAssets& sprite_assets() const { return sprite_assets_; }
+  int AddSpriteInstance(engine2::SpriteAssetId asset);
+  engine2::SpriteInstance& sprite_instance(int index) {
+    return sprite_instances_[index];
+  }
+
  private:
   void MovePlayer(Direction direction, bool key_down);
 
   engine2::Window* window_;
   engine2::Graphics2D* graphics_;
   engine2::TextureCache texture_cache_;
+  // Outlives the sprites packed into it.
+  engine2::TextureAtlas texture_atlas_;
   engine2::SpriteCache sprite_cache_;
+  // Before the things that add instances to them.
+  engine2::SpriteAssets sprite_assets_;
+  std::vector<engine2::SpriteInstance> sprite_instances_;
   engine2::Camera2D<Thing> camera_;
   engine2::Timing::FramerateRegulator idler_{60};
 
@@ -44,10 +44,10 @@ int SpriteIndex(Direction direction, Player::Movement movement) {
 }  // namespace
 
 std::unique_ptr<Texture> Player::sTexture{};
-std::array<Sprite, 8> Player::sSprites{};
+std::array<SpriteAssetId, 8> Player::sSpriteAssetIds{};
 
 // static
-bool Player::Load(Graphics2D* graphics) {
+bool Player::Load(Graphics2D* graphics, SpriteAssets* assets) {
   if (sTexture)
     return true;
 
@@ -57,15 +57,15 @@ bool Player::Load(Graphics2D* graphics) {
 
   // If this code changes, SpriteIndex() should probably also change.
   for (int x = 0; x < 4; ++x) {
-    sSprites[SpriteIndex(x, 0)] = Sprite(
-        sTexture.get(), {MakePlayerFrame({x, 1}), MakePlayerFrame({x, 0})});
+    sSpriteAssetIds[SpriteIndex(x, 0)] = assets->Add(SpriteAsset(
+        sTexture.get(), {MakePlayerFrame({x, 1}), MakePlayerFrame({x, 0})}));
 
     // Walking
     std::vector<Sprite::AnimationFrame> walk_frames;
     for (int y = 1; y < 5; ++y)
       walk_frames.push_back(MakePlayerFrame({x, y}));
-    sSprites[SpriteIndex(x, 1)] =
-        Sprite(sTexture.get(), std::move(walk_frames));
+    sSpriteAssetIds[SpriteIndex(x, 1)] =
+        assets->Add(SpriteAsset(sTexture.get(), std::move(walk_frames)));
   }
   return true;
 }
@@ -77,8 +77,8 @@ Player::Player(Game* game,
     : Thing(game,
             graphics,
             camera,
-            &sSprites[SpriteIndex(kPlayerInitialDirection,
-                                  kPlayerInitialMovement)],
+            // The sprite assets may not be loaded yet.
+            kNoSprite,
             {start_point, kPlayerHitBox.size},
             kPlayerMassKg),
       direction_(kPlayerInitialDirection),
@@ -106,7 +106,7 @@ Vec<double, 2>& Player::velocity() {
 }
 
 void Player::SetSprite() {
-  active_sprite_ = &sSprites[SpriteIndex(direction_, movement_)];
+  SetSpriteAsset(sSpriteAssetIds[SpriteIndex(direction_, movement_)]);
 }
 
 }  // namespace piratedemo
\ No newline at end of file
@@ -6,7 +6,7 @@
 #include "engine2/camera2d.h"
 #include "engine2/graphics2d.h"
 #include "engine2/rect_object.h"
-#include "engine2/sprite.h"
+#include "engine2/sprite_asset.h"
 #include "piratedemo/thing.h"
 #include "piratedemo/types.h"
 
@@ -24,8 +24,10 @@ class Player : public Thing {
  public:
   enum class Movement { kStand, kWalk };
 
-  // Load player sprites.
-  static bool Load(engine2::Graphics2D* graphics);
+  // Loads player sprites into |assets|, once, for every player to share.
+  // Players must use the same |assets|.
+  static bool Load(engine2::Graphics2D* graphics,
+                   engine2::SpriteAssets* assets);
 
   Player(Game* game,
          const engine2::Point<>& start_point,
@@ -34,6 +36,9 @@ class Player : public Thing {
 
   void Face(Direction direction);
   void SetMovement(Movement movement);
+  // Shows the sprite for the current direction and movement. Load() must
+  // have succeeded.
+  void SetSprite();
 
   // for Space
   void OnCollideWith(const Player& other,
@@ -46,10 +51,8 @@ class Player : public Thing {
   engine2::Vec<double, 2>& velocity();
 
  private:
-  void SetSprite();
-
   static std::unique_ptr<engine2::Texture> sTexture;
-  static std::array<engine2::Sprite, 8> sSprites;
+  static std::array<engine2::SpriteAssetId, 8> sSpriteAssetIds;
 
   int hp_ = 100;
   Direction direction_;
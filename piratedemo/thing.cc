@@ -9,27 +9,40 @@ namespace piratedemo {
 Thing::Thing(Game* game,
              Graphics2D* graphics,
              Camera2D<Thing>* camera,
-             Sprite* active_sprite,
+             SpriteAssetId sprite_asset,
              const Rect<>& world_rect,
              double mass_kg)
     : RectObject<2>(world_rect, mass_kg),
       game_(game),
       graphics_(graphics),
-      camera_(camera),
-      active_sprite_(active_sprite) {}
+      camera_(camera) {
+  if (sprite_asset != kNoSprite)
+    sprite_ = game_->AddSpriteInstance(sprite_asset);
+}
 
 void Thing::Draw() {
-  if (!active_sprite_)
+  if (sprite_ < 0)
     return;
 
-  active_sprite_->Draw(graphics_, WorldToScreen(rect_.pos));
-  active_sprite_->Update(game_->last_update_time());
+  game_->sprite_assets().Draw(graphics_, game_->sprite_instance(sprite_),
+                              WorldToScreen(rect_.pos));
 }
 
 bool Thing::operator<(const Thing& other) const {
   return rect_.y() < other.rect_.y();
 }
 
+void Thing::SetSpriteAsset(SpriteAssetId asset) {
+  if (sprite_ < 0)
+    sprite_ = game_->AddSpriteInstance(asset);
+  else if (asset == game_->sprite_instance(sprite_).asset)
+    return;
+
+  SpriteInstance& instance = game_->sprite_instance(sprite_);
+  instance.asset = asset;
+  instance.start_time = game_->last_update_time();
+}
+
 Point<> Thing::WorldToScreen(const Point<>& point) const {
   return point - camera_->GetRect().pos;
 }
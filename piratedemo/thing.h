@@ -3,7 +3,7 @@
 
 #include "engine2/camera2d.h"
 #include "engine2/graphics2d.h"
-#include "engine2/sprite.h"
+#include "engine2/sprite_asset.h"
 
 namespace piratedemo {
 
@@ -12,10 +12,15 @@ class Game;
 class Thing : public engine2::Camera2D<Thing>::Visible,
               public engine2::RectObject<2> {
  public:
+  // For things that aren't drawn.
+  static constexpr engine2::SpriteAssetId kNoSprite = -1;
+
+  // |sprite_asset| is one of the game's sprite_assets(), or kNoSprite to
+  // leave the thing undrawn until SetSpriteAsset().
   Thing(Game* game,
         engine2::Graphics2D* graphics,
         engine2::Camera2D<Thing>* camera,
-        engine2::Sprite* active_sprite,
+        engine2::SpriteAssetId sprite_asset,
         const engine2::Rect<>& world_rect,
         double mass_kg);
 
@@ -23,12 +28,17 @@ class Thing : public engine2::Camera2D<Thing>::Visible,
   bool operator<(const Thing& other) const;
 
  protected:
-  engine2::Sprite* active_sprite_ = nullptr;
+  // Plays |asset| from the start, unless it's already playing. Gives the
+  // thing a sprite instance if it doesn't have one yet.
+  void SetSpriteAsset(engine2::SpriteAssetId asset);
 
  private:
   engine2::Point<> WorldToScreen(const engine2::Point<>& point) const;
 
   Game* game_;
+  // Index of this thing's instance in the game's sprite instances, which are
+  // animated together once per frame, or -1 for things that aren't drawn.
+  int sprite_ = -1;
 
   // Screen-coords graphics renderer.
   engine2::Graphics2D* graphics_;
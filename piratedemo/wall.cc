@@ -6,6 +6,7 @@ using namespace engine2;
 namespace piratedemo {
 
 Wall::Wall(Game* game, const Rect<>& world_rect)
-    : Thing(game, game->graphics(), game->camera(), nullptr, world_rect, 1) {}
+    : Thing(game, game->graphics(), game->camera(), kNoSprite, world_rect,
+            1) {}
 
 }  // namespace piratedemo
\ No newline at end of file
@@ -1,9 +1,9 @@
 #include <SDL2/SDL_mouse.h>
 #include <algorithm>
 #include <cmath>
-#include <deque>
 #include <fstream>
 #include <iostream>
+#include <vector>
 
 #include "engine2/rgba_color.h"
 #include "engine2/time.h"
@@ -183,6 +183,8 @@ void Editor::OnKeyDown(const SDL_KeyboardEvent& event) {
       break;
     case SDLK_f:
       show_flags_ = !show_flags_;
+      // The flags are baked into the map's render cache.
+      map_->InvalidateRenderCache();
       break;
 
     // TODO: remove once layer picker is done!
@@ -355,6 +357,11 @@ void Editor::OnQuit(const SDL_QuitEvent& event) {
   Stop();
 }
 
+void Editor::OnRenderTargetsReset() {
+  // The map's baked blocks are render targets, so their contents are gone.
+  map_->InvalidateRenderCache();
+}
+
 void Editor::DrawMapGrid() {
   Vec<int64_t, 2> grid_size_pixels_ = grid_size_tiles_ * map_->GetTileSize();
   Vec<int64_t, 2> phase = window_in_world_.pos % grid_size_pixels_;
@@ -438,7 +445,7 @@ void Editor::Save() {
     return;
   }
 
-  if (!map_->Write(stream)) {
+  if (!map_->Write(stream, TileMap::GridEncoding::kCompressed)) {
     Error("Failed to write map file.");
     return;
   }
@@ -484,6 +491,10 @@ void Editor::FloodFill(const engine2::TileMap::GridPoint& point,
                        uint16_t index,
                        ActionStack* action_stack) {
   Vec<int64_t, 2> grid_size = map_->GetGridSize();
+  if (point.x() < 0 || point.y() < 0 || point.x() >= grid_size.x() ||
+      point.y() >= grid_size.y()) {
+    return;
+  }
   uint16_t to_replace = map_->GetTileIndex(point, layer);
   if (to_replace == index)
     return;
@@ -493,21 +504,57 @@ void Editor::FloodFill(const engine2::TileMap::GridPoint& point,
         ActionStack::Action(ActionStack::Action::Type::kSetTileIndex));
   }
 
-  std::deque<TileMap::GridPoint> points_;
-  points_.push_back(point);
-  while (!points_.empty()) {
-    TileMap::GridPoint fill_point = points_.front();
-    if (fill_point.x() >= 0 && fill_point.y() >= 0 &&
-        fill_point.x() < grid_size.x() && fill_point.y() < grid_size.y() &&
-        map_->GetTileIndex(fill_point, layer) == to_replace) {
-      points_.push_back(TileMap::GridPoint{fill_point.x() + 1, fill_point.y()});
-      points_.push_back(TileMap::GridPoint{fill_point.x() - 1, fill_point.y()});
-      points_.push_back(TileMap::GridPoint{fill_point.x(), fill_point.y() + 1});
-      points_.push_back(TileMap::GridPoint{fill_point.x(), fill_point.y() - 1});
-      SetSingleTileIndexInternal(fill_point, layer, index, action_stack);
+  // Scanline fill: fill the whole run of matching tiles around each seed,
+  // then seed each run of matching tiles in the rows above and below it.
+  // Tiles are read a span at a time, which is much faster than a tile at a
+  // time. The run is found one chunk-aligned span at a time, so each seed
+  // only reads about as far as its run reaches.
+  constexpr int64_t kSpan = TileMap::kChunkSize;
+  std::vector<uint16_t> span(kSpan);
+  std::vector<uint16_t> row;
+  std::vector<TileMap::GridPoint> seeds{point};
+  while (!seeds.empty()) {
+    TileMap::GridPoint seed = seeds.back();
+    seeds.pop_back();
+    if (map_->GetTileIndex(seed, layer) != to_replace)
+      continue;
+
+    int64_t left = seed.x();
+    bool more = true;
+    while (more && left > 0) {
+      int64_t start = (left - 1) / kSpan * kSpan;
+      map_->GetRowTileIndices({start, seed.y()}, layer, left - start,
+                              span.data());
+      while (left > start && span[left - 1 - start] == to_replace)
+        --left;
+      more = left == start;
     }
+    int64_t right = seed.x();
+    more = true;
+    while (more && right + 1 < grid_size.x()) {
+      int64_t start = right + 1;
+      int64_t end = std::min((start / kSpan + 1) * kSpan, grid_size.x());
+      map_->GetRowTileIndices({start, seed.y()}, layer, end - start,
+                              span.data());
+      while (right + 1 < end && span[right + 1 - start] == to_replace)
+        ++right;
+      more = right + 1 == end;
+    }
+    for (int64_t x = left; x <= right; ++x)
+      SetSingleTileIndexInternal({x, seed.y()}, layer, index, action_stack);
 
-    points_.pop_front();
+    row.resize(right - left + 1);
+    for (int64_t y : {seed.y() - 1, seed.y() + 1}) {
+      if (y < 0 || y >= grid_size.y())
+        continue;
+      map_->GetRowTileIndices({left, y}, layer, row.size(), row.data());
+      for (int64_t x = left; x <= right; ++x) {
+        if (row[x - left] == to_replace &&
+            (x == left || row[x - left - 1] != to_replace)) {
+          seeds.push_back({x, y});
+        }
+      }
+    }
   }
 }
 
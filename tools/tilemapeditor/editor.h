@@ -53,6 +53,8 @@ class Editor : public engine2::FrameLoop, public engine2::EventHandler {
 
   void OnQuit(const SDL_QuitEvent& event) override;
 
+  void OnRenderTargetsReset() override;
+
   engine2::Graphics2D* graphics() { return graphics_; }
   engine2::Font* font() { return font_; }
   engine2::Point<int64_t, 2> TouchPointToPixels(
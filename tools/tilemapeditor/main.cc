@@ -164,6 +164,12 @@ void Run(const engine2::CommandLineParser& flags) {
 
     initial_status_text = "Opened " + map_file_name;
   }
+  // The editor draws, fills and edits one layer at a time.
+  map->SetGridLayout(TileMap::GridLayout::kLayerMajor);
+  // Zoomed out, the editor shows far more tiles than a game would.
+  map->SetRenderCacheSize(256);
+  map->SetBatchDrawing(true);
+  map->SetLodEnabled(true);
 
   tilemapeditor::Editor editor(window.get(), graphics.get(), font.get(),
                                map.get(), icons_texture.get(), &sprite_cache,